@@ -0,0 +1,81 @@
+#include "atomicvalue.h"
+
+#include <string.h>
+
+static uint64_t atomic_value_load(AtomicValue *v)
+{
+    int seq;
+    uint32_t lo, hi;
+
+    for (;;) {
+        seq = SDL_AtomicGet(&v->seq);
+        if (seq & 1)
+            continue;
+        lo = (uint32_t)SDL_AtomicGet(&v->lo);
+        hi = (uint32_t)SDL_AtomicGet(&v->hi);
+        if (SDL_AtomicGet(&v->seq) == seq)
+            break;
+    }
+
+    return (uint64_t)hi << 32 | lo;
+}
+
+//the caller holds v->lock
+static void atomic_value_store(AtomicValue *v, uint64_t x)
+{
+    SDL_AtomicAdd(&v->seq, 1);
+    SDL_AtomicSet(&v->lo, (int)(uint32_t)x);
+    SDL_AtomicSet(&v->hi, (int)(uint32_t)(x >> 32));
+    SDL_AtomicAdd(&v->seq, 1);
+}
+
+static uint64_t double_bits(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits)
+{
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+int64_t atomic_value_get_int64(AtomicValue *v)
+{
+    return (int64_t)atomic_value_load(v);
+}
+
+void atomic_value_set_int64(AtomicValue *v, int64_t x)
+{
+    SDL_AtomicLock(&v->lock);
+    atomic_value_store(v, (uint64_t)x);
+    SDL_AtomicUnlock(&v->lock);
+}
+
+double atomic_value_get_double(AtomicValue *v)
+{
+    return bits_double(atomic_value_load(v));
+}
+
+void atomic_value_set_double(AtomicValue *v, double x)
+{
+    SDL_AtomicLock(&v->lock);
+    atomic_value_store(v, double_bits(x));
+    SDL_AtomicUnlock(&v->lock);
+}
+
+//read, add and publish as one step against the other writers, returns the new value
+double atomic_value_add_double(AtomicValue *v, double x)
+{
+    double sum;
+
+    SDL_AtomicLock(&v->lock);
+    sum = bits_double(atomic_value_load(v)) + x;
+    atomic_value_store(v, double_bits(sum));
+    SDL_AtomicUnlock(&v->lock);
+
+    return sum;
+}
@@ -0,0 +1,41 @@
+#ifndef ATOMICVALUE_H
+#define ATOMICVALUE_H
+
+#define CACHELINE_SIZE 64
+//between groups of fields written by different threads, so a write to one
+//group never invalidates the cache line another thread is reading
+#define CACHELINE_PAD(name) char name[CACHELINE_SIZE]
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+//64 bit value shared between threads. SDL only has 32 bit atomics, so the halves
+//are published under a sequence number: writers take the spinlock, readers never
+//block and retry while a write is in progress. every access is an SDL atomic,
+//which are sequentially consistent
+typedef struct AtomicValue {
+    SDL_atomic_t seq; //odd while a write is in progress
+    SDL_atomic_t lo;
+    SDL_atomic_t hi;
+    SDL_SpinLock lock;
+} AtomicValue;
+
+int64_t atomic_value_get_int64(AtomicValue *v);
+
+void atomic_value_set_int64(AtomicValue *v, int64_t x);
+
+double atomic_value_get_double(AtomicValue *v);
+
+void atomic_value_set_double(AtomicValue *v, double x);
+
+double atomic_value_add_double(AtomicValue *v, double x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ATOMICVALUE_H
@@ -0,0 +1,351 @@
+#include "audiokernels.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUDIO_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AUDIO_TARGET_SSE2
+#define AUDIO_TARGET_AVX2
+#else
+#define AUDIO_TARGET_SSE2 __attribute__((target("sse2")))
+#define AUDIO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//s16 gain in 14 bit fixed point, gains up to 1 fit a 16 bit multiply
+#define GAIN_S16_SHIFT 14
+
+//every isa has the same set and must give identical output. the interleave
+//helpers write channels c to c + k - 1 of samples i to n - 1
+struct AudioRowsScalar {
+    template <class T>
+    static void interleave(T *dst, const T *const *src, int channels, int c, int k, int n, int i)
+    {
+        for (; i < n; i++) {
+            for (int j = c; j < c + k; j++)
+                dst[i * channels + j] = src[j][i];
+        }
+    }
+
+    static void interleave32(uint32_t *dst, const uint32_t *const *src, int channels, int n)
+    {
+        interleave(dst, src, channels, 0, channels, n, 0);
+    }
+
+    static void interleave16(uint16_t *dst, const uint16_t *const *src, int channels, int n)
+    {
+        interleave(dst, src, channels, 0, channels, n, 0);
+    }
+
+    static void gain_s16(int16_t *dst, const int16_t *src, int n, int g, int i)
+    {
+        for (; i < n; i++) {
+            int v = (src[i] * g + (1 << (GAIN_S16_SHIFT - 1))) >> GAIN_S16_SHIFT;
+            dst[i] = v < -32768 ? -32768 : v > 32767 ? 32767 : v;
+        }
+    }
+
+    static void gain_flt(float *dst, const float *src, int n, float g, int i)
+    {
+        for (; i < n; i++) {
+            float v = src[i] * g;
+            dst[i] = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+        }
+    }
+};
+
+#ifdef AUDIO_KERNELS_X86
+struct AudioRowsSse2 {
+    //4 channels of 4 samples, transposed into 4 interleaved sample frames
+    AUDIO_TARGET_SSE2 static void interleave32_4(uint32_t *dst, const uint32_t *const *src, int channels, int c, int n)
+    {
+        int i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src[c] + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src[c + 1] + i));
+            __m128i x = _mm_loadu_si128((const __m128i *)(src[c + 2] + i));
+            __m128i y = _mm_loadu_si128((const __m128i *)(src[c + 3] + i));
+            __m128i ab_lo = _mm_unpacklo_epi32(a, b), ab_hi = _mm_unpackhi_epi32(a, b);
+            __m128i xy_lo = _mm_unpacklo_epi32(x, y), xy_hi = _mm_unpackhi_epi32(x, y);
+            uint32_t *d = dst + i * channels + c;
+            _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi64(ab_lo, xy_lo));
+            _mm_storeu_si128((__m128i *)(d + channels), _mm_unpackhi_epi64(ab_lo, xy_lo));
+            _mm_storeu_si128((__m128i *)(d + 2 * channels), _mm_unpacklo_epi64(ab_hi, xy_hi));
+            _mm_storeu_si128((__m128i *)(d + 3 * channels), _mm_unpackhi_epi64(ab_hi, xy_hi));
+        }
+        AudioRowsScalar::interleave(dst, src, channels, c, 4, n, i);
+    }
+
+    AUDIO_TARGET_SSE2 static void interleave32_2(uint32_t *dst, const uint32_t *const *src, int channels, int c, int n)
+    {
+        int i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src[c] + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src[c + 1] + i));
+            __m128i lo = _mm_unpacklo_epi32(a, b), hi = _mm_unpackhi_epi32(a, b);
+            uint32_t *d = dst + i * channels + c;
+            _mm_storel_epi64((__m128i *)d, lo);
+            _mm_storel_epi64((__m128i *)(d + channels), _mm_unpackhi_epi64(lo, lo));
+            _mm_storel_epi64((__m128i *)(d + 2 * channels), hi);
+            _mm_storel_epi64((__m128i *)(d + 3 * channels), _mm_unpackhi_epi64(hi, hi));
+        }
+        AudioRowsScalar::interleave(dst, src, channels, c, 2, n, i);
+    }
+
+    AUDIO_TARGET_SSE2 static void interleave32_from(uint32_t *dst, const uint32_t *const *src, int channels, int c, int n)
+    {
+        for (; c + 4 <= channels; c += 4)
+            interleave32_4(dst, src, channels, c, n);
+        for (; c + 2 <= channels; c += 2)
+            interleave32_2(dst, src, channels, c, n);
+        AudioRowsScalar::interleave(dst, src, channels, c, channels - c, n, 0);
+    }
+
+    AUDIO_TARGET_SSE2 static void interleave32(uint32_t *dst, const uint32_t *const *src, int channels, int n)
+    {
+        interleave32_from(dst, src, channels, 0, n);
+    }
+
+    //4 channels of 8 samples, two 64 bit sample frames per register
+    AUDIO_TARGET_SSE2 static void interleave16_4(uint16_t *dst, const uint16_t *const *src, int channels, int c, int n)
+    {
+        int i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src[c] + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src[c + 1] + i));
+            __m128i x = _mm_loadu_si128((const __m128i *)(src[c + 2] + i));
+            __m128i y = _mm_loadu_si128((const __m128i *)(src[c + 3] + i));
+            __m128i ab_lo = _mm_unpacklo_epi16(a, b), ab_hi = _mm_unpackhi_epi16(a, b);
+            __m128i xy_lo = _mm_unpacklo_epi16(x, y), xy_hi = _mm_unpackhi_epi16(x, y);
+            __m128i f[4] = { _mm_unpacklo_epi32(ab_lo, xy_lo), _mm_unpackhi_epi32(ab_lo, xy_lo),
+                             _mm_unpacklo_epi32(ab_hi, xy_hi), _mm_unpackhi_epi32(ab_hi, xy_hi) };
+            uint16_t *d = dst + i * channels + c;
+            for (int j = 0; j < 4; j++) {
+                _mm_storel_epi64((__m128i *)(d + 2 * j * channels), f[j]);
+                _mm_storel_epi64((__m128i *)(d + (2 * j + 1) * channels), _mm_unpackhi_epi64(f[j], f[j]));
+            }
+        }
+        AudioRowsScalar::interleave(dst, src, channels, c, 4, n, i);
+    }
+
+    AUDIO_TARGET_SSE2 static void interleave16(uint16_t *dst, const uint16_t *const *src, int channels, int n)
+    {
+        int c = 0;
+
+        for (; c + 4 <= channels; c += 4)
+            interleave16_4(dst, src, channels, c, n);
+        if (channels == 2) {
+            //stereo frames are contiguous, the only layout worth a pair kernel
+            int i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i));
+                _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi16(a, b));
+                _mm_storeu_si128((__m128i *)(dst + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+            }
+            AudioRowsScalar::interleave(dst, src, channels, 0, 2, n, i);
+            return;
+        }
+        AudioRowsScalar::interleave(dst, src, channels, c, channels - c, n, 0);
+    }
+
+    AUDIO_TARGET_SSE2 static void gain_s16(int16_t *dst, const int16_t *src, int n, int g, int i)
+    {
+        const __m128i gain = _mm_set1_epi16(g);
+        const __m128i round = _mm_set1_epi32(1 << (GAIN_S16_SHIFT - 1));
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i lo = _mm_mullo_epi16(x, gain), hi = _mm_mulhi_epi16(x, gain);
+            __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), GAIN_S16_SHIFT);
+            __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), GAIN_S16_SHIFT);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(p0, p1));
+        }
+        AudioRowsScalar::gain_s16(dst, src, n, g, i);
+    }
+
+    AUDIO_TARGET_SSE2 static void gain_flt(float *dst, const float *src, int n, float g, int i)
+    {
+        const __m128 gain = _mm_set1_ps(g), lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(dst + i, _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), gain), lo), hi));
+        AudioRowsScalar::gain_flt(dst, src, n, g, i);
+    }
+};
+
+//7.1 gets a full 8x8 transpose, narrower groups and s16 use the sse2 code
+struct AudioRowsAvx2 : AudioRowsSse2 {
+    AUDIO_TARGET_AVX2 static void interleave32_8(uint32_t *dst, const uint32_t *const *src, int channels, int c, int n)
+    {
+        int i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+            __m256i r[8], t[8], u[8];
+            for (int j = 0; j < 8; j++)
+                r[j] = _mm256_loadu_si256((const __m256i *)(src[c + j] + i));
+            for (int j = 0; j < 8; j += 2) {
+                t[j] = _mm256_unpacklo_epi32(r[j], r[j + 1]);
+                t[j + 1] = _mm256_unpackhi_epi32(r[j], r[j + 1]);
+            }
+            //u[0..3] are samples 0-3 (and 4-7 in the high lane) of channels 0-3,
+            //u[4..7] the same of channels 4-7
+            for (int j = 0; j < 8; j += 4) {
+                u[j] = _mm256_unpacklo_epi64(t[j], t[j + 2]);
+                u[j + 1] = _mm256_unpackhi_epi64(t[j], t[j + 2]);
+                u[j + 2] = _mm256_unpacklo_epi64(t[j + 1], t[j + 3]);
+                u[j + 3] = _mm256_unpackhi_epi64(t[j + 1], t[j + 3]);
+            }
+            uint32_t *d = dst + i * channels + c;
+            for (int j = 0; j < 4; j++) {
+                _mm256_storeu_si256((__m256i *)(d + j * channels), _mm256_permute2x128_si256(u[j], u[j + 4], 0x20));
+                _mm256_storeu_si256((__m256i *)(d + (j + 4) * channels), _mm256_permute2x128_si256(u[j], u[j + 4], 0x31));
+            }
+        }
+        AudioRowsScalar::interleave(dst, src, channels, c, 8, n, i);
+    }
+
+    AUDIO_TARGET_AVX2 static void interleave32(uint32_t *dst, const uint32_t *const *src, int channels, int n)
+    {
+        int c = 0;
+
+        for (; c + 8 <= channels; c += 8)
+            interleave32_8(dst, src, channels, c, n);
+        interleave32_from(dst, src, channels, c, n);
+    }
+
+    AUDIO_TARGET_AVX2 static void gain_s16(int16_t *dst, const int16_t *src, int n, int g, int i)
+    {
+        const __m256i gain = _mm256_set1_epi16(g);
+        const __m256i round = _mm256_set1_epi32(1 << (GAIN_S16_SHIFT - 1));
+
+        //the unpacks and the pack all work within the 128 bit lanes, so the
+        //order comes out right without a permute
+        for (; i + 16 <= n; i += 16) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256i lo = _mm256_mullo_epi16(x, gain), hi = _mm256_mulhi_epi16(x, gain);
+            __m256i p0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round), GAIN_S16_SHIFT);
+            __m256i p1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round), GAIN_S16_SHIFT);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packs_epi32(p0, p1));
+        }
+        AudioRowsSse2::gain_s16(dst, src, n, g, i);
+    }
+
+    AUDIO_TARGET_AVX2 static void gain_flt(float *dst, const float *src, int n, float g, int i)
+    {
+        const __m256 gain = _mm256_set1_ps(g), lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), gain), lo), hi));
+        AudioRowsSse2::gain_flt(dst, src, n, g, i);
+    }
+};
+#endif
+
+template <class Rows>
+struct AudioKernels {
+    static void interleave32(uint8_t *dst, const uint8_t *const *src, int channels, int nb_samples)
+    {
+        Rows::interleave32((uint32_t *)dst, (const uint32_t *const *)src, channels, nb_samples);
+    }
+
+    static void interleave16(uint8_t *dst, const uint8_t *const *src, int channels, int nb_samples)
+    {
+        Rows::interleave16((uint16_t *)dst, (const uint16_t *const *)src, channels, nb_samples);
+    }
+
+    static void gain_s16(uint8_t *dst, const uint8_t *src, int nb_values, float gain)
+    {
+        Rows::gain_s16((int16_t *)dst, (const int16_t *)src, nb_values, (int)(gain * (1 << GAIN_S16_SHIFT) + 0.5f), 0);
+    }
+
+    static void gain_flt(uint8_t *dst, const uint8_t *src, int nb_values, float gain)
+    {
+        Rows::gain_flt((float *)dst, (const float *)src, nb_values, gain, 0);
+    }
+};
+
+#ifdef AUDIO_KERNELS_X86
+#define AUDIO_KERNEL(fmt, func) { fmt, { AudioKernels<AudioRowsScalar>::func, \
+                                         AudioKernels<AudioRowsSse2>::func, \
+                                         AudioKernels<AudioRowsAvx2>::func } }
+#else
+#define AUDIO_KERNEL(fmt, func) { fmt, { AudioKernels<AudioRowsScalar>::func, NULL, NULL } }
+#endif
+
+//keyed by the planar input format
+static const struct {
+    enum AVSampleFormat fmt;
+    AudioInterleaveFunc funcs[PIXEL_ISA_COUNT];
+} interleave_kernels[] = {
+    AUDIO_KERNEL(AV_SAMPLE_FMT_FLTP, interleave32),
+    AUDIO_KERNEL(AV_SAMPLE_FMT_S32P, interleave32),
+    AUDIO_KERNEL(AV_SAMPLE_FMT_S16P, interleave16),
+};
+
+//keyed by the interleaved output format
+static const struct {
+    enum AVSampleFormat fmt;
+    AudioGainFunc funcs[PIXEL_ISA_COUNT];
+} gain_kernels[] = {
+    AUDIO_KERNEL(AV_SAMPLE_FMT_FLT, gain_flt),
+    AUDIO_KERNEL(AV_SAMPLE_FMT_S16, gain_s16),
+};
+
+//isa < 0 picks the best one of this cpu, -1 when the cpu lacks the isa
+static int audio_kernel_isa(int isa)
+{
+    if (isa < 0)
+        return pixel_kernel_best_isa();
+    if (isa >= PIXEL_ISA_COUNT || isa > pixel_kernel_best_isa())
+        return -1;
+    return isa;
+}
+
+AudioInterleaveFunc audio_kernel_interleave(enum AVSampleFormat fmt, int isa)
+{
+    if ((isa = audio_kernel_isa(isa)) < 0)
+        return NULL;
+
+    for (unsigned int i = 0; i < sizeof(interleave_kernels) / sizeof(interleave_kernels[0]); i++) {
+        if (interleave_kernels[i].fmt == fmt)
+            return interleave_kernels[i].funcs[isa];
+    }
+
+    return NULL;
+}
+
+AudioGainFunc audio_kernel_gain(enum AVSampleFormat fmt, int isa)
+{
+    if ((isa = audio_kernel_isa(isa)) < 0)
+        return NULL;
+
+    for (unsigned int i = 0; i < sizeof(gain_kernels) / sizeof(gain_kernels[0]); i++) {
+        if (gain_kernels[i].fmt == fmt)
+            return gain_kernels[i].funcs[isa];
+    }
+
+    return NULL;
+}
+
+//the gain moves from one volume to the next in steps over the buffer, a jump
+//in the middle of a waveform clicks
+void audio_gain_ramp(AudioGainFunc gain, uint8_t *buf, int nb_frames, int channels, int bytes_per_sample,
+                     float from, float to)
+{
+    int nb_blocks = from == to || nb_frames < AUDIO_GAIN_RAMP_BLOCKS ? 1 : AUDIO_GAIN_RAMP_BLOCKS;
+    int done = 0;
+
+    for (int b = 1; b <= nb_blocks; b++) {
+        int end = (int)((int64_t)nb_frames * b / nb_blocks);
+        uint8_t *p = buf + done * channels * bytes_per_sample;
+        gain(p, p, (end - done) * channels, from + (to - from) * b / nb_blocks);
+        done = end;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef AUDIOKERNELS_H
+#define AUDIOKERNELS_H
+
+#define AUDIO_GAIN_RAMP_BLOCKS 16 //volume changes are spread over this many steps
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavutil/samplefmt.h>
+#include "pixelkernels.h"
+
+//planar to interleaved, nb_samples of every channel
+typedef void (*AudioInterleaveFunc)(uint8_t *dst, const uint8_t *const *src, int channels, int nb_samples);
+
+//dst = src * gain over nb_values interleaved values, clipped. dst may be src
+typedef void (*AudioGainFunc)(uint8_t *dst, const uint8_t *src, int nb_values, float gain);
+
+AudioInterleaveFunc audio_kernel_interleave(enum AVSampleFormat fmt, int isa);
+
+AudioGainFunc audio_kernel_gain(enum AVSampleFormat fmt, int isa);
+
+void audio_gain_ramp(AudioGainFunc gain, uint8_t *buf, int nb_frames, int channels, int bytes_per_sample,
+                     float from, float to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIOKERNELS_H
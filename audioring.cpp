@@ -0,0 +1,124 @@
+#include "audioring.h"
+
+int audio_ring_init(AudioRing *r, int size)
+{
+    memset(r, 0, sizeof(AudioRing));
+    r->end_pts = NAN;
+    if (size <= 0 || size > INT_MAX / 2)
+        return -1;
+    r->data = (uint8_t *)SDL_malloc(size);
+    if (!r->data)
+        return -1;
+    r->size = size;
+
+    return 0;
+}
+
+void audio_ring_free(AudioRing *r)
+{
+    SDL_free(r->data);
+    r->data = NULL;
+    r->size = 0;
+}
+
+static unsigned int audio_ring_advance(AudioRing *r, unsigned int pos, unsigned int len)
+{
+    pos += len;
+
+    return pos >= 2 * r->size ? pos - 2 * r->size : pos;
+}
+
+static unsigned int audio_ring_used(AudioRing *r, unsigned int read_pos, unsigned int write_pos)
+{
+    return write_pos >= read_pos ? write_pos - read_pos : write_pos + 2 * r->size - read_pos;
+}
+
+//bytes the writer may add, the reader only ever makes it larger
+int audio_ring_space(AudioRing *r)
+{
+    unsigned int used;
+
+    SDL_AtomicLock(&r->lock);
+    used = audio_ring_used(r, r->read_pos, r->write_pos);
+    SDL_AtomicUnlock(&r->lock);
+
+    return r->size - used;
+}
+
+static void audio_ring_copy(uint8_t *dst, const uint8_t *src, unsigned int len, unsigned int pos,
+                            unsigned int size, int to_ring)
+{
+    unsigned int offset = pos >= size ? pos - size : pos;
+    unsigned int first = FFMIN(len, size - offset);
+
+    if (to_ring) {
+        memcpy(dst + offset, src, first);
+        memcpy(dst, src + first, len - first);
+    } else {
+        memcpy(dst, src + offset, first);
+        memcpy(dst + first, src, len - first);
+    }
+}
+
+//append len bytes, end_pts is the pts right after the last of them. the writer
+//checks audio_ring_space first, it can only grow until the write
+int audio_ring_write(AudioRing *r, const uint8_t *data, int len, double end_pts)
+{
+    unsigned int pos;
+    int space = audio_ring_space(r);
+
+    len = FFMIN(len, space);
+    if (len <= 0)
+        return 0;
+
+    pos = r->write_pos; //only this thread moves it
+    audio_ring_copy(r->data, data, len, pos, r->size, 1);
+
+    SDL_AtomicLock(&r->lock);
+    r->write_pos = audio_ring_advance(r, pos, len);
+    r->end_pts = end_pts;
+    SDL_AtomicUnlock(&r->lock);
+
+    return len;
+}
+
+//called by the writer after a seek, the reader drops the old data on its next read
+void audio_ring_flush(AudioRing *r)
+{
+    SDL_AtomicLock(&r->lock);
+    r->flush_pos = r->write_pos;
+    r->flush = 1;
+    r->end_pts = NAN;
+    SDL_AtomicUnlock(&r->lock);
+}
+
+//take up to len bytes, returns how many were there. queued and end_pts tell what
+//is left behind them, so the caller can work out the pts of what it plays
+int audio_ring_read(AudioRing *r, uint8_t *dst, int len, int *queued, double *end_pts)
+{
+    unsigned int pos, used;
+
+    SDL_AtomicLock(&r->lock);
+    //the reader never gets past a write that came before the flush
+    if (r->flush) {
+        r->read_pos = r->flush_pos;
+        r->flush = 0;
+    }
+    pos = r->read_pos;
+    used = audio_ring_used(r, pos, r->write_pos);
+    SDL_AtomicUnlock(&r->lock);
+
+    len = FFMIN((unsigned int)len, used);
+    audio_ring_copy(dst, r->data, len, pos, r->size, 0);
+
+    SDL_AtomicLock(&r->lock);
+    //a flush in the meantime is seen on the next read
+    r->read_pos = audio_ring_advance(r, pos, len);
+    if (queued)
+        *queued = audio_ring_used(r, r->read_pos, r->write_pos);
+    if (end_pts)
+        *end_pts = r->end_pts;
+    SDL_AtomicUnlock(&r->lock);
+
+    return len;
+}
@@ -0,0 +1,44 @@
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <math.h>
+#include <libavutil/common.h>
+#include <SDL2/SDL.h>
+
+//decoded audio between the decoder (the only writer) and the device callback
+//(the only reader). the positions count bytes modulo twice the size, so a full
+//ring differs from an empty one and they never wrap where the size does not
+//divide. only they and the pts are taken under the spinlock, the copies run
+//outside of it
+typedef struct AudioRing {
+    uint8_t *data;
+    unsigned int size;
+    unsigned int read_pos;
+    unsigned int write_pos;
+    unsigned int flush_pos; //everything before it was written before a seek
+    int flush; //flush_pos is waiting for the reader
+    double end_pts; //pts of the byte at write_pos, NAN if unknown
+    SDL_SpinLock lock;
+} AudioRing;
+
+int audio_ring_init(AudioRing *r, int size);
+
+void audio_ring_free(AudioRing *r);
+
+int audio_ring_space(AudioRing *r);
+
+int audio_ring_write(AudioRing *r, const uint8_t *data, int len, double end_pts);
+
+void audio_ring_flush(AudioRing *r);
+
+int audio_ring_read(AudioRing *r, uint8_t *dst, int len, int *queued, double *end_pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIORING_H
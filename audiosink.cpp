@@ -0,0 +1,283 @@
+#include "audiosink.h"
+#include "clock.h"
+
+#define AUDIO_SINK_PAUSE_POLL 10 //ms
+#define AUDIO_SINK_MAX_LATE 0.5 //a software clock further behind restarts instead of catching up
+#define WAV_HEADER_SIZE 44
+
+static AudioSink *audio_sink_alloc(const char *name)
+{
+    AudioSink *sink = (AudioSink *)av_mallocz(sizeof(AudioSink));
+    if (!sink)
+        return NULL;
+
+    sink->name = name;
+
+    return sink;
+}
+
+static int audio_sink_sdl_open(AudioSink *sink, const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained, int allowed_changes)
+{
+    sink->dev = SDL_OpenAudioDevice(NULL, 0, wanted, obtained, allowed_changes);
+    if (!sink->dev) {
+        printf("open audio device failed: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    sink->spec = *obtained;
+    //sdl asks for the next buffer when the last one starts playing
+    sink->delay_bytes = obtained->size;
+
+    return 0;
+}
+
+static void audio_sink_sdl_pause(AudioSink *sink, int on)
+{
+    SDL_PauseAudioDevice(sink->dev, on);
+}
+
+static void audio_sink_sdl_close(AudioSink *sink)
+{
+    //waits for a running callback to return
+    SDL_CloseAudioDevice(sink->dev);
+    sink->dev = 0;
+}
+
+//one device per sink, every session opens its own
+AudioSink *audio_sink_sdl_create()
+{
+    AudioSink *sink = audio_sink_alloc("sdl");
+    if (!sink)
+        return NULL;
+
+    sink->open = audio_sink_sdl_open;
+    sink->pause = audio_sink_sdl_pause;
+    sink->close = audio_sink_sdl_close;
+
+    return sink;
+}
+
+static void wav_put_le(uint8_t *p, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+//samples go out in the host order, which is what a wav holds on little-endian machines
+static int wav_write_header(AudioSink *sink)
+{
+    uint8_t h[WAV_HEADER_SIZE];
+    int bits = SDL_AUDIO_BITSIZE(sink->spec.format);
+    int block_align = bits / 8 * sink->spec.channels;
+    uint32_t data_size = (uint32_t)FFMIN(sink->nb_bytes, (int64_t)UINT32_MAX - (WAV_HEADER_SIZE - 8));
+
+    memcpy(h, "RIFF", 4);
+    wav_put_le(h + 4, data_size + WAV_HEADER_SIZE - 8, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    wav_put_le(h + 16, 16, 4);
+    wav_put_le(h + 20, SDL_AUDIO_ISFLOAT(sink->spec.format) ? 3 : 1, 2); //ieee float or pcm
+    wav_put_le(h + 22, sink->spec.channels, 2);
+    wav_put_le(h + 24, sink->spec.freq, 4);
+    wav_put_le(h + 28, sink->spec.freq * block_align, 4);
+    wav_put_le(h + 32, block_align, 2);
+    wav_put_le(h + 34, bits, 2);
+    memcpy(h + 36, "data", 4);
+    wav_put_le(h + 40, data_size, 4);
+
+    if (fseek(sink->file, 0, SEEK_SET) < 0 || fwrite(h, 1, WAV_HEADER_SIZE, sink->file) != WAV_HEADER_SIZE)
+        return -1;
+
+    return fseek(sink->file, 0, SEEK_END) < 0 ? -1 : 0;
+}
+
+//stands in for the device thread: pulls one buffer per buffer duration, on
+//deadlines from the start so the millisecond sleeps don't add up to a drift
+static int audio_sink_clock_thread(void *userdata)
+{
+    AudioSink *sink = (AudioSink *)userdata;
+    double period = (double)sink->spec.samples / sink->spec.freq;
+    double next = clock_time();
+    double wait;
+
+    while (!SDL_AtomicGet(&sink->quit)) {
+        if (SDL_AtomicGet(&sink->paused)) {
+            SDL_Delay(AUDIO_SINK_PAUSE_POLL);
+            next = clock_time();
+            continue;
+        }
+
+        sink->spec.callback(sink->spec.userdata, sink->buf, sink->spec.size);
+
+        if (sink->file) {
+            if (fwrite(sink->buf, 1, sink->spec.size, sink->file) != sink->spec.size) {
+                printf("audio sink: write to %s failed, the rest is dropped\n", sink->filename);
+                fclose(sink->file);
+                sink->file = NULL;
+            } else {
+                sink->nb_bytes += sink->spec.size;
+            }
+        }
+
+        next += period;
+        wait = next - clock_time();
+        if (wait > 0)
+            SDL_Delay((Uint32)(wait * 1000));
+        else if (wait < -AUDIO_SINK_MAX_LATE)
+            next = clock_time();
+    }
+
+    return 0;
+}
+
+static void audio_sink_clock_close(AudioSink *sink)
+{
+    if (sink->tid) {
+        SDL_AtomicSet(&sink->quit, 1);
+        SDL_WaitThread(sink->tid, NULL);
+        sink->tid = NULL;
+    }
+
+    if (sink->file) {
+        if (sink->wav && wav_write_header(sink) < 0)
+            printf("audio sink: wav header of %s not written\n", sink->filename);
+        fclose(sink->file);
+        sink->file = NULL;
+    }
+
+    av_freep(&sink->buf);
+}
+
+//takes any spec as it is, there is no hardware to negotiate with
+static int audio_sink_clock_open(AudioSink *sink, const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained, int)
+{
+    sink->spec = *wanted;
+    sink->spec.silence = 0;
+    sink->spec.size = SDL_AUDIO_BITSIZE(wanted->format) / 8 * wanted->channels * wanted->samples;
+    //a buffer is played from the moment it is pulled
+    sink->delay_bytes = 0;
+    sink->nb_bytes = 0;
+
+    if (sink->spec.freq <= 0 || !sink->spec.size || !sink->spec.callback)
+        return -1;
+
+    sink->buf = (uint8_t *)av_malloc(sink->spec.size);
+    if (!sink->buf)
+        goto fail;
+
+    if (sink->filename) {
+        sink->file = fopen(sink->filename, "wb");
+        if (!sink->file) {
+            printf("audio sink: can't open %s\n", sink->filename);
+            goto fail;
+        }
+        if (sink->wav && wav_write_header(sink) < 0) {
+            printf("audio sink: write to %s failed\n", sink->filename);
+            goto fail;
+        }
+    }
+
+    SDL_AtomicSet(&sink->quit, 0);
+    SDL_AtomicSet(&sink->paused, 1);
+    sink->tid = SDL_CreateThread(audio_sink_clock_thread, "audiosink", sink);
+    if (!sink->tid) {
+        printf("create thread failed: %s", SDL_GetError());
+        goto fail;
+    }
+
+    *obtained = sink->spec;
+
+    return 0;
+
+fail:
+    audio_sink_clock_close(sink);
+    return -1;
+}
+
+static void audio_sink_clock_pause(AudioSink *sink, int on)
+{
+    SDL_AtomicSet(&sink->paused, on);
+}
+
+//consumes the samples in real time and drops them, for machines without a sound card
+AudioSink *audio_sink_null_create()
+{
+    AudioSink *sink = audio_sink_alloc("null");
+    if (!sink)
+        return NULL;
+
+    sink->open = audio_sink_clock_open;
+    sink->pause = audio_sink_clock_pause;
+    sink->close = audio_sink_clock_close;
+
+    return sink;
+}
+
+//like the null sink, but every buffer also goes to filename: a wav when the name
+//ends in .wav, headerless samples otherwise
+AudioSink *audio_sink_file_create(const char *filename)
+{
+    AudioSink *sink;
+    size_t len;
+
+    if (!filename)
+        return NULL;
+
+    sink = audio_sink_null_create();
+    if (!sink)
+        return NULL;
+
+    sink->name = "file";
+    sink->filename = av_strdup(filename);
+    if (!sink->filename) {
+        av_freep(&sink);
+        return NULL;
+    }
+
+    len = strlen(filename);
+    sink->wav = len >= 4 && !SDL_strcasecmp(filename + len - 4, ".wav");
+
+    return sink;
+}
+
+int audio_sink_open(AudioSink *sink, const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained, int allowed_changes)
+{
+    if (!sink || sink->opened || !wanted || !obtained)
+        return -1;
+
+    if (sink->open(sink, wanted, obtained, allowed_changes) < 0)
+        return -1;
+
+    sink->opened = 1;
+
+    return 0;
+}
+
+int audio_sink_is_open(AudioSink *sink)
+{
+    return sink && sink->opened;
+}
+
+void audio_sink_pause(AudioSink *sink, int on)
+{
+    if (audio_sink_is_open(sink))
+        sink->pause(sink, on);
+}
+
+void audio_sink_close(AudioSink *sink)
+{
+    if (!audio_sink_is_open(sink))
+        return;
+
+    sink->close(sink);
+    sink->opened = 0;
+}
+
+void audio_sink_free(AudioSink **sink)
+{
+    if (!sink || !*sink)
+        return;
+
+    audio_sink_close(*sink);
+    av_freep(&(*sink)->filename);
+    av_freep(sink);
+}
@@ -0,0 +1,64 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavutil/avutil.h>
+#include <SDL2/SDL.h>
+
+typedef struct AudioSink AudioSink;
+
+//where a session plays its samples. like an sdl device the sink pulls them
+//through spec.callback, one buffer at a time at the pace of its own clock, so the
+//audio clock and the a/v sync work the same with or without a sound card
+struct AudioSink {
+    //fills obtained the way SDL_OpenAudioDevice does, the sink starts paused
+    int (*open)(AudioSink *sink, const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained, int allowed_changes);
+    void (*pause)(AudioSink *sink, int on);
+    //no callback runs once this returns
+    void (*close)(AudioSink *sink);
+    const char *name;
+    int opened;
+    SDL_AudioSpec spec;
+    //bytes still to be played ahead of the buffer a callback fills
+    int delay_bytes;
+
+    //sdl
+    SDL_AudioDeviceID dev;
+
+    //software clock of the null and file sinks
+    SDL_Thread *tid;
+    SDL_atomic_t quit;
+    SDL_atomic_t paused;
+    uint8_t *buf;
+    char *filename;
+    FILE *file;
+    int wav;
+    int64_t nb_bytes;
+};
+
+AudioSink *audio_sink_sdl_create();
+
+AudioSink *audio_sink_null_create();
+
+AudioSink *audio_sink_file_create(const char *filename);
+
+int audio_sink_open(AudioSink *sink, const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained, int allowed_changes);
+
+int audio_sink_is_open(AudioSink *sink);
+
+void audio_sink_pause(AudioSink *sink, int on);
+
+void audio_sink_close(AudioSink *sink);
+
+void audio_sink_free(AudioSink **sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIOSINK_H
@@ -0,0 +1,507 @@
+#include "batch.h"
+
+extern "C"{
+#include <libavutil/md5.h>
+}
+
+//the checksum side of one stream, over every decoded byte in decode order
+typedef struct BatchStream {
+    struct AVMD5 *md5;
+    int64_t nb_frames;
+    int64_t nb_errors;
+    int last_error;
+} BatchStream;
+
+typedef struct Batch {
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
+    SDL_sem *slots; //files that may still be opened
+    SDL_mutex *mutex; //whole lines only
+    FILE *out;
+    int frame_lines;
+
+    //under mutex
+    int nb_files;
+    int nb_failed;
+    int64_t nb_frames;
+} Batch;
+
+//one file, decoded start to end on a single worker
+typedef struct BatchFile {
+    Batch *b;
+    const char *filename;
+    MediaState *s;
+    BatchStream *streams;
+    int nb_streams;
+    struct AVMD5 *frame_md5;
+    AVFrame *frame;
+    uint8_t *buf; //packed copy of a video frame
+    int buf_size;
+} BatchFile;
+
+void json_put_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void md5_hex(struct AVMD5 *md5, char hex[33])
+{
+    uint8_t sum[16];
+
+    av_md5_final(md5, sum);
+    for (int i = 0; i < 16; i++)
+        snprintf(hex + 2 * i, 3, "%02x", sum[i]);
+}
+
+//feeds the frame bytes the way framemd5 sees them: a video frame packed without
+//padding, audio plane after plane (one plane when packed). buf is the scratch
+//copy of video frames. returns the byte count
+static int batch_frame_update(struct AVMD5 *frame_md5, struct AVMD5 *stream_md5,
+                              uint8_t **buf, int *buf_size, AVFrame *frame, int video)
+{
+    int size;
+
+    av_md5_init(frame_md5);
+
+    if (video) {
+        size = av_image_get_buffer_size((AVPixelFormat)frame->format, frame->width, frame->height, 1);
+        if (size < 0)
+            return -1;
+        if (size > *buf_size) {
+            av_freep(buf);
+            *buf_size = 0;
+            *buf = (uint8_t *)av_malloc(size);
+            if (!*buf)
+                return -1;
+            *buf_size = size;
+        }
+        if (av_image_copy_to_buffer(*buf, size, frame->data, frame->linesize,
+                                    (AVPixelFormat)frame->format, frame->width, frame->height, 1) < 0)
+            return -1;
+        av_md5_update(frame_md5, *buf, size);
+        av_md5_update(stream_md5, *buf, size);
+    } else {
+        int planar = av_sample_fmt_is_planar((AVSampleFormat)frame->format);
+        int nb_planes = planar ? frame->channels : 1;
+        int plane_size = frame->nb_samples * av_get_bytes_per_sample((AVSampleFormat)frame->format)
+                * (planar ? 1 : frame->channels);
+
+        for (int i = 0; i < nb_planes; i++) {
+            av_md5_update(frame_md5, frame->extended_data[i], plane_size);
+            av_md5_update(stream_md5, frame->extended_data[i], plane_size);
+        }
+        size = plane_size * nb_planes;
+    }
+
+    return size;
+}
+
+static void batch_frame_line(Batch *b, const char *filename, int index, int64_t n,
+                             AVRational time_base, int64_t pts, int size, struct AVMD5 *frame_md5)
+{
+    char md5[33];
+
+    md5_hex(frame_md5, md5);
+
+    SDL_LockMutex(b->mutex);
+    fprintf(b->out, "{\"kind\":\"frame\",\"file\":");
+    json_put_string(b->out, filename);
+    fprintf(b->out, ",\"stream\":%d,\"frame\":%lld,", index, (long long)n);
+    if (pts == AV_NOPTS_VALUE)
+        fprintf(b->out, "\"pts\":null,\"time\":null,");
+    else
+        fprintf(b->out, "\"pts\":%lld,\"time\":%.6f,", (long long)pts, pts * av_q2d(time_base));
+    fprintf(b->out, "\"size\":%d,\"md5\":\"%s\"}\n", size, md5);
+    SDL_UnlockMutex(b->mutex);
+}
+
+//decodes every frame in pkt, an empty packet drains the decoder. errors are
+//counted on the stream and the file goes on
+static void batch_decode_packet(BatchFile *f, AVPacket *pkt)
+{
+    AVStream *st;
+    AVCodecContext *c;
+    BatchStream *bs;
+    AVPacket p = *pkt;
+    int got_frame, ret, size;
+
+    if (pkt->stream_index < 0 || pkt->stream_index >= f->nb_streams)
+        return;
+
+    st = f->s->ic->streams[pkt->stream_index];
+    c = st->codec;
+    bs = &f->streams[pkt->stream_index];
+    if (c->codec_type != AVMEDIA_TYPE_VIDEO && c->codec_type != AVMEDIA_TYPE_AUDIO)
+        return;
+
+    for (;;) {
+        got_frame = 0;
+        if (c->codec_type == AVMEDIA_TYPE_VIDEO)
+            ret = avcodec_decode_video2(c, f->frame, &got_frame, &p);
+        else
+            ret = avcodec_decode_audio4(c, f->frame, &got_frame, &p);
+        if (ret < 0) {
+            bs->nb_errors++;
+            bs->last_error = ret;
+            return;
+        }
+
+        if (got_frame) {
+            size = batch_frame_update(f->frame_md5, bs->md5, &f->buf, &f->buf_size, f->frame,
+                                      c->codec_type == AVMEDIA_TYPE_VIDEO);
+            if (size < 0) {
+                bs->nb_errors++;
+                bs->last_error = AVERROR(ENOMEM);
+            } else if (f->b->frame_lines) {
+                batch_frame_line(f->b, f->filename, pkt->stream_index, bs->nb_frames, st->time_base,
+                                 av_frame_get_best_effort_timestamp(f->frame), size, f->frame_md5);
+            }
+            bs->nb_frames++;
+            av_frame_unref(f->frame);
+        }
+
+        if (!pkt->size) {
+            if (!got_frame)
+                return;
+        } else if (c->codec_type == AVMEDIA_TYPE_AUDIO && ret > 0 && ret < p.size) {
+            //audio packets may hold several frames
+            p.data += ret;
+            p.size -= ret;
+        } else {
+            return;
+        }
+    }
+}
+
+static void batch_file_line(BatchFile *f, const char *error, double ms)
+{
+    Batch *b = f->b;
+    int64_t nb_frames = 0;
+    int failed = error != NULL;
+
+    SDL_LockMutex(b->mutex);
+    fprintf(b->out, "{\"kind\":\"file\",\"file\":");
+    json_put_string(b->out, f->filename);
+    fprintf(b->out, ",\"ms\":%.1f,\"streams\":[", ms);
+    for (int i = 0; i < f->nb_streams; i++) {
+        AVCodecContext *c = f->s->ic->streams[i]->codec;
+        BatchStream *bs = &f->streams[i];
+        const char *type = av_get_media_type_string(c->codec_type);
+        char md5[33], err[AV_ERROR_MAX_STRING_SIZE] = "";
+
+        md5_hex(bs->md5, md5);
+        fprintf(b->out, "%s{\"index\":%d,\"type\":\"%s\",\"codec\":\"%s\",\"frames\":%lld,\"errors\":%lld,\"md5\":\"%s\"",
+                i ? "," : "", i, type ? type : "unknown", avcodec_get_name(c->codec_id),
+                (long long)bs->nb_frames, (long long)bs->nb_errors, md5);
+        if (bs->nb_errors) {
+            av_strerror(bs->last_error, err, sizeof(err));
+            fprintf(b->out, ",\"last_error\":");
+            json_put_string(b->out, err);
+            failed = 1;
+        }
+        fputc('}', b->out);
+        nb_frames += bs->nb_frames;
+    }
+    fprintf(b->out, "],\"status\":\"%s\"", failed ? "error" : "ok");
+    if (error) {
+        fprintf(b->out, ",\"error\":");
+        json_put_string(b->out, error);
+    }
+    fprintf(b->out, "}\n");
+
+    b->nb_files++;
+    b->nb_failed += failed;
+    b->nb_frames += nb_frames;
+    SDL_UnlockMutex(b->mutex);
+}
+
+static void batch_file_free(BatchFile *f)
+{
+    for (int i = 0; i < f->nb_streams; i++)
+        av_freep(&f->streams[i].md5);
+    av_freep(&f->streams);
+    av_freep(&f->frame_md5);
+    av_frame_free(&f->frame);
+    av_freep(&f->buf);
+    media_state_free(&f->s);
+    av_freep(&f);
+}
+
+static void batch_task(void *opaque)
+{
+    BatchFile *f = (BatchFile *)opaque;
+    Batch *b = f->b;
+    Uint64 start = SDL_GetPerformanceCounter();
+    const char *error = NULL;
+    AVPacket pkt;
+
+    if (media_open_input_file(&f->s, f->filename) < 0) {
+        error = "open failed";
+        goto end;
+    }
+
+    f->nb_streams = f->s->ic->nb_streams;
+    f->streams = (BatchStream *)av_mallocz(f->nb_streams * sizeof(BatchStream));
+    f->frame_md5 = av_md5_alloc();
+    f->frame = av_frame_alloc();
+    if (!f->streams || !f->frame_md5 || !f->frame) {
+        f->nb_streams = 0;
+        error = "out of memory";
+        goto end;
+    }
+    for (int i = 0; i < f->nb_streams; i++) {
+        f->streams[i].md5 = av_md5_alloc();
+        if (!f->streams[i].md5) {
+            error = "out of memory";
+            goto end;
+        }
+        av_md5_init(f->streams[i].md5);
+    }
+
+    //straight through, no queues, clocks or sleeping
+    av_init_packet(&pkt);
+    while (av_read_frame(f->s->ic, &pkt) >= 0) {
+        batch_decode_packet(f, &pkt);
+        av_packet_unref(&pkt);
+    }
+
+    for (int i = 0; i < f->nb_streams; i++) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        pkt.stream_index = i;
+        batch_decode_packet(f, &pkt);
+    }
+
+end:
+    if (!f->s) {
+        //nothing to report per stream
+        SDL_LockMutex(b->mutex);
+        fprintf(b->out, "{\"kind\":\"file\",\"file\":");
+        json_put_string(b->out, f->filename);
+        fprintf(b->out, ",\"ms\":%.1f,\"streams\":[],\"status\":\"error\",\"error\":\"%s\"}\n",
+                (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(), error);
+        b->nb_files++;
+        b->nb_failed++;
+        SDL_UnlockMutex(b->mutex);
+    } else {
+        for (int i = 0; i < f->nb_streams; i++) {
+            if (!f->streams[i].md5)
+                f->nb_streams = i;
+        }
+        batch_file_line(f, error, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    }
+
+    batch_file_free(f);
+    SDL_SemPost(b->slots);
+}
+
+//-j N, -o out.jsonl and -summary, -buffer N too when max_buffered is given.
+//returns the index of the first file
+static int batch_open(Batch *b, int argc, char *argv[], int *nb_workers, int *max_buffered)
+{
+    const char *out_name = NULL;
+    int first = 0;
+
+    memset(b, 0, sizeof(Batch));
+    b->frame_lines = 1;
+
+    while (first < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "-j") && first + 1 < argc) {
+            *nb_workers = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-buffer") && max_buffered && first + 1 < argc) {
+            *max_buffered = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-o") && first + 1 < argc) {
+            out_name = argv[first + 1];
+            first += 2;
+        } else if (!strcmp(argv[first], "-summary")) {
+            //per file lines only
+            b->frame_lines = 0;
+            first++;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc)
+        return -1;
+
+    b->out = out_name ? fopen(out_name, "w") : stdout;
+    if (!b->out) {
+        printf("batch: can't open %s\n", out_name);
+        return -1;
+    }
+
+    return first;
+}
+
+//-batch [-j N] [-o out.jsonl] [-summary] file [file ...]
+//decodes the files on N workers (0 = one per cpu) and writes json lines: one per
+//decoded frame, one per file with the stream checksums and one for the whole run.
+//lines of different files interleave, -j 1 keeps them in order
+int batch_run(int argc, char *argv[])
+{
+    Batch b;
+    int nb_workers = 0, first, ret = 0;
+    Uint64 start;
+    double ms;
+
+    first = batch_open(&b, argc, argv, &nb_workers, NULL);
+    if (first < 0)
+        return -1;
+
+    thread_task_group_init(&b.tasks);
+    b.pool = thread_pool_create(nb_workers);
+    b.mutex = SDL_CreateMutex();
+    b.slots = b.pool ? SDL_CreateSemaphore(b.pool->nb_workers * BATCH_FILES_PER_WORKER) : NULL;
+    if (!b.pool || !b.mutex || !b.slots) {
+        ret = -1;
+        goto clean;
+    }
+
+    start = SDL_GetPerformanceCounter();
+
+    //files are opened only when a slot is free, however many are queued
+    for (int i = first; i < argc; i++) {
+        BatchFile *f;
+
+        SDL_SemWait(b.slots);
+        f = (BatchFile *)av_mallocz(sizeof(BatchFile));
+        if (!f) {
+            SDL_SemPost(b.slots);
+            ret = -1;
+            break;
+        }
+        f->b = &b;
+        f->filename = argv[i];
+        if (thread_pool_submit(b.pool, &b.tasks, TASK_PRIORITY_NORMAL, batch_task, f) < 0) {
+            av_freep(&f);
+            SDL_SemPost(b.slots);
+            ret = -1;
+            break;
+        }
+    }
+
+    thread_task_group_wait(&b.tasks);
+
+    ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    fprintf(b.out, "{\"kind\":\"batch\",\"files\":%d,\"failed\":%d,\"frames\":%lld,\"workers\":%d,\"ms\":%.1f,\"fps\":%.1f}\n",
+            b.nb_files, b.nb_failed, (long long)b.nb_frames, b.pool->nb_workers, ms,
+            ms > 0 ? b.nb_frames * 1000.0 / ms : 0.0);
+
+    //a qc gate fails on any broken file
+    if (b.nb_failed)
+        ret = -1;
+
+clean:
+    if (b.slots)
+        SDL_DestroySemaphore(b.slots);
+    if (b.mutex)
+        SDL_DestroyMutex(b.mutex);
+    thread_pool_free(&b.pool);
+    thread_task_group_destroy(&b.tasks);
+    if (b.out != stdout)
+        fclose(b.out);
+
+    return ret;
+}
+
+//where the extracted frames go, in pts order
+typedef struct BatchExtract {
+    Batch *b;
+    const char *filename;
+    ExtractStats *stats;
+    struct AVMD5 *frame_md5;
+    struct AVMD5 *stream_md5;
+    uint8_t *buf;
+    int buf_size;
+    int64_t nb_frames;
+} BatchExtract;
+
+static int batch_extract_write(VideoSink *sink, AVFrame *frame, double)
+{
+    BatchExtract *x = (BatchExtract *)sink->opaque;
+    int size = batch_frame_update(x->frame_md5, x->stream_md5, &x->buf, &x->buf_size, frame, 1);
+
+    if (size < 0)
+        return -1;
+
+    if (x->b->frame_lines)
+        batch_frame_line(x->b, x->filename, x->stats->stream_index, x->nb_frames,
+                         x->stats->time_base, frame->pts, size, x->frame_md5);
+    x->nb_frames++;
+
+    return 0;
+}
+
+//-extract [-j N] [-buffer N] [-o out.jsonl] [-summary] file
+//the video of one file decoded on N workers at once (see extract_video), with the
+//same frame lines as -batch in pts order and a last line with the stream md5, so
+//the result can be checked against -j 1 or -batch
+int batch_extract_run(int argc, char *argv[])
+{
+    Batch b;
+    BatchExtract x;
+    ExtractStats stats;
+    VideoSink *sink = NULL;
+    int nb_workers = 0, max_buffered = EXTRACT_MAX_BUFFERED, first, ret;
+    Uint64 start;
+    double ms;
+    char md5[33];
+
+    first = batch_open(&b, argc, argv, &nb_workers, &max_buffered);
+    if (first < 0)
+        return -1;
+
+    memset(&x, 0, sizeof(x));
+    x.b = &b;
+    x.filename = argv[first];
+    x.stats = &stats;
+    x.frame_md5 = av_md5_alloc();
+    x.stream_md5 = av_md5_alloc();
+    b.mutex = SDL_CreateMutex();
+    if (x.frame_md5 && x.stream_md5 && b.mutex)
+        sink = video_sink_alloc(batch_extract_write, &x);
+    if (!sink) {
+        ret = -1;
+        goto clean;
+    }
+    av_md5_init(x.stream_md5);
+
+    start = SDL_GetPerformanceCounter();
+    ret = extract_video(x.filename, nb_workers, max_buffered, sink, &stats);
+    ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+
+    md5_hex(x.stream_md5, md5);
+    fprintf(b.out, "{\"kind\":\"extract\",\"file\":");
+    json_put_string(b.out, x.filename);
+    fprintf(b.out, ",\"stream\":%d,\"frames\":%lld,\"errors\":%lld,\"md5\":\"%s\",\"workers\":%d,\"ranges\":%d,"
+            "\"ms\":%.1f,\"fps\":%.1f,\"status\":\"%s\"}\n",
+            stats.stream_index, (long long)x.nb_frames, (long long)stats.nb_errors, md5,
+            stats.nb_workers, stats.nb_ranges, ms, ms > 0 ? x.nb_frames * 1000.0 / ms : 0.0,
+            ret < 0 || stats.nb_errors ? "error" : "ok");
+    if (stats.nb_errors)
+        ret = -1;
+
+clean:
+    video_sink_free(&sink);
+    av_freep(&x.frame_md5);
+    av_freep(&x.stream_md5);
+    av_freep(&x.buf);
+    if (b.mutex)
+        SDL_DestroyMutex(b.mutex);
+    if (b.out != stdout)
+        fclose(b.out);
+
+    return ret;
+}
@@ -0,0 +1,15 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "mediastate.h"
+#include "extract.h"
+
+#define BATCH_FILES_PER_WORKER 2 //files open at once per worker, bounds the memory
+
+void json_put_string(FILE *out, const char *str);
+
+int batch_run(int argc, char *argv[]);
+
+int batch_extract_run(int argc, char *argv[]);
+
+#endif // BATCH_H
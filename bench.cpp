@@ -0,0 +1,1195 @@
+#include "bench.h"
+#include "benchsuite.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "benchheap.h"
+
+#include <stdlib.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/opt.h>
+#include <libavutil/channel_layout.h>
+}
+
+//simulated per frame cost of the pipeline stages, in microseconds
+#define BENCH_DEMUX_US 50
+#define BENCH_DECODE_US 1500
+#define BENCH_CONVERT_US 400
+#define BENCH_FPS 25
+#define BENCH_SECONDS 4
+#define BENCH_CONVERT_FRAMES 20
+#define BENCH_PIXELS_FRAMES 50
+#define BENCH_PIXELS_SWS_TOLERANCE 2 //largest sample difference to swscale, rounding of the range and depth conversions
+#define BENCH_UPLOAD_FRAMES 50
+#define BENCH_ALLOC_FRAMES 10000
+#define BENCH_ALLOC_WARMUP 100 //frames before the counters must stay flat
+#define BENCH_ALLOC_GOP 50
+#define BENCH_ALLOC_FILE "bench-alloc.mkv" //generated clip the session path loops over
+#define BENCH_ALLOC_CLIP_SECONDS 4
+#define BENCH_ATOMICS_ITERATIONS 10000000
+#define BENCH_AUDIO_FRAMES 2000
+#define BENCH_AUDIO_SAMPLES 1024
+#define BENCH_AUDIO_RATE 48000
+
+typedef struct BenchSession {
+    struct BenchScheduler *b;
+    int index;
+    int priority;
+
+    //frames demuxed but not decoded yet, thread mode only
+    SDL_sem *packets;
+    SDL_Thread *demux_tid;
+    SDL_Thread *decode_tid;
+
+    int nb_frames;
+    double *latency; //ms between the frame's due time and the end of its conversion
+} BenchSession;
+
+typedef struct BenchScheduler {
+    BenchSession *sessions;
+    int nb_sessions;
+    int nb_frames;
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
+    Uint64 start;
+    SDL_atomic_t quit;
+} BenchScheduler;
+
+typedef struct BenchFrame {
+    BenchSession *session;
+    int index;
+} BenchFrame;
+
+static double bench_iterations_per_us;
+
+int audio_decode_frame(MediaState* s, uint8_t *audio_buf, int buf_size);
+
+//the allocation counter of the preloaded benchheap shim, NULL without it
+static BenchHeapWatchFunc bench_heap_hook;
+
+static int bench_heap_find()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    bench_heap_hook = (BenchHeapWatchFunc)dlsym(RTLD_DEFAULT, BENCH_HEAP_WATCH);
+    return bench_heap_hook != NULL;
+#endif
+}
+
+static void bench_heap_watch(BenchHeap *h)
+{
+    if (bench_heap_hook)
+        bench_heap_hook(h);
+}
+
+double bench_now_ms(Uint64 start)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+//a fixed amount of computation, unlike a timed spin it really takes longer when
+//the cores are oversubscribed
+void bench_burn(int us)
+{
+    volatile double acc = 0;
+    long n = (long)(us * bench_iterations_per_us);
+
+    for (long i = 0; i < n; i++)
+        acc += i * 0.5;
+}
+
+void bench_calibrate()
+{
+    Uint64 start;
+    double elapsed;
+
+    if (bench_iterations_per_us > 0)
+        return;
+
+    bench_iterations_per_us = 100;
+    start = SDL_GetPerformanceCounter();
+    bench_burn(100000);
+    elapsed = bench_now_ms(start) * 1000;
+    bench_iterations_per_us = 100 * 100000 / (elapsed > 1 ? elapsed : 1);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double bench_percentile(double *values, int nb_values, double percentile)
+{
+    if (nb_values <= 0)
+        return 0;
+
+    qsort(values, nb_values, sizeof(double), compare_double);
+
+    int i = (int)(percentile / 100 * (nb_values - 1) + 0.5);
+    return values[i];
+}
+
+static double frame_due_ms(int index)
+{
+    return index * 1000.0 / BENCH_FPS;
+}
+
+static void wait_until(BenchScheduler *b, double ms)
+{
+    double now = bench_now_ms(b->start);
+    if (ms > now)
+        SDL_Delay((Uint32)(ms - now));
+}
+
+static void frame_done(BenchSession *bs, int index)
+{
+    bs->latency[index] = bench_now_ms(bs->b->start) - frame_due_ms(index);
+    bs->nb_frames++;
+}
+
+//thread per session: a demuxer and a decoder thread like media_start without pool
+static int bench_demux_thread(void *userdata)
+{
+    BenchSession *bs = (BenchSession *)userdata;
+
+    for (int i = 0; i < bs->b->nb_frames && !SDL_AtomicGet(&bs->b->quit); i++) {
+        wait_until(bs->b, frame_due_ms(i));
+        bench_burn(BENCH_DEMUX_US);
+        SDL_SemPost(bs->packets);
+    }
+
+    return 0;
+}
+
+static int bench_decode_thread(void *userdata)
+{
+    BenchSession *bs = (BenchSession *)userdata;
+
+    for (int i = 0; i < bs->b->nb_frames; i++) {
+        SDL_SemWait(bs->packets);
+        bench_burn(BENCH_DECODE_US);
+        bench_burn(BENCH_CONVERT_US);
+        frame_done(bs, i);
+    }
+
+    return 0;
+}
+
+//shared pool: demux, decode and convert of every frame are separate tasks
+static void bench_convert_task(void *userdata)
+{
+    BenchFrame *f = (BenchFrame *)userdata;
+
+    bench_burn(BENCH_CONVERT_US);
+    frame_done(f->session, f->index);
+    av_free(f);
+}
+
+static void bench_decode_task(void *userdata)
+{
+    BenchFrame *f = (BenchFrame *)userdata;
+
+    bench_burn(BENCH_DECODE_US);
+    thread_pool_submit(f->session->b->pool, &f->session->b->tasks, f->session->priority, bench_convert_task, f);
+}
+
+static void bench_demux_task(void *userdata)
+{
+    BenchFrame *f = (BenchFrame *)userdata;
+
+    bench_burn(BENCH_DEMUX_US);
+    thread_pool_submit(f->session->b->pool, &f->session->b->tasks, f->session->priority, bench_decode_task, f);
+}
+
+//returns 0 on success and fills the frames/s and latency percentiles
+static int bench_scheduler_run(int nb_sessions, int use_pool, double *fps,
+                               double *p50, double *p99, double *p99_focused)
+{
+    BenchScheduler b;
+    double *all, *focused;
+    int nb_all = 0, nb_focused = 0;
+    double elapsed;
+
+    memset(&b, 0, sizeof(b));
+    b.nb_sessions = nb_sessions;
+    b.nb_frames = BENCH_FPS * BENCH_SECONDS;
+    b.sessions = (BenchSession *)av_mallocz(nb_sessions * sizeof(BenchSession));
+    all = (double *)av_malloc(nb_sessions * b.nb_frames * sizeof(double));
+    focused = (double *)av_malloc(b.nb_frames * sizeof(double));
+    if (!b.sessions || !all || !focused)
+        return -1;
+
+    thread_task_group_init(&b.tasks);
+    if (use_pool && !(b.pool = thread_pool_create(0)))
+        return -1;
+
+    for (int i = 0; i < nb_sessions; i++) {
+        BenchSession *bs = &b.sessions[i];
+        bs->b = &b;
+        bs->index = i;
+        //one focused session, the way a video wall has one selected tile
+        bs->priority = i == 0 ? TASK_PRIORITY_HIGH : TASK_PRIORITY_NORMAL;
+        bs->latency = (double *)av_mallocz(b.nb_frames * sizeof(double));
+        bs->packets = SDL_CreateSemaphore(0);
+    }
+
+    b.start = SDL_GetPerformanceCounter();
+
+    if (use_pool) {
+        //the frame clock of every session runs on this one thread, like the SDL timer
+        for (int f = 0; f < b.nb_frames; f++) {
+            wait_until(&b, frame_due_ms(f));
+            for (int i = 0; i < nb_sessions; i++) {
+                BenchFrame *frame = (BenchFrame *)av_malloc(sizeof(BenchFrame));
+                frame->session = &b.sessions[i];
+                frame->index = f;
+                thread_pool_submit(b.pool, &b.tasks, b.sessions[i].priority, bench_demux_task, frame);
+            }
+        }
+        thread_task_group_wait(&b.tasks);
+    } else {
+        for (int i = 0; i < nb_sessions; i++) {
+            BenchSession *bs = &b.sessions[i];
+            bs->demux_tid = SDL_CreateThread(bench_demux_thread, "bench_demux", bs);
+            bs->decode_tid = SDL_CreateThread(bench_decode_thread, "bench_decode", bs);
+        }
+        for (int i = 0; i < nb_sessions; i++) {
+            SDL_WaitThread(b.sessions[i].demux_tid, NULL);
+            SDL_WaitThread(b.sessions[i].decode_tid, NULL);
+        }
+    }
+
+    elapsed = bench_now_ms(b.start);
+
+    for (int i = 0; i < nb_sessions; i++) {
+        BenchSession *bs = &b.sessions[i];
+        for (int f = 0; f < bs->nb_frames; f++) {
+            all[nb_all++] = bs->latency[f];
+            if (i == 0)
+                focused[nb_focused++] = bs->latency[f];
+        }
+        av_free(bs->latency);
+        SDL_DestroySemaphore(bs->packets);
+    }
+
+    *fps = nb_all * 1000.0 / elapsed;
+    *p50 = bench_percentile(all, nb_all, 50);
+    *p99 = bench_percentile(all, nb_all, 99);
+    *p99_focused = bench_percentile(focused, nb_focused, 99);
+
+    thread_pool_free(&b.pool);
+    thread_task_group_destroy(&b.tasks);
+    av_free(b.sessions);
+    av_free(all);
+    av_free(focused);
+
+    return 0;
+}
+
+//thread per session against the shared pool at 4, 16 and 64 sessions
+int bench_scheduler()
+{
+    static const int sessions[] = { 4, 16, 64 };
+
+    bench_calibrate();
+
+    printf("scheduler: %d cpus, %d fps per session, %d/%d/%d us demux/decode/convert per frame\n",
+           SDL_GetCPUCount(), BENCH_FPS, BENCH_DEMUX_US, BENCH_DECODE_US, BENCH_CONVERT_US);
+    printf("%8s %8s %8s %12s %10s %10s %14s\n",
+           "sessions", "mode", "threads", "frames/s", "p50 ms", "p99 ms", "focused p99");
+
+    for (unsigned int i = 0; i < sizeof(sessions) / sizeof(sessions[0]); i++) {
+        for (int use_pool = 0; use_pool < 2; use_pool++) {
+            double fps, p50, p99, p99_focused;
+            if (bench_scheduler_run(sessions[i], use_pool, &fps, &p50, &p99, &p99_focused) < 0)
+                return -1;
+            printf("%8d %8s %8d %12.1f %10.2f %10.2f %14.2f\n",
+                   sessions[i], use_pool ? "pool" : "threads",
+                   use_pool ? SDL_GetCPUCount() : sessions[i] * 2,
+                   fps, p50, p99, p99_focused);
+        }
+    }
+
+    return 0;
+}
+
+//deterministic picture content: gradients so the scaler has something to
+//filter, or noise over the whole sample range for exactness checks
+static AVFrame *bench_alloc_frame(int w, int h, enum AVPixelFormat fmt, int noise)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    unsigned int seed = 12345;
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->width = w;
+    frame->height = h;
+    frame->format = fmt;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    for (int p = 0; p < av_pix_fmt_count_planes(fmt); p++) {
+        int depth = desc->comp[0].depth;
+        int size = depth > 8 ? 2 : 1;
+        int n = av_image_get_linesize(fmt, w, p) / size;
+        int rows = p == 1 || p == 2 ? AV_CEIL_RSHIFT(h, desc->log2_chroma_h) : h;
+        int max = (1 << depth) - 1;
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < n; x++) {
+                int v;
+                if (noise) {
+                    seed = seed * 1103515245 + 12345;
+                    v = (seed >> 16) & max;
+                } else {
+                    v = ((x * 7 + y * 3 + p * 50) * (max + 1) / 1024) & max;
+                }
+                if (size == 2)
+                    ((uint16_t *)(frame->data[p] + y * frame->linesize[p]))[x] = v;
+                else
+                    frame->data[p][y * frame->linesize[p] + x] = v;
+            }
+        }
+    }
+
+    return frame;
+}
+
+//ms per frame of the sliced converter at 1/2/4/8 threads, for sources up to 4k
+//converted to yuv420p at the same size and at half size
+int bench_convert()
+{
+    static const int sizes[][2] = { { 640, 360 }, { 1920, 1080 }, { 3840, 2160 } };
+    static const enum AVPixelFormat formats[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10LE };
+    static const int threads[] = { 1, 2, 4, 8 };
+    int ret = 0;
+
+    printf("convert: %d cpus, %d frames per run, bicubic\n", SDL_GetCPUCount(), BENCH_CONVERT_FRAMES);
+    printf("%12s %12s %10s", "source", "format", "output");
+    for (unsigned int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+        printf(" %6d thr", threads[t]);
+    printf("\n");
+
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (unsigned int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+            for (int half = 0; half < 2; half++) {
+                int w = sizes[i][0], h = sizes[i][1];
+                int dst_w = half ? w / 2 : w, dst_h = half ? h / 2 : h;
+                AVFrame *src = bench_alloc_frame(w, h, formats[f], 0);
+                AVFrame *dst = bench_alloc_frame(dst_w, dst_h, AV_PIX_FMT_YUV420P, 0);
+                char size[32];
+
+                if (!src || !dst) {
+                    av_frame_free(&src);
+                    av_frame_free(&dst);
+                    return -1;
+                }
+
+                snprintf(size, sizeof(size), "%dx%d", dst_w, dst_h);
+                printf("%5dx%-6d %12s %10s", w, h, av_get_pix_fmt_name(formats[f]), size);
+
+                for (unsigned int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+                    //the calling thread converts the last slice itself
+                    ThreadPool *pool = threads[t] > 1 ? thread_pool_create(threads[t] - 1) : NULL;
+                    VideoConverter *cv = video_converter_create(pool, threads[t]);
+                    Uint64 start;
+
+                    if (!cv || (threads[t] > 1 && !pool)) {
+                        video_converter_free(&cv);
+                        thread_pool_free(&pool);
+                        ret = -1;
+                        break;
+                    }
+
+                    //the first frame builds the scalers, keep it out of the timing
+                    video_converter_scale(cv, src, dst->data, dst->linesize, dst_w, dst_h, AV_PIX_FMT_YUV420P);
+                    start = SDL_GetPerformanceCounter();
+                    for (int n = 0; n < BENCH_CONVERT_FRAMES; n++)
+                        video_converter_scale(cv, src, dst->data, dst->linesize, dst_w, dst_h, AV_PIX_FMT_YUV420P);
+                    printf(" %10.2f", bench_now_ms(start) / BENCH_CONVERT_FRAMES);
+
+                    video_converter_free(&cv);
+                    thread_pool_free(&pool);
+                }
+                printf("\n");
+
+                av_frame_free(&src);
+                av_frame_free(&dst);
+            }
+        }
+    }
+
+    return ret;
+}
+
+//differing samples of two yuv420p pictures and the largest difference
+static int bench_compare_frames(AVFrame *a, AVFrame *b, int *max_diff)
+{
+    int mismatches = 0;
+
+    *max_diff = 0;
+    for (int p = 0; p < 3; p++) {
+        int pw = p ? AV_CEIL_RSHIFT(a->width, 1) : a->width;
+        int ph = p ? AV_CEIL_RSHIFT(a->height, 1) : a->height;
+        for (int y = 0; y < ph; y++) {
+            for (int x = 0; x < pw; x++) {
+                int d = abs(a->data[p][y * a->linesize[p] + x] - b->data[p][y * b->linesize[p] + x]);
+                if (d) {
+                    mismatches++;
+                    *max_diff = FFMAX(*max_diff, d);
+                }
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+//swscale as the kernels are compared to: undithered, since the kernels round
+static struct SwsContext *bench_reference_scaler(int w, int h, enum AVPixelFormat src_fmt)
+{
+    struct SwsContext *sws_ctx = sws_alloc_context();
+    if (!sws_ctx)
+        return NULL;
+
+    av_opt_set_int(sws_ctx, "srcw", w, 0);
+    av_opt_set_int(sws_ctx, "srch", h, 0);
+    av_opt_set_int(sws_ctx, "src_format", src_fmt, 0);
+    av_opt_set_int(sws_ctx, "dstw", w, 0);
+    av_opt_set_int(sws_ctx, "dsth", h, 0);
+    av_opt_set_int(sws_ctx, "dst_format", AV_PIX_FMT_YUV420P, 0);
+    av_opt_set_int(sws_ctx, "sws_flags", SWS_BICUBIC, 0);
+    av_opt_set(sws_ctx, "sws_dither", "none", 0);
+
+    if (sws_init_context(sws_ctx, NULL, NULL) < 0) {
+        sws_freeContext(sws_ctx);
+        return NULL;
+    }
+
+    return sws_ctx;
+}
+
+static double bench_pixels_time(PixelKernelFunc kernel, struct SwsContext *sws_ctx, AVFrame *src, AVFrame *dst)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    for (int n = 0; n < BENCH_PIXELS_FRAMES; n++) {
+        if (kernel)
+            kernel(src->data, src->linesize, dst->data, dst->linesize, src->width, src->height);
+        else
+            sws_scale(sws_ctx, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    }
+
+    return bench_now_ms(start) / BENCH_PIXELS_FRAMES;
+}
+
+//single thread ms per 1080p frame of every kernel isa against swscale, then
+//exactness on an odd sized noise picture: the vector kernels must match the
+//scalar one bit for bit and no sample may be further than the tolerance from
+//swscale
+int bench_pixels()
+{
+    static const enum AVPixelFormat formats[] = { AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUVJ420P };
+    static const int sizes[][2] = { { 1920, 1080 }, { 641, 361 } };
+    int ret = 0;
+
+    printf("pixels: best isa %s, ms per %dx%d frame, one thread\n",
+           pixel_isa_name(pixel_kernel_best_isa()), sizes[0][0], sizes[0][1]);
+    printf("%12s %10s", "format", "swscale");
+    for (int isa = 0; isa < PIXEL_ISA_COUNT; isa++)
+        printf(" %10s", pixel_isa_name(isa));
+    printf(" %16s %16s\n", "simd != scalar", "swscale diff");
+
+    for (unsigned int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        int simd_mismatches = 0, sws_mismatches = 0, sws_max_diff = 0;
+
+        printf("%12s", av_get_pix_fmt_name(formats[f]));
+
+        for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            int w = sizes[i][0], h = sizes[i][1];
+            int exactness = i > 0;
+            AVFrame *src = bench_alloc_frame(w, h, formats[f], exactness);
+            AVFrame *ref = bench_alloc_frame(w, h, AV_PIX_FMT_YUV420P, 0);
+            AVFrame *dst = bench_alloc_frame(w, h, AV_PIX_FMT_YUV420P, 0);
+            struct SwsContext *sws_ctx = bench_reference_scaler(w, h, formats[f]);
+
+            if (!src || !ref || !dst || !sws_ctx) {
+                av_frame_free(&src);
+                av_frame_free(&ref);
+                av_frame_free(&dst);
+                sws_freeContext(sws_ctx);
+                printf("\n");
+                return -1;
+            }
+
+            if (!exactness)
+                printf(" %10.2f", bench_pixels_time(NULL, sws_ctx, src, ref));
+
+            PixelKernelFunc scalar = pixel_kernel_find(formats[f], AV_PIX_FMT_YUV420P, PIXEL_ISA_SCALAR);
+            if (exactness) {
+                int max_diff;
+                sws_scale(sws_ctx, src->data, src->linesize, 0, h, ref->data, ref->linesize);
+                scalar(src->data, src->linesize, dst->data, dst->linesize, w, h);
+                sws_mismatches = bench_compare_frames(ref, dst, &sws_max_diff);
+                av_frame_copy(ref, dst);
+                for (int isa = PIXEL_ISA_SCALAR + 1; isa < PIXEL_ISA_COUNT; isa++) {
+                    PixelKernelFunc kernel = pixel_kernel_find(formats[f], AV_PIX_FMT_YUV420P, isa);
+                    if (!kernel)
+                        continue;
+                    kernel(src->data, src->linesize, dst->data, dst->linesize, w, h);
+                    simd_mismatches += bench_compare_frames(ref, dst, &max_diff);
+                }
+            } else {
+                for (int isa = 0; isa < PIXEL_ISA_COUNT; isa++) {
+                    PixelKernelFunc kernel = pixel_kernel_find(formats[f], AV_PIX_FMT_YUV420P, isa);
+                    if (kernel)
+                        printf(" %10.2f", bench_pixels_time(kernel, NULL, src, dst));
+                    else
+                        printf(" %10s", "-");
+                }
+            }
+
+            av_frame_free(&src);
+            av_frame_free(&ref);
+            av_frame_free(&dst);
+            sws_freeContext(sws_ctx);
+        }
+
+        printf(" %16d %9d max %d%s\n", simd_mismatches, sws_mismatches, sws_max_diff,
+               sws_max_diff > BENCH_PIXELS_SWS_TOLERANCE ? " over tolerance" : "");
+        if (simd_mismatches || sws_max_diff > BENCH_PIXELS_SWS_TOLERANCE)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+//the old output path, convert into a picture and SDL_UpdateTexture it, against
+//converting straight into the locked streaming texture. a hidden window with
+//the software renderer keeps it runnable without a gpu
+int bench_upload()
+{
+    static const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    SDL_Window *window;
+    SDL_Renderer *render;
+    int ret = 0;
+
+    window = SDL_CreateWindow("bench", 0, 0, 64, 64, SDL_WINDOW_HIDDEN);
+    render = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE) : NULL;
+    if (!render) {
+        printf("upload: no renderer, skipped: %s\n", SDL_GetError());
+        if (window)
+            SDL_DestroyWindow(window);
+        return 0;
+    }
+
+    printf("upload: nv12 to iyuv texture, %d frames per run, one thread\n", BENCH_UPLOAD_FRAMES);
+    printf("%10s %10s %16s %16s %10s\n", "size", "path", "written/frame", "copied/frame", "ms/frame");
+
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int w = sizes[i][0], h = sizes[i][1];
+        int size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, w, h, 1);
+        AVFrame *src = bench_alloc_frame(w, h, AV_PIX_FMT_NV12, 0);
+        AVFrame *pic = bench_alloc_frame(w, h, AV_PIX_FMT_YUV420P, 0);
+        SDL_Texture *texture = SDL_CreateTexture(render, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, w, h);
+        VideoConverter *cv = video_converter_create(NULL, 1);
+        char name[32];
+
+        if (!src || !pic || !texture || !cv) {
+            ret = -1;
+            goto next;
+        }
+
+        snprintf(name, sizeof(name), "%dx%d", w, h);
+
+        for (int direct = 0; direct < 2; direct++) {
+            int64_t copied = 0;
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            for (int n = 0; n < BENCH_UPLOAD_FRAMES; n++) {
+                if (direct) {
+                    uint8_t *data[4] = { NULL };
+                    int linesize[4] = { 0 };
+                    void *pixels;
+                    int pitch;
+
+                    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0) {
+                        ret = -1;
+                        break;
+                    }
+                    data[0] = (uint8_t *)pixels;
+                    linesize[0] = pitch;
+                    data[1] = data[0] + pitch * h;
+                    linesize[1] = pitch / 2;
+                    data[2] = data[1] + (pitch / 2) * ((h + 1) / 2);
+                    linesize[2] = pitch / 2;
+                    video_converter_scale(cv, src, data, linesize, w, h, AV_PIX_FMT_YUV420P);
+                    SDL_UnlockTexture(texture);
+                } else {
+                    video_converter_scale(cv, src, pic->data, pic->linesize, w, h, AV_PIX_FMT_YUV420P);
+                    SDL_UpdateYUVTexture(texture, NULL, pic->data[0], pic->linesize[0],
+                                         pic->data[1], pic->linesize[1], pic->data[2], pic->linesize[2]);
+                    copied += size;
+                }
+            }
+
+            printf("%10s %10s %16d %16lld %10.2f\n", name, direct ? "locked" : "update",
+                   size, (long long)(copied / BENCH_UPLOAD_FRAMES), bench_now_ms(start) / BENCH_UPLOAD_FRAMES);
+        }
+
+next:
+        video_converter_free(&cv);
+        if (texture)
+            SDL_DestroyTexture(texture);
+        av_frame_free(&src);
+        av_frame_free(&pic);
+    }
+
+    SDL_DestroyRenderer(render);
+    SDL_DestroyWindow(window);
+
+    return ret;
+}
+
+//encode one short gop of tiny mpeg4 frames to feed the video decoder
+static int bench_encode_gop(AVPacket *packets, int nb_packets)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    AVCodecContext *c;
+    AVFrame *frame;
+    int nb = 0;
+
+    if (!codec || !(c = avcodec_alloc_context3(codec)))
+        return -1;
+
+    c->width = 64;
+    c->height = 64;
+    c->pix_fmt = AV_PIX_FMT_YUV420P;
+    c->time_base.num = 1;
+    c->time_base.den = 25;
+    c->gop_size = nb_packets;
+    c->max_b_frames = 0;
+
+    frame = bench_alloc_frame(c->width, c->height, c->pix_fmt, 0);
+    if (!frame || avcodec_open2(c, codec, NULL) < 0) {
+        av_frame_free(&frame);
+        avcodec_free_context(&c);
+        return -1;
+    }
+
+    for (int i = 0; nb < nb_packets && i < nb_packets * 2; i++) {
+        int got_packet = 0;
+        av_init_packet(&packets[nb]);
+        packets[nb].data = NULL;
+        packets[nb].size = 0;
+        frame->pts = i;
+        frame->data[0][i % (c->width * c->height)] ^= 0xff; //every frame differs a bit
+        if (avcodec_encode_video2(c, &packets[nb], i < nb_packets ? frame : NULL, &got_packet) < 0)
+            break;
+        if (got_packet)
+            nb++;
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&c);
+
+    return nb;
+}
+
+//the decode paths of a session: packet queue, pooled decoder buffers, frame
+//queue. returns the pool buffers and queue nodes allocated after the warm up,
+//heap gets every allocation after it
+static int bench_alloc_run(AVCodecContext *c, AVPacket *packets, int nb_packets,
+                           int *pool_allocs, int *node_allocs, BenchHeap *heap)
+{
+    PacketQueue pq;
+    FrameQueue fq;
+    AVFrame *decode_frame = av_frame_alloc(), *show_frame = av_frame_alloc();
+    int nb_frames = 0, pool_start = 0, node_start = 0;
+    double pts;
+
+    packet_queue_init(&pq);
+    frame_queue_init(&fq, VIDEO_FRAME_QUEUE_SIZE);
+
+    for (int i = 0; decode_frame && show_frame && nb_frames < BENCH_ALLOC_FRAMES; i++) {
+        AVPacket pkt;
+        int got_frame = 0, ret;
+
+        //start over like after a seek
+        if (i % nb_packets == 0)
+            avcodec_flush_buffers(c);
+
+        if (av_packet_ref(&pkt, &packets[i % nb_packets]) < 0 || packet_queue_put(&pq, &pkt) < 0)
+            break;
+        packet_queue_get(&pq, &pkt, 0);
+
+        if (c->codec_type == AVMEDIA_TYPE_VIDEO)
+            ret = avcodec_decode_video2(c, decode_frame, &got_frame, &pkt);
+        else
+            ret = avcodec_decode_audio4(c, decode_frame, &got_frame, &pkt);
+        av_packet_unref(&pkt);
+        if (ret < 0)
+            break;
+        if (!got_frame)
+            continue;
+
+        frame_queue_put(&fq, decode_frame, nb_frames);
+        av_frame_unref(decode_frame);
+        frame_queue_get(&fq, show_frame, &pts);
+        av_frame_unref(show_frame);
+
+        if (++nb_frames == BENCH_ALLOC_WARMUP) {
+            pool_start = frame_pool_allocations();
+            node_start = pq.nb_node_allocs;
+            bench_heap_watch(heap);
+        }
+    }
+    bench_heap_watch(NULL);
+
+    *pool_allocs = frame_pool_allocations() - pool_start;
+    *node_allocs = pq.nb_node_allocs - node_start;
+
+    av_frame_free(&decode_frame);
+    av_frame_free(&show_frame);
+    packet_queue_destroy(&pq);
+    frame_queue_destroy(&fq);
+
+    return nb_frames;
+}
+
+static AVCodecContext *bench_open_decoder(enum AVCodecID id, FramePool *fp)
+{
+    AVCodec *codec = avcodec_find_decoder(id);
+    AVCodecContext *c = codec ? avcodec_alloc_context3(codec) : NULL;
+
+    if (!c)
+        return NULL;
+
+    if (id == AV_CODEC_ID_PCM_S16LE) {
+        c->channels = 2;
+        c->channel_layout = AV_CH_LAYOUT_STEREO;
+        c->sample_rate = 48000;
+    }
+    c->refcounted_frames = 1;
+    frame_pool_attach(fp, c);
+
+    if (avcodec_open2(c, codec, NULL) < 0)
+        avcodec_free_context(&c);
+
+    return c;
+}
+
+//a whole session on a generated clip, looped by seeking back, without its
+//threads: the demuxer steps uncounted and the per frame paths of the decoders
+//and the presenter, video_decode_step, decode_and_show and audio_decode_frame,
+//are counted on this thread after the warm up
+static int bench_alloc_session(BenchHeap *video_heap, BenchHeap *audio_heap, int *nb_audio, int *audio_counted)
+{
+    MediaState *s = NULL;
+    int nb_video = 0, idle = 0;
+
+    *nb_audio = 0;
+    *audio_counted = 0;
+    if (bench_suite_generate(BENCH_ALLOC_FILE, AV_CODEC_ID_MPEG4, 320, 180, BENCH_ALLOC_CLIP_SECONDS, 1) < 0)
+        return -1;
+    if (media_open_input_file(&s, BENCH_ALLOC_FILE) < 0) {
+        remove(BENCH_ALLOC_FILE);
+        return -1;
+    }
+
+    media_set_audio_sink(s, audio_sink_null_create());
+    media_set_video_sink(s, video_sink_null_create());
+    if (media_open_audio_device(s) < 0 || s->video_stream_index == -1) {
+        media_state_free(&s);
+        remove(BENCH_ALLOC_FILE);
+        return -1;
+    }
+
+    while (nb_video < BENCH_ALLOC_FRAMES && idle < 1000) {
+        int shown = 0;
+        int counting = nb_video >= BENCH_ALLOC_WARMUP;
+
+        if (s->demux_eof)
+            media_seek(s, 0);
+        demux_step(s);
+
+        bench_heap_watch(counting ? video_heap : NULL);
+        while (video_decode_step(s) > 0)
+            ;
+        while (decode_and_show(s) >= 0)
+            shown++;
+        bench_heap_watch(counting ? audio_heap : NULL);
+        while (audio_decode_frame(s, s->audio_buf, MAX_AUDIO_FRAME_SIZE * 2) >= 0) {
+            (*nb_audio)++;
+            *audio_counted += counting;
+        }
+        bench_heap_watch(NULL);
+
+        nb_video += shown;
+        idle = shown ? 0 : idle + 1;
+    }
+
+    media_stop(s);
+    media_state_free(&s);
+    remove(BENCH_ALLOC_FILE);
+
+    return nb_video;
+}
+
+//counted is the number of frames after the warm up
+static int bench_alloc_report(const char *path, int nb_frames, int counted, int pool_allocs, int node_allocs,
+                              BenchHeap *heap)
+{
+    printf("%8s %10d %14d %14d", path, nb_frames, pool_allocs, node_allocs);
+    if (bench_heap_hook)
+        printf(" %10lld %10.2f\n", (long long)heap->nb_large, (double)heap->nb_small / FFMAX(counted, 1));
+    else
+        printf(" %10s %10s\n", "-", "-");
+
+    return nb_frames < BENCH_ALLOC_FRAMES || pool_allocs || node_allocs || heap->nb_large ? -1 : 0;
+}
+
+//10000 frames through the video and the audio decode paths and through a
+//session, after the warm up neither the frame pools nor the packet queues may
+//allocate anymore, and with the benchheap shim preloaded no allocation of a
+//frame, picture or sample buffer may show up on the heap. the small refcount
+//headers libavutil allocates per buffer reference can't be pooled, they are
+//reported per frame
+int bench_alloc()
+{
+    AVPacket packets[BENCH_ALLOC_GOP];
+    AVPacket audio;
+    FramePool video_pool, audio_pool;
+    AVCodecContext *c;
+    BenchHeap heap, audio_heap;
+    int nb_packets, nb_frames, nb_audio, audio_counted, pool_allocs, node_allocs;
+    int ret = 0;
+
+    frame_pool_init(&video_pool);
+    frame_pool_init(&audio_pool);
+
+    printf("alloc: %d frames per path, counted after %d frames%s\n", BENCH_ALLOC_FRAMES, BENCH_ALLOC_WARMUP,
+           bench_heap_find() ? "" : ", the heap is not counted without LD_PRELOAD=libbenchheap.so");
+    printf("%8s %10s %14s %14s %10s %10s\n", "path", "frames", "pool buffers", "queue nodes", "heap", "headers/f");
+
+    nb_packets = bench_encode_gop(packets, BENCH_ALLOC_GOP);
+    c = nb_packets > 0 ? bench_open_decoder(AV_CODEC_ID_MPEG4, &video_pool) : NULL;
+    if (c) {
+        memset(&heap, 0, sizeof(heap));
+        nb_frames = bench_alloc_run(c, packets, nb_packets, &pool_allocs, &node_allocs, &heap);
+        ret |= bench_alloc_report("video", nb_frames, nb_frames - BENCH_ALLOC_WARMUP, pool_allocs, node_allocs, &heap);
+        avcodec_free_context(&c);
+    } else {
+        printf("%8s no mpeg4 codec, skipped\n", "video");
+    }
+    for (int i = 0; i < nb_packets; i++)
+        av_packet_unref(&packets[i]);
+
+    //1024 stereo s16 samples of silence
+    c = bench_open_decoder(AV_CODEC_ID_PCM_S16LE, &audio_pool);
+    if (c && av_new_packet(&audio, 1024 * 2 * 2) == 0) {
+        memset(audio.data, 0, audio.size);
+        memset(&heap, 0, sizeof(heap));
+        nb_frames = bench_alloc_run(c, &audio, 1, &pool_allocs, &node_allocs, &heap);
+        ret |= bench_alloc_report("audio", nb_frames, nb_frames - BENCH_ALLOC_WARMUP, pool_allocs, node_allocs, &heap);
+        av_packet_unref(&audio);
+    } else {
+        printf("%8s no pcm codec, skipped\n", "audio");
+    }
+    avcodec_free_context(&c);
+
+    frame_pool_uninit(&video_pool);
+    frame_pool_uninit(&audio_pool);
+
+    //the pools and queues of the session are its own, only the heap is counted
+    memset(&heap, 0, sizeof(heap));
+    memset(&audio_heap, 0, sizeof(audio_heap));
+    nb_frames = bench_alloc_session(&heap, &audio_heap, &nb_audio, &audio_counted);
+    if (nb_frames < 0) {
+        printf("%8s no session, skipped\n", "session");
+    } else {
+        ret |= bench_alloc_report("show", nb_frames, nb_frames - BENCH_ALLOC_WARMUP, 0, 0, &heap);
+        ret |= bench_alloc_report("sound", nb_audio, audio_counted, 0, 0, &audio_heap);
+    }
+
+    return ret;
+}
+
+//two counters written by two threads, on one cache line or on separate ones
+typedef struct BenchPacked {
+    volatile int64_t audio;
+    volatile int64_t video;
+} BenchPacked;
+
+typedef struct BenchPadded {
+    volatile int64_t audio;
+    CACHELINE_PAD(pad);
+    volatile int64_t video;
+} BenchPadded;
+
+typedef struct BenchContention {
+    volatile int64_t *counter;
+    AtomicValue *clock;
+    int writer;
+    SDL_atomic_t *go;
+    double ms;
+} BenchContention;
+
+static int bench_counter_thread(void *userdata)
+{
+    BenchContention *b = (BenchContention *)userdata;
+    Uint64 start;
+
+    while (!SDL_AtomicGet(b->go))
+        ;
+
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_ATOMICS_ITERATIONS; i++)
+        *b->counter += 1;
+    b->ms = bench_now_ms(start);
+
+    return 0;
+}
+
+//the audio callback publishing its clock while the presenter reads it
+static int bench_clock_thread(void *userdata)
+{
+    BenchContention *b = (BenchContention *)userdata;
+    volatile double sum = 0;
+    Uint64 start;
+
+    while (!SDL_AtomicGet(b->go))
+        ;
+
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_ATOMICS_ITERATIONS / 10; i++) {
+        if (b->writer)
+            atomic_value_set_double(b->clock, i * 0.001);
+        else
+            sum += atomic_value_get_double(b->clock);
+    }
+    b->ms = bench_now_ms(start);
+
+    return 0;
+}
+
+static int bench_contention_run(SDL_ThreadFunction func, BenchContention *b)
+{
+    SDL_Thread *threads[2];
+    SDL_atomic_t go;
+
+    SDL_AtomicSet(&go, 0);
+    for (int i = 0; i < 2; i++) {
+        b[i].go = &go;
+        threads[i] = SDL_CreateThread(func, "bench_contention", &b[i]);
+        if (!threads[i])
+            return -1;
+    }
+    SDL_AtomicSet(&go, 1);
+    for (int i = 0; i < 2; i++)
+        SDL_WaitThread(threads[i], NULL);
+
+    return 0;
+}
+
+//false sharing between two writer threads, and the cost of the seqlocked clock
+//with a writer and a reader running at once. also the run to do under tsan
+int bench_atomics()
+{
+    BenchPacked packed;
+    BenchPadded padded;
+    AtomicValue clock;
+    BenchContention b[2];
+
+    memset(&packed, 0, sizeof(packed));
+    memset(&padded, 0, sizeof(padded));
+    memset(&clock, 0, sizeof(clock));
+
+    printf("atomics: %d cpus, %d increments per thread, %d clock accesses per thread\n",
+           SDL_GetCPUCount(), BENCH_ATOMICS_ITERATIONS, BENCH_ATOMICS_ITERATIONS / 10);
+    printf("%10s %14s %14s\n", "layout", "thread 1 ms", "thread 2 ms");
+
+    memset(b, 0, sizeof(b));
+    b[0].counter = &packed.audio;
+    b[1].counter = &packed.video;
+    if (bench_contention_run(bench_counter_thread, b) < 0)
+        return -1;
+    printf("%10s %14.2f %14.2f\n", "packed", b[0].ms, b[1].ms);
+
+    memset(b, 0, sizeof(b));
+    b[0].counter = &padded.audio;
+    b[1].counter = &padded.video;
+    if (bench_contention_run(bench_counter_thread, b) < 0)
+        return -1;
+    printf("%10s %14.2f %14.2f\n", "padded", b[0].ms, b[1].ms);
+
+    memset(b, 0, sizeof(b));
+    b[0].clock = b[1].clock = &clock;
+    b[0].writer = 1;
+    if (bench_contention_run(bench_clock_thread, b) < 0)
+        return -1;
+    printf("clock: %.1f ns per set, %.1f ns per get\n",
+           b[0].ms * 1e6 / (BENCH_ATOMICS_ITERATIONS / 10), b[1].ms * 1e6 / (BENCH_ATOMICS_ITERATIONS / 10));
+
+    //the last value written must come back whole
+    if (atomic_value_get_double(&clock) != (BENCH_ATOMICS_ITERATIONS / 10 - 1) * 0.001)
+        return -1;
+
+    return 0;
+}
+
+static double bench_audio_ns(Uint64 start, int channels)
+{
+    return bench_now_ms(start) * 1000000 / ((double)BENCH_AUDIO_FRAMES * BENCH_AUDIO_SAMPLES * channels);
+}
+
+//the old output path, swr_convert fltp to s16 and SDL_MixAudioFormat for the
+//volume, against interleaving and a gain ramp in float with every kernel isa.
+//ns per sample of one channel, one thread. then the vector kernels must match
+//the scalar ones bit for bit, including the s16 ones
+int bench_audio()
+{
+    static const int channel_counts[] = { 6, 8 };
+    int ret = 0;
+
+    printf("audio: best isa %s, ns per sample, %d sample frames, one thread\n",
+           pixel_isa_name(pixel_kernel_best_isa()), BENCH_AUDIO_SAMPLES);
+    printf("%9s %10s", "channels", "swr+mix");
+    for (int isa = 0; isa < PIXEL_ISA_COUNT; isa++)
+        printf(" %10s", pixel_isa_name(isa));
+    printf(" %16s\n", "simd != scalar");
+
+    for (unsigned int c = 0; c < sizeof(channel_counts) / sizeof(channel_counts[0]); c++) {
+        int channels = channel_counts[c];
+        int64_t layout = av_get_default_channel_layout(channels);
+        int size = BENCH_AUDIO_SAMPLES * channels * 4;
+        int s16_size = size / 2;
+        unsigned int seed = 12345;
+        int mismatches = 0;
+        AVFrame *src = av_frame_alloc();
+        uint8_t *out = (uint8_t *)av_malloc(size);
+        uint8_t *ref = (uint8_t *)av_malloc(size);
+        uint8_t *mix = (uint8_t *)av_malloc(s16_size);
+        struct SwrContext *swr_ctx = swr_alloc_set_opts(NULL, layout, AV_SAMPLE_FMT_S16, BENCH_AUDIO_RATE,
+                                                        layout, AV_SAMPLE_FMT_FLTP, BENCH_AUDIO_RATE, 0, NULL);
+        Uint64 start;
+
+        if (src) {
+            src->format = AV_SAMPLE_FMT_FLTP;
+            src->nb_samples = BENCH_AUDIO_SAMPLES;
+            src->channel_layout = layout;
+            src->channels = channels;
+        }
+        if (!src || !out || !ref || !mix || !swr_ctx || swr_init(swr_ctx) < 0 || av_frame_get_buffer(src, 32) < 0) {
+            printf("\n");
+            ret = -1;
+            goto clean;
+        }
+
+        //noise a little over full scale, so the clipping is exercised
+        for (int ch = 0; ch < channels; ch++) {
+            for (int i = 0; i < BENCH_AUDIO_SAMPLES; i++) {
+                seed = seed * 1103515245 + 12345;
+                ((float *)src->extended_data[ch])[i] = ((seed >> 8) & 0xffff) / 32768.0f - 1.0f;
+                ((float *)src->extended_data[ch])[i] *= 1.1f;
+            }
+        }
+
+        printf("%9d", channels);
+
+        start = SDL_GetPerformanceCounter();
+        for (int n = 0; n < BENCH_AUDIO_FRAMES; n++) {
+            swr_convert(swr_ctx, &out, BENCH_AUDIO_SAMPLES, (const uint8_t **)src->extended_data, BENCH_AUDIO_SAMPLES);
+            memset(mix, 0, s16_size);
+            SDL_MixAudioFormat(mix, out, AUDIO_S16SYS, s16_size, SDL_MIX_MAXVOLUME * 0.7);
+        }
+        printf(" %10.2f", bench_audio_ns(start, channels));
+
+        for (int isa = 0; isa < PIXEL_ISA_COUNT; isa++) {
+            AudioInterleaveFunc interleave = audio_kernel_interleave(AV_SAMPLE_FMT_FLTP, isa);
+            AudioGainFunc gain = audio_kernel_gain(AV_SAMPLE_FMT_FLT, isa);
+            if (!interleave || !gain) {
+                printf(" %10s", "-");
+                continue;
+            }
+            start = SDL_GetPerformanceCounter();
+            for (int n = 0; n < BENCH_AUDIO_FRAMES; n++) {
+                interleave(out, (const uint8_t *const *)src->extended_data, channels, BENCH_AUDIO_SAMPLES);
+                audio_gain_ramp(gain, out, BENCH_AUDIO_SAMPLES, channels, 4, 0.6f, 0.7f);
+            }
+            printf(" %10.2f", bench_audio_ns(start, channels));
+        }
+
+        //every kernel of every isa on the same input as the scalar one, the s16
+        //ones take the float planes as 16 bit data
+        for (int isa = PIXEL_ISA_SCALAR + 1; isa < PIXEL_ISA_COUNT; isa++) {
+            static const enum AVSampleFormat formats[][2] = {
+                { AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT }, { AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16 }
+            };
+            for (int f = 0; f < 2; f++) {
+                int sample_size = av_get_bytes_per_sample(formats[f][1]);
+                AudioInterleaveFunc interleave = audio_kernel_interleave(formats[f][0], isa);
+                AudioGainFunc gain = audio_kernel_gain(formats[f][1], isa);
+                if (!interleave || !gain)
+                    continue;
+                //odd length for the tails
+                int nb_samples = BENCH_AUDIO_SAMPLES - 3;
+                audio_kernel_interleave(formats[f][0], PIXEL_ISA_SCALAR)(ref, (const uint8_t *const *)src->extended_data,
+                                                                         channels, nb_samples);
+                audio_gain_ramp(audio_kernel_gain(formats[f][1], PIXEL_ISA_SCALAR), ref, nb_samples, channels,
+                                sample_size, 1.0f, 0.35f);
+                interleave(out, (const uint8_t *const *)src->extended_data, channels, nb_samples);
+                audio_gain_ramp(gain, out, nb_samples, channels, sample_size, 1.0f, 0.35f);
+                if (memcmp(ref, out, nb_samples * channels * sample_size))
+                    mismatches++;
+            }
+        }
+        printf(" %16d\n", mismatches);
+        if (mismatches)
+            ret = -1;
+
+clean:
+        av_frame_free(&src);
+        av_freep(&out);
+        av_freep(&ref);
+        av_freep(&mix);
+        swr_free(&swr_ctx);
+    }
+
+    return ret;
+}
+
+int bench_run(int argc, char *argv[])
+{
+    const char *name = argc > 0 ? argv[0] : "all";
+    int ret = 0;
+
+    //generated media and stored baselines, not part of "all"
+    if (!strcmp(name, "suite"))
+        return bench_suite_run(argc - 1, argv + 1);
+
+    if (!strcmp(name, "all") || !strcmp(name, "scheduler"))
+        ret |= bench_scheduler();
+    if (!strcmp(name, "all") || !strcmp(name, "convert"))
+        ret |= bench_convert();
+    if (!strcmp(name, "all") || !strcmp(name, "pixels"))
+        ret |= bench_pixels();
+    if (!strcmp(name, "all") || !strcmp(name, "upload"))
+        ret |= bench_upload();
+    if (!strcmp(name, "all") || !strcmp(name, "alloc"))
+        ret |= bench_alloc();
+    if (!strcmp(name, "all") || !strcmp(name, "atomics"))
+        ret |= bench_atomics();
+    if (!strcmp(name, "all") || !strcmp(name, "audio"))
+        ret |= bench_audio();
+
+    return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "mediastate.h"
+
+void bench_calibrate();
+
+void bench_burn(int us);
+
+double bench_now_ms(Uint64 start);
+
+double bench_percentile(double *values, int nb_values, double percentile);
+
+int bench_scheduler();
+
+int bench_convert();
+
+int bench_pixels();
+
+int bench_upload();
+
+int bench_alloc();
+
+int bench_atomics();
+
+int bench_audio();
+
+int bench_run(int argc, char *argv[]);
+
+#endif // BENCH_H
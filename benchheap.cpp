@@ -0,0 +1,74 @@
+#include "benchheap.h"
+#include <stddef.h>
+#include <errno.h>
+
+//malloc and its siblings for LD_PRELOAD=libbenchheap.so myplayer_sdl -bench alloc.
+//glibc keeps its own allocator reachable under the __libc_ names, so every
+//allocation of the process goes through here, ffmpeg's included, and free stays
+//glibc's. it is never linked into the player, a replaced malloc breaks the
+//sanitizer builds. only the thread that called bench_heap_watch counts, no sdl
+//or libav call is made since it runs before either is up
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+}
+
+//initial-exec, a lazily allocated tls block would call malloc from malloc
+static __thread BenchHeap *bench_heap __attribute__((tls_model("initial-exec")));
+
+static void bench_heap_count(size_t size)
+{
+    BenchHeap *h = bench_heap;
+
+    if (!h)
+        return;
+    if (size < BENCH_HEAP_SMALL)
+        h->nb_small++;
+    else
+        h->nb_large++;
+}
+
+extern "C" void bench_heap_watch(BenchHeap *h)
+{
+    bench_heap = h;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    bench_heap_count(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    bench_heap_count(n * size);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    bench_heap_count(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t align, size_t size)
+{
+    bench_heap_count(size);
+    return __libc_memalign(align, size);
+}
+
+extern "C" void *aligned_alloc(size_t align, size_t size)
+{
+    bench_heap_count(size);
+    return __libc_memalign(align, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t align, size_t size)
+{
+    bench_heap_count(size);
+    *ptr = __libc_memalign(align, size);
+    return *ptr ? 0 : ENOMEM;
+}
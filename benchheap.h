@@ -0,0 +1,26 @@
+#ifndef BENCHHEAP_H
+#define BENCHHEAP_H
+
+#define BENCH_HEAP_SMALL 128 //bytes, below are the refcount headers libavutil allocates per buffer reference
+#define BENCH_HEAP_WATCH "bench_heap_watch" //what the bench looks the shim up by
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <stdint.h>
+
+//heap allocations of one thread while it is counting
+typedef struct BenchHeap {
+    int64_t nb_small; //refcount headers
+    int64_t nb_large; //frames, pictures, samples, anything a pool should have kept
+} BenchHeap;
+
+//count the allocations of the calling thread into h, NULL stops
+typedef void (*BenchHeapWatchFunc)(BenchHeap *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCHHEAP_H
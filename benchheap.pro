@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# allocation counting shim of "-bench alloc", preloaded and never linked into
+# the player: LD_PRELOAD=./libbenchheap.so ./myplayer_sdl -bench alloc
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = benchheap
+TEMPLATE = lib
+CONFIG += plugin
+CONFIG -= qt
+
+# replacing malloc needs glibc's __libc_ allocator behind it
+!linux: error("benchheap is a glibc LD_PRELOAD shim")
+
+SOURCES += benchheap.cpp
+
+HEADERS += benchheap.h
@@ -0,0 +1,811 @@
+#include "benchsuite.h"
+#include "bench.h"
+#include "converter.h"
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/avstring.h>
+}
+
+typedef struct SuiteCodec {
+    enum AVCodecID id;
+    const char *name;
+} SuiteCodec;
+
+static const SuiteCodec suite_codec_list[] = {
+    { AV_CODEC_ID_MPEG4, "mpeg4" },
+    { AV_CODEC_ID_MPEG2VIDEO, "mpeg2" },
+    { AV_CODEC_ID_MJPEG, "mjpeg" },
+};
+
+static const int suite_sizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+
+typedef struct SuiteProducer {
+    PacketQueue *q;
+    AVPacket *packet;
+    int nb_packets;
+} SuiteProducer;
+
+static void suite_add(Suite *su, const char *name, double value, const char *unit,
+                      int higher_is_better, double tolerance, double slack)
+{
+    SuiteMetric *m;
+
+    if (su->nb_metrics >= SUITE_MAX_METRICS)
+        return;
+
+    m = &su->metrics[su->nb_metrics++];
+    av_strlcpy(m->name, name, sizeof(m->name));
+    m->unit = unit;
+    m->value = value;
+    m->higher_is_better = higher_is_better;
+    m->tolerance = tolerance;
+    m->slack = slack;
+}
+
+//a gradient and a box moving across it, so the encoders have motion to code
+static void suite_fill_picture(AVFrame *frame, int index)
+{
+    int w = frame->width, h = frame->height;
+    int bx = (index * 8) % FFMAX(w - 64, 1), by = h / 2 - 32;
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < w; x++)
+            row[x] = (x + y + index * 2) & 0xff;
+        if (y >= by && y < by + 64)
+            memset(row + bx, 235, FFMIN(64, w - bx));
+    }
+    for (int y = 0; y < h / 2; y++) {
+        for (int x = 0; x < w / 2; x++) {
+            frame->data[1][y * frame->linesize[1] + x] = (128 + x + index) & 0xff;
+            frame->data[2][y * frame->linesize[2] + x] = (128 + y - index) & 0xff;
+        }
+    }
+}
+
+//a 440 hz tone, s16 stereo
+static void suite_fill_samples(AVFrame *frame, int64_t start)
+{
+    int16_t *data = (int16_t *)frame->data[0];
+
+    for (int i = 0; i < frame->nb_samples; i++) {
+        int16_t v = (int16_t)(sin(2 * M_PI * 440 * (start + i) / frame->sample_rate) * 8000);
+        data[2 * i] = v;
+        data[2 * i + 1] = v;
+    }
+}
+
+//encode frame (NULL drains) and mux the packet that comes out, returns 1 after
+//a packet, 0 when there was none and <0 on errors
+static int suite_encode(AVFormatContext *oc, AVStream *st, AVFrame *frame)
+{
+    AVPacket pkt;
+    int got_packet = 0, ret;
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+        ret = avcodec_encode_video2(st->codec, &pkt, frame, &got_packet);
+    else
+        ret = avcodec_encode_audio2(st->codec, &pkt, frame, &got_packet);
+    if (ret < 0)
+        return -1;
+    if (!got_packet)
+        return 0;
+
+    av_packet_rescale_ts(&pkt, st->codec->time_base, st->time_base);
+    pkt.stream_index = st->index;
+    if (av_interleaved_write_frame(oc, &pkt) < 0)
+        return -1;
+
+    return 1;
+}
+
+//write a matroska clip of seconds with a key frame every second, and an mp2
+//tone when audio is set. everything comes from the libav encoders
+int bench_suite_generate(const char *path, enum AVCodecID codec_id, int w, int h, int seconds, int audio)
+{
+    AVFormatContext *oc = NULL;
+    AVStream *vst = NULL, *ast = NULL;
+    AVCodec *vcodec = avcodec_find_encoder(codec_id);
+    AVCodec *acodec = audio ? avcodec_find_encoder(AV_CODEC_ID_MP2) : NULL;
+    AVFrame *picture = NULL, *samples = NULL;
+    AVCodecContext *c;
+    int64_t nb_samples = 0;
+    int nb_frames = seconds * SUITE_FPS;
+    int header = 0, ret = -1;
+
+    if (!vcodec || (audio && !acodec)) {
+        printf("%s: no encoder, skipped\n", path);
+        return -1;
+    }
+
+    if (avformat_alloc_output_context2(&oc, NULL, "matroska", path) < 0)
+        return -1;
+
+    vst = avformat_new_stream(oc, vcodec);
+    if (!vst)
+        goto clean;
+    c = vst->codec;
+    c->codec_id = codec_id;
+    c->width = w;
+    c->height = h;
+    c->pix_fmt = codec_id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+    c->time_base = AVRational{ 1, SUITE_FPS };
+    c->gop_size = SUITE_FPS; //the seeks land on these
+    c->max_b_frames = codec_id == AV_CODEC_ID_MJPEG ? 0 : 2;
+    c->bit_rate = (int64_t)w * h * 3;
+    vst->time_base = c->time_base;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(c, vcodec, NULL) < 0)
+        goto clean;
+
+    if (audio) {
+        ast = avformat_new_stream(oc, acodec);
+        if (!ast)
+            goto clean;
+        c = ast->codec;
+        c->sample_fmt = AV_SAMPLE_FMT_S16;
+        c->sample_rate = 48000;
+        c->channels = 2;
+        c->channel_layout = AV_CH_LAYOUT_STEREO;
+        c->bit_rate = 128000;
+        c->time_base = AVRational{ 1, c->sample_rate };
+        ast->time_base = c->time_base;
+        if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+            c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (avcodec_open2(c, acodec, NULL) < 0)
+            goto clean;
+
+        samples = av_frame_alloc();
+        if (!samples)
+            goto clean;
+        samples->format = c->sample_fmt;
+        samples->nb_samples = c->frame_size;
+        samples->channel_layout = c->channel_layout;
+        samples->channels = c->channels;
+        samples->sample_rate = c->sample_rate;
+        if (av_frame_get_buffer(samples, 0) < 0)
+            goto clean;
+    }
+
+    picture = av_frame_alloc();
+    if (!picture)
+        goto clean;
+    picture->width = w;
+    picture->height = h;
+    picture->format = vst->codec->pix_fmt;
+    if (av_frame_get_buffer(picture, 32) < 0)
+        goto clean;
+
+    if (avio_open(&oc->pb, path, AVIO_FLAG_WRITE) < 0) {
+        printf("%s: can't write\n", path);
+        goto clean;
+    }
+    if (avformat_write_header(oc, NULL) < 0)
+        goto clean;
+    header = 1;
+
+    for (int i = 0; i < nb_frames; i++) {
+        //the sound up to this picture first, the muxer interleaves the rest
+        while (ast && nb_samples * SUITE_FPS < (int64_t)i * samples->sample_rate) {
+            if (av_frame_make_writable(samples) < 0)
+                goto clean;
+            suite_fill_samples(samples, nb_samples);
+            samples->pts = nb_samples;
+            nb_samples += samples->nb_samples;
+            if (suite_encode(oc, ast, samples) < 0)
+                goto clean;
+        }
+
+        //the encoder may still hold the previous picture
+        if (av_frame_make_writable(picture) < 0)
+            goto clean;
+        suite_fill_picture(picture, i);
+        picture->pts = i;
+        if (suite_encode(oc, vst, picture) < 0)
+            goto clean;
+    }
+
+    while ((ret = suite_encode(oc, vst, NULL)) > 0)
+        ;
+    while (ret == 0 && ast && (ret = suite_encode(oc, ast, NULL)) > 0)
+        ;
+
+clean:
+    if (header && av_write_trailer(oc) < 0)
+        ret = -1;
+    if (vst)
+        avcodec_close(vst->codec);
+    if (ast)
+        avcodec_close(ast->codec);
+    av_frame_free(&picture);
+    av_frame_free(&samples);
+    if (oc->pb)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+
+    if (ret < 0)
+        printf("%s: could not be generated\n", path);
+
+    return ret;
+}
+
+static int suite_producer_thread(void *userdata)
+{
+    SuiteProducer *p = (SuiteProducer *)userdata;
+    AVPacket pkt;
+
+    for (int i = 0; i < p->nb_packets; i++) {
+        if (av_packet_ref(&pkt, p->packet) < 0 || packet_queue_put(p->q, &pkt) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+//puts from 1 and from several producer threads against one consumer, the
+//packets share their buffer so only the queue itself is measured
+static int suite_queue(Suite *su)
+{
+    int counts[] = { 1, SUITE_QUEUE_PRODUCERS };
+    AVPacket packet;
+    int ret = 0;
+
+    if (av_new_packet(&packet, 64) < 0)
+        return -1;
+    memset(packet.data, 0, packet.size);
+
+    for (unsigned int n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+        int nb_producers = counts[n];
+        SDL_Thread *threads[SUITE_QUEUE_PRODUCERS];
+        SuiteProducer producers[SUITE_QUEUE_PRODUCERS];
+        int total = 0;
+        PacketQueue q;
+        AVPacket pkt;
+        Uint64 start;
+        char name[64];
+
+        packet_queue_init(&q);
+        start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < nb_producers; i++) {
+            producers[i].q = &q;
+            producers[i].packet = &packet;
+            producers[i].nb_packets = SUITE_QUEUE_PACKETS / nb_producers;
+            total += producers[i].nb_packets;
+            threads[i] = SDL_CreateThread(suite_producer_thread, "suite_producer", &producers[i]);
+        }
+        for (int i = 0; i < total; i++) {
+            if (packet_queue_get(&q, &pkt, 1) <= 0) {
+                ret = -1;
+                break;
+            }
+            av_packet_unref(&pkt);
+        }
+        for (int i = 0; i < nb_producers; i++)
+            SDL_WaitThread(threads[i], NULL);
+
+        snprintf(name, sizeof(name), "queue.producers%d", nb_producers);
+        suite_add(su, name, total / bench_now_ms(start), "k/s", 1, SUITE_TOLERANCE, 0);
+        packet_queue_destroy(&q);
+    }
+
+    av_packet_unref(&packet);
+
+    return ret;
+}
+
+static AVCodecContext *suite_open_decoder(AVFormatContext *ic, int *stream_index)
+{
+    AVCodec *codec = NULL;
+    AVCodecContext *c;
+
+    *stream_index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (*stream_index < 0 || !codec)
+        return NULL;
+
+    c = ic->streams[*stream_index]->codec;
+    c->refcounted_frames = 1;
+    if (avcodec_open2(c, codec, NULL) < 0)
+        return NULL;
+
+    return c;
+}
+
+static int suite_open(const char *path, AVFormatContext **pic)
+{
+    *pic = NULL;
+    if (avformat_open_input(pic, path, NULL, NULL) < 0)
+        return -1;
+    if (avformat_find_stream_info(*pic, NULL) < 0) {
+        avformat_close_input(pic);
+        return -1;
+    }
+
+    return 0;
+}
+
+//decode a clip, convert every frame to the window size and upload it, each
+//stage timed on its own. frames per second of each
+static int suite_codec(Suite *su, const char *path, const char *name, SDL_Renderer *render)
+{
+    AVFormatContext *ic = NULL;
+    AVCodecContext *c = NULL;
+    AVFrame *frame = av_frame_alloc(), *pic = av_frame_alloc();
+    SDL_Texture *texture = NULL;
+    VideoConverter *cv = video_converter_create(NULL, 1);
+    double decode_ms = 0, convert_ms = 0, upload_ms = 0;
+    int stream_index, nb_frames = 0, eof = 0, ret = -1;
+    char metric[64];
+    AVPacket pkt;
+
+    if (!frame || !pic || !cv || suite_open(path, &ic) < 0 || !(c = suite_open_decoder(ic, &stream_index)))
+        goto clean;
+
+    pic->width = SUITE_OUT_W;
+    pic->height = SUITE_OUT_H;
+    pic->format = AV_PIX_FMT_YUV420P;
+    if (av_frame_get_buffer(pic, 32) < 0)
+        goto clean;
+    if (render)
+        texture = SDL_CreateTexture(render, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, SUITE_OUT_W, SUITE_OUT_H);
+
+    while (!eof) {
+        int got_picture = 0;
+        Uint64 start;
+
+        if (av_read_frame(ic, &pkt) < 0) {
+            //empty packets return the delayed frames
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            pkt.stream_index = stream_index;
+            eof = 1;
+        }
+        if (pkt.stream_index != stream_index) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        do {
+            start = SDL_GetPerformanceCounter();
+            if (avcodec_decode_video2(c, frame, &got_picture, &pkt) < 0)
+                got_picture = 0;
+            decode_ms += bench_now_ms(start);
+            if (!got_picture)
+                break;
+
+            start = SDL_GetPerformanceCounter();
+            video_converter_scale(cv, frame, pic->data, pic->linesize, SUITE_OUT_W, SUITE_OUT_H, AV_PIX_FMT_YUV420P);
+            convert_ms += bench_now_ms(start);
+
+            if (texture) {
+                start = SDL_GetPerformanceCounter();
+                SDL_UpdateYUVTexture(texture, NULL, pic->data[0], pic->linesize[0],
+                                     pic->data[1], pic->linesize[1], pic->data[2], pic->linesize[2]);
+                upload_ms += bench_now_ms(start);
+            }
+            av_frame_unref(frame);
+            nb_frames++;
+        } while (eof);
+        av_packet_unref(&pkt);
+    }
+
+    if (nb_frames != SUITE_CLIP_SECONDS * SUITE_FPS)
+        printf("%s: %d frames decoded, %d were encoded\n", path, nb_frames, SUITE_CLIP_SECONDS * SUITE_FPS);
+    else
+        ret = 0;
+
+    snprintf(metric, sizeof(metric), "decode.%s", name);
+    suite_add(su, metric, nb_frames * 1000 / FFMAX(decode_ms, 0.001), "fps", 1, SUITE_TOLERANCE, 0);
+    snprintf(metric, sizeof(metric), "convert.%s", name);
+    suite_add(su, metric, nb_frames * 1000 / FFMAX(convert_ms, 0.001), "fps", 1, SUITE_TOLERANCE, 0);
+    if (texture) {
+        snprintf(metric, sizeof(metric), "upload.%s", name);
+        suite_add(su, metric, nb_frames * 1000 / FFMAX(upload_ms, 0.001), "fps", 1, SUITE_TOLERANCE, 0);
+    }
+
+clean:
+    if (ret < 0 && !nb_frames)
+        printf("%s: could not be decoded\n", path);
+    if (texture)
+        SDL_DestroyTexture(texture);
+    video_converter_free(&cv);
+    av_frame_free(&frame);
+    av_frame_free(&pic);
+    if (c)
+        avcodec_close(c);
+    avformat_close_input(&ic);
+
+    return ret;
+}
+
+//every codec at every size. the upload runs on the software renderer of a
+//hidden window, so it needs no gpu
+static int suite_codecs(Suite *su)
+{
+    SDL_Window *window = SDL_CreateWindow("bench", 0, 0, 64, 64, SDL_WINDOW_HIDDEN);
+    SDL_Renderer *render = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE) : NULL;
+    int ret = 0;
+
+    if (!render)
+        printf("codecs: no renderer, the upload is skipped: %s\n", SDL_GetError());
+
+    for (unsigned int i = 0; i < sizeof(suite_codec_list) / sizeof(suite_codec_list[0]); i++) {
+        for (unsigned int j = 0; j < sizeof(suite_sizes) / sizeof(suite_sizes[0]); j++) {
+            char path[1024], name[64];
+
+            snprintf(name, sizeof(name), "%s.%dx%d", suite_codec_list[i].name, suite_sizes[j][0], suite_sizes[j][1]);
+            snprintf(path, sizeof(path), "%s/%s.mkv", su->media_dir, name);
+            if (bench_suite_generate(path, suite_codec_list[i].id, suite_sizes[j][0], suite_sizes[j][1],
+                                     SUITE_CLIP_SECONDS, 0) < 0) {
+                //an encoder left out of this ffmpeg build is not a failure
+                if (!avcodec_find_encoder(suite_codec_list[i].id))
+                    break;
+                ret = -1;
+                continue;
+            }
+            if (suite_codec(su, path, name, render) < 0)
+                ret = -1;
+        }
+    }
+
+    if (render)
+        SDL_DestroyRenderer(render);
+    if (window)
+        SDL_DestroyWindow(window);
+
+    return ret;
+}
+
+//time from av_seek_frame to the first frame at or after the target, the key
+//frame before it and the frames up to it are decoded like the player does
+static int suite_seek(Suite *su)
+{
+    AVFormatContext *ic = NULL;
+    AVCodecContext *c = NULL;
+    AVFrame *frame = av_frame_alloc();
+    double latency[SUITE_SEEKS];
+    unsigned int seed = 12345;
+    int stream_index, nb_seeks = 0, ret = -1;
+    char path[1024];
+    AVRational tb;
+
+    snprintf(path, sizeof(path), "%s/seek.mpeg4.1280x720.mkv", su->media_dir);
+    if (!frame || bench_suite_generate(path, AV_CODEC_ID_MPEG4, 1280, 720, SUITE_SEEK_SECONDS, 0) < 0
+            || suite_open(path, &ic) < 0 || !(c = suite_open_decoder(ic, &stream_index)))
+        goto clean;
+    tb = ic->streams[stream_index]->time_base;
+
+    for (int i = 0; i < SUITE_SEEKS; i++) {
+        int64_t target;
+        int found = 0;
+        AVPacket pkt;
+        Uint64 start;
+
+        //anywhere but the last second, there is a frame after every target
+        seed = seed * 1103515245 + 12345;
+        target = av_rescale_q((int64_t)((seed >> 8) % ((SUITE_SEEK_SECONDS - 1) * 1000)) * 1000,
+                              AVRational{ 1, AV_TIME_BASE }, tb);
+
+        start = SDL_GetPerformanceCounter();
+        if (av_seek_frame(ic, stream_index, target, AVSEEK_FLAG_BACKWARD) < 0)
+            continue;
+        avcodec_flush_buffers(c);
+
+        while (!found && av_read_frame(ic, &pkt) >= 0) {
+            int got_picture = 0;
+            if (pkt.stream_index == stream_index && avcodec_decode_video2(c, frame, &got_picture, &pkt) >= 0
+                    && got_picture) {
+                found = av_frame_get_best_effort_timestamp(frame) >= target;
+                av_frame_unref(frame);
+            }
+            av_packet_unref(&pkt);
+        }
+        if (found)
+            latency[nb_seeks++] = bench_now_ms(start);
+    }
+
+    if (nb_seeks == SUITE_SEEKS)
+        ret = 0;
+    else
+        printf("seek: %d of %d seeks found their frame\n", nb_seeks, SUITE_SEEKS);
+
+    //latencies of a few ms jitter a lot, hence the slack
+    suite_add(su, "seek.mpeg4.1280x720.p50", bench_percentile(latency, nb_seeks, 50), "ms", 0, 0.5, 5);
+    suite_add(su, "seek.mpeg4.1280x720.p95", bench_percentile(latency, nb_seeks, 95), "ms", 0, 0.5, 10);
+
+clean:
+    av_frame_free(&frame);
+    if (c)
+        avcodec_close(c);
+    avformat_close_input(&ic);
+
+    return ret;
+}
+
+#ifdef _WIN32
+//the working set in KiB
+static int64_t suite_rss_kb()
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return -1;
+
+    return (int64_t)(pmc.WorkingSetSize / 1024);
+}
+
+static void suite_mkdir(const char *path)
+{
+    _mkdir(path);
+}
+#else
+//resident memory in KiB, -1 where /proc is missing
+static int64_t suite_rss_kb()
+{
+    long long pages, resident;
+    FILE *f = fopen("/proc/self/statm", "r");
+    int n;
+
+    if (!f)
+        return -1;
+    n = fscanf(f, "%lld %lld", &pages, &resident);
+    fclose(f);
+
+    return n == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+}
+
+static void suite_mkdir(const char *path)
+{
+    mkdir(path, 0755);
+}
+#endif
+
+//a whole session on a generated clip with null sinks, in real time: how far
+//video and audio drift apart, whether the memory grows and how deep the packet
+//queues get and how often the frame queue runs dry
+static int suite_soak(Suite *su)
+{
+    MediaState *s = NULL;
+    char path[1024];
+    int64_t rss_start = -1, rss_end = -1;
+    double offset_start = NAN, offset_end = NAN, offset_max = 0;
+    int queue_max = 0, nb_samples = 0, nb_checks = 0, nb_starved = 0, underruns;
+    Uint32 start, next_sample;
+    SDL_Event event;
+
+    snprintf(path, sizeof(path), "%s/soak.mpeg4.640x360.mkv", su->media_dir);
+    if (bench_suite_generate(path, AV_CODEC_ID_MPEG4, 640, 360, su->soak_seconds, 1) < 0
+            || media_open_input_file(&s, path) < 0)
+        return -1;
+
+    media_set_audio_sink(s, audio_sink_null_create());
+    media_open_audio_device(s);
+    media_set_video_sink(s, video_sink_null_create());
+    if (media_start(s) < 0) {
+        media_state_free(&s);
+        return -1;
+    }
+
+    printf("soak: %d s of playback\n", su->soak_seconds);
+    start = next_sample = SDL_GetTicks();
+    while (!SDL_AtomicGet(&s->quit)) {
+        if (SDL_WaitEventTimeout(&event, 100))
+            media_handle_event(s, &event);
+
+        //the decoder keeps the frame queue full, a queue found empty means the
+        //presenter had nothing to show. the queue can't grow past its size,
+        //its depth is no metric
+        if (SDL_GetTicks() - start >= SUITE_SOAK_WARMUP) {
+            SDL_LockMutex(s->video_frame_queue.mutex);
+            nb_starved += !s->video_frame_queue.nb_frames;
+            SDL_UnlockMutex(s->video_frame_queue.mutex);
+            nb_checks++;
+        }
+
+        if (SDL_GetTicks() < next_sample)
+            continue;
+        next_sample += 1000;
+
+        double offset = media_av_offset(s);
+        int bytes = packet_queue_size(&s->audio_packet_queue, NULL) + packet_queue_size(&s->video_packet_queue, NULL);
+
+        queue_max = FFMAX(queue_max, bytes);
+        if (SDL_GetTicks() - start < SUITE_SOAK_WARMUP || isnan(offset))
+            continue;
+
+        if (isnan(offset_start)) {
+            offset_start = offset;
+            rss_start = suite_rss_kb();
+        }
+        offset_end = offset;
+        offset_max = FFMAX(offset_max, fabs(offset));
+        rss_end = suite_rss_kb();
+        nb_samples++;
+    }
+
+    media_stop(s);
+    underruns = SDL_AtomicGet(&s->nb_underruns);
+    media_state_free(&s);
+
+    if (!nb_samples) {
+        printf("soak: no a/v offset was measured\n");
+        return -1;
+    }
+
+    suite_add(su, "soak.av_offset_max", offset_max * 1000, "ms", 0, SUITE_TOLERANCE, 20);
+    suite_add(su, "soak.av_drift", fabs(offset_end - offset_start) * 1000, "ms", 0, SUITE_TOLERANCE, 20);
+    if (rss_start >= 0 && rss_end >= 0)
+        suite_add(su, "soak.rss_growth", (double)(rss_end - rss_start), "KiB", 0, SUITE_TOLERANCE, 2048);
+    suite_add(su, "soak.queue_max", queue_max / 1024.0, "KiB", 0, SUITE_TOLERANCE, 256);
+    suite_add(su, "soak.frame_queue_starved", nb_starved * 100.0 / FFMAX(nb_checks, 1), "%", 0, SUITE_TOLERANCE, 5);
+    suite_add(su, "soak.underruns", underruns, "", 0, 0, 2);
+
+    return 0;
+}
+
+static SuiteMetric *suite_find(SuiteMetric *metrics, int nb_metrics, const char *name)
+{
+    for (int i = 0; i < nb_metrics; i++) {
+        if (!strcmp(metrics[i].name, name))
+            return &metrics[i];
+    }
+
+    return NULL;
+}
+
+//"name value" lines, # starts a comment
+static int suite_load_baseline(const char *path, SuiteMetric *metrics, int max_metrics)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int n = 0;
+
+    if (!f)
+        return 0;
+
+    while (n < max_metrics && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#')
+            continue;
+        memset(&metrics[n], 0, sizeof(metrics[n]));
+        if (sscanf(line, "%63s %lf", metrics[n].name, &metrics[n].value) == 2)
+            n++;
+    }
+    fclose(f);
+
+    return n;
+}
+
+//the metrics of this run replace theirs, the ones not run are kept
+static int suite_save_baseline(Suite *su, const char *path, SuiteMetric *base, int nb_base)
+{
+    char tmp[1024];
+    FILE *f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f) {
+        printf("%s: can't write\n", tmp);
+        return -1;
+    }
+
+    fprintf(f, "# myplayer_sdl -bench suite, a metric fails when it is %.0f%% worse than here\n",
+            SUITE_TOLERANCE * 100);
+    for (int i = 0; i < nb_base; i++) {
+        if (!suite_find(su->metrics, su->nb_metrics, base[i].name))
+            fprintf(f, "%s %.3f\n", base[i].name, base[i].value);
+    }
+    for (int i = 0; i < su->nb_metrics; i++)
+        fprintf(f, "%s %.3f\n", su->metrics[i].name, su->metrics[i].value);
+
+    if (fclose(f) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    //rename doesn't replace an existing file on windows
+    remove(path);
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+//returns the number of metrics worse than their baseline allows
+static int suite_compare(Suite *su, SuiteMetric *base, int nb_base)
+{
+    int nb_regressions = 0;
+
+    printf("%-32s %12s %7s %12s %8s  %s\n", "metric", "value", "unit", "baseline", "change", "");
+    for (int i = 0; i < su->nb_metrics; i++) {
+        SuiteMetric *m = &su->metrics[i];
+        SuiteMetric *b = suite_find(base, nb_base, m->name);
+        const char *status = "new";
+        char change[16] = "";
+
+        if (b) {
+            double worse = m->higher_is_better ? b->value - m->value : m->value - b->value;
+            status = "ok";
+            if (worse > FFMAX(fabs(b->value) * m->tolerance, m->slack)) {
+                status = "REGRESSED";
+                nb_regressions++;
+            }
+            if (b->value != 0)
+                snprintf(change, sizeof(change), "%+.1f%%", (m->value - b->value) * 100 / fabs(b->value));
+            printf("%-32s %12.2f %7s %12.2f %8s  %s\n", m->name, m->value, m->unit, b->value, change, status);
+        } else {
+            printf("%-32s %12.2f %7s %12s %8s  %s\n", m->name, m->value, m->unit, "-", change, status);
+        }
+    }
+
+    return nb_regressions;
+}
+
+//-bench suite [-only queue|codecs|seek|soak] [-soak SECONDS] [-baseline FILE] [-update] [-dir DIR]
+int bench_suite_run(int argc, char *argv[])
+{
+    static Suite su;
+    static SuiteMetric base[SUITE_MAX_METRICS];
+    const char *only = NULL, *baseline = SUITE_BASELINE_FILE;
+    int update = 0, nb_base, nb_regressions, ret = 0;
+
+    memset(&su, 0, sizeof(su));
+    su.media_dir = SUITE_MEDIA_DIR;
+    su.soak_seconds = SUITE_SOAK_SECONDS;
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "-only") && i + 1 < argc)
+            only = argv[++i];
+        else if (!strcmp(argv[i], "-soak") && i + 1 < argc)
+            su.soak_seconds = FFMAX(atoi(argv[++i]), SUITE_SOAK_WARMUP / 1000 + 2);
+        else if (!strcmp(argv[i], "-baseline") && i + 1 < argc)
+            baseline = argv[++i];
+        else if (!strcmp(argv[i], "-dir") && i + 1 < argc)
+            su.media_dir = argv[++i];
+        else if (!strcmp(argv[i], "-update"))
+            update = 1;
+    }
+
+    suite_mkdir(su.media_dir);
+
+    if (!only || !strcmp(only, "queue"))
+        ret |= suite_queue(&su);
+    if (!only || !strcmp(only, "codecs"))
+        ret |= suite_codecs(&su);
+    if (!only || !strcmp(only, "seek"))
+        ret |= suite_seek(&su);
+    if (!only || !strcmp(only, "soak"))
+        ret |= suite_soak(&su);
+
+    nb_base = suite_load_baseline(baseline, base, SUITE_MAX_METRICS);
+    nb_regressions = suite_compare(&su, base, nb_base);
+    if (update) {
+        if (suite_save_baseline(&su, baseline, base, nb_base) < 0)
+            ret = -1;
+        else
+            printf("%s: %d metrics saved\n", baseline, su.nb_metrics);
+    } else if (nb_regressions) {
+        printf("%d metrics regressed against %s\n", nb_regressions, baseline);
+        ret = -1;
+    } else if (!nb_base) {
+        printf("%s: no baseline, run with -update to save one\n", baseline);
+    }
+
+    return ret;
+}
@@ -0,0 +1,41 @@
+#ifndef BENCHSUITE_H
+#define BENCHSUITE_H
+
+#include "mediastate.h"
+
+#define SUITE_MEDIA_DIR "bench-media" //generated clips, written again on every run
+#define SUITE_BASELINE_FILE "bench.baseline"
+#define SUITE_TOLERANCE 0.25 //a metric may get this much worse than its baseline
+#define SUITE_MAX_METRICS 64
+#define SUITE_FPS 25
+#define SUITE_CLIP_SECONDS 4
+#define SUITE_OUT_W 1280 //the window frames are converted for
+#define SUITE_OUT_H 720
+#define SUITE_SEEK_SECONDS 20
+#define SUITE_SEEKS 30
+#define SUITE_QUEUE_PACKETS 200000
+#define SUITE_QUEUE_PRODUCERS 4
+#define SUITE_SOAK_SECONDS 30
+#define SUITE_SOAK_WARMUP 2000 //ms before the drift and the memory are measured from
+
+typedef struct SuiteMetric {
+    char name[64];
+    const char *unit;
+    double value;
+    int higher_is_better;
+    double tolerance; //relative to the baseline
+    double slack; //absolute, for metrics that are near 0
+} SuiteMetric;
+
+typedef struct Suite {
+    SuiteMetric metrics[SUITE_MAX_METRICS];
+    int nb_metrics;
+    const char *media_dir;
+    int soak_seconds;
+} Suite;
+
+int bench_suite_generate(const char *path, enum AVCodecID codec_id, int w, int h, int seconds, int audio);
+
+int bench_suite_run(int argc, char *argv[]);
+
+#endif // BENCHSUITE_H
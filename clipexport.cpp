@@ -0,0 +1,272 @@
+#include "clipexport.h"
+#include "clock.h"
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+ClipExport *clip_export_create(const char *src, const char *dst, int64_t in, int64_t out)
+{
+    ClipExport *ce;
+
+    if (!src || !dst || out <= in)
+        return NULL;
+
+    ce = (ClipExport *)av_mallocz(sizeof(ClipExport));
+    if (!ce)
+        return NULL;
+
+    ce->src = av_strdup(src);
+    ce->dst = av_strdup(dst);
+    ce->in = in;
+    ce->out = out;
+    if (!ce->src || !ce->dst) {
+        clip_export_free(&ce);
+        return NULL;
+    }
+
+    return ce;
+}
+
+void clip_export_free(ClipExport **pce)
+{
+    ClipExport *ce;
+
+    if (!pce || !*pce)
+        return;
+
+    ce = *pce;
+
+    av_freep(&ce->src);
+    av_freep(&ce->dst);
+
+    av_freep(pce);
+}
+
+static int clip_export_interrupt(void *opaque)
+{
+    ClipExport *ce = (ClipExport *)opaque;
+    return SDL_AtomicGet(&ce->cancel);
+}
+
+//the audio, video and subtitle streams of ic, map gets the output index of each
+//input stream or -1
+static int clip_export_streams(AVFormatContext *ic, AVFormatContext *oc, int *map)
+{
+    int nb_streams = 0;
+
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        AVStream *ist = ic->streams[i], *ost;
+        enum AVMediaType type = ist->codec->codec_type;
+
+        map[i] = -1;
+        if (type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_SUBTITLE)
+            continue;
+
+        ost = avformat_new_stream(oc, NULL);
+        if (!ost || avcodec_copy_context(ost->codec, ist->codec) < 0)
+            return -1;
+        //the tag of the source container may mean something else in this one
+        ost->codec->codec_tag = 0;
+        ost->time_base = ist->time_base;
+        ost->sample_aspect_ratio = ist->sample_aspect_ratio;
+        av_dict_copy(&ost->metadata, ist->metadata, 0);
+        if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+            ost->codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        map[i] = nb_streams++;
+    }
+
+    return nb_streams;
+}
+
+static int64_t clip_export_us(AVPacket *pkt, AVStream *st)
+{
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+
+    return ts != AV_NOPTS_VALUE ? av_rescale_q(ts, st->time_base, AVRational{ 1, AV_TIME_BASE }) : AV_NOPTS_VALUE;
+}
+
+//blocking, the packets are copied as they are and only their timestamps move so
+//the clip starts at 0. returns the state it ended in
+int clip_export_remux(ClipExport *ce)
+{
+    AVFormatContext *ic = NULL, *oc = NULL;
+    AVPacket pkt;
+    int *map = NULL, *done = NULL;
+    int key_stream, nb_open, header = 0, started = 0, created = 0;
+    int state = CLIP_EXPORT_FAILED;
+    double start_time = clock_time();
+
+    ic = avformat_alloc_context();
+    if (!ic)
+        goto clean;
+    ic->interrupt_callback.callback = clip_export_interrupt;
+    ic->interrupt_callback.opaque = ce;
+    if (avformat_open_input(&ic, ce->src, NULL, NULL) < 0 || avformat_find_stream_info(ic, NULL) < 0) {
+        printf("%s: can't open for the export\n", ce->src);
+        goto clean;
+    }
+
+    //the container follows the extension, a name without one gets matroska
+    if (avformat_alloc_output_context2(&oc, NULL, NULL, ce->dst) < 0
+            && avformat_alloc_output_context2(&oc, NULL, "matroska", ce->dst) < 0)
+        goto clean;
+
+    map = (int *)av_malloc_array(ic->nb_streams, sizeof(int));
+    done = (int *)av_mallocz_array(ic->nb_streams, sizeof(int));
+    if (!map || !done || clip_export_streams(ic, oc, map) <= 0)
+        goto clean;
+
+    if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&oc->pb, ce->dst, AVIO_FLAG_WRITE) < 0) {
+            printf("%s: can't write\n", ce->dst);
+            goto clean;
+        }
+        created = 1;
+    }
+    if (avformat_write_header(oc, NULL) < 0)
+        goto clean;
+    header = 1;
+
+    //the clip starts on a key frame of the video, of the audio without video
+    key_stream = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (key_stream < 0)
+        key_stream = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (key_stream < 0 || av_seek_frame(ic, key_stream, av_rescale_q(ce->in, AVRational{ 1, AV_TIME_BASE },
+                                                                     ic->streams[key_stream]->time_base),
+                                        AVSEEK_FLAG_BACKWARD) < 0) {
+        printf("%s: can't seek to the in point\n", ce->src);
+        goto clean;
+    }
+
+    //the streams still before out, subtitles may end anywhere
+    nb_open = 0;
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        enum AVMediaType type = ic->streams[i]->codec->codec_type;
+        done[i] = map[i] < 0 || type == AVMEDIA_TYPE_SUBTITLE;
+        nb_open += !done[i];
+    }
+
+    while (nb_open > 0 && av_read_frame(ic, &pkt) >= 0) {
+        AVStream *ist = ic->streams[pkt.stream_index];
+        int64_t ts = clip_export_us(&pkt, ist);
+        int64_t pts;
+
+        if (SDL_AtomicGet(&ce->cancel)) {
+            av_packet_unref(&pkt);
+            break;
+        }
+
+        //nothing goes out before the first key frame, its time is the clip's 0
+        if (!started) {
+            if (pkt.stream_index != key_stream || !(pkt.flags & AV_PKT_FLAG_KEY) || ts == AV_NOPTS_VALUE) {
+                av_packet_unref(&pkt);
+                continue;
+            }
+            ce->start = ts;
+            started = 1;
+        }
+
+        pts = pkt.pts != AV_NOPTS_VALUE ? av_rescale_q(pkt.pts, ist->time_base, AVRational{ 1, AV_TIME_BASE }) : ts;
+        if (map[pkt.stream_index] < 0 || ts == AV_NOPTS_VALUE || pts < ce->start
+                || (done[pkt.stream_index] && ist->codec->codec_type != AVMEDIA_TYPE_SUBTITLE)) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+        if (pts >= ce->out) {
+            if (!done[pkt.stream_index]) {
+                done[pkt.stream_index] = 1;
+                nb_open--;
+            }
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        SDL_AtomicSet(&ce->progress, (int)av_clip64((pts - ce->in) * 1000 / (ce->out - ce->in), 0, 1000));
+
+        int64_t shift = av_rescale_q(ce->start, AVRational{ 1, AV_TIME_BASE }, ist->time_base);
+        if (pkt.pts != AV_NOPTS_VALUE)
+            pkt.pts -= shift;
+        if (pkt.dts != AV_NOPTS_VALUE)
+            pkt.dts -= shift;
+        av_packet_rescale_ts(&pkt, ist->time_base, oc->streams[map[pkt.stream_index]]->time_base);
+        pkt.stream_index = map[pkt.stream_index];
+        pkt.pos = -1;
+        ce->nb_packets++;
+        ce->nb_bytes += pkt.size;
+
+        //the muxer takes the reference
+        if (av_interleaved_write_frame(oc, &pkt) < 0) {
+            printf("%s: write error\n", ce->dst);
+            goto clean;
+        }
+    }
+
+    if (SDL_AtomicGet(&ce->cancel)) {
+        state = CLIP_EXPORT_CANCELLED;
+    } else if (!started) {
+        printf("%s: no key frame in the range\n", ce->src);
+    } else {
+        SDL_AtomicSet(&ce->progress, 1000);
+        state = CLIP_EXPORT_DONE;
+    }
+
+clean:
+    if (header && av_write_trailer(oc) < 0)
+        state = CLIP_EXPORT_FAILED;
+    if (oc && oc->pb && !(oc->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    avformat_close_input(&ic);
+    av_freep(&map);
+    av_freep(&done);
+    //a partial file is no clip, a file that was there before is left alone
+    if (state != CLIP_EXPORT_DONE && created)
+        remove(ce->dst);
+
+    ce->elapsed = clock_time() - start_time;
+    SDL_AtomicSet(&ce->state, state);
+
+    return state;
+}
+
+//the export on a thread of its own, it only waits for the disk
+int clip_export_callback(void *userdata)
+{
+    ClipExport *ce = (ClipExport *)userdata;
+    if (!ce)
+        return -1;
+
+    clip_export_remux(ce);
+
+    return 0;
+}
+
+//-export IN OUT input output, IN and OUT in seconds
+int clip_export_run(int argc, char *argv[])
+{
+    ClipExport *ce;
+    int state;
+
+    if (argc < 4) {
+        printf("usage: -export IN OUT input output\n");
+        return -1;
+    }
+
+    ce = clip_export_create(argv[2], argv[3], (int64_t)(atof(argv[0]) * AV_TIME_BASE),
+                            (int64_t)(atof(argv[1]) * AV_TIME_BASE));
+    if (!ce) {
+        printf("the out point must come after the in point\n");
+        return -1;
+    }
+
+    state = clip_export_remux(ce);
+    if (state == CLIP_EXPORT_DONE)
+        printf("%s: %lld packets, %.1f MB from %.3f s in %.2f s, %.1f MB/s\n", ce->dst,
+               (long long)ce->nb_packets, ce->nb_bytes / 1e6, (double)ce->start / AV_TIME_BASE, ce->elapsed,
+               ce->nb_bytes / 1e6 / FFMAX(ce->elapsed, 1e-6));
+
+    clip_export_free(&ce);
+
+    return state == CLIP_EXPORT_DONE ? 0 : -1;
+}
@@ -0,0 +1,53 @@
+#ifndef CLIPEXPORT_H
+#define CLIPEXPORT_H
+
+#define CLIP_EXPORT_FILE "clip-%d%s" //marked clips of the player, numbered, with the source extension
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavformat/avformat.h>
+#include <SDL2/SDL.h>
+
+enum ClipExportState {
+    CLIP_EXPORT_RUNNING = 0,
+    CLIP_EXPORT_DONE,
+    CLIP_EXPORT_FAILED,
+    CLIP_EXPORT_CANCELLED
+};
+
+//a time range of a file remuxed into another without decoding, from the key frame
+//at or before in up to out. the file is opened again, so a playing session
+//keeps its demuxer and its queues
+typedef struct ClipExport {
+    char *src;
+    char *dst;
+    int64_t in; //us of the source, like its pts
+    int64_t out;
+    SDL_atomic_t state; //enum ClipExportState
+    SDL_atomic_t progress; //per mille of the range
+    SDL_atomic_t cancel;
+
+    //written by the export, read once it is done
+    int64_t start; //us of the key frame the clip starts at
+    int64_t nb_packets;
+    int64_t nb_bytes;
+    double elapsed; //seconds
+} ClipExport;
+
+ClipExport *clip_export_create(const char *src, const char *dst, int64_t in, int64_t out);
+
+void clip_export_free(ClipExport **ce);
+
+int clip_export_remux(ClipExport *ce);
+
+int clip_export_callback(void *);
+
+int clip_export_run(int argc, char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLIPEXPORT_H
@@ -0,0 +1,72 @@
+#include "clock.h"
+
+double clock_time()
+{
+    return av_gettime_relative() / 1000000.0;
+}
+
+void clock_init(Clock *c)
+{
+    c->lock = 0;
+    c->speed = 1.0;
+    c->paused = 0;
+    clock_set(c, NAN);
+}
+
+double clock_get(Clock *c)
+{
+    double time, pts;
+
+    SDL_AtomicLock(&c->lock);
+    if (c->paused) {
+        pts = c->pts;
+    } else {
+        time = clock_time();
+        pts = c->pts_drift + time - (time - c->last_updated) * (1.0 - c->speed);
+    }
+    SDL_AtomicUnlock(&c->lock);
+
+    return pts;
+}
+
+//time is when pts was (or will be) presented, in clock_time seconds
+void clock_set_at(Clock *c, double pts, double time)
+{
+    SDL_AtomicLock(&c->lock);
+    c->pts = pts;
+    c->last_updated = time;
+    c->pts_drift = pts - time;
+    SDL_AtomicUnlock(&c->lock);
+}
+
+void clock_set(Clock *c, double pts)
+{
+    clock_set_at(c, pts, clock_time());
+}
+
+void clock_set_paused(Clock *c, int paused)
+{
+    //restart from where it stopped, not from where the system time is now
+    clock_set(c, clock_get(c));
+    SDL_AtomicLock(&c->lock);
+    c->paused = paused;
+    SDL_AtomicUnlock(&c->lock);
+}
+
+void clock_set_speed(Clock *c, double speed)
+{
+    clock_set(c, clock_get(c));
+    SDL_AtomicLock(&c->lock);
+    c->speed = speed;
+    SDL_AtomicUnlock(&c->lock);
+}
+
+//follow the slave when c is not running yet or the two are far apart
+void clock_sync_to_slave(Clock *c, Clock *slave)
+{
+    double clock = clock_get(c);
+    double slave_clock = clock_get(slave);
+
+    if (!isnan(slave_clock) && (isnan(clock) || fabs(clock - slave_clock) > CLOCK_NOSYNC_THRESHOLD))
+        clock_set(c, slave_clock);
+}
@@ -0,0 +1,55 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#define CLOCK_SYNC_THRESHOLD_MIN 0.04 //no correction below this, in seconds
+#define CLOCK_SYNC_THRESHOLD_MAX 0.1
+#define CLOCK_FRAMEDUP_THRESHOLD 0.1 //frames longer than this are not doubled
+#define CLOCK_NOSYNC_THRESHOLD 10.0 //larger errors are a jump, not drift
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <math.h>
+#include <libavutil/time.h>
+#include <SDL2/SDL.h>
+
+enum ClockSyncMaster {
+    CLOCK_SYNC_AUDIO = 0,
+    CLOCK_SYNC_VIDEO,
+    CLOCK_SYNC_EXTERNAL
+};
+
+//a presentation clock that keeps running between updates. it is set when a
+//sample becomes audible or a frame is shown and extrapolated from the system
+//time in between, at the given speed. NAN until the first update after a seek
+typedef struct Clock {
+    double pts;
+    double pts_drift; //pts - system time of the last update
+    double last_updated;
+    double speed;
+    int paused;
+    SDL_SpinLock lock; //the audio callback updates it while others read
+} Clock;
+
+double clock_time();
+
+void clock_init(Clock *c);
+
+double clock_get(Clock *c);
+
+void clock_set_at(Clock *c, double pts, double time);
+
+void clock_set(Clock *c, double pts);
+
+void clock_set_paused(Clock *c, int paused);
+
+void clock_set_speed(Clock *c, double speed);
+
+void clock_sync_to_slave(Clock *c, Clock *slave);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_H
@@ -0,0 +1,245 @@
+#include "compositor.h"
+
+static Uint32 compositor_timer_callback(Uint32 interval, void *userdata)
+{
+    Compositor *c = (Compositor *)userdata;
+    SDL_Event event;
+
+    if (SDL_AtomicGet(&c->quit)) {
+        SDL_AtomicSet(&c->timer_running, 0); //last access to c
+        return 0;
+    }
+
+    SDL_zero(event);
+    event.type = COMPOSITOR_EVENT;
+    event.user.data1 = c;
+    SDL_PushEvent(&event);
+
+    return interval;
+}
+
+static void compositor_clear(Compositor *c)
+{
+    AVFrame *f = c->canvas;
+
+    //black in limited range yuv
+    memset(f->data[0], 16, f->linesize[0] * f->height);
+    memset(f->data[1], 128, f->linesize[1] * (f->height / 2));
+    memset(f->data[2], 128, f->linesize[2] * (f->height / 2));
+
+    c->dirty.x = 0;
+    c->dirty.y = 0;
+    c->dirty.w = f->width;
+    c->dirty.h = f->height;
+}
+
+//headless compositors have no window, the canvas is read by the host under c->mutex
+Compositor *compositor_create(int width, int height, int cols, int rows, int headless)
+{
+    Compositor *c;
+    SDL_DisplayMode mode;
+
+    if (width <= 0 || height <= 0 || cols <= 0 || rows <= 0)
+        return NULL;
+
+    c = (Compositor *)av_mallocz(sizeof(Compositor));
+    if (!c)
+        return NULL;
+
+    c->cols = cols;
+    c->rows = rows;
+    c->refresh_rate = COMPOSITOR_DEFAULT_REFRESH;
+
+    c->mutex = SDL_CreateMutex();
+    c->canvas = av_frame_alloc();
+    if (!c->mutex || !c->canvas)
+        goto clean;
+
+    c->canvas->format = AV_PIX_FMT_YUV420P;
+    c->canvas->width = width & ~1;
+    c->canvas->height = height & ~1;
+    if (av_frame_get_buffer(c->canvas, 32) < 0)
+        goto clean;
+
+    compositor_clear(c);
+
+    if (headless)
+        return c;
+
+    c->display = SDL_CreateWindow("Mosaic",
+                                  100, 100,
+                                  c->canvas->width, c->canvas->height,
+                                  SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+    if (!c->display)
+        goto clean;
+
+    c->render = SDL_CreateRenderer(c->display, -1, 0);
+    if (!c->render)
+        goto clean;
+
+    c->texture = SDL_CreateTexture(c->render, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING,
+                                   c->canvas->width, c->canvas->height);
+    if (!c->texture)
+        goto clean;
+
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(c->display), &mode) == 0 && mode.refresh_rate > 0)
+        c->refresh_rate = mode.refresh_rate;
+
+    SDL_AtomicSet(&c->timer_running, 1);
+    if (!SDL_AddTimer(1000 / c->refresh_rate, compositor_timer_callback, c)) {
+        SDL_AtomicSet(&c->timer_running, 0);
+        goto clean;
+    }
+
+    return c;
+
+clean:
+    compositor_free(&c);
+    return NULL;
+}
+
+void compositor_free(Compositor **pc)
+{
+    Compositor *c;
+
+    if (!pc || !*pc)
+        return;
+
+    c = *pc;
+
+    SDL_AtomicSet(&c->quit, 1);
+    while (SDL_AtomicGet(&c->timer_running))
+        SDL_Delay(1);
+
+    if (c->texture)
+        SDL_DestroyTexture(c->texture);
+    if (c->render)
+        SDL_DestroyRenderer(c->render);
+    if (c->display)
+        SDL_DestroyWindow(c->display);
+
+    if (c->canvas)
+        av_frame_free(&c->canvas);
+    if (c->mutex)
+        SDL_DestroyMutex(c->mutex);
+
+    av_free(c);
+
+    *pc = NULL;
+}
+
+//the part of a tile a src_w x src_h picture covers, keeping its aspect ratio
+//and the chroma alignment of the canvas
+int compositor_tile_rect(Compositor *c, int tile, int src_w, int src_h, SDL_Rect *r)
+{
+    if (!c || tile < 0 || tile >= c->cols * c->rows || src_w <= 0 || src_h <= 0)
+        return -1;
+
+    int cell_w = c->canvas->width / c->cols;
+    int cell_h = c->canvas->height / c->rows;
+    double ratio = (double)src_w / src_h;
+
+    if ((double)cell_w / cell_h > ratio) {
+        r->h = cell_h;
+        r->w = cell_h * ratio;
+    } else {
+        r->w = cell_w;
+        r->h = cell_w / ratio;
+    }
+    r->w &= ~1;
+    r->h &= ~1;
+    r->x = ((tile % c->cols) * cell_w + (cell_w - r->w) / 2) & ~1;
+    r->y = ((tile / c->cols) * cell_h + (cell_h - r->h) / 2) & ~1;
+
+    if (r->w <= 0 || r->h <= 0)
+        return -1;
+
+    return 0;
+}
+
+//convert a decoded frame straight into its tile. the tiles don't overlap, so
+//the sessions convert in parallel and only the dirty rect is shared. a present
+//during the conversion may upload half a tile, the draw marks it again after
+int compositor_draw(Compositor *c, const SDL_Rect *r, VideoConverter *cv, AVFrame *frame)
+{
+    AVFrame *f = c->canvas;
+    uint8_t *dst[4];
+    int ret;
+
+    dst[0] = f->data[0] + r->y * f->linesize[0] + r->x;
+    dst[1] = f->data[1] + (r->y / 2) * f->linesize[1] + r->x / 2;
+    dst[2] = f->data[2] + (r->y / 2) * f->linesize[2] + r->x / 2;
+    dst[3] = NULL;
+
+    ret = video_converter_scale(cv, frame, dst, f->linesize, r->w, r->h, AV_PIX_FMT_YUV420P);
+
+    SDL_LockMutex(c->mutex);
+    if (c->dirty.w > 0 && c->dirty.h > 0)
+        SDL_UnionRect(&c->dirty, r, &c->dirty);
+    else
+        c->dirty = *r;
+    c->nb_draws++;
+    SDL_UnlockMutex(c->mutex);
+
+    return ret;
+}
+
+//one upload of everything drawn since the last call, then one present
+int compositor_present(Compositor *c)
+{
+    AVFrame *f = c->canvas;
+    SDL_Rect r;
+
+    if (!c->render)
+        return 0;
+
+    SDL_LockMutex(c->mutex);
+    r = c->dirty;
+    c->dirty.w = 0;
+    c->dirty.h = 0;
+    if (r.w > 0 && r.h > 0) {
+        SDL_UpdateYUVTexture(c->texture, &r,
+                             f->data[0] + r.y * f->linesize[0] + r.x, f->linesize[0],
+                             f->data[1] + (r.y / 2) * f->linesize[1] + r.x / 2, f->linesize[1],
+                             f->data[2] + (r.y / 2) * f->linesize[2] + r.x / 2, f->linesize[2]);
+        c->nb_uploads++;
+    }
+    SDL_UnlockMutex(c->mutex);
+
+    if (r.w <= 0 || r.h <= 0) //nothing new, the window keeps the last present
+        return 0;
+
+    SDL_RenderClear(c->render);
+    SDL_RenderCopy(c->render, c->texture, NULL, NULL);
+    SDL_RenderPresent(c->render);
+    c->nb_presents++;
+
+    return 0;
+}
+
+int compositor_handle_event(Compositor *c, SDL_Event *event)
+{
+    if (!c || !event)
+        return 0;
+
+    if (event->type == COMPOSITOR_EVENT) {
+        if (event->user.data1 != c)
+            return 0;
+        compositor_present(c);
+        return 1;
+    }
+
+    if (event->type == SDL_WINDOWEVENT && c->display
+            && event->window.windowID == SDL_GetWindowID(c->display)) {
+        //the back buffer is lost on expose and resize, present the whole canvas again
+        SDL_LockMutex(c->mutex);
+        c->dirty.x = 0;
+        c->dirty.y = 0;
+        c->dirty.w = c->canvas->width;
+        c->dirty.h = c->canvas->height;
+        SDL_UnlockMutex(c->mutex);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#define COMPOSITOR_EVENT (SDL_USEREVENT + 3)
+#define COMPOSITOR_DEFAULT_REFRESH 60
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL.h>
+#include "converter.h"
+
+//many sessions drawing into tiles of one canvas, presented once per refresh
+typedef struct Compositor {
+    SDL_Window *display; //all NULL when headless
+    SDL_Renderer *render;
+    SDL_Texture *texture;
+
+    AVFrame *canvas; //yuv420p, the sessions convert straight into their tile
+    SDL_mutex *mutex;
+    SDL_Rect dirty; //union of the tiles drawn since the last present
+    int cols;
+    int rows;
+
+    SDL_atomic_t quit;
+    SDL_atomic_t timer_running;
+    int refresh_rate;
+
+    //statistics
+    int64_t nb_draws;
+    int64_t nb_uploads;
+    int64_t nb_presents;
+} Compositor;
+
+Compositor *compositor_create(int width, int height, int cols, int rows, int headless);
+
+void compositor_free(Compositor **c);
+
+int compositor_tile_rect(Compositor *c, int tile, int src_w, int src_h, SDL_Rect *r);
+
+int compositor_draw(Compositor *c, const SDL_Rect *r, VideoConverter *cv, AVFrame *frame);
+
+int compositor_present(Compositor *c);
+
+int compositor_handle_event(Compositor *c, SDL_Event *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPOSITOR_H
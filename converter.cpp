@@ -0,0 +1,322 @@
+#include "converter.h"
+
+static const int quality_flags[] = {
+    SWS_POINT,
+    SWS_BILINEAR,
+    SWS_BICUBIC
+};
+
+static void plane_shifts(enum AVPixelFormat fmt, int shift[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+
+    for (int i = 0; i < 4; i++)
+        shift[i] = 0;
+
+    if (!desc)
+        return;
+
+    //components 1 and 2 are the chroma ones, luma and alpha are never subsampled
+    for (int c = 1; c < 3 && c < desc->nb_components; c++)
+        shift[desc->comp[c].plane] = desc->log2_chroma_h;
+}
+
+//the ratio of a vertically scaled picture only repeats every unit rows, bands
+//made of whole units all scale by exactly src_h / dst_h. units also hold whole
+//chroma rows of both formats. returns the number of units in the picture
+static int scale_units(int src_h, int dst_h, int align, int *unit_src, int *unit_dst)
+{
+    int g = (int)av_gcd(src_h, dst_h);
+    int k = 1;
+
+    while ((src_h / g * k) % align || (dst_h / g * k) % align)
+        k++;
+
+    *unit_src = src_h / g * k;
+    *unit_dst = dst_h / g * k;
+
+    return dst_h / *unit_dst;
+}
+
+static void convert_slice_free_scratch(ConvertSlice *sl)
+{
+    av_freep(&sl->scratch[0]);
+    for (int p = 0; p < 4; p++) {
+        sl->scratch[p] = NULL;
+        sl->scratch_stride[p] = 0;
+    }
+}
+
+//rebuild the slice layout and their scalers, only when something changed
+static int video_converter_config(VideoConverter *cv, int src_w, int src_h, int src_fmt,
+                                  int dst_w, int dst_h, int dst_fmt)
+{
+    int align, nb_slices, nb_units, unit_src, unit_dst, margin;
+
+    if (cv->nb_slices && cv->src_w == src_w && cv->src_h == src_h && cv->src_fmt == src_fmt
+            && cv->dst_w == dst_w && cv->dst_h == dst_h && cv->dst_fmt == dst_fmt
+            && cv->sws_quality == cv->quality)
+        return 0;
+
+    if (src_h <= 0 || dst_h <= 0) {
+        cv->nb_slices = 0;
+        return -1;
+    }
+
+    plane_shifts((AVPixelFormat)src_fmt, cv->src_shift);
+    plane_shifts((AVPixelFormat)dst_fmt, cv->dst_shift);
+    cv->src_planes = av_pix_fmt_count_planes((AVPixelFormat)src_fmt);
+    cv->dst_planes = av_pix_fmt_count_planes((AVPixelFormat)dst_fmt);
+
+    //slice borders must fall on whole chroma rows of both formats
+    align = 1 << FFMAX(FFMAX(cv->src_shift[1], cv->src_shift[2]),
+                       FFMAX(cv->dst_shift[1], cv->dst_shift[2]));
+
+    //without vertical scaling every row maps to one row and bands are exact.
+    //with it each scaler also gets the rows its filter reaches into around
+    //the band, in whole units so the margins scale like the rest
+    if (src_h == dst_h) {
+        unit_src = unit_dst = align;
+        nb_units = dst_h / align;
+        margin = 0;
+    } else {
+        int margin_rows = CONVERTER_MARGIN_TAPS * ((src_h + dst_h - 1) / dst_h + 1);
+
+        nb_units = scale_units(src_h, dst_h, align, &unit_src, &unit_dst);
+        margin = (margin_rows + unit_src - 1) / unit_src;
+    }
+
+    nb_slices = FFMIN(cv->max_slices, dst_h / CONVERTER_MIN_SLICE_ROWS);
+    nb_slices = FFMIN(nb_slices, nb_units);
+    nb_slices = FFMAX(nb_slices, 1);
+
+    //pure repacks skip swscale, the quality tiers mean nothing for them
+    cv->kernel = NULL;
+    if (src_w == dst_w && src_h == dst_h)
+        cv->kernel = pixel_kernel_find((AVPixelFormat)src_fmt, (AVPixelFormat)dst_fmt, -1);
+
+    for (int i = 0; i < nb_slices; i++) {
+        ConvertSlice *sl = &cv->slices[i];
+        int u0 = (int)((int64_t)nb_units * i / nb_slices);
+        int u1 = (int)((int64_t)nb_units * (i + 1) / nb_slices);
+        int w0 = FFMAX(u0 - margin, 0);
+        int w1 = u1 + margin;
+        //the last band and windows reaching the last unit run to the picture end
+        int end = i == nb_slices - 1 || w1 >= nb_units;
+
+        sl->cv = cv;
+        sl->dst_y = u0 * unit_dst;
+        sl->dst_h = (i == nb_slices - 1 ? dst_h : u1 * unit_dst) - sl->dst_y;
+        sl->win_y = w0 * unit_dst;
+        sl->win_h = (end ? dst_h : w1 * unit_dst) - sl->win_y;
+        sl->src_y = w0 * unit_src;
+        sl->src_h = (end ? src_h : w1 * unit_src) - sl->src_y;
+
+        convert_slice_free_scratch(sl);
+
+        if (cv->kernel) {
+            if (sl->src_h <= 0) {
+                cv->nb_slices = 0;
+                return -1;
+            }
+            continue;
+        }
+
+        //a scaler only sees its window, the filter taps clamp at the window
+        //edges and those rows never leave the scratch picture
+        sl->sws_ctx = sws_getCachedContext(sl->sws_ctx,
+                                           src_w, sl->src_h, (AVPixelFormat)src_fmt,
+                                           dst_w, sl->win_h, (AVPixelFormat)dst_fmt,
+                                           quality_flags[cv->quality], NULL, NULL, NULL);
+        if (!sl->sws_ctx || sl->src_h <= 0 || sl->dst_h <= 0) {
+            cv->nb_slices = 0;
+            return -1;
+        }
+
+        if ((sl->win_y != sl->dst_y || sl->win_h != sl->dst_h)
+                && av_image_alloc(sl->scratch, sl->scratch_stride, dst_w, sl->win_h,
+                                  (AVPixelFormat)dst_fmt, 32) < 0) {
+            cv->nb_slices = 0;
+            return -1;
+        }
+    }
+
+    for (int i = nb_slices; i < cv->nb_slices; i++) {
+        sws_freeContext(cv->slices[i].sws_ctx);
+        cv->slices[i].sws_ctx = NULL;
+        convert_slice_free_scratch(&cv->slices[i]);
+    }
+
+    cv->nb_slices = nb_slices;
+    cv->src_w = src_w;
+    cv->src_h = src_h;
+    cv->src_fmt = src_fmt;
+    cv->dst_w = dst_w;
+    cv->dst_h = dst_h;
+    cv->dst_fmt = dst_fmt;
+    cv->sws_quality = cv->quality;
+
+    return 0;
+}
+
+static void convert_slice(void *userdata)
+{
+    ConvertSlice *sl = (ConvertSlice *)userdata;
+    VideoConverter *cv = sl->cv;
+    const uint8_t *src[4];
+    uint8_t *dst[4];
+
+    //only picture planes move with the band, a palette stays where it is
+    for (int p = 0; p < 4; p++) {
+        src[p] = cv->src[p] && p < cv->src_planes ? cv->src[p] + (sl->src_y >> cv->src_shift[p]) * cv->src_stride[p] : cv->src[p];
+        dst[p] = cv->dst[p] && p < cv->dst_planes ? cv->dst[p] + (sl->dst_y >> cv->dst_shift[p]) * cv->dst_stride[p] : cv->dst[p];
+    }
+
+    if (cv->kernel) {
+        cv->kernel(src, cv->src_stride, dst, cv->dst_stride, cv->src_w, sl->src_h);
+        return;
+    }
+
+    if (!sl->scratch[0]) {
+        sws_scale(sl->sws_ctx, src, cv->src_stride, 0, sl->src_h, dst, cv->dst_stride);
+        return;
+    }
+
+    //the whole window into the scratch picture, then only the band's rows out
+    sws_scale(sl->sws_ctx, src, cv->src_stride, 0, sl->src_h, sl->scratch, sl->scratch_stride);
+
+    for (int p = 0; p < cv->dst_planes; p++) {
+        int shift = cv->dst_shift[p];
+        int y0 = sl->dst_y >> shift;
+        int y1 = (sl->dst_y + sl->dst_h + (1 << shift) - 1) >> shift;
+        int bytes = av_image_get_linesize((AVPixelFormat)cv->dst_fmt, cv->dst_w, p);
+        const uint8_t *from = sl->scratch[p] + (y0 - (sl->win_y >> shift)) * sl->scratch_stride[p];
+
+        if (!dst[p] || bytes <= 0)
+            continue;
+        for (int y = y0; y < y1; y++, from += sl->scratch_stride[p])
+            memcpy(cv->dst[p] + y * cv->dst_stride[p], from, bytes);
+    }
+}
+
+//downgrade after a few frames over budget, come back after a long time well under it
+static void video_converter_adapt(VideoConverter *cv)
+{
+    if (!cv->auto_quality || cv->budget_ms <= 0)
+        return;
+
+    if (cv->last_ms > cv->budget_ms) {
+        cv->under_budget = 0;
+        if (++cv->over_budget >= CONVERTER_OVER_BUDGET_FRAMES && cv->quality > CONVERT_QUALITY_POINT) {
+            cv->quality--;
+            cv->over_budget = 0;
+        }
+    } else if (cv->last_ms < cv->budget_ms / 2) {
+        cv->over_budget = 0;
+        if (++cv->under_budget >= CONVERTER_UNDER_BUDGET_FRAMES && cv->quality < cv->max_quality) {
+            cv->quality++;
+            cv->under_budget = 0;
+        }
+    } else {
+        cv->over_budget = 0;
+        cv->under_budget = 0;
+    }
+}
+
+//max_slices <= 0 uses one slice per worker plus the calling thread
+VideoConverter *video_converter_create(ThreadPool *pool, int max_slices)
+{
+    VideoConverter *cv = (VideoConverter *)av_mallocz(sizeof(VideoConverter));
+    if (!cv)
+        return NULL;
+
+    if (max_slices <= 0)
+        max_slices = pool ? pool->nb_workers + 1 : 1;
+
+    cv->pool = pool;
+    cv->max_slices = FFMIN(max_slices, CONVERTER_MAX_SLICES);
+    cv->quality = CONVERT_QUALITY_BICUBIC;
+    cv->max_quality = CONVERT_QUALITY_BICUBIC;
+    thread_task_group_init(&cv->tasks);
+
+    return cv;
+}
+
+void video_converter_free(VideoConverter **pcv)
+{
+    VideoConverter *cv;
+
+    if (!pcv || !*pcv)
+        return;
+
+    cv = *pcv;
+
+    thread_task_group_wait(&cv->tasks);
+    thread_task_group_destroy(&cv->tasks);
+
+    for (int i = 0; i < CONVERTER_MAX_SLICES; i++) {
+        if (cv->slices[i].sws_ctx)
+            sws_freeContext(cv->slices[i].sws_ctx);
+        convert_slice_free_scratch(&cv->slices[i]);
+    }
+
+    av_free(cv);
+
+    *pcv = NULL;
+}
+
+//budget_ms is the time the conversion of one frame may take before auto
+//quality steps down a tier
+void video_converter_set_quality(VideoConverter *cv, int quality, int auto_quality, double budget_ms)
+{
+    if (quality < CONVERT_QUALITY_POINT)
+        quality = CONVERT_QUALITY_POINT;
+    if (quality > CONVERT_QUALITY_BICUBIC)
+        quality = CONVERT_QUALITY_BICUBIC;
+
+    cv->quality = quality;
+    cv->max_quality = quality;
+    cv->auto_quality = auto_quality;
+    cv->budget_ms = budget_ms;
+    cv->over_budget = 0;
+    cv->under_budget = 0;
+}
+
+//convert src into dst, the slices run on the pool and the last one on the
+//calling thread, returns once the whole picture is done
+int video_converter_scale(VideoConverter *cv, AVFrame *src,
+                          uint8_t *const dst[4], const int dst_stride[4],
+                          int dst_w, int dst_h, enum AVPixelFormat dst_fmt)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    ThreadPool *pool;
+    int last;
+
+    if (video_converter_config(cv, src->width, src->height, src->format, dst_w, dst_h, dst_fmt) < 0)
+        return -1;
+
+    for (int p = 0; p < 4; p++) {
+        cv->src[p] = src->data[p];
+        cv->src_stride[p] = src->linesize[p];
+        cv->dst[p] = dst[p];
+        cv->dst_stride[p] = dst_stride[p];
+    }
+
+    //a worker waiting for its own slices could deadlock the pool, run them inline
+    pool = thread_pool_is_worker(cv->pool) ? NULL : cv->pool;
+
+    last = cv->nb_slices - 1;
+    for (int i = 0; i < last; i++) {
+        if (!pool || thread_pool_submit(pool, &cv->tasks, TASK_PRIORITY_HIGH,
+                                        convert_slice, &cv->slices[i]) < 0)
+            convert_slice(&cv->slices[i]);
+    }
+    convert_slice(&cv->slices[last]);
+
+    thread_task_group_wait(&cv->tasks);
+
+    cv->last_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    video_converter_adapt(cv);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef CONVERTER_H
+#define CONVERTER_H
+
+#define CONVERTER_MAX_SLICES 16
+#define CONVERTER_MIN_SLICE_ROWS 64
+#define CONVERTER_MARGIN_TAPS 4 //source rows of margin per unit of downscale, above the bicubic support
+#define CONVERTER_OVER_BUDGET_FRAMES 3 //frames over budget before downgrading
+#define CONVERTER_UNDER_BUDGET_FRAMES 120 //frames well under budget before upgrading
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include "threadpool.h"
+#include "pixelkernels.h"
+
+enum ConvertQuality {
+    CONVERT_QUALITY_POINT = 0,
+    CONVERT_QUALITY_BILINEAR,
+    CONVERT_QUALITY_BICUBIC
+};
+
+//horizontal band of the picture, converted by its own scaler on one worker.
+//with vertical scaling the scaler also reads and writes margin rows around the
+//band, so its filter never clamps inside the picture, and only the band itself
+//is copied out of the scratch picture
+typedef struct ConvertSlice {
+    struct VideoConverter *cv;
+    struct SwsContext *sws_ctx;
+    int src_y; //source rows the scaler reads
+    int src_h;
+    int dst_y; //rows of the band in the picture
+    int dst_h;
+    int win_y; //rows the scaler writes, the band with its margins
+    int win_h;
+    uint8_t *scratch[4]; //NULL without margins, the scaler writes into the picture
+    int scratch_stride[4];
+} ConvertSlice;
+
+typedef struct VideoConverter {
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
+
+    ConvertSlice slices[CONVERTER_MAX_SLICES];
+    int nb_slices;
+    int max_slices;
+
+    //configuration the slices were built for
+    int src_w;
+    int src_h;
+    int src_fmt;
+    int dst_w;
+    int dst_h;
+    int dst_fmt;
+    int sws_quality;
+
+    //current job
+    const uint8_t *src[4];
+    int src_stride[4];
+    uint8_t *dst[4];
+    int dst_stride[4];
+    int src_shift[4]; //log2 vertical subsampling of each plane
+    int dst_shift[4];
+    int src_planes;
+    int dst_planes;
+    PixelKernelFunc kernel; //same size repack, replaces the scalers when set
+
+    //automatic downgrade when the stage is over its budget
+    int quality;
+    int max_quality;
+    int auto_quality;
+    double budget_ms;
+    double last_ms;
+    int over_budget;
+    int under_budget;
+} VideoConverter;
+
+VideoConverter *video_converter_create(ThreadPool *pool, int max_slices);
+
+void video_converter_free(VideoConverter **cv);
+
+void video_converter_set_quality(VideoConverter *cv, int quality, int auto_quality, double budget_ms);
+
+int video_converter_scale(VideoConverter *cv, AVFrame *src,
+                          uint8_t *const dst[4], const int dst_stride[4],
+                          int dst_w, int dst_h, enum AVPixelFormat dst_fmt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONVERTER_H
@@ -1,4 +1,5 @@
 #include "decoder.h"
+#include "demuxer.h"
 
 double get_frame_pts(MediaState *s, AVFrame *src, double pts)
 {
@@ -29,103 +30,166 @@ int refresh_callback(void *userdata)
     SDL_Event event;
 
     while(1) {
-        if (s->quit)
+        if (SDL_AtomicGet(&s->quit))
             break;
 
-        if (s->audio_stream_index == -1 && s->pause) {//pause
-            SDL_Delay(10);
-            continue;
-        }
-        if (SDL_AUDIO_PAUSED == SDL_GetAudioStatus()) {//pause
+        if (SDL_AtomicGet(&s->pause)) {//pause
             SDL_Delay(10);
             continue;
         }
 
+        //tag the event with its session, several players may share the event queue
+        SDL_zero(event);
         event.type = REFRESH_EVENT;
+        event.user.data1 = s;
         SDL_PushEvent(&event);
 
-        SDL_Delay(s->delay);
+        SDL_Delay(SDL_AtomicGet(&s->delay));
     }
 
     return 0;
 }
 
-int decode_and_show(MediaState *s)
+//same as refresh_callback, but driven by the shared SDL timer thread instead of
+//a thread per session, the returned value is the next interval
+Uint32 refresh_timer_callback(Uint32 interval, void *userdata)
 {
-    int ret, got_picture;
-    AVFrame *frame = NULL;
-    AVPacket pkt, *packet = &pkt;
-    double video_pts, audio_pts;
-    double diff, frame_delay;
-
-    av_init_packet(packet);
-    packet->data = NULL;
-    packet->size = 0;
+    MediaState *s = (MediaState *)userdata;
+    SDL_Event event;
+    int delay;
+    UNUSED(interval);
 
-    if (packet_queue_get(&s->video_packet_queue, packet, 0) <= 0) { //!block
-        //no data
-        return -1;
+    if (SDL_AtomicGet(&s->quit)) {
+        //last access to s, media_stop waits for this
+        thread_task_group_done(&s->tasks);
+        return 0;
     }
 
-    //receive FLUSH data to flush codec, because of seeking
-    if (strcmp((char *)packet->data, FLUSH_DATA) == 0) {
-        avcodec_flush_buffers(s->video_stream->codec);
-        av_packet_unref(packet);
-        return 0;
+    if (SDL_AtomicGet(&s->pause))
+        return 10;
+
+    SDL_zero(event);
+    event.type = REFRESH_EVENT;
+    event.user.data1 = s;
+    SDL_PushEvent(&event);
+
+    delay = SDL_AtomicGet(&s->delay);
+    return delay > 0 ? delay : 1;
+}
+
+//(re)create the streaming textures the frames are converted into
+int video_alloc_textures(MediaState *s, int w, int h)
+{
+    for (int i = 0; i < VIDEO_TEXTURE_COUNT; i++) {
+        if (s->textures[i])
+            SDL_DestroyTexture(s->textures[i]);
+        s->textures[i] = SDL_CreateTexture(s->render, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, w, h);
+        if (!s->textures[i]) {
+            printf("create texture failed: %s\n", SDL_GetError());
+            return -1;
+        }
     }
 
-    frame = av_frame_alloc();
-    ret = avcodec_decode_video2(s->video_codec_ctx, frame, &got_picture, packet);
-    if (ret < 0) {
-        printf("decode error\n");
-        av_frame_free(&frame);
-        av_packet_unref(packet);
+    s->texture_index = 0;
+    s->texture_w = w;
+    s->texture_h = h;
+
+    return 0;
+}
+
+//follow the decoded size (lowres) and the output size (window resize), the
+//textures are only reallocated when they change
+static int video_output_config(MediaState *s)
+{
+    if (!media_video_converter(s))
         return -1;
+
+    if (s->compositor || (s->out_w == s->texture_w && s->out_h == s->texture_h))
+        return 0;
+
+    return video_alloc_textures(s, s->out_w, s->out_h);
+}
+
+//convert into the next texture through its locked memory, there is no
+//intermediate picture and no SDL_UpdateTexture copy
+static SDL_Texture *video_upload_frame(MediaState *s, AVFrame *frame)
+{
+    SDL_Texture *texture = s->textures[s->texture_index];
+    uint8_t *data[4] = { NULL };
+    int linesize[4] = { 0 };
+    void *pixels;
+    int pitch;
+
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0) {
+        printf("lock texture failed: %s\n", SDL_GetError());
+        return NULL;
     }
 
-//sync video and audio
-    if (s->audio_stream_index != -1) {
-        if (packet->dts == AV_NOPTS_VALUE && frame->opaque && *(uint64_t*)frame->opaque != AV_NOPTS_VALUE) {
-            video_pts = *(uint64_t *)frame->opaque;
-        } else if (packet->dts != AV_NOPTS_VALUE) {
-            video_pts = packet->dts;
-        } else {
-            video_pts = 0.0;
-        }
+    //iyuv: the y plane, then u and v at half the pitch
+    data[0] = (uint8_t *)pixels;
+    linesize[0] = pitch;
+    data[1] = data[0] + pitch * s->texture_h;
+    linesize[1] = pitch / 2;
+    data[2] = data[1] + (pitch / 2) * ((s->texture_h + 1) / 2);
+    linesize[2] = pitch / 2;
 
-        video_pts *= av_q2d(s->video_stream->time_base);
-        video_pts = get_frame_pts(s, frame, video_pts);
+    video_converter_scale(s->converter, frame, data, linesize, s->out_w, s->out_h, s->display_pix_fmt);
 
-        frame_delay = video_pts - s->frame_last_pts;
-        if (frame_delay <= 0 || frame_delay >= 1.0)
-            frame_delay = s->frame_last_delay;
+    SDL_UnlockTexture(texture);
 
-        s->frame_last_delay = frame_delay;
-        s->frame_last_pts = video_pts;
+    s->nb_bytes_converted += av_image_get_buffer_size(s->display_pix_fmt, s->out_w, s->out_h, 1);
+    s->nb_frames_shown++;
+    s->texture_index = (s->texture_index + 1) % VIDEO_TEXTURE_COUNT;
 
-        audio_pts = s->audio_clock;
-        diff = video_pts - audio_pts;
-        if (diff <= -frame_delay) // 慢了，delay设为0
-            frame_delay /= 2;
-        else if (diff >= frame_delay) // 快了，加倍delay
-            frame_delay *= 2;
+    return texture;
+}
 
-        s->delay = (frame_delay) * 1000 + 0.5;
-    } else {
-        if (packet->pts != AV_NOPTS_VALUE) {
-            s->video_clock = av_q2d(s->video_stream->time_base) * packet->pts;
-        }
+//time until the next refresh. the frame lasts frame_delay, shortened when the
+//picture is behind the master clock and stretched when it is ahead. errors below
+//the threshold are left alone so the refresh rate does not jitter
+static double video_target_delay(MediaState *s, double video_pts, double frame_delay)
+{
+    double diff, sync_threshold;
+
+    if (media_sync_master(s) == CLOCK_SYNC_VIDEO)
+        return frame_delay;
+
+    diff = video_pts - media_master_clock(s);
+    if (isnan(diff) || fabs(diff) >= CLOCK_NOSYNC_THRESHOLD)
+        return frame_delay;
+
+    sync_threshold = FFMAX(CLOCK_SYNC_THRESHOLD_MIN, FFMIN(CLOCK_SYNC_THRESHOLD_MAX, frame_delay));
+    if (diff <= -sync_threshold) // 慢了
+        frame_delay = FFMAX(0, frame_delay + diff);
+    else if (diff >= sync_threshold && frame_delay > CLOCK_FRAMEDUP_THRESHOLD) // 快了
+        frame_delay += diff;
+    else if (diff >= sync_threshold)
+        frame_delay *= 2;
 
-        s->delay = 1000 / av_q2d(s->video_stream->r_frame_rate);
+    return frame_delay;
+}
+
+//the window or compositor tile: convert, upload and present
+static int video_sink_sdl_write(VideoSink *sink, AVFrame *frame, double pts)
+{
+    MediaState *s = (MediaState *)sink->opaque;
+
+    if (video_output_config(s) < 0) {
+        printf("video output config failed\n");
+        return -1;
     }
-//sync end
 
-    sws_scale(s->sws_ctx,
-              (uint8_t const * const *)frame->data,
-              frame->linesize, 0, s->video_codec_ctx->height,
-              s->video_out_frame->data, s->video_out_frame->linesize);
+    //the compositor presents every tile at once on its own tick
+    if (s->compositor) {
+        compositor_draw(s->compositor, &s->tile, s->converter, frame);
+        return 0;
+    }
+
+    SDL_Texture *texture = video_upload_frame(s, frame);
+    if (!texture)
+        return -1;
 
-    double ratio = (double)s->video_codec_ctx->width / s->video_codec_ctx->height;
+    double ratio = media_video_ratio(s);
     double tmp = (double)s->r.w / s->r.h;
 
     SDL_Rect r;
@@ -139,138 +203,454 @@ int decode_and_show(MediaState *s)
     r.x = (s->r.w - r.w) / 2;
     r.y = (s->r.h - r.h) / 2;
 
-    SDL_UpdateTexture(s->texture, NULL, s->video_out_frame->data[0], s->video_out_frame->linesize[0]);
     SDL_RenderClear(s->render);
-    SDL_RenderCopy(s->render, s->texture, NULL, &r);
+    SDL_RenderCopy(s->render, texture, NULL, &r);
+    if (s->subtitle_atlas) {
+        double now = media_master_clock(s);
+        subtitle_atlas_update(s->subtitle_atlas, &s->subtitle_queue, isnan(now) ? pts : now);
+        subtitle_atlas_draw(s->subtitle_atlas, &r, s->video_width, s->video_height);
+    }
     SDL_RenderPresent(s->render);
 
-    av_frame_free(&frame);
+    return 0;
+}
+
+VideoSink *video_sink_sdl_create(MediaState *s)
+{
+    VideoSink *sink = video_sink_alloc(video_sink_sdl_write, s);
+
+    if (sink)
+        sink->scaled = 1;
+
+    return sink;
+}
+
+//show the next decoded frame, decoding itself runs in video_decode_step
+int decode_and_show(MediaState *s)
+{
+    AVFrame *frame = s->video_show_frame;
+    double video_pts, frame_delay;
+    int64_t present_start;
+    int ret;
+
+    if (!frame)
+        return -1;
+
+    //the sink refused the last frame, offer it again before taking a new one
+    if (s->video_sink_pending) {
+        video_pts = s->video_sink_pts;
+        goto write;
+    }
+
+    if (!frame_queue_get(&s->video_frame_queue, frame, &video_pts)) {
+        //no data
+        return -1;
+    }
+
+    //a picture held much longer than its delay is a stall, the frames after a
+    //seek or a splice are measured on their own
+    if (s->flight && !frame->opaque && s->frame_last_show_time > 0) {
+        double held = clock_time() - s->frame_last_show_time - s->frame_last_delay;
+        if (held * 1000 > s->flight->stall_ms)
+            flight_recorder_trip(s->flight, FLIGHT_PRESENT, (int)(held * 1000));
+    }
+
+    //from the request to the first frame after it
+    if (((intptr_t)frame->opaque == VIDEO_MARK_SEEK || (intptr_t)frame->opaque == VIDEO_MARK_SEEK_SWITCH) && s->flight) {
+        flight_recorder_span(s->flight, FLIGHT_SEEK_SHOWN, s->seek_request_time, (int)(video_pts * 1000));
+        if (flight_recorder_now(s->flight) - s->seek_request_time > s->flight->seek_ms * 1000LL)
+            flight_recorder_trip(s->flight, FLIGHT_SEEK_SHOWN,
+                                 (int)((flight_recorder_now(s->flight) - s->seek_request_time) / 1000));
+    }
+
+    //first frame of another file, the previous one was on screen for
+    //frame_last_delay and anything longer is a stall at the splice. a seek
+    //within the file keeps the size
+    if ((intptr_t)frame->opaque == VIDEO_MARK_SPLICE || (intptr_t)frame->opaque == VIDEO_MARK_SEEK_SWITCH) {
+        int64_t size = atomic_value_get_int64(&s->video_next_size);
+        if ((intptr_t)frame->opaque == VIDEO_MARK_SPLICE && s->frame_last_show_time > 0) {
+            double late = clock_time() - s->frame_last_show_time - s->frame_last_delay;
+            s->transition_late_max = FFMAX(s->transition_late_max, late);
+            s->nb_transitions++;
+        }
+        if (size > 0 && !s->video_filter) {
+            s->video_width = (int)(size >> 32);
+            s->video_height = (int)(size & 0xffffffff);
+            if (s->display)
+                media_update_output_size(s, s->r.w, s->r.h);
+            else
+                media_publish_output_size(s);
+        }
+    }
+    frame->opaque = NULL;
+
+    //a filter may crop, scale or set the sample aspect ratio, what is shown is
+    //its output and the frames carry its size
+    if (s->video_filter && (frame->width != s->video_width || frame->height != s->video_height
+                            || frame->sample_aspect_ratio.num != s->video_sar.num
+                            || frame->sample_aspect_ratio.den != s->video_sar.den)) {
+        s->video_width = frame->width;
+        s->video_height = frame->height;
+        s->video_sar = frame->sample_aspect_ratio;
+        if (s->display)
+            media_update_output_size(s, s->r.w, s->r.h);
+        else
+            media_publish_output_size(s);
+    }
+    s->frame_last_show_time = clock_time();
+
+//sync video to the master clock
+    frame_delay = video_pts - s->frame_last_pts;
+    if (frame_delay <= 0 || frame_delay >= 1.0)
+        frame_delay = s->frame_last_delay;
+
+    s->frame_last_delay = frame_delay;
+    s->frame_last_pts = video_pts;
+
+    frame_delay = video_target_delay(s, video_pts, frame_delay);
+    SDL_AtomicSet(&s->delay, (int)(frame_delay * 1000 + 0.5));
+
+    clock_set(&s->video_clk, video_pts);
+    clock_sync_to_slave(&s->ext_clk, &s->video_clk);
+//sync end
+
+write:
+    present_start = flight_recorder_now(s->flight);
+    ret = video_sink_write(s->video_sink, frame, video_pts);
+    flight_recorder_span(s->flight, FLIGHT_PRESENT, present_start, (int)(video_pts * 1000));
+    s->video_sink_pending = ret == VIDEO_SINK_AGAIN;
+    if (s->video_sink_pending) {
+        s->video_sink_pts = video_pts;
+        return 0;
+    }
+
+    av_frame_unref(frame);
+
+    return ret;
+}
+
+//when the picture on screen is much smaller than the source, decode at a reduced
+//resolution where the codec supports it and drop the loop filter. lowres needs a
+//codec reopen, so it only changes on a keyframe
+static void video_decoder_config(MediaState *s, AVPacket *packet)
+{
+    AVCodecContext *c = s->video_codec_ctx;
+    int64_t size = atomic_value_get_int64(&s->video_scale_size);
+    int video_w = (int)(size >> 48 & 0xffff), video_h = (int)(size >> 32 & 0xffff);
+    int out_w = (int)(size >> 16 & 0xffff), out_h = (int)(size & 0xffff);
+    int ratio, lowres;
+    enum AVDiscard skip;
+
+    //frames for the host application keep their full size. a filter's output
+    //size is no function of its input, the decoder keeps the source size for it
+    if (!out_w || !out_h || !s->video_sink->scaled || s->video_filter)
+        return;
+
+    ratio = FFMIN(video_w / out_w, video_h / out_h);
+
+    skip = ratio >= 4 ? AVDISCARD_ALL : ratio >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    c->skip_loop_filter = skip;
+
+    for (lowres = 0; (2 << lowres) <= ratio && lowres < s->video_codec->max_lowres; lowres++)
+        ;
+
+    if (lowres == c->lowres || !(packet->flags & AV_PKT_FLAG_KEY))
+        return;
+
+    avcodec_close(c);
+    c->lowres = lowres;
+    c->refcounted_frames = 1;
+    if (avcodec_open2(c, s->video_codec, NULL) < 0) {
+        printf("cannot reopen video codec with lowres %d\n", lowres);
+        c->lowres = 0;
+        avcodec_open2(c, s->video_codec, NULL);
+    }
+}
+
+//the packets after a marker belong to item, the decoder leaves the files before
+//it and the presenter gets the new size with the first frame. the mark goes on
+//that frame even when the item stays, a seek within the file is still a seek
+static void video_switch_item(MediaState *s, MediaItem *item, int mark)
+{
+    AVCodecContext *c = item->video_stream->codec;
+
+    if (item == s->video_item) {
+        s->video_mark = mark;
+        return;
+    }
+    s->video_mark = mark == VIDEO_MARK_SEEK ? VIDEO_MARK_SEEK_SWITCH : mark;
+
+    media_item_leave(&s->video_item, item);
+    s->video_stream = item->video_stream;
+    s->video_codec_ctx = c;
+    s->video_codec = item->video_codec;
+    s->video_pts_offset = item->offset;
+    s->video_clock = 0;
+    atomic_value_set_int64(&s->video_next_size, (int64_t)c->width << 32 | c->height);
+}
+
+//decode one video packet into the frame queue, returns <0 when the session quits,
+//0 when there is nothing to do (frame queue full or no packet) and 1 otherwise
+int video_decode_step(MediaState *s)
+{
+    int ret, got_picture;
+    AVFrame *frame = s->video_decode_frame;
+    AVPacket pkt, *packet = &pkt;
+    int64_t ts, decode_start;
+    double video_pts;
+    //with a filter the decoded frames wait for the graph instead of the presenter
+    FrameQueue *queue = s->video_filter ? &s->video_filter->in_queue : &s->video_frame_queue;
+
+    if (SDL_AtomicGet(&s->quit))
+        return -1;
+
+    if (frame_queue_full(queue))
+        return 0;
+
+    av_init_packet(packet);
+    packet->data = NULL;
+    packet->size = 0;
+
+    //the previous file ends, empty packets return the delayed frames
+    if (s->video_switch)
+        goto decode;
+
+    if (packet_queue_get(&s->video_packet_queue, packet, 0) <= 0) { //!block
+        //no data
+        return 0;
+    }
+    flight_recorder_mark(s->flight, FLIGHT_PACKET_GET, s->video_stream_index);
+
+    //receive FLUSH data to flush codec, because of seeking
+    if (strcmp((char *)packet->data, FLUSH_DATA) == 0) {
+        video_switch_item(s, demux_marker_item(packet), VIDEO_MARK_SEEK);
+        avcodec_flush_buffers(s->video_codec_ctx);
+        frame_queue_flush(&s->video_frame_queue);
+        if (s->video_filter)
+            video_filter_flush(s->video_filter);
+        s->video_clock = 0;
+        av_packet_unref(packet);
+        return 1;
+    }
+
+    if (strcmp((char *)packet->data, SWITCH_DATA) == 0) {
+        s->video_switch = demux_marker_item(packet);
+        av_packet_unref(packet);
+        goto decode;
+    }
+
+    video_decoder_config(s, packet);
+
+decode:
+    decode_start = flight_recorder_now(s->flight);
+    ret = avcodec_decode_video2(s->video_codec_ctx, frame, &got_picture, packet);
+    flight_recorder_watch(s->flight, FLIGHT_VIDEO_DECODE, decode_start, packet->size);
     av_packet_unref(packet);
+    if (s->video_switch && (ret < 0 || !got_picture)) {
+        //drained, the next frames come from the new file
+        video_switch_item(s, s->video_switch, VIDEO_MARK_SPLICE);
+        s->video_switch = NULL;
+        return 1;
+    }
 
-    return 0;
+    if (ret < 0) {
+        printf("decode error\n");
+        return 1;
+    }
+
+    if (!got_picture)
+        return 1;
+
+    ts = av_frame_get_best_effort_timestamp(frame);
+    video_pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(s->video_stream->time_base) + s->video_pts_offset : 0;
+    video_pts = get_frame_pts(s, frame, video_pts);
+
+    //the presenter takes over the size of the new file with this frame
+    frame->opaque = (void *)(intptr_t)s->video_mark;
+    s->video_mark = VIDEO_MARK_NONE;
+
+    frame_queue_put(queue, frame, video_pts);
+    av_frame_unref(frame);
+
+    return 1;
 }
 
+//video decoder thread of a session without thread pool
 int decode_callback(void *userdata)
 {
     MediaState *s = (MediaState *)userdata;
     if (!s)
         return -1;
 
-    AVPacket pkt1, *packet = &pkt1;
-
-    int ret, got_picture, numBytes;
+    int ret;
+    while ((ret = video_decode_step(s)) >= 0) {
+        if (SDL_AtomicGet(&s->pause) || ret == 0) {
+            SDL_Delay(5);
+        }
+    }
 
-    double video_pts = 0; //video pts
-    double audio_pts = 0; //audio pts
+    return 0;
+}
 
-    //decode video
-    AVFrame *frame, *out_frame;
-    uint8_t *out_buffer_rgb; //rgb buffer after decode
-    struct SwsContext *img_convert_ctx;  //convert for video format
+//video decoder task of a session on the thread pool, a few packets per run so
+//the other sessions get their turn
+void decode_task(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    int ret = 1;
 
-    frame = av_frame_alloc();
-    out_frame = av_frame_alloc();
+    for (int i = 0; i < DECODE_TASK_PACKETS && ret > 0 && !SDL_AtomicGet(&s->pause); i++)
+        ret = video_decode_step(s);
 
-    //convert YUV
-    img_convert_ctx = sws_getContext(s->video_codec_ctx->width, s->video_codec_ctx->height,
-                                     s->video_codec_ctx->pix_fmt,
-                                     s->video_codec_ctx->width, s->video_codec_ctx->height,
-                                     s->display_pix_fmt,
-                                     SWS_BICUBIC, NULL, NULL, NULL);
+    if (ret < 0)
+        return;
 
-    numBytes = avpicture_get_size(s->display_pix_fmt, s->video_codec_ctx->width, s->video_codec_ctx->height);
+    media_submit_task(s, decode_task, (ret == 0 || SDL_AtomicGet(&s->pause)) ? 5 : 0);
+}
 
-    out_buffer_rgb = (uint8_t *)av_malloc(numBytes * sizeof(uint8_t));
-    avpicture_fill((AVPicture *)out_frame, out_buffer_rgb,
-                   s->display_pix_fmt,
-                   s->video_codec_ctx->width, s->video_codec_ctx->height);
+//filter thread of a session without thread pool
+int filter_callback(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    if (!s || !s->video_filter)
+        return -1;
 
-    while(1) {
-        if (s->quit) {
-            break;
-        }
-        if (s->audio_stream_index == -1 && s->pause) {
-            SDL_Delay(10);
-			continue;
-		}
-        if (SDL_AUDIO_PAUSED == SDL_GetAudioStatus()) { //pause
-            SDL_Delay(10);
-            continue;
-        }
-        if (packet_queue_get(&s->video_packet_queue, packet, 0) <= 0) { //!block
-            SDL_Delay(10); //no data
-            continue;
+    while (!SDL_AtomicGet(&s->quit)) {
+        if (SDL_AtomicGet(&s->pause) || video_filter_step(s->video_filter, &s->video_frame_queue) == 0) {
+            SDL_Delay(5);
         }
+    }
 
-        //receive FLUSH data to flush codec, because of seeking
-        if (strcmp((char*)packet->data, FLUSH_DATA) == 0) {
-            avcodec_flush_buffers(s->video_stream->codec);
-            av_packet_unref(packet);
-            continue;
-        }
+    return 0;
+}
 
-        ret = avcodec_decode_video2(s->video_codec_ctx, frame, &got_picture, packet);
+//filter task of a session on the thread pool, the graph's own slice threads do
+//the heavy part
+void filter_task(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    int ret = 1;
 
-        if (ret < 0) {
-            printf("decode error\n");
-            av_packet_unref(packet);
-            continue;
-        }
+    if (SDL_AtomicGet(&s->quit))
+        return;
 
-//sync video and audio
-        if (s->audio_stream_index != -1) {
-            if (packet->dts == AV_NOPTS_VALUE
-                    && frame->opaque
-                    && *(uint64_t*)frame->opaque != AV_NOPTS_VALUE) {
-                video_pts = *(uint64_t *)frame->opaque;
-            } else if (packet->dts != AV_NOPTS_VALUE) {
-                video_pts = packet->dts;
-            } else {
-                video_pts = 0;
-            }
-
-            video_pts *= av_q2d(s->video_stream->time_base);
-            video_pts = get_frame_pts(s, frame, video_pts);
-
-            while(1) {
-                if (s->quit) {
-                    break;
-                }
-
-                audio_pts = s->audio_clock;
-
-                //in demuxer.cpp, we set video_clock 0 for seeking
-                //so we should update video pts
-                //if not when we seek backwards, it will running here forever
-                video_pts = s->video_clock;
-                if (video_pts <= audio_pts)
-                    break;
-
-                int delayTime = (video_pts - audio_pts) * 1000;
-                delayTime = delayTime > 5 ? 5 : delayTime;
-                SDL_Delay(delayTime);
-            }
-        } else {
-            if (packet->pts != AV_NOPTS_VALUE) {
-                s->video_clock = av_q2d(s->video_stream->time_base) * packet->pts;
-            }
-
-            SDL_Delay(1000 / av_q2d(s->video_stream->r_frame_rate));
-        }
-//sync end
+    for (int i = 0; i < FILTER_TASK_FRAMES && ret > 0 && !SDL_AtomicGet(&s->pause); i++)
+        ret = video_filter_step(s->video_filter, &s->video_frame_queue);
 
-        if (got_picture) {
-            sws_scale(img_convert_ctx,
-                      (uint8_t const * const *) frame->data,
-                      frame->linesize, 0, s->video_codec_ctx->height,
-                      out_frame->data, out_frame->linesize);
-        }
+    media_submit_task(s, filter_task, (ret == 0 || SDL_AtomicGet(&s->pause)) ? 5 : 0);
+}
+
+//the packets after a marker belong to item, a file without subtitles leaves the
+//decoder idle until the next one
+static void subtitle_switch_item(MediaState *s, MediaItem *item)
+{
+    if (item == s->subtitle_item)
+        return;
 
+    media_item_leave(&s->subtitle_item, item);
+    s->subtitle_stream = item->subtitle_stream;
+    s->subtitle_codec_ctx = item->subtitle_stream ? item->subtitle_stream->codec : NULL;
+    s->subtitle_pts_offset = item->offset;
+}
+
+//decode one subtitle packet into the subtitle queue, returns like
+//video_decode_step. bitmaps and text are turned into argb here, the presenter
+//only uploads them
+int subtitle_decode_step(MediaState *s)
+{
+    AVPacket pkt, *packet = &pkt;
+    AVSubtitle sub;
+    Subtitle *st;
+    int ret, got_sub;
+    double start, end;
+
+    if (SDL_AtomicGet(&s->quit))
+        return -1;
+
+    if (subtitle_queue_full(&s->subtitle_queue))
+        return 0;
+
+    if (packet_queue_get(&s->subtitle_packet_queue, packet, 0) <= 0)
+        return 0;
+
+    if (strcmp((char *)packet->data, FLUSH_DATA) == 0) {
+        subtitle_switch_item(s, demux_marker_item(packet));
+        if (s->subtitle_codec_ctx)
+            avcodec_flush_buffers(s->subtitle_codec_ctx);
+        subtitle_queue_flush(&s->subtitle_queue);
         av_packet_unref(packet);
+        return 1;
+    }
+
+    //nothing to drain, subtitle decoders have no delay
+    if (strcmp((char *)packet->data, SWITCH_DATA) == 0) {
+        subtitle_switch_item(s, demux_marker_item(packet));
+        av_packet_unref(packet);
+        return 1;
+    }
+
+    if (!s->subtitle_codec_ctx) {
+        av_packet_unref(packet);
+        return 1;
+    }
+
+    ret = avcodec_decode_subtitle2(s->subtitle_codec_ctx, &sub, &got_sub, packet);
+    if (ret < 0 || !got_sub) {
+        av_packet_unref(packet);
+        return 1;
+    }
+
+    //the packet has the time in the stream, the display times are relative to it
+    if (packet->pts != AV_NOPTS_VALUE)
+        start = packet->pts * av_q2d(s->subtitle_stream->time_base);
+    else if (sub.pts != AV_NOPTS_VALUE)
+        start = (double)sub.pts / AV_TIME_BASE;
+    else
+        start = 0;
+    start += s->subtitle_pts_offset;
+    end = start + sub.end_display_time / 1000.0;
+    if (!sub.end_display_time || sub.end_display_time == UINT32_MAX)
+        end = packet->duration > 0 ? start + packet->duration * av_q2d(s->subtitle_stream->time_base) : INFINITY;
+    start += sub.start_display_time / 1000.0;
+
+    st = subtitle_create(&sub, start, end, s->subtitle_codec_ctx->width, s->subtitle_codec_ctx->height);
+    if (st && !subtitle_queue_put(&s->subtitle_queue, st))
+        subtitle_free(&st);
+
+    avsubtitle_free(&sub);
+    av_packet_unref(packet);
+
+    return 1;
+}
+
+//subtitle decoder thread of a session without thread pool
+int subtitle_callback(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    if (!s)
+        return -1;
+
+    int ret;
+    while ((ret = subtitle_decode_step(s)) >= 0) {
+        if (SDL_AtomicGet(&s->pause) || ret == 0) {
+            SDL_Delay(10);
+        }
     }
-    av_free(frame);
-    av_free(out_frame);
-    av_free(out_buffer_rgb);
 
     return 0;
 }
+
+//subtitle decoder task of a session on the thread pool
+void subtitle_task(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    int ret = 1;
+
+    for (int i = 0; i < DECODE_TASK_PACKETS && ret > 0 && !SDL_AtomicGet(&s->pause); i++)
+        ret = subtitle_decode_step(s);
+
+    if (ret < 0)
+        return;
+
+    media_submit_task(s, subtitle_task, (ret == 0 || SDL_AtomicGet(&s->pause)) ? 10 : 0);
+}
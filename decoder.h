@@ -3,10 +3,33 @@
 
 #include "mediastate.h"
 
+#define DECODE_TASK_PACKETS 4
+#define FILTER_TASK_FRAMES 4
+
 int refresh_callback(void *);
 
+Uint32 refresh_timer_callback(Uint32 interval, void *);
+
+int video_alloc_textures(MediaState *s, int w, int h);
+
+VideoSink *video_sink_sdl_create(MediaState *s);
+
 int decode_and_show(MediaState *s);
 
+int video_decode_step(MediaState *s);
+
 int decode_callback(void *);
 
+void decode_task(void *);
+
+int filter_callback(void *);
+
+void filter_task(void *);
+
+int subtitle_decode_step(MediaState *s);
+
+int subtitle_callback(void *);
+
+void subtitle_task(void *);
+
 #endif // DECODER_H
@@ -1,79 +1,335 @@
 #include "demuxer.h"
 
-int demux_callback(void *userdata)
+//a packet of its own for every queue, each decoder unrefs its copy
+int demux_put_marker(PacketQueue *q, const char *tag, MediaItem *item)
 {
-    MediaState *s = (MediaState *)userdata;
-    if (!s)
+    AVPacket packet;
+
+    if (av_new_packet(&packet, DEMUX_MARKER_SIZE + sizeof(item)) < 0)
         return -1;
 
-    int ret = 0;
-    AVPacket packet;
-    while (1) { //quit? -> read? -> write
-        if (s->quit) {
+    strcpy((char *)packet.data, tag);
+    memcpy(packet.data + DEMUX_MARKER_SIZE, &item, sizeof(item));
+
+    if (packet_queue_put(q, &packet) < 0) {
+        av_packet_unref(&packet);
+        return -1;
+    }
+
+    return 0;
+}
+
+MediaItem *demux_marker_item(AVPacket *packet)
+{
+    MediaItem *item;
+
+    memcpy(&item, packet->data + DEMUX_MARKER_SIZE, sizeof(item));
+
+    return item;
+}
+
+//close the files every decoder has left, they are left in order. they are
+//unlinked under the lock and closed outside of it
+static void demux_close_items(MediaState *s)
+{
+    while (s->items != s->demux_item && SDL_AtomicGet(&s->items->nb_left) >= s->items->nb_users) {
+        MediaItem *item = s->items;
+
+        SDL_AtomicLock(&s->items_lock);
+        s->items = item->next;
+        SDL_AtomicUnlock(&s->items_lock);
+
+        media_item_free(&item);
+    }
+}
+
+//the end of the stream the next file is lined up after, in session time
+static void demux_track_end(MediaState *s, AVPacket *packet)
+{
+    MediaItem *item = s->demux_item;
+    AVStream *stream = item->audio_stream ? item->audio_stream : item->video_stream;
+    double end;
+
+    if (!stream || packet->stream_index != stream->index || packet->pts == AV_NOPTS_VALUE)
+        return;
+
+    end = (packet->pts + packet->duration) * av_q2d(stream->time_base) + item->offset;
+    if (isnan(s->demux_end) || end > s->demux_end)
+        s->demux_end = end;
+}
+
+//continue with the queued file at the end of the current one. the decoders
+//drain their codecs at the marker and go on with the next packets, nothing is
+//flushed so the sound and the picture have no gap. returns 1 after a splice, 0
+//while the next file is still opening and <0 when the session ends here
+static int demux_splice(MediaState *s)
+{
+    MediaItem *cur = s->demux_item, *item;
+    double end;
+
+    switch (SDL_AtomicGet(&s->next_state)) {
+        case MEDIA_NEXT_OPENING:
+            return 0;
+        case MEDIA_NEXT_READY:
             break;
+        default:
+            return -1;
+    }
+
+    item = s->next_item;
+    s->next_item = NULL;
+
+    //the decoders and the device were set up for these streams
+    if ((item->audio_stream_index != -1) != (s->audio_stream_index != -1)
+            || (item->video_stream_index != -1) != (s->video_stream_index != -1)) {
+        printf("%s: other streams than %s, no gapless switch\n", item->filename, cur->filename);
+        media_item_free(&item);
+        SDL_AtomicSet(&s->next_state, MEDIA_NEXT_FAILED);
+        return -1;
+    }
+
+    end = s->demux_end;
+    if (isnan(end))
+        end = cur->offset + cur->start_time
+                + (cur->ic->duration != AV_NOPTS_VALUE ? (double)cur->ic->duration / AV_TIME_BASE : 0);
+    item->offset = end - item->start_time;
+    item->nb_users = cur->nb_users;
+    SDL_AtomicLock(&s->items_lock);
+    cur->next = item;
+    SDL_AtomicUnlock(&s->items_lock);
+
+    if (s->audio_stream_index != -1)
+        demux_put_marker(&s->audio_packet_queue, SWITCH_DATA, item);
+    if (s->video_stream_index != -1)
+        demux_put_marker(&s->video_packet_queue, SWITCH_DATA, item);
+    if (s->subtitle_atlas)
+        demux_put_marker(&s->subtitle_packet_queue, SWITCH_DATA, item);
+
+    s->demux_item = item;
+    s->ic = item->ic;
+    s->audio_stream_index = item->audio_stream_index;
+    s->video_stream_index = item->video_stream_index;
+    s->subtitle_stream_index = s->subtitle_atlas ? item->subtitle_stream_index : -1;
+    s->demux_end = NAN;
+    s->prepare_time_max = FFMAX(s->prepare_time_max, item->prepare_time);
+    s->nb_splices++;
+
+    SDL_AtomicSet(&s->next_state, MEDIA_NEXT_NONE);
+
+    return 1;
+}
+
+//move the demuxer to pos (session time) and flush the decoders, a timeshifted
+//session moves within its ring
+static void demux_seek(MediaState *s, int64_t pos)
+{
+    //the position is in session time, it stays within the current file
+    int64_t seek_pos = FFMAX(pos - (int64_t)(s->demux_item->offset * AV_TIME_BASE), 0);
+    int64_t start = flight_recorder_now(s->flight);
+
+    if (s->timeshift) {
+        if (timeshift_seek(s->timeshift, seek_pos) < 0)
+            return;
+    } else {
+        int stream_index = av_find_default_stream_index(s->ic);
+        if (stream_index >= 0) {
+            seek_pos = av_rescale_q(seek_pos, AVRational{ 1, AV_TIME_BASE }, s->ic->streams[stream_index]->time_base);
         }
 
-        //end of the file and queue is empty
-        if (ret < 0) {
-            if (s->audio_stream_index != -1 && !s->audio_packet_queue.first_pkt)
-                break;
-            if (s->video_stream_index != -1 && !s->video_packet_queue.first_pkt)
-                break;
+        if (av_seek_frame(s->ic, stream_index, seek_pos, AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY) < 0) {
+            printf("%s: error while seeking\n", s->ic->filename);
+            return;
         }
+    }
 
-        //seek part
-        if (s->seek_req) {
-            int stream_index = av_find_default_stream_index(s->ic);
-            if (stream_index >= 0) {
-                s->seek_pos = av_rescale_q(s->seek_pos, AVRational{ 1, AV_TIME_BASE }, s->ic->streams[stream_index]->time_base);
-            }
+    //the decoders may still be on an earlier file, the marker takes them
+    //to this one
+    if (s->audio_stream_index >= 0) { //audio
+        packet_queue_flush(&s->audio_packet_queue); //flush queue
+         //push FLUSH pkt in queue
+        demux_put_marker(&s->audio_packet_queue, FLUSH_DATA, s->demux_item);
+    }
+    if (s->video_stream_index >= 0) { //video
+        packet_queue_flush(&s->video_packet_queue); //flush queue
+        //push FLUSH pkt in queue
+        demux_put_marker(&s->video_packet_queue, FLUSH_DATA, s->demux_item);
+    }
+    //the decoder may wait on a queue full of subtitles for the old position
+    if (s->subtitle_atlas) {
+        packet_queue_flush(&s->subtitle_packet_queue);
+        subtitle_queue_flush(&s->subtitle_queue);
+        demux_put_marker(&s->subtitle_packet_queue, FLUSH_DATA, s->demux_item);
+    }
+    //the clocks start again with the first sample and frame after the seek
+    clock_set(&s->audio_clk, NAN);
+    clock_set(&s->video_clk, NAN);
+    clock_set(&s->ext_clk, (double)pos / AV_TIME_BASE);
+    s->demux_eof = 0;
+    s->demux_end = NAN;
 
-            if (av_seek_frame(s->ic, stream_index, s->seek_pos, AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY) < 0) {
-                  printf("%s: error while seeking\n", s->ic->filename);
-            } else {
-                //avpacket for video or audio
-                AVPacket packet;
-                av_new_packet(&packet, 10);
-                strcpy((char *)packet.data, FLUSH_DATA);
-
-                if (s->audio_stream_index >= 0) { //audio
-                    packet_queue_flush(&s->audio_packet_queue); //flush queue
-                     //push FLUSH pkt in queue
-                    packet_queue_put(&s->audio_packet_queue, &packet);
-                }
-                if (s->video_stream_index >= 0) { //video
-                    packet_queue_flush(&s->video_packet_queue); //flush queue
-                    //push FLUSH pkt in queue
-                    packet_queue_put(&s->video_packet_queue, &packet);
-                    s->video_clock = 0;
-                }
-            }
-            s->seek_req = 0;
-			s->seek_pos = 0;
-        }
+    flight_recorder_span(s->flight, FLIGHT_SEEK_DEMUX, start, (int)(pos / 1000));
+}
+
+//one iteration of the demux loop, returns <0 when demuxing is finished,
+//0 when the caller should back off (queues full) and 1 otherwise
+int demux_step(MediaState *s)
+{
+    int ret;
+    int64_t start;
+    AVPacket packet;
+
+    if (SDL_AtomicGet(&s->quit))
+        return -1;
+
+    demux_close_items(s);
+
+    //seek part
+    if (SDL_AtomicGet(&s->seek_req)) {
+        demux_seek(s, atomic_value_get_int64(&s->seek_pos));
+        //a new request may only come in after this
+        SDL_AtomicSet(&s->seek_req, 0);
+    }
+
+    //paused for longer than the ring holds, go on from the oldest packets left
+    if (s->timeshift && timeshift_lost(s->timeshift)) {
+        int64_t start, end;
+        s->timeshift->nb_lost++;
+        if (timeshift_window(s->timeshift, &start, &end) == 0)
+            demux_seek(s, start + (int64_t)(s->demux_item->offset * AV_TIME_BASE));
+    }
+
+    //end of the file, wait until the queues are played out
+    if (s->demux_eof) {
+        int nb_audio = 0, nb_video = 0;
+        packet_queue_size(&s->audio_packet_queue, &nb_audio);
+        packet_queue_size(&s->video_packet_queue, &nb_video);
+        if ((s->audio_stream_index == -1 || !nb_audio)
+                && (s->video_stream_index == -1 || !nb_video))
+            return -1;
+        return 0;
+    }
+
+    //read but not all
+    if (packet_queue_size(&s->audio_packet_queue, NULL) > MAX_AUDIO_SIZE
+            || packet_queue_size(&s->video_packet_queue, NULL) > MAX_VIDEO_SIZE) {
+        return 0;
+    }
+
+    //read frame, a timeshifted session gets what the recorder wrote
+    start = flight_recorder_now(s->flight);
+    if (s->timeshift) {
+        ret = timeshift_read(s->timeshift, &packet);
+        if (ret == 0)
+            return 0; //live
+        if (ret > 0)
+            ret = 0;
+    } else {
+        ret = av_read_frame(s->ic, &packet);
+    }
+    flight_recorder_span(s->flight, FLIGHT_PACKET_READ, start, ret < 0 ? ret : packet.stream_index);
+    if (ret < 0) {
+        ret = demux_splice(s);
+        if (ret >= 0)
+            return ret;
+        s->demux_eof = 1;
+        return 1;
+    }
+
+    demux_track_end(s, &packet);
+
+    //read a frame, push into queue
+    if (packet.stream_index == s->video_stream_index || packet.stream_index == s->audio_stream_index)
+        flight_recorder_mark(s->flight, FLIGHT_PACKET_PUT, packet.stream_index);
+    if(packet.stream_index == s->video_stream_index)
+        packet_queue_put(&s->video_packet_queue, &packet);
+    else if (packet.stream_index == s->audio_stream_index)
+        packet_queue_put(&s->audio_packet_queue, &packet);
+    else if (packet.stream_index == s->subtitle_stream_index)
+        packet_queue_put(&s->subtitle_packet_queue, &packet);
+    else
+        av_packet_unref(&packet);
+
+    s->is_buffering = 1;
+
+    return 1;
+}
+
+int demux_callback(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    if (!s)
+        return -1;
+
+    int ret;
+    while ((ret = demux_step(s)) >= 0) { //quit? -> read? -> write
+        if (ret == 0)
+            SDL_Delay(s->timeshift ? 10 : 100); //at the live end the queues are short
+    }
+
+    //quit
+    SDL_AtomicSet(&s->quit, 1);
+
+    return 0;
+}
+
+//demuxer task of a session on the thread pool
+void demux_task(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    int ret = 1;
+
+    for (int i = 0; i < DEMUX_TASK_PACKETS && ret > 0; i++)
+        ret = demux_step(s);
+
+    if (ret < 0) {
+        SDL_AtomicSet(&s->quit, 1);
+        return;
+    }
 
-        //read but not all
-        if (s->audio_packet_queue.size > MAX_AUDIO_SIZE || s->video_packet_queue.size > MAX_VIDEO_SIZE) {
-            SDL_Delay(100);
+    media_submit_task(s, demux_task, ret == 0 ? 10 : 0);
+}
+
+//recorder of a timeshifted session, it reads the input at the pace the source
+//sets whatever the player does. a blocking read would hold a pool worker, so it
+//is always a thread
+int record_callback(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    AVPacket packet;
+    double start = NAN, first = 0;
+    int64_t time = AV_NOPTS_VALUE;
+
+    if (!s || !s->timeshift)
+        return -1;
+
+    while (!SDL_AtomicGet(&s->quit) && av_read_frame(s->ic, &packet) >= 0) {
+        if (packet.stream_index != s->audio_stream_index && packet.stream_index != s->video_stream_index) {
+            av_packet_unref(&packet);
             continue;
         }
 
-        //read frame
-        ret = av_read_frame(s->ic, &packet);
-        if(ret > -1) { //read a frame, push into queue
-            if(packet.stream_index == s->video_stream_index)
-                packet_queue_put(&s->video_packet_queue, &packet);
-            else if (packet.stream_index == s->audio_stream_index)
-                packet_queue_put(&s->audio_packet_queue, &packet);
-            else
-                av_packet_unref(&packet);
-
-            s->is_buffering = 1;
+        AVRational tb = s->ic->streams[packet.stream_index]->time_base;
+        int64_t ts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+        //packets without a time seek like the one before them
+        if (ts != AV_NOPTS_VALUE)
+            time = av_rescale_q(ts, tb, AVRational{ 1, AV_TIME_BASE });
+
+        //a file stands in for a live source, its packets come in at their dts
+        if (s->record_realtime && packet.dts != AV_NOPTS_VALUE) {
+            double t = packet.dts * av_q2d(tb);
+            if (isnan(start)) {
+                start = clock_time();
+                first = t;
+            }
+            while (!SDL_AtomicGet(&s->quit) && t - first > clock_time() - start)
+                SDL_Delay(FFMIN((Uint32)((t - first - (clock_time() - start)) * 1000) + 1, 10));
         }
+
+        timeshift_write(s->timeshift, &packet, time);
+        av_packet_unref(&packet);
     }
 
-    //quit
-    s->quit = 1;
+    timeshift_set_eof(s->timeshift);
 
     return 0;
 }
@@ -3,6 +3,19 @@
 
 #include "mediastate.h"
 
+#define DEMUX_TASK_PACKETS 16
+#define DEMUX_MARKER_SIZE 8 //the tag, then the item the following packets belong to
+
+int demux_put_marker(PacketQueue *q, const char *tag, MediaItem *item);
+
+MediaItem *demux_marker_item(AVPacket *packet);
+
+int demux_step(MediaState *s);
+
 int demux_callback(void *);
 
+void demux_task(void *);
+
+int record_callback(void *);
+
 #endif // DEMUXER_H
@@ -0,0 +1,428 @@
+#include "extract.h"
+
+//frames of one keyframe-aligned range, in pts order. start and end are pts in the
+//stream time base, the decoder keeps the frames with start <= pts < end
+typedef struct ExtractRange {
+    int64_t seek_ts;
+    int64_t start;
+    int64_t end;
+    AVFrame **frames; //fifo, consumed from rindex
+    int nb_frames;
+    int rindex;
+    int capacity;
+    int done;
+} ExtractRange;
+
+typedef struct Extractor {
+    const char *filename;
+    int stream_index;
+    ExtractRange *ranges;
+    int nb_ranges;
+    SDL_atomic_t next_range; //taken in order, so the head range is always being decoded
+    SDL_atomic_t nb_errors;
+    SDL_atomic_t quit;
+
+    //the reorder buffer, under mutex
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    int head; //the range the sink gets frames from
+    int nb_buffered;
+    int max_buffered;
+
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
+} Extractor;
+
+//opens filename with only its first video stream read, for the offline modes
+int extract_open_video(const char *filename, AVFormatContext **pic, int *stream_index)
+{
+    AVFormatContext *ic = NULL;
+
+    if (avformat_open_input(&ic, filename, NULL, NULL) < 0)
+        return -1;
+    if (avformat_find_stream_info(ic, NULL) < 0)
+        goto fail;
+
+    *stream_index = -1;
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        if (ic->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
+            *stream_index = i;
+            break;
+        }
+    }
+    if (*stream_index < 0)
+        goto fail;
+    //the demuxer skips the rest
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        if ((int)i != *stream_index)
+            ic->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    *pic = ic;
+    return 0;
+
+fail:
+    avformat_close_input(&ic);
+    return -1;
+}
+
+//every keyframe with a pts, from a demux-only pass. packets per gop come along so
+//the ranges can be balanced by frames instead of by keyframes
+static int extract_scan_keyframes(AVFormatContext *ic, int stream_index,
+                                  int64_t **keyframes, int64_t **gop_packets)
+{
+    AVPacket pkt;
+    int nb = 0, capacity = 0;
+    int64_t last = AV_NOPTS_VALUE;
+
+    *keyframes = NULL;
+    *gop_packets = NULL;
+
+    av_init_packet(&pkt);
+    while (av_read_frame(ic, &pkt) >= 0) {
+        if (pkt.stream_index == stream_index) {
+            if (pkt.flags & AV_PKT_FLAG_KEY && pkt.pts != AV_NOPTS_VALUE
+                    && (last == AV_NOPTS_VALUE || pkt.pts > last)) {
+                if (nb == capacity) {
+                    capacity = FFMAX(64, capacity * 2);
+                    if (av_reallocp_array(keyframes, capacity, sizeof(int64_t)) < 0
+                            || av_reallocp_array(gop_packets, capacity, sizeof(int64_t)) < 0) {
+                        av_packet_unref(&pkt);
+                        return -1;
+                    }
+                }
+                (*keyframes)[nb] = last = pkt.pts;
+                (*gop_packets)[nb++] = 0;
+            }
+            if (nb > 0)
+                (*gop_packets)[nb - 1]++;
+        }
+        av_packet_unref(&pkt);
+    }
+
+    return nb;
+}
+
+//consecutive gops grouped until a range holds about target frames
+static int extract_plan_ranges(Extractor *e, const int64_t *keyframes, const int64_t *gop_packets,
+                               int nb_keyframes, int64_t target)
+{
+    int nb = 0;
+
+    e->ranges = (ExtractRange *)av_mallocz(FFMAX(nb_keyframes, 1) * sizeof(ExtractRange));
+    if (!e->ranges)
+        return -1;
+
+    if (nb_keyframes <= 1) {
+        //no usable keyframes, one range decoded from the start
+        e->ranges[0].seek_ts = nb_keyframes ? keyframes[0] : AV_NOPTS_VALUE;
+        e->ranges[0].start = INT64_MIN;
+        e->ranges[0].end = INT64_MAX;
+        e->nb_ranges = 1;
+        return 0;
+    }
+
+    for (int i = 0; i < nb_keyframes; ) {
+        int64_t frames = 0;
+        ExtractRange *r = &e->ranges[nb++];
+
+        r->seek_ts = keyframes[i];
+        //frames before the first keyframe can't be decoded anyway
+        r->start = i == 0 ? INT64_MIN : keyframes[i];
+        do {
+            frames += gop_packets[i++];
+        } while (i < nb_keyframes && frames < target);
+        r->end = i < nb_keyframes ? keyframes[i] : INT64_MAX;
+    }
+    e->nb_ranges = nb;
+
+    return 0;
+}
+
+//moves frame into range r. returns 0, or 1 when the range is complete or the
+//extraction stopped
+static int extract_put_frame(Extractor *e, int r, AVFrame *frame)
+{
+    ExtractRange *range = &e->ranges[r];
+    int64_t pts = av_frame_get_best_effort_timestamp(frame);
+    AVFrame *ref;
+
+    if (e->nb_ranges > 1) {
+        if (pts == AV_NOPTS_VALUE || pts < range->start) {
+            //the open-gop leading frames belong to the range before
+            av_frame_unref(frame);
+            return 0;
+        }
+        if (pts >= range->end) {
+            //the decoder outputs in pts order, everything before end is out
+            av_frame_unref(frame);
+            return 1;
+        }
+    }
+    frame->pts = pts;
+
+    SDL_LockMutex(e->mutex);
+    //only ranges ahead of the sink wait for room, the head always goes on
+    while (!SDL_AtomicGet(&e->quit) && r != e->head && e->nb_buffered >= e->max_buffered)
+        SDL_CondWait(e->cond, e->mutex);
+    if (SDL_AtomicGet(&e->quit)) {
+        SDL_UnlockMutex(e->mutex);
+        av_frame_unref(frame);
+        return 1;
+    }
+    if (range->rindex + range->nb_frames == range->capacity) {
+        int capacity = FFMAX(16, range->capacity * 2);
+        if (range->rindex > 0) {
+            memmove(range->frames, range->frames + range->rindex, range->nb_frames * sizeof(AVFrame *));
+            range->rindex = 0;
+        } else if (av_reallocp_array(&range->frames, capacity, sizeof(AVFrame *)) < 0) {
+            SDL_UnlockMutex(e->mutex);
+            SDL_AtomicAdd(&e->nb_errors, 1);
+            av_frame_unref(frame);
+            return 1;
+        } else {
+            range->capacity = capacity;
+        }
+    }
+    ref = av_frame_alloc();
+    if (ref) {
+        av_frame_move_ref(ref, frame);
+        range->frames[range->rindex + range->nb_frames++] = ref;
+        e->nb_buffered++;
+        SDL_CondBroadcast(e->cond);
+    }
+    SDL_UnlockMutex(e->mutex);
+
+    if (!ref) {
+        av_frame_unref(frame);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void extract_range_done(Extractor *e, int r)
+{
+    SDL_LockMutex(e->mutex);
+    e->ranges[r].done = 1;
+    SDL_CondBroadcast(e->cond);
+    SDL_UnlockMutex(e->mutex);
+}
+
+static void extract_decode_range(Extractor *e, int r, AVFormatContext *ic, AVCodecContext *c, AVFrame *frame)
+{
+    ExtractRange *range = &e->ranges[r];
+    AVPacket pkt;
+    int got_frame, ret, eof = 0;
+
+    avcodec_flush_buffers(c);
+    if (range->seek_ts != AV_NOPTS_VALUE
+            && av_seek_frame(ic, e->stream_index, range->seek_ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        SDL_AtomicAdd(&e->nb_errors, 1);
+        return;
+    }
+
+    while (!SDL_AtomicGet(&e->quit)) {
+        av_init_packet(&pkt);
+        if (!eof && av_read_frame(ic, &pkt) < 0)
+            eof = 1;
+        if (eof) {
+            //drain the delayed frames
+            pkt.data = NULL;
+            pkt.size = 0;
+        } else if (pkt.stream_index != e->stream_index) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        got_frame = 0;
+        ret = avcodec_decode_video2(c, frame, &got_frame, &pkt);
+        av_packet_unref(&pkt);
+        if (ret < 0) {
+            SDL_AtomicAdd(&e->nb_errors, 1);
+            if (eof)
+                break;
+            continue;
+        }
+
+        if (got_frame && extract_put_frame(e, r, frame))
+            break;
+        if (eof && !got_frame)
+            break;
+    }
+}
+
+//one worker: its own demuxer and decoder, ranges taken in order until none is left
+static void extract_worker(void *opaque)
+{
+    Extractor *e = (Extractor *)opaque;
+    AVFormatContext *ic = NULL;
+    AVCodecContext *c = NULL;
+    AVCodec *codec;
+    AVFrame *frame = av_frame_alloc();
+    FramePool fp;
+    int stream_index, r;
+
+    frame_pool_init(&fp);
+
+    if (frame && extract_open_video(e->filename, &ic, &stream_index) == 0) {
+        c = ic->streams[stream_index]->codec;
+        codec = avcodec_find_decoder(c->codec_id);
+        //the parallelism is across ranges, one thread per decoder
+        c->thread_count = 1;
+        c->refcounted_frames = 1;
+        frame_pool_attach(&fp, c);
+        if (!codec || avcodec_open2(c, codec, NULL) < 0)
+            c = NULL;
+    }
+    if (!c) {
+        printf("extract: can't open the decoder of %s\n", e->filename);
+        SDL_AtomicAdd(&e->nb_errors, 1);
+    }
+
+    while ((r = SDL_AtomicAdd(&e->next_range, 1)) < e->nb_ranges) {
+        if (c)
+            extract_decode_range(e, r, ic, c, frame);
+        extract_range_done(e, r);
+    }
+
+    if (c)
+        avcodec_close(c);
+    avformat_close_input(&ic);
+    av_frame_free(&frame);
+    frame_pool_uninit(&fp);
+}
+
+//the head range's next frame, blocks until it is decoded. returns 0 once every
+//range is through
+static AVFrame *extract_next_frame(Extractor *e)
+{
+    AVFrame *frame = NULL;
+
+    SDL_LockMutex(e->mutex);
+    while (e->head < e->nb_ranges) {
+        ExtractRange *range = &e->ranges[e->head];
+        if (range->nb_frames > 0) {
+            frame = range->frames[range->rindex++];
+            range->nb_frames--;
+            e->nb_buffered--;
+            SDL_CondBroadcast(e->cond);
+            break;
+        }
+        if (range->done) {
+            //the next range may buffer without limit now, wake it up
+            e->head++;
+            SDL_CondBroadcast(e->cond);
+            continue;
+        }
+        SDL_CondWait(e->cond, e->mutex);
+    }
+    SDL_UnlockMutex(e->mutex);
+
+    return frame;
+}
+
+//decodes the video of filename on nb_workers threads (0 = one per cpu), each on
+//its own keyframe-aligned ranges, and hands the frames to sink in pts order as
+//fast as the sink takes them. at most max_buffered frames wait for the reorder
+int extract_video(const char *filename, int nb_workers, int max_buffered,
+                  VideoSink *sink, ExtractStats *stats)
+{
+    Extractor e;
+    AVFormatContext *ic = NULL;
+    int64_t *keyframes = NULL, *gop_packets = NULL, nb_packets = 0, target;
+    int nb_keyframes, ret = 0;
+    AVFrame *frame;
+
+    memset(&e, 0, sizeof(e));
+    memset(stats, 0, sizeof(ExtractStats));
+    e.filename = filename;
+    e.max_buffered = max_buffered > 0 ? max_buffered : EXTRACT_MAX_BUFFERED;
+    thread_task_group_init(&e.tasks);
+
+    if (!sink || extract_open_video(filename, &ic, &e.stream_index) < 0) {
+        printf("extract: no video in %s\n", filename);
+        ret = -1;
+        goto clean;
+    }
+    stats->stream_index = e.stream_index;
+    stats->time_base = ic->streams[e.stream_index]->time_base;
+
+    nb_keyframes = extract_scan_keyframes(ic, e.stream_index, &keyframes, &gop_packets);
+    avformat_close_input(&ic);
+    if (nb_keyframes < 0) {
+        ret = -1;
+        goto clean;
+    }
+
+    e.pool = thread_pool_create(nb_workers);
+    e.mutex = SDL_CreateMutex();
+    e.cond = SDL_CreateCond();
+    if (!e.pool || !e.mutex || !e.cond) {
+        ret = -1;
+        goto clean;
+    }
+
+    //small enough for every worker to finish a range inside its share of the
+    //reorder buffer, large enough to keep each worker busy a while
+    for (int i = 0; i < nb_keyframes; i++)
+        nb_packets += gop_packets[i];
+    target = FFMIN(nb_packets / (e.pool->nb_workers * EXTRACT_RANGES_PER_WORKER),
+                   e.max_buffered / e.pool->nb_workers);
+    if (extract_plan_ranges(&e, keyframes, gop_packets, nb_keyframes, FFMAX(target, 1)) < 0) {
+        ret = -1;
+        goto clean;
+    }
+
+    stats->nb_workers = FFMIN(e.pool->nb_workers, e.nb_ranges);
+    stats->nb_ranges = e.nb_ranges;
+
+    for (int i = 0; i < stats->nb_workers; i++) {
+        if (thread_pool_submit(e.pool, &e.tasks, TASK_PRIORITY_NORMAL, extract_worker, &e) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    while (ret == 0 && (frame = extract_next_frame(&e))) {
+        int sink_ret;
+
+        while ((sink_ret = video_sink_write(sink, frame, frame->pts * av_q2d(stats->time_base))) == VIDEO_SINK_AGAIN)
+            SDL_Delay(1);
+        av_frame_free(&frame);
+        if (sink_ret < 0) {
+            ret = -1;
+            break;
+        }
+        stats->nb_frames++;
+    }
+
+    //a failed sink or submit: the workers drop the rest
+    SDL_AtomicSet(&e.quit, 1);
+    SDL_LockMutex(e.mutex);
+    SDL_CondBroadcast(e.cond);
+    SDL_UnlockMutex(e.mutex);
+    thread_task_group_wait(&e.tasks);
+
+    stats->nb_errors = SDL_AtomicGet(&e.nb_errors);
+
+clean:
+    for (int i = 0; i < e.nb_ranges; i++) {
+        ExtractRange *range = &e.ranges[i];
+        for (int j = 0; j < range->nb_frames; j++)
+            av_frame_free(&range->frames[range->rindex + j]);
+        av_freep(&range->frames);
+    }
+    av_freep(&e.ranges);
+    av_freep(&keyframes);
+    av_freep(&gop_packets);
+    avformat_close_input(&ic);
+    thread_pool_free(&e.pool);
+    if (e.cond)
+        SDL_DestroyCond(e.cond);
+    if (e.mutex)
+        SDL_DestroyMutex(e.mutex);
+    thread_task_group_destroy(&e.tasks);
+
+    return ret;
+}
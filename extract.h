@@ -0,0 +1,24 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include "mediastate.h"
+
+#define EXTRACT_RANGES_PER_WORKER 4 //more ranges than workers evens out slow gops
+#define EXTRACT_MAX_BUFFERED 256 //decoded frames held for the reorder, all ranges together
+
+//stream_index and time_base are set before the first frame reaches the sink
+typedef struct ExtractStats {
+    int stream_index;
+    AVRational time_base;
+    int nb_workers;
+    int nb_ranges;
+    int64_t nb_frames; //handed to the sink
+    int64_t nb_errors; //packets the decoders rejected
+} ExtractStats;
+
+int extract_open_video(const char *filename, AVFormatContext **pic, int *stream_index);
+
+int extract_video(const char *filename, int nb_workers, int max_buffered,
+                  VideoSink *sink, ExtractStats *stats);
+
+#endif // EXTRACT_H
@@ -0,0 +1,194 @@
+#include "flightrecorder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+static SDL_atomic_t flight_ids;
+
+static const char *flight_names[FLIGHT_EVENT_COUNT] = {
+    "packet read",
+    "packet put",
+    "packet get",
+    "video decode",
+    "audio decode",
+    "present",
+    "audio callback",
+    "underrun",
+    "seek request",
+    "seek demux",
+    "seek shown",
+};
+
+//prefix NULL records without automatic dumps
+FlightRecorder *flight_recorder_create(const char *prefix)
+{
+    FlightRecorder *fr = (FlightRecorder *)av_mallocz(sizeof(FlightRecorder));
+    if (!fr)
+        return NULL;
+
+    fr->origin = SDL_GetPerformanceCounter();
+    fr->ticks_per_us = SDL_GetPerformanceFrequency() / 1e6;
+    fr->id = SDL_AtomicAdd(&flight_ids, 1);
+    fr->stall_ms = FLIGHT_STALL_MS;
+    fr->seek_ms = FLIGHT_SEEK_MS;
+    if (prefix)
+        snprintf(fr->prefix, sizeof(fr->prefix), "%s", prefix);
+
+    return fr;
+}
+
+void flight_recorder_free(FlightRecorder **fr)
+{
+    av_freep(fr);
+}
+
+int64_t flight_recorder_now(FlightRecorder *fr)
+{
+    if (!fr)
+        return 0;
+
+    return (int64_t)((SDL_GetPerformanceCounter() - fr->origin) / fr->ticks_per_us);
+}
+
+static void flight_recorder_put(FlightRecorder *fr, int type, int64_t start, int dur, int arg)
+{
+    int index = SDL_AtomicAdd(&fr->head, 1);
+    FlightSlot *slot = &fr->slots[index & (FLIGHT_EVENTS - 1)];
+
+    SDL_AtomicSet(&slot->seq, 0);
+    SDL_AtomicSet(&slot->type, type);
+    SDL_AtomicSet(&slot->tid, (int)SDL_ThreadID());
+    SDL_AtomicSet(&slot->start_lo, (int)(uint32_t)start);
+    SDL_AtomicSet(&slot->start_hi, (int)(uint32_t)(start >> 32));
+    SDL_AtomicSet(&slot->dur, dur);
+    SDL_AtomicSet(&slot->arg, arg);
+    SDL_AtomicSet(&slot->seq, index + 1);
+}
+
+//an event from start (flight_recorder_now) until now
+void flight_recorder_span(FlightRecorder *fr, int type, int64_t start, int arg)
+{
+    if (!fr)
+        return;
+
+    flight_recorder_put(fr, type, start, (int)(flight_recorder_now(fr) - start), arg);
+}
+
+void flight_recorder_mark(FlightRecorder *fr, int type, int arg)
+{
+    if (!fr)
+        return;
+
+    flight_recorder_put(fr, type, flight_recorder_now(fr), -1, arg);
+}
+
+//a span that trips the recorder when it took longer than stall_ms
+void flight_recorder_watch(FlightRecorder *fr, int type, int64_t start, int arg)
+{
+    int64_t dur;
+
+    if (!fr)
+        return;
+
+    dur = flight_recorder_now(fr) - start;
+    flight_recorder_put(fr, type, start, (int)dur, arg);
+    if (dur > fr->stall_ms * 1000LL)
+        flight_recorder_trip(fr, type, (int)(dur / 1000));
+}
+
+//safe on any thread, the audio callback included: the dump is left to
+//flight_recorder_poll. the first anomaly names the dump
+void flight_recorder_trip(FlightRecorder *fr, int type, int arg)
+{
+    if (!fr)
+        return;
+
+    flight_recorder_mark(fr, type, arg);
+    if (SDL_AtomicCAS(&fr->trip, 0, type + 1))
+        SDL_AtomicSet(&fr->trip_arg, arg);
+}
+
+//the events still in the ring as chrome trace-event json (chrome://tracing or
+//perfetto). events overwritten while they are read are left out
+int flight_recorder_dump(FlightRecorder *fr, const char *path, const char *reason)
+{
+    FILE *f;
+    unsigned int head, first;
+    int nb_events = 0;
+
+    if (!fr || !path)
+        return -1;
+
+    f = fopen(path, "w");
+    if (!f) {
+        printf("%s: can't write the flight recorder\n", path);
+        return -1;
+    }
+
+    head = (unsigned int)SDL_AtomicGet(&fr->head);
+    first = head - FFMIN(head, FLIGHT_EVENTS);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"reason\":\"%s\"},\"traceEvents\":[\n",
+            reason ? reason : "");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"session %d\"}}",
+            fr->id, fr->id);
+
+    for (unsigned int i = first; i != head; i++) {
+        FlightSlot *slot = &fr->slots[i & (FLIGHT_EVENTS - 1)];
+        int seq = SDL_AtomicGet(&slot->seq);
+        int type = SDL_AtomicGet(&slot->type);
+        int tid = SDL_AtomicGet(&slot->tid);
+        int64_t start = (int64_t)((uint64_t)(uint32_t)SDL_AtomicGet(&slot->start_hi) << 32
+                                  | (uint32_t)SDL_AtomicGet(&slot->start_lo));
+        int dur = SDL_AtomicGet(&slot->dur);
+        int arg = SDL_AtomicGet(&slot->arg);
+
+        //a writer came round again meanwhile
+        if (seq != (int)(i + 1) || SDL_AtomicGet(&slot->seq) != seq || type < 0 || type >= FLIGHT_EVENT_COUNT)
+            continue;
+
+        if (dur >= 0)
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%d,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%d}}",
+                    flight_names[type], (long long)start, dur, fr->id, tid, arg);
+        else
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%d}}",
+                    flight_names[type], (long long)start, fr->id, tid, arg);
+        nb_events++;
+    }
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f) != 0)
+        return -1;
+
+    printf("%s: %d events, %s\n", path, nb_events, reason ? reason : "on demand");
+
+    return nb_events;
+}
+
+//from the event loop: writes the dump after an anomaly, at most one per
+//FLIGHT_DUMP_INTERVAL. returns 1 after a dump
+int flight_recorder_poll(FlightRecorder *fr)
+{
+    char path[300], reason[64];
+    int trip;
+    Uint32 now;
+
+    if (!fr || !fr->prefix[0] || !(trip = SDL_AtomicGet(&fr->trip)))
+        return 0;
+
+    now = SDL_GetTicks();
+    if (fr->nb_dumps >= FLIGHT_MAX_DUMPS || (fr->nb_dumps && now - fr->last_dump < FLIGHT_DUMP_INTERVAL))
+        return 0;
+
+    snprintf(reason, sizeof(reason), "%s %d", flight_names[trip - 1], SDL_AtomicGet(&fr->trip_arg));
+    snprintf(path, sizeof(path), "%s-%d-%d.json", fr->prefix, fr->id, fr->nb_dumps);
+    SDL_AtomicSet(&fr->trip, 0);
+    fr->last_dump = now;
+    fr->nb_dumps++;
+
+    return flight_recorder_dump(fr, path, reason) >= 0;
+}
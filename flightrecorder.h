@@ -0,0 +1,88 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#define FLIGHT_EVENTS 4096 //the last events kept, a power of two. some 10 s of a playing session
+#define FLIGHT_STALL_MS 250 //a decode or a picture held longer than this is a stall
+#define FLIGHT_SEEK_MS 2000 //from the request to the first frame shown
+#define FLIGHT_DUMP_INTERVAL 10000 //ms between automatic dumps
+#define FLIGHT_MAX_DUMPS 10 //automatic dumps of a session
+#define FLIGHT_PREFIX "flight"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+enum FlightEventType {
+    FLIGHT_PACKET_READ = 0,
+    FLIGHT_PACKET_PUT,
+    FLIGHT_PACKET_GET,
+    FLIGHT_VIDEO_DECODE,
+    FLIGHT_AUDIO_DECODE,
+    FLIGHT_PRESENT,
+    FLIGHT_AUDIO_CALLBACK,
+    FLIGHT_UNDERRUN,
+    FLIGHT_SEEK_REQUEST,
+    FLIGHT_SEEK_DEMUX,
+    FLIGHT_SEEK_SHOWN,
+    FLIGHT_EVENT_COUNT
+};
+
+//one event, every field an SDL atomic like AtomicValue. seq tells the reader
+//whether the slot still holds the event it expects
+typedef struct FlightSlot {
+    SDL_atomic_t seq; //index + 1 of the event, 0 while it is written
+    SDL_atomic_t type;
+    SDL_atomic_t tid;
+    SDL_atomic_t start_lo; //us since the recorder was created
+    SDL_atomic_t start_hi;
+    SDL_atomic_t dur; //us, -1 for an instant
+    SDL_atomic_t arg;
+} FlightSlot;
+
+//the recent pipeline events of a session, cheap enough to stay on: a writer
+//claims a slot with one atomic add and never waits. an anomaly only raises a
+//flag, the event loop writes the dump in chrome trace-event json
+typedef struct FlightRecorder {
+    FlightSlot slots[FLIGHT_EVENTS];
+    SDL_atomic_t head; //events recorded so far
+    Uint64 origin;
+    double ticks_per_us;
+    int id; //of the session in the file names and the trace
+
+    int stall_ms;
+    int seek_ms;
+    char prefix[256]; //automatic dumps are <prefix>-<id>-<n>.json, empty turns them off
+    SDL_atomic_t trip; //FlightEventType + 1 of an anomaly not dumped yet
+    SDL_atomic_t trip_arg;
+
+    //the event loop only
+    Uint32 last_dump;
+    int nb_dumps;
+} FlightRecorder;
+
+FlightRecorder *flight_recorder_create(const char *prefix);
+
+void flight_recorder_free(FlightRecorder **fr);
+
+int64_t flight_recorder_now(FlightRecorder *fr);
+
+void flight_recorder_span(FlightRecorder *fr, int type, int64_t start, int arg);
+
+void flight_recorder_mark(FlightRecorder *fr, int type, int arg);
+
+void flight_recorder_watch(FlightRecorder *fr, int type, int64_t start, int arg);
+
+void flight_recorder_trip(FlightRecorder *fr, int type, int arg);
+
+int flight_recorder_dump(FlightRecorder *fr, const char *path, const char *reason);
+
+int flight_recorder_poll(FlightRecorder *fr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLIGHTRECORDER_H
@@ -0,0 +1,166 @@
+#include "framepool.h"
+
+//buffers really allocated by every pool, flat once playback is steady
+static SDL_atomic_t nb_allocations;
+
+static AVBufferRef *frame_pool_alloc(int size)
+{
+    SDL_AtomicAdd(&nb_allocations, 1);
+    return av_buffer_alloc(size);
+}
+
+static void frame_pool_reset(FramePool *fp)
+{
+    for (int i = 0; i < fp->nb_pools; i++) {
+        //frames still holding buffers keep the old pool alive until they are unreferenced
+        av_buffer_pool_uninit(&fp->pools[i]);
+        fp->sizes[i] = 0;
+    }
+    fp->nb_pools = 0;
+}
+
+//reuse the pools while the sizes fit. video pools are also rebuilt when they are
+//much too large (lowres), audio ones only grow since the last frame is often short
+static int frame_pool_config(FramePool *fp, const int *sizes, int nb_sizes, int shrink)
+{
+    int fits = nb_sizes == fp->nb_pools;
+
+    for (int i = 0; fits && i < nb_sizes; i++)
+        fits = sizes[i] <= fp->sizes[i] && (!shrink || sizes[i] >= fp->sizes[i] / 2);
+    if (fits)
+        return 0;
+
+    frame_pool_reset(fp);
+
+    for (int i = 0; i < nb_sizes; i++) {
+        fp->pools[i] = av_buffer_pool_init(sizes[i] + FRAME_POOL_PADDING, frame_pool_alloc);
+        if (!fp->pools[i]) {
+            fp->nb_pools = i;
+            frame_pool_reset(fp);
+            return -1;
+        }
+        fp->sizes[i] = sizes[i];
+    }
+    fp->nb_pools = nb_sizes;
+
+    return 0;
+}
+
+//plane sizes of a video frame the way avcodec_default_get_buffer2 lays it out
+static int video_plane_sizes(AVCodecContext *c, AVFrame *frame, int linesize[4], int sizes[4])
+{
+    int w = frame->width, h = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    uint8_t *data[4];
+    int size, unaligned, nb_planes;
+
+    avcodec_align_dimensions2(c, &w, &h, linesize_align);
+
+    do {
+        if (av_image_fill_linesizes(linesize, (AVPixelFormat)frame->format, w) < 0)
+            return -1;
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (int i = 0; i < 4; i++)
+            unaligned |= linesize[i] % FRAME_POOL_STRIDE_ALIGN || (linesize_align[i] && linesize[i] % linesize_align[i]);
+    } while (unaligned);
+
+    size = av_image_fill_pointers(data, (AVPixelFormat)frame->format, h, NULL, linesize);
+    if (size < 0)
+        return -1;
+
+    nb_planes = av_pix_fmt_count_planes((AVPixelFormat)frame->format);
+    for (int i = 0; i < nb_planes; i++) {
+        sizes[i] = i == nb_planes - 1 ? size - (int)(data[i] - data[0])
+                                      : (int)(data[i + 1] - data[i]);
+    }
+
+    return nb_planes;
+}
+
+void frame_pool_init(FramePool *fp)
+{
+    memset(fp, 0, sizeof(FramePool));
+    fp->mutex = SDL_CreateMutex();
+}
+
+void frame_pool_uninit(FramePool *fp)
+{
+    frame_pool_reset(fp);
+    if (fp->mutex)
+        SDL_DestroyMutex(fp->mutex);
+    fp->mutex = NULL;
+}
+
+//call before avcodec_open2, codecs without direct rendering keep their own buffers
+void frame_pool_attach(FramePool *fp, AVCodecContext *c)
+{
+    c->opaque = fp;
+    c->get_buffer2 = frame_pool_get_buffer2;
+    c->thread_safe_callbacks = 1; //the pool locks itself
+}
+
+int frame_pool_get_buffer2(AVCodecContext *c, AVFrame *frame, int flags)
+{
+    FramePool *fp = (FramePool *)c->opaque;
+    int linesize[AV_NUM_DATA_POINTERS] = { 0 };
+    int sizes[AV_NUM_DATA_POINTERS];
+    int nb_planes, ret = 0;
+
+    if (!fp || !(c->codec->capabilities & AV_CODEC_CAP_DR1))
+        return avcodec_default_get_buffer2(c, frame, flags);
+
+    if (c->codec_type == AVMEDIA_TYPE_VIDEO) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        //palettes and hardware frames stay with libavcodec
+        if (!desc || desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL | AV_PIX_FMT_FLAG_HWACCEL))
+            return avcodec_default_get_buffer2(c, frame, flags);
+        nb_planes = video_plane_sizes(c, frame, linesize, sizes);
+    } else if (c->codec_type == AVMEDIA_TYPE_AUDIO) {
+        int planar = av_sample_fmt_is_planar((AVSampleFormat)frame->format);
+        nb_planes = planar ? c->channels : 1;
+        if (nb_planes > AV_NUM_DATA_POINTERS)
+            return avcodec_default_get_buffer2(c, frame, flags);
+        if (av_samples_get_buffer_size(&linesize[0], c->channels, frame->nb_samples,
+                                       (AVSampleFormat)frame->format, 0) < 0)
+            return -1;
+        for (int i = 0; i < nb_planes; i++)
+            sizes[i] = linesize[0];
+    } else {
+        return avcodec_default_get_buffer2(c, frame, flags);
+    }
+
+    if (nb_planes <= 0)
+        return -1;
+
+    SDL_LockMutex(fp->mutex);
+    if (frame_pool_config(fp, sizes, nb_planes, c->codec_type == AVMEDIA_TYPE_VIDEO) < 0) {
+        ret = -1;
+    } else {
+        for (int i = 0; i < nb_planes; i++) {
+            frame->buf[i] = av_buffer_pool_get(fp->pools[i]);
+            if (!frame->buf[i]) {
+                ret = -1;
+                break;
+            }
+            frame->data[i] = frame->buf[i]->data;
+            frame->linesize[i] = c->codec_type == AVMEDIA_TYPE_AUDIO ? linesize[0] : linesize[i];
+        }
+    }
+    SDL_UnlockMutex(fp->mutex);
+
+    if (ret < 0) {
+        for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+            av_buffer_unref(&frame->buf[i]);
+        return ret;
+    }
+
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+int frame_pool_allocations()
+{
+    return SDL_AtomicGet(&nb_allocations);
+}
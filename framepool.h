@@ -0,0 +1,39 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#define FRAME_POOL_STRIDE_ALIGN 64 //enough for avx512 loads of the decoders
+#define FRAME_POOL_PADDING 64
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <SDL2/SDL.h>
+
+//recycled buffers of one decoder, handed out through get_buffer2. the pools are
+//sized on the first frame and only rebuilt when the format needs other sizes
+typedef struct FramePool {
+    AVBufferPool *pools[AV_NUM_DATA_POINTERS];
+    int sizes[AV_NUM_DATA_POINTERS];
+    int nb_pools;
+    SDL_mutex *mutex;
+} FramePool;
+
+void frame_pool_init(FramePool *fp);
+
+void frame_pool_uninit(FramePool *fp);
+
+void frame_pool_attach(FramePool *fp, AVCodecContext *c);
+
+int frame_pool_get_buffer2(AVCodecContext *c, AVFrame *frame, int flags);
+
+int frame_pool_allocations();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,86 @@
+#include "framequeue.h"
+
+void frame_queue_init(FrameQueue *q, int max_frames)
+{
+    if (max_frames > FRAME_QUEUE_MAX_SIZE)
+        max_frames = FRAME_QUEUE_MAX_SIZE;
+
+    q->rindex = 0;
+    q->nb_frames = 0;
+    q->max_frames = max_frames;
+    for (int i = 0; i < max_frames; i++)
+        q->frames[i] = av_frame_alloc();
+    q->mutex = SDL_CreateMutex();
+}
+
+void frame_queue_flush(FrameQueue *q)
+{
+    SDL_LockMutex(q->mutex);
+    for (int i = 0; i < q->max_frames; i++) {
+        if (q->frames[i])
+            av_frame_unref(q->frames[i]);
+    }
+    q->rindex = 0;
+    q->nb_frames = 0;
+    SDL_UnlockMutex(q->mutex);
+}
+
+void frame_queue_destroy(FrameQueue *q)
+{
+    for (int i = 0; i < q->max_frames; i++) {
+        if (q->frames[i])
+            av_frame_free(&q->frames[i]);
+    }
+    q->nb_frames = 0;
+    if (q->mutex)
+        SDL_DestroyMutex(q->mutex);
+    q->mutex = NULL;
+}
+
+int frame_queue_full(FrameQueue *q)
+{
+    int full;
+
+    SDL_LockMutex(q->mutex);
+    full = q->nb_frames >= q->max_frames;
+    SDL_UnlockMutex(q->mutex);
+
+    return full;
+}
+
+// move the frame reference into the queue, frame is left blank
+int frame_queue_put(FrameQueue *q, AVFrame *frame, double pts)
+{
+    int ret = 0;
+
+    SDL_LockMutex(q->mutex);
+    if (q->nb_frames < q->max_frames) {
+        int windex = (q->rindex + q->nb_frames) % q->max_frames;
+        av_frame_move_ref(q->frames[windex], frame);
+        q->pts[windex] = pts;
+        q->nb_frames++;
+        ret = 1;
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
+
+// move the oldest frame reference out of the queue, never blocks
+int frame_queue_get(FrameQueue *q, AVFrame *frame, double *pts)
+{
+    int ret = 0;
+
+    SDL_LockMutex(q->mutex);
+    if (q->nb_frames > 0) {
+        av_frame_move_ref(frame, q->frames[q->rindex]);
+        if (pts)
+            *pts = q->pts[q->rindex];
+        q->rindex = (q->rindex + 1) % q->max_frames;
+        q->nb_frames--;
+        ret = 1;
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
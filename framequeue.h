@@ -0,0 +1,39 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#define FRAME_QUEUE_MAX_SIZE 16
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL.h>
+
+//decoded frames waiting for presentation, the slots are allocated once
+typedef struct FrameQueue {
+    AVFrame *frames[FRAME_QUEUE_MAX_SIZE];
+    double pts[FRAME_QUEUE_MAX_SIZE];
+    int rindex;
+    int nb_frames;
+    int max_frames;
+    SDL_mutex *mutex;
+} FrameQueue;
+
+void frame_queue_init(FrameQueue *q, int max_frames);
+
+void frame_queue_flush(FrameQueue *q);
+
+void frame_queue_destroy(FrameQueue *q);
+
+int frame_queue_full(FrameQueue *q);
+
+int frame_queue_put(FrameQueue *q, AVFrame *frame, double pts);
+
+int frame_queue_get(FrameQueue *q, AVFrame *frame, double *pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAMEQUEUE_H
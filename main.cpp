@@ -1,23 +1,329 @@
 #define SDL_MAIN_HANDLED
 
 #include "mediastate.h"
+#include "bench.h"
+#include "batch.h"
+#include "thumbnail.h"
+#include "scanner.h"
+#include "clipexport.h"
+
+#define MAX_SESSIONS 64
+#define MOSAIC_WIDTH 1280
+#define MOSAIC_HEIGHT 720
+
+//the audio sink for -audio: null, or a file that gets -N before the extension
+//for every session after the first
+static AudioSink *session_audio_sink(const char *name, int index)
+{
+    char filename[1024];
+    const char *ext;
+
+    if (!strcmp(name, "null"))
+        return audio_sink_null_create();
+
+    if (index == 0)
+        return audio_sink_file_create(name);
+
+    ext = strrchr(name, '.');
+    if (!ext || strchr(ext, '/') || strchr(ext, '\\'))
+        ext = name + strlen(name);
+    snprintf(filename, sizeof(filename), "%.*s-%d%s", (int)(ext - name), name, index, ext);
+
+    return audio_sink_file_create(filename);
+}
+
+typedef struct PlayerOptions {
+    ThreadPool *pool;
+    Compositor *compositor;
+    int no_video;
+    int sync_master;
+    int audio_latency;
+    const char *audio_sink;
+    const char *video_filter;
+    int filter_threads;
+    int64_t timeshift_size;
+    int realtime;
+    const char *flight_prefix;
+    int flight_stall_ms;
+} PlayerOptions;
+
+//tile in the mosaic, index numbers the audio files of the sessions
+static MediaState *player_open(const PlayerOptions *o, const char *filename, int tile, int index)
+{
+    MediaState *s = NULL;
+
+    if (media_open_input_file(&s, filename) < 0)
+        return NULL;
+    //a file without video only plays its sound
+    if (s->video_stream_index != -1) {
+        if (o->compositor && media_attach_compositor(s, o->compositor, tile) < 0) {
+            printf("%s: no tile %d for the video\n", filename, tile);
+            media_state_free(&s);
+            return NULL;
+        }
+        if (!o->compositor && !o->no_video && media_create_video_display(s, NULL) < 0) {
+            printf("%s: can't create the video display: %s\n", filename, SDL_GetError());
+            media_state_free(&s);
+            return NULL;
+        }
+    }
+    if (o->audio_sink)
+        media_set_audio_sink(s, session_audio_sink(o->audio_sink, index));
+    media_set_audio_latency(s, o->audio_latency);
+    media_open_audio_device(s);
+    media_set_sync_master(s, o->sync_master);
+    media_set_thread_pool(s, o->pool);
+    if (o->video_filter && media_set_video_filter(s, o->video_filter, o->filter_threads) < 0)
+        printf("%s: video filter not set\n", filename);
+    if (o->flight_prefix || o->flight_stall_ms > 0)
+        media_set_flight_recorder(s, o->flight_prefix ? o->flight_prefix : FLIGHT_PREFIX, o->flight_stall_ms, 0);
+    if (o->timeshift_size > 0) {
+        char path[64];
+        snprintf(path, sizeof(path), TIMESHIFT_FILE, index);
+        if (media_set_timeshift(s, path, o->timeshift_size, o->realtime) < 0)
+            printf("%s: no timeshift\n", filename);
+    }
+
+    if (media_start(s) < 0) {
+        media_state_free(&s);
+        return NULL;
+    }
+
+    return s;
+}
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    PlayerOptions o = { NULL, NULL, 0, CLOCK_SYNC_AUDIO, AUDIO_LATENCY_BALANCED, NULL, NULL, 0, 0, 0, NULL, 0 };
+    int cols = 0, rows = 0, headless = 0, playlist = 0;
+    int next = 0, queued = -1, restart = -1, nb_opened = 0;
+    int first = 1;
+
+    if (argc < 2)
         return -1;
 
     media_init();
 
-    MediaState *s = NULL;
+    if (!strcmp(argv[1], "-bench")) {
+        int ret = bench_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
 
-    media_open_input_file(&s, argv[1]);
-    media_create_video_display(s, NULL);
-    media_open_audio_device(s);
+    if (!strcmp(argv[1], "-batch")) {
+        int ret = batch_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
+
+    if (!strcmp(argv[1], "-extract")) {
+        int ret = batch_extract_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
+
+    if (!strcmp(argv[1], "-scan")) {
+        int ret = scanner_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
+
+    if (!strcmp(argv[1], "-export")) {
+        int ret = clip_export_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
+
+    if (!strcmp(argv[1], "-thumbs")) {
+        int ret = thumbnail_run(argc - 2, argv + 2);
+        media_uninit();
+        return ret;
+    }
+
+    while (first < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "-pool") && first + 1 < argc) {
+            //every session shares N workers (0 sizes it to the cpus)
+            o.pool = thread_pool_create(atoi(argv[first + 1]));
+            first += 2;
+        } else if (!strcmp(argv[first], "-mosaic") && first + 1 < argc) {
+            //all sessions in one COLSxROWS window
+            sscanf(argv[first + 1], "%dx%d", &cols, &rows);
+            first += 2;
+        } else if (!strcmp(argv[first], "-sync") && first + 1 < argc) {
+            //clock the other streams follow: audio, video or ext
+            if (!strcmp(argv[first + 1], "video"))
+                o.sync_master = CLOCK_SYNC_VIDEO;
+            else if (!strcmp(argv[first + 1], "ext"))
+                o.sync_master = CLOCK_SYNC_EXTERNAL;
+            first += 2;
+        } else if (!strcmp(argv[first], "-latency") && first + 1 < argc) {
+            //audio buffering: low, balanced or power
+            if (!strcmp(argv[first + 1], "low"))
+                o.audio_latency = AUDIO_LATENCY_LOW;
+            else if (!strcmp(argv[first + 1], "power"))
+                o.audio_latency = AUDIO_LATENCY_POWER;
+            first += 2;
+        } else if (!strcmp(argv[first], "-video") && first + 1 < argc) {
+            //"null" decodes and paces the video without showing it
+            o.no_video = !strcmp(argv[first + 1], "null");
+            first += 2;
+        } else if (!strcmp(argv[first], "-audio") && first + 1 < argc) {
+            //"null" paces the audio without a sound card, anything else is a
+            //.wav or raw file the samples are written to
+            o.audio_sink = argv[first + 1];
+            first += 2;
+        } else if (!strcmp(argv[first], "-vf") && first + 1 < argc) {
+            //libavfilter graph the frames go through before they are shown
+            o.video_filter = argv[first + 1];
+            first += 2;
+        } else if (!strcmp(argv[first], "-vf-threads") && first + 1 < argc) {
+            //slice threads of that graph (0 sizes it to the cpus)
+            o.filter_threads = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-timeshift") && first + 1 < argc) {
+            //the input is recorded into a ring of N MB on disk, playback can
+            //pause and rewind within it while the source goes on
+            o.timeshift_size = (int64_t)atoi(argv[first + 1]) * 1024 * 1024;
+            if (o.timeshift_size <= 0)
+                o.timeshift_size = TIMESHIFT_DEFAULT_SIZE;
+            first += 2;
+        } else if (!strcmp(argv[first], "-realtime")) {
+            //read files at the pace of their timestamps, like a live source
+            o.realtime = 1;
+            first++;
+        } else if (!strcmp(argv[first], "-flight") && first + 1 < argc) {
+            //where the flight recorder dumps after a stall, "off" only records
+            o.flight_prefix = !strcmp(argv[first + 1], "off") ? "" : argv[first + 1];
+            first += 2;
+        } else if (!strcmp(argv[first], "-flight-stall") && first + 1 < argc) {
+            //ms a decode or a picture may take before it counts as a stall
+            o.flight_stall_ms = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-playlist")) {
+            //the files play one after the other in one session, each is
+            //opened while the one before it plays
+            playlist = 1;
+            first++;
+        } else if (!strcmp(argv[first], "-headless")) {
+            headless = 1;
+            first++;
+        } else {
+            break;
+        }
+    }
+
+    //a ring holds the packets of one input, the files are sessions of their own
+    if (playlist && o.timeshift_size > 0) {
+        printf("-playlist is ignored with -timeshift\n");
+        playlist = 0;
+    }
+
+    if (cols > 0 && rows > 0)
+        o.compositor = compositor_create(MOSAIC_WIDTH, MOSAIC_HEIGHT, cols, rows, headless);
+
+    //one session per file, all of them share this process and its event loop
+    MediaState *sessions[MAX_SESSIONS] = { NULL };
+    int nb_sessions = 0;
+
+    //a playlist is one session, the next file is queued as soon as the slot is free
+    for (next = first; next < argc && nb_sessions < MAX_SESSIONS; next++) {
+        MediaState *s = player_open(&o, argv[next], nb_sessions, nb_opened);
+        if (!s)
+            continue;
+        sessions[nb_sessions++] = s;
+        nb_opened++;
+        if (playlist) {
+            next++;
+            break;
+        }
+    }
+
+    SDL_Event event;
+    while (1) {
+        int running = 0;
+
+        if (playlist && sessions[0] && restart < 0) {
+            int state = media_next_state(sessions[0]);
+            if (state == MEDIA_NEXT_FAILED) {
+                //played in a session of its own after this one
+                restart = queued;
+            } else if (state == MEDIA_NEXT_NONE && next < argc) {
+                if (media_queue_next(sessions[0], argv[next]) == 0)
+                    queued = next;
+                next++;
+            }
+        }
+
+        for (int i = 0; i < nb_sessions; i++) {
+            if (sessions[i] && SDL_AtomicGet(&sessions[i]->quit)) {
+                //the demuxer got to the end, the user did not close it
+                media_stop(sessions[i]);
+                int ended = sessions[i]->demux_eof;
+                if (sessions[i]->nb_splices)
+                    printf("session %d: %d files spliced, opened in at most %.1f ms, the picture at most %.1f ms late at %d of them\n",
+                           i, sessions[i]->nb_splices, sessions[i]->prepare_time_max * 1000,
+                           sessions[i]->transition_late_max * 1000, sessions[i]->nb_transitions);
+                double av_offset = media_av_offset(sessions[i]);
+                if (audio_sink_is_open(sessions[i]->audio_sink))
+                    printf("session %d: %d audio underruns\n", i, SDL_AtomicGet(&sessions[i]->nb_underruns));
+                if (!isnan(av_offset))
+                    printf("session %d: a/v offset %.1f ms at the end\n", i, av_offset * 1000);
+                if (sessions[i]->nb_frames_shown)
+                    printf("session %d: %lld frames shown, %lld bytes written per frame\n", i,
+                           (long long)sessions[i]->nb_frames_shown,
+                           (long long)(sessions[i]->nb_bytes_converted / sessions[i]->nb_frames_shown));
+                SubtitleAtlas *sa = sessions[i]->subtitle_atlas;
+                if (sa && sa->nb_subtitles)
+                    printf("session %d: %lld subtitles shown, %lld bitmaps uploaded, atlas reset %lld times\n", i,
+                           (long long)sa->nb_subtitles, (long long)sa->nb_uploads, (long long)sa->nb_resets);
+                VideoFilter *f = sessions[i]->video_filter;
+                if (f && f->nb_frames_out)
+                    printf("session %d: filter %lld frames in, %lld out, %.2f ms per frame, %.2f ms at most, %d graphs built\n",
+                           i, (long long)f->nb_frames_in, (long long)f->nb_frames_out,
+                           f->filter_time * 1000 / f->nb_frames_out, f->filter_time_max * 1000, f->nb_configs);
+                TimeShift *ts = sessions[i]->timeshift;
+                int64_t ts_start, ts_end;
+                if (ts && timeshift_window(ts, &ts_start, &ts_end) == 0)
+                    printf("session %d: timeshift window %.1f s, %lld packets overwritten, fell out of it %d times\n",
+                           i, (double)(ts_end - ts_start) / AV_TIME_BASE, (long long)ts->nb_evicted, ts->nb_lost);
+                media_state_free(&sessions[i]);
+
+                //a file that could not be spliced starts a new session at the end
+                if (playlist && ended) {
+                    for (next = restart >= 0 ? restart : next; next < argc && !sessions[i]; next++)
+                        sessions[i] = player_open(&o, argv[next], i, nb_opened);
+                    nb_opened += sessions[i] != NULL;
+                    restart = -1;
+                }
+            }
+            if (sessions[i])
+                running++;
+        }
+        if (!running)
+            break;
+
+        if (!SDL_WaitEventTimeout(&event, 100))
+            continue;
+
+        if (compositor_handle_event(o.compositor, &event))
+            continue;
+
+        for (int i = 0; i < nb_sessions; i++) {
+            if (sessions[i])
+                media_handle_event(sessions[i], &event);
+        }
+    }
+
+    if (o.compositor) {
+        printf("mosaic: %lld draws, %lld uploads, %lld presents\n",
+               (long long)o.compositor->nb_draws, (long long)o.compositor->nb_uploads,
+               (long long)o.compositor->nb_presents);
+        compositor_free(&o.compositor);
+    }
 
-    media_play(s);
+    thread_pool_free(&o.pool);
 
-    media_state_free(&s);
+    media_uninit();
 
     return 0;
 }
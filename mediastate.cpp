@@ -5,14 +5,38 @@
 int interrupt_cb(void *ctx);
 int audio_decode_frame(MediaState* s, uint8_t *audio_buf, int buf_size);
 void audio_callback(void* userdata, uint8_t *stream, int len);
+static int audio_fill_callback(void *userdata);
+static void audio_fill_task(void *userdata);
+
+static ThreadPool *convert_pool;
+
+//device buffer and how far the decoder runs ahead of it, in ms
+static const struct AudioLatencyProfile {
+    const char *name;
+    int device_ms;
+    int lead_ms;
+} audio_latency_profiles[AUDIO_LATENCY_COUNT] = {
+    { "low", 5, 200 },
+    { "balanced", 20, 100 },
+    { "power", 85, 500 },
+};
 
 void media_init()
 {
     av_register_all();
+    avfilter_register_all();
 
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
 }
 
+//call once after every session has been freed
+void media_uninit()
+{
+    thread_pool_free(&convert_pool);
+
+    SDL_Quit();
+}
+
 MediaState *media_state_alloc()
 {
     MediaState *s;
@@ -34,6 +58,7 @@ void media_state_init(MediaState *s)
 
     s->audio_stream_index = -1;
     s->video_stream_index = -1;
+    s->subtitle_stream_index = -1;
 
     s->display_pix_fmt = AV_PIX_FMT_YUV420P;
 
@@ -42,13 +67,38 @@ void media_state_init(MediaState *s)
     s->r.w = 640;
     s->r.h = 480;
 
-    s->vol = SDL_MIX_MAXVOLUME * 0.7;
+    SDL_AtomicSet(&s->vol, SDL_MIX_MAXVOLUME * 0.7);
 
     s->frame_last_delay = 40e-3;
-    s->delay = 40;
+    SDL_AtomicSet(&s->delay, 40);
+
+    clock_init(&s->audio_clk);
+    clock_init(&s->video_clk);
+    clock_init(&s->ext_clk);
+    SDL_AtomicSet(&s->sync_master, CLOCK_SYNC_AUDIO);
+    s->audio_clock = NAN;
+    s->demux_end = NAN;
+    s->mark_in = AV_NOPTS_VALUE;
+    s->mark_out = AV_NOPTS_VALUE;
+    s->audio_latency = AUDIO_LATENCY_BALANCED;
+    s->audio_diff_avg_coef = exp(log(0.01) / AUDIO_DIFF_AVG_NB);
+
+    SDL_AtomicSet(&s->priority, TASK_PRIORITY_NORMAL);
+
+    s->convert_quality = CONVERT_QUALITY_BICUBIC;
+    s->convert_auto = 1;
 
     packet_queue_init(&s->video_packet_queue);
     packet_queue_init(&s->audio_packet_queue);
+    packet_queue_init(&s->subtitle_packet_queue);
+    subtitle_queue_init(&s->subtitle_queue);
+    frame_queue_init(&s->video_frame_queue, VIDEO_FRAME_QUEUE_SIZE);
+    frame_pool_init(&s->video_frame_pool);
+    frame_pool_init(&s->audio_frame_pool);
+    thread_task_group_init(&s->tasks);
+
+    //on by default, without it the events are simply not recorded
+    s->flight = flight_recorder_create(FLIGHT_PREFIX);
 }
 
 void media_state_free(MediaState **ps)
@@ -60,16 +110,21 @@ void media_state_free(MediaState **ps)
 
     s = *ps;
 
-    SDL_CloseAudio();
+    //stop the threads first, they still use everything below
+    media_stop(s);
 
-    if (s->display)
-        SDL_DestroyWindow(s->display);
+    //waits for a running callback to return
+    audio_sink_free(&s->audio_sink);
+
+    for (int i = 0; i < VIDEO_TEXTURE_COUNT; i++) {
+        if (s->textures[i])
+            SDL_DestroyTexture(s->textures[i]);
+    }
+    subtitle_atlas_free(&s->subtitle_atlas);
     if (s->render)
         SDL_DestroyRenderer(s->render);
-    if (s->texture)
-        SDL_DestroyTexture(s->texture);
-
-    SDL_Quit();
+    if (s->display)
+        SDL_DestroyWindow(s->display);
 
     if (s->pkt.data)
         av_packet_unref(&s->pkt);
@@ -80,17 +135,22 @@ void media_state_free(MediaState **ps)
     if (s->audio_out_frame) //avframe free
         av_frame_free(&s->audio_out_frame);
 
-    if (s->audio_codec_ctx) //audio context
-        avcodec_close(s->audio_codec_ctx);
+    if (s->video_decode_frame)
+        av_frame_free(&s->video_decode_frame);
 
-    if (s->video_out_frame)
-        av_frame_free(&s->video_out_frame);
+    if (s->video_show_frame)
+        av_frame_free(&s->video_show_frame);
 
-    if (s->video_codec_ctx) //video context
-        avcodec_close(s->video_codec_ctx);
-
-    if (s->ic) //format context
-        avformat_close_input(&s->ic);
+    //the files with their codecs, every decoder has stopped
+    while (s->items) {
+        MediaItem *next = s->items->next;
+        media_item_free(&s->items);
+        s->items = next;
+    }
+    media_item_free(&s->next_item);
+    timeshift_free(&s->timeshift);
+    flight_recorder_free(&s->flight);
+    clip_export_free(&s->export_job);
 
     if (s->swr_ctx) //swr free
         swr_free(&s->swr_ctx);
@@ -98,80 +158,201 @@ void media_state_free(MediaState **ps)
     if (s->audio_buf) //buff free
         av_freep(&s->audio_buf);
 
-    if (s->sws_ctx)
-        sws_freeContext(s->sws_ctx);
+    audio_ring_free(&s->audio_ring);
 
-    if (s->video_buf)
-        av_freep(&s->video_buf);
+    if (s->converter)
+        video_converter_free(&s->converter);
 
-    packet_queue_flush(&s->video_packet_queue);
-    packet_queue_flush(&s->audio_packet_queue);
+    video_sink_free(&s->video_sink);
+    video_filter_free(&s->video_filter);
+
+    packet_queue_destroy(&s->video_packet_queue);
+    packet_queue_destroy(&s->audio_packet_queue);
+    packet_queue_destroy(&s->subtitle_packet_queue);
+    subtitle_queue_destroy(&s->subtitle_queue);
+    frame_queue_destroy(&s->video_frame_queue);
+    //after the codecs are closed, buffers still out keep their pool alive
+    frame_pool_uninit(&s->video_frame_pool);
+    frame_pool_uninit(&s->audio_frame_pool);
+    thread_task_group_destroy(&s->tasks);
 
     av_free(s);
 
     *ps = NULL;
 }
 
-int media_open_input_file(MediaState **ps, const char *filename)
+static MediaItem *media_item_alloc(const char *filename)
 {
-    MediaState *s = *ps;
+    MediaItem *item = (MediaItem *)av_mallocz(sizeof(MediaItem));
+    if (!item)
+        return NULL;
+
+    item->filename = av_strdup(filename);
+    if (!item->filename) {
+        av_free(item);
+        return NULL;
+    }
+    item->audio_stream_index = -1;
+    item->video_stream_index = -1;
+    item->subtitle_stream_index = -1;
 
-    if (!s && !(s = media_state_alloc()))
-        return -1;
+    return item;
+}
+
+void media_item_free(MediaItem **pitem)
+{
+    MediaItem *item;
+
+    if (!pitem || !*pitem)
+        return;
+
+    item = *pitem;
 
+    if (item->ic) {
+        for (unsigned int i = 0; i < item->ic->nb_streams; i++)
+            avcodec_close(item->ic->streams[i]->codec);
+        avformat_close_input(&item->ic);
+    }
+    av_freep(&item->filename);
+    av_freep(pitem);
+}
+
+//move *cur along the chain up to item, the demuxer closes a file once every
+//decoder has left it
+void media_item_leave(MediaItem **cur, MediaItem *item)
+{
+    while (*cur != item) {
+        MediaItem *next = (*cur)->next;
+        SDL_AtomicAdd(&(*cur)->nb_left, 1);
+        *cur = next;
+    }
+}
+
+//open and probe the file and open a decoder for each stream, the frames come
+//from the session's pools
+static int media_item_open(MediaState *s, MediaItem *item)
+{
+    AVStream *first;
     int ret;
 
     // open file and read information
-    ret = avformat_open_input(&s->ic, filename, NULL, NULL);
+    ret = avformat_open_input(&item->ic, item->filename, NULL, NULL);
     if (ret < 0) {
         printf("open file failed, the file path may be invalid!");
-        goto clean; // open failed
+        return ret; // open failed
     }
 
-    s->ic->interrupt_callback.callback = interrupt_cb; //callback
-    s->ic->interrupt_callback.opaque = s;
+    item->ic->interrupt_callback.callback = interrupt_cb; //callback
+    item->ic->interrupt_callback.opaque = s;
 
     // stream infomation
-    ret = avformat_find_stream_info(s->ic, NULL);
+    ret = avformat_find_stream_info(item->ic, NULL);
     if (ret < 0) {
         printf("has no audio and video stream!");
-        goto clean; // no stream information
+        return ret; // no stream information
     }
 
     // dump video information
-    av_dump_format(s->ic, 0, filename, 0);
+    av_dump_format(item->ic, 0, item->filename, 0);
 
     //find video and audio stream
-    s->audio_stream_index = -1;
-    s->video_stream_index = -1;
-    for (unsigned int i = 0; i < s->ic->nb_streams; i++) {
-        AVStream *stream = s->ic->streams[i];
+    for (unsigned int i = 0; i < item->ic->nb_streams; i++) {
+        AVStream *stream = item->ic->streams[i];
         AVCodecContext *c = stream->codec;
         AVCodec *codec = avcodec_find_decoder(c->codec_id);
         if (!codec) {
-            ret = -1;
             printf("unsupported %d codec!", c->codec_type);
-            goto clean;
+            return -1;
         }
 
+        //decoded frames are queued, so they must own their buffers
+        c->refcounted_frames = 1;
+        if (c->codec_type == AVMEDIA_TYPE_VIDEO)
+            frame_pool_attach(&s->video_frame_pool, c);
+        else if (c->codec_type == AVMEDIA_TYPE_AUDIO)
+            frame_pool_attach(&s->audio_frame_pool, c);
+        else if (c->codec_type == AVMEDIA_TYPE_SUBTITLE)
+            c->pkt_timebase = stream->time_base; //text decoders time their events with it
+
         ret = avcodec_open2(c, codec, NULL); //open
         if (ret < 0) {
             printf("cannot open %d codec!", c->codec_type);
-            goto clean;
+            return ret;
         }
 
         if (c->codec_type == AVMEDIA_TYPE_VIDEO) {
-            s->video_stream_index = i;
-            s->video_stream = stream;
-            s->video_codec_ctx = c;
-            s->video_codec = codec;
+            item->video_stream_index = i;
+            item->video_stream = stream;
+            item->video_codec = codec;
         } else if (c->codec_type == AVMEDIA_TYPE_AUDIO) {
-            s->audio_stream_index = i;
-            s->audio_stream = stream;
-            s->audio_codec_ctx = c;
-            s->audio_codec = codec;
+            item->audio_stream_index = i;
+            item->audio_stream = stream;
+            item->audio_codec = codec;
+        } else if (c->codec_type == AVMEDIA_TYPE_SUBTITLE && item->subtitle_stream_index == -1) {
+            item->subtitle_stream_index = i;
+            item->subtitle_stream = stream;
         }
     }
+
+    //the audio goes on without a gap at a splice, so its pts set the timeline
+    first = item->audio_stream ? item->audio_stream : item->video_stream;
+    if (first && first->start_time != AV_NOPTS_VALUE)
+        item->start_time = first->start_time * av_q2d(first->time_base);
+    else if (item->ic->start_time != AV_NOPTS_VALUE)
+        item->start_time = (double)item->ic->start_time / AV_TIME_BASE;
+
+    return 0;
+}
+
+int media_open_input_file(MediaState **ps, const char *filename)
+{
+    MediaState *s = *ps;
+    MediaItem *item;
+
+    if (!s && !(s = media_state_alloc()))
+        return -1;
+
+    int ret = -1;
+
+    item = media_item_alloc(filename);
+    if (!item)
+        goto clean;
+    s->items = item;
+
+    ret = media_item_open(s, item);
+    if (ret < 0)
+        goto clean;
+
+    s->demux_item = s->audio_item = s->video_item = s->subtitle_item = item;
+    s->ic = item->ic;
+
+    if (item->video_stream) {
+        s->video_stream_index = item->video_stream_index;
+        s->video_stream = item->video_stream;
+        s->video_codec_ctx = item->video_stream->codec;
+        s->video_codec = item->video_codec;
+        s->video_width = s->video_codec_ctx->width;
+        s->video_height = s->video_codec_ctx->height;
+        atomic_value_set_int64(&s->video_next_size, (int64_t)s->video_width << 32 | s->video_height);
+
+        s->video_decode_frame = av_frame_alloc();
+        s->video_show_frame = av_frame_alloc();
+        if (!s->video_decode_frame || !s->video_show_frame) {
+            ret = -1;
+            goto clean;
+        }
+    }
+    if (item->audio_stream) {
+        s->audio_stream_index = item->audio_stream_index;
+        s->audio_stream = item->audio_stream;
+        s->audio_codec_ctx = item->audio_stream->codec;
+        s->audio_codec = item->audio_codec;
+    }
+    if (item->subtitle_stream) {
+        s->subtitle_stream_index = item->subtitle_stream_index;
+        s->subtitle_stream = item->subtitle_stream;
+        s->subtitle_codec_ctx = item->subtitle_stream->codec;
+    }
     *ps = s;
     return 0;
 
@@ -181,32 +362,74 @@ clean:
     return ret;
 }
 
-int media_create_video_display(MediaState *s, void *handle)
+static int media_prepare_callback(void *userdata)
 {
-    if (!s || !s->video_codec_ctx)
+    MediaState *s = (MediaState *)userdata;
+    double start = clock_time();
+
+    if (media_item_open(s, s->next_item) < 0) {
+        printf("%s: cannot be queued\n", s->next_item->filename);
+        media_item_free(&s->next_item);
+        SDL_AtomicSet(&s->next_state, MEDIA_NEXT_FAILED);
         return -1;
+    }
 
-    s->video_out_frame = av_frame_alloc();
-    if (!s->video_out_frame)
-        goto clean;
+    s->next_item->prepare_time = clock_time() - start;
+    SDL_AtomicSet(&s->next_state, MEDIA_NEXT_READY);
 
-    //convert YUV
-    s->sws_ctx = sws_getContext(s->video_codec_ctx->width, s->video_codec_ctx->height,
-                                s->video_codec_ctx->pix_fmt,
-                                s->video_codec_ctx->width, s->video_codec_ctx->height,
-                                s->display_pix_fmt,
-                                SWS_BICUBIC, NULL, NULL, NULL);
-    if (!s->sws_ctx)
-        goto clean;
+    return 0;
+}
 
-    s->video_buf_size = avpicture_get_size(s->display_pix_fmt, s->video_codec_ctx->width, s->video_codec_ctx->height);
+//open filename on a background thread while the session plays, the demuxer
+//continues with it at the end of the current file when it has the same kinds
+//of streams. the window, textures, audio device, scaler and resampler stay, the
+//decoders are opened ahead. one file can wait at a time
+int media_queue_next(MediaState *s, const char *filename)
+{
+    int state;
 
-    s->video_buf = (uint8_t *)av_malloc(s->video_buf_size * sizeof(uint8_t));
+    //the ring holds the packets of one input
+    if (!s || !filename || !s->items || s->timeshift)
+        return -1;
 
-    if (avpicture_fill((AVPicture *)s->video_out_frame, s->video_buf,
-                       s->display_pix_fmt,
-                       s->video_codec_ctx->width, s->video_codec_ctx->height) < 0)
-        goto clean;
+    state = SDL_AtomicGet(&s->next_state);
+    if (state == MEDIA_NEXT_OPENING || state == MEDIA_NEXT_READY)
+        return -1;
+
+    if (s->prepare_tid) {
+        SDL_WaitThread(s->prepare_tid, NULL);
+        s->prepare_tid = NULL;
+    }
+
+    s->next_item = media_item_alloc(filename);
+    if (!s->next_item)
+        return -1;
+
+    SDL_AtomicSet(&s->next_state, MEDIA_NEXT_OPENING);
+    s->prepare_tid = SDL_CreateThread(media_prepare_callback, "prepare", s);
+    if (!s->prepare_tid) {
+        printf("create thread failed: %s", SDL_GetError());
+        media_item_free(&s->next_item);
+        SDL_AtomicSet(&s->next_state, MEDIA_NEXT_NONE);
+        return -1;
+    }
+
+    return 0;
+}
+
+//enum MediaNextState, NONE again once the demuxer took the queued file
+int media_next_state(MediaState *s)
+{
+    if (!s)
+        return MEDIA_NEXT_NONE;
+
+    return SDL_AtomicGet(&s->next_state);
+}
+
+int media_create_video_display(MediaState *s, void *handle)
+{
+    if (!s || !s->video_codec_ctx || s->compositor)
+        return -1;
 
     s->r.x = 0;
     s->r.y = 0;
@@ -226,30 +449,112 @@ int media_create_video_display(MediaState *s, void *handle)
     s->render = SDL_CreateRenderer(s->display, -1, 0);
     if (!s->render)
          goto clean;
-    s->texture = SDL_CreateTexture(s->render, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, s->r.w, s->r.h);
-    if (!s->texture)
+    if (video_alloc_textures(s, s->r.w, s->r.h) < 0)
          goto clean;
 
+    //a foreign window keeps its own size
+    SDL_GetWindowSize(s->display, &s->r.w, &s->r.h);
+    media_update_output_size(s, s->r.w, s->r.h);
+
     return 0;
 
 clean:
-    if (s->video_out_frame)
-        av_frame_free(&s->video_out_frame);
-    if (s->sws_ctx)
-        sws_freeContext(s->sws_ctx);
-    if (s->video_buf)
-        av_freep(&s->video_buf);
-
-    if (s->display)
-        SDL_DestroyWindow(s->display);
-    if (s->render)
+    for (int i = 0; i < VIDEO_TEXTURE_COUNT; i++) {
+        if (s->textures[i]) {
+            SDL_DestroyTexture(s->textures[i]);
+            s->textures[i] = NULL;
+        }
+    }
+    if (s->render) {
         SDL_DestroyRenderer(s->render);
-    if (s->texture)
-        SDL_DestroyTexture(s->texture);
+        s->render = NULL;
+    }
+    if (s->display) {
+        SDL_DestroyWindow(s->display);
+        s->display = NULL;
+    }
 
     return -1;
 }
 
+//draw into a tile of a shared compositor instead of an own window, the
+//frames are downscaled to the tile while converting
+int media_attach_compositor(MediaState *s, Compositor *c, int tile)
+{
+    if (!s || !c || !s->video_codec_ctx || s->display || s->compositor)
+        return -1;
+
+    if (compositor_tile_rect(c, tile, s->video_codec_ctx->width, s->video_codec_ctx->height, &s->tile) < 0)
+        return -1;
+
+    s->compositor = c;
+    s->out_w = s->tile.w;
+    s->out_h = s->tile.h;
+    media_publish_output_size(s);
+
+    return 0;
+}
+
+//fit the source into a w x h area, the decoder and the scaler then work at that
+//size instead of the full source resolution. never upscale, SDL does it for free
+void media_update_output_size(MediaState *s, int w, int h)
+{
+    if (!s->video_width || !s->video_height || w <= 0 || h <= 0)
+        return;
+
+    double ratio = media_video_ratio(s);
+    int out_w, out_h;
+
+    if ((double)w / h > ratio) {
+        out_h = h;
+        out_w = h * ratio;
+    } else {
+        out_w = w;
+        out_h = w / ratio;
+    }
+
+    if (out_w > s->video_width || out_h > s->video_height) {
+        out_w = s->video_width;
+        out_h = s->video_height;
+    }
+
+    //chroma planes of the display format are half size
+    s->out_w = FFMAX(out_w & ~1, 2);
+    s->out_h = FFMAX(out_h & ~1, 2);
+    media_publish_output_size(s);
+}
+
+//display aspect ratio of the picture, the sample aspect ratio a filter set included
+double media_video_ratio(MediaState *s)
+{
+    double ratio = (double)s->video_width / s->video_height;
+
+    if (s->video_sar.num > 0 && s->video_sar.den > 0)
+        ratio *= av_q2d(s->video_sar);
+
+    return ratio;
+}
+
+//the sizes are written by the event loop, the video decoder picks its lowres
+//from them as one snapshot
+void media_publish_output_size(MediaState *s)
+{
+    atomic_value_set_int64(&s->video_scale_size,
+                           (int64_t)(s->video_width & 0xffff) << 48 | (int64_t)(s->video_height & 0xffff) << 32
+                           | (int64_t)(s->out_w & 0xffff) << 16 | (s->out_h & 0xffff));
+}
+
+//low, balanced or power, must be called before media_open_audio_device
+int media_set_audio_latency(MediaState *s, int latency)
+{
+    if (!s || audio_sink_is_open(s->audio_sink) || latency < 0 || latency >= AUDIO_LATENCY_COUNT)
+        return -1;
+
+    s->audio_latency = latency;
+
+    return 0;
+}
+
 int media_open_audio_device(MediaState *s)
 {
     if (!s || !s->audio_codec_ctx)
@@ -258,16 +563,50 @@ int media_open_audio_device(MediaState *s)
     // Set audio settings from codec info
     SDL_AudioSpec wanted_spec, spec;
     if (s->audio_stream_index != -1) {
+        const AudioLatencyProfile *profile = &audio_latency_profiles[s->audio_latency];
+        enum AVSampleFormat out_fmt;
+        int samples = 1, ring_size, default_sink = 0;
+
+        //sdl wants a power of two
+        while (samples < profile->device_ms * s->audio_codec_ctx->sample_rate / 1000)
+            samples <<= 1;
+
         wanted_spec.freq = s->audio_codec_ctx->sample_rate;
-        wanted_spec.format = AUDIO_S16SYS;
+        //float decoders stay float when the device takes it, the rest go out as s16
+        wanted_spec.format = av_get_packed_sample_fmt(s->audio_codec_ctx->sample_fmt) == AV_SAMPLE_FMT_FLT
+                ? AUDIO_F32SYS : AUDIO_S16SYS;
         wanted_spec.channels = s->audio_codec_ctx->channels;
         wanted_spec.silence = 0;
-        wanted_spec.samples = SDL_AUDIO_BUFFER_SIZE;
+        wanted_spec.samples = samples;
         wanted_spec.callback = audio_callback;
         wanted_spec.userdata = s;
 
-        if (SDL_OpenAudio(&wanted_spec, &spec) < 0) {
-            printf("open audio device failed: %s", SDL_GetError());
+        //every session owns its device, so several players can share the process.
+        //the device may pick its own format, rate, channels and buffer, the
+        //resampler converts to whatever it obtained
+        if (!s->audio_sink) {
+            default_sink = 1;
+            s->audio_sink = audio_sink_sdl_create();
+        }
+        if (audio_sink_open(s->audio_sink, &wanted_spec, &spec, SDL_AUDIO_ALLOW_ANY_CHANGE) == 0
+                && spec.format != AUDIO_F32SYS && spec.format != AUDIO_S16SYS) {
+            //a sample type we don't produce, sdl converts from s16 then
+            audio_sink_close(s->audio_sink);
+            wanted_spec.format = AUDIO_S16SYS;
+            audio_sink_open(s->audio_sink, &wanted_spec, &spec,
+                            SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE
+                            | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+        }
+        if (!audio_sink_is_open(s->audio_sink) && default_sink) {
+            //no sound card, the samples are still consumed in real time so the
+            //audio clock paces the session as usual
+            printf("no audio device, playing to the null sink\n");
+            audio_sink_free(&s->audio_sink);
+            s->audio_sink = audio_sink_null_create();
+            audio_sink_open(s->audio_sink, &wanted_spec, &spec, SDL_AUDIO_ALLOW_ANY_CHANGE);
+        }
+        if (!audio_sink_is_open(s->audio_sink)) {
+            printf("open audio sink failed\n");
             return -1;
         }
 
@@ -276,22 +615,161 @@ int media_open_audio_device(MediaState *s)
         s->audio_out_frame = av_frame_alloc();
         s->wanted_frame = av_frame_alloc();
 
-        s->wanted_frame->format = AV_SAMPLE_FMT_S16;
+        out_fmt = spec.format == AUDIO_F32SYS ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16;
+        s->wanted_frame->format = out_fmt;
         s->wanted_frame->sample_rate = spec.freq;
         s->wanted_frame->channel_layout = av_get_default_channel_layout(spec.channels);
         s->wanted_frame->channels = spec.channels;
 
-        SDL_PauseAudio(0);
+        s->audio_hw_buf_size = spec.size;
+        s->audio_bytes_per_sec = av_samples_get_buffer_size(NULL, spec.channels, spec.freq, out_fmt, 1);
+        s->audio_fill_delay = FFMAX(1, spec.samples * 500 / spec.freq);
+
+        //whole sample frames, at least a few device buffers
+        ring_size = FFMAX(profile->lead_ms * s->audio_bytes_per_sec / 1000, 4 * (int)spec.size);
+        ring_size -= ring_size % (spec.channels * av_get_bytes_per_sample(out_fmt));
+
+        s->audio_interleave = audio_kernel_interleave(av_get_planar_sample_fmt(out_fmt), -1);
+        s->audio_gain_func = audio_kernel_gain(out_fmt, -1);
+        s->audio_gain = (float)SDL_AtomicGet(&s->vol) / SDL_MIX_MAXVOLUME;
+
+        if (!s->audio_buf || !s->audio_out_frame || !s->wanted_frame
+                || audio_ring_init(&s->audio_ring, ring_size) < 0) {
+            printf("audio buffers alloc failed\n");
+            audio_sink_close(s->audio_sink);
+            return -1;
+        }
+
+        printf("audio: %s sink, %s latency, %s %d Hz, %d channels, %d samples device buffer (%.1f ms), %d ms decoded ahead\n",
+               s->audio_sink->name, profile->name, av_get_sample_fmt_name(out_fmt), spec.freq, spec.channels, spec.samples,
+               media_audio_latency(s) * 1000,
+               ring_size * 1000 / s->audio_bytes_per_sec);
+
+        audio_sink_pause(s->audio_sink, SDL_AtomicGet(&s->pause));
     }
 
     return 0;
 }
 
+//seconds the device buffer holds, the output latency the session really got
+double media_audio_latency(MediaState *s)
+{
+    if (!s || !audio_sink_is_open(s->audio_sink) || s->audio_bytes_per_sec <= 0)
+        return 0;
+
+    return (double)s->audio_hw_buf_size / s->audio_bytes_per_sec;
+}
+
+//number of samples to make of this frame so the audio clock moves towards the
+//master. only the averaged difference counts, single callbacks jitter too much
+static int audio_synchronize(MediaState *s, int nb_samples, int sample_rate)
+{
+    double diff, avg_diff;
+
+    if (media_sync_master(s) == CLOCK_SYNC_AUDIO)
+        return nb_samples;
+
+    diff = clock_get(&s->audio_clk) - media_master_clock(s);
+    if (isnan(diff) || fabs(diff) >= CLOCK_NOSYNC_THRESHOLD) {
+        s->audio_diff_avg_count = 0;
+        s->audio_diff_cum = 0;
+        return nb_samples;
+    }
+
+    s->audio_diff_cum = diff + s->audio_diff_avg_coef * s->audio_diff_cum;
+    if (s->audio_diff_avg_count < AUDIO_DIFF_AVG_NB) {
+        s->audio_diff_avg_count++;
+        return nb_samples;
+    }
+
+    //corrections smaller than the device buffer would not be heard anyway
+    avg_diff = s->audio_diff_cum * (1.0 - s->audio_diff_avg_coef);
+    if (fabs(avg_diff) < (double)s->audio_hw_buf_size / s->audio_bytes_per_sec)
+        return nb_samples;
+
+    //audio ahead of the master gets more samples, so it lasts longer
+    return av_clip(nb_samples + (int)(diff * sample_rate),
+                   nb_samples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100,
+                   nb_samples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100);
+}
+
+//the frame is already at the device rate, channels and sample type, so it only
+//needs interleaving. the resampler stays for rate or layout changes and drift
+//correction, and is only bypassed once it has no samples buffered
+static int audio_passthrough(MediaState *s, AVFrame *frame, int wanted_nb_samples)
+{
+    int channels = frame->channels;
+
+    return frame->sample_rate == s->wanted_frame->sample_rate
+            && channels == s->wanted_frame->channels
+            //ffmpeg and sdl order the channels of these alike
+            && (channels == 1 || channels == 2 || channels == 6 || channels == 8)
+            && av_get_packed_sample_fmt((AVSampleFormat)frame->format) == s->wanted_frame->format
+            && wanted_nb_samples == frame->nb_samples
+            && (!s->swr_ctx || swr_get_delay(s->swr_ctx, frame->sample_rate) == 0);
+}
+
+static int audio_frame_interleave(MediaState *s, AVFrame *frame, uint8_t *audio_buf, int buf_size)
+{
+    int size = av_samples_get_buffer_size(NULL, frame->channels, frame->nb_samples,
+                                          (AVSampleFormat)s->wanted_frame->format, 1);
+    if (size < 0 || size > buf_size)
+        return -1;
+
+    if (av_sample_fmt_is_planar((AVSampleFormat)frame->format))
+        s->audio_interleave(audio_buf, (const uint8_t *const *)frame->extended_data, frame->channels, frame->nb_samples);
+    else
+        memcpy(audio_buf, frame->data[0], size);
+
+    return size;
+}
+
 //if the network is poor, running frequently
 int interrupt_cb(void *ctx)
 {
-   (MediaState *)ctx;
-   return 0;
+   MediaState *s = (MediaState *)ctx;
+   return SDL_AtomicGet(&s->quit); //abort blocking io when the session is torn down
+}
+
+//the resampler is kept across frames and only rebuilt when the decoded format
+//changes, this also keeps its buffered samples
+static int audio_resampler_config(MediaState *s, AVFrame *frame)
+{
+    if (s->swr_ctx && s->swr_in_layout == (int64_t)frame->channel_layout
+            && s->swr_in_format == frame->format && s->swr_in_rate == frame->sample_rate)
+        return 0;
+
+    swr_free(&s->swr_ctx);
+    s->swr_ctx = swr_alloc_set_opts(NULL,
+                                    s->wanted_frame->channel_layout,
+                                    (AVSampleFormat)s->wanted_frame->format,
+                                    s->wanted_frame->sample_rate,
+                                    frame->channel_layout,
+                                    (AVSampleFormat)frame->format,
+                                    frame->sample_rate, 0, NULL);
+    if (!s->swr_ctx || swr_init(s->swr_ctx) < 0) {
+        swr_free(&s->swr_ctx);
+        return -1;
+    }
+
+    s->swr_in_layout = frame->channel_layout;
+    s->swr_in_format = frame->format;
+    s->swr_in_rate = frame->sample_rate;
+
+    return 0;
+}
+
+//the packets after a marker belong to item, the decoder leaves the files before it
+static void audio_switch_item(MediaState *s, MediaItem *item)
+{
+    if (item == s->audio_item)
+        return;
+
+    media_item_leave(&s->audio_item, item);
+    s->audio_stream = item->audio_stream;
+    s->audio_codec_ctx = item->audio_stream->codec;
+    s->audio_codec = item->audio_codec;
+    s->audio_pts_offset = item->offset;
 }
 
 //decode audio data
@@ -299,7 +777,7 @@ int audio_decode_frame(MediaState* s, uint8_t *audio_buf, int buf_size)
 {
     UNUSED(buf_size);
 
-    if (s->quit || s->seek_req)
+    if (SDL_AtomicGet(&s->quit) || SDL_AtomicGet(&s->seek_req))
         return -1;
 
 #if 1
@@ -308,38 +786,50 @@ int audio_decode_frame(MediaState* s, uint8_t *audio_buf, int buf_size)
     packet->data = NULL;
     packet->size = 0;
 
-    if (packet_queue_get(&s->audio_packet_queue, packet, 0) <= 0) //get packet from queue
+    //the previous file ends, empty packets return what the codec still holds
+    if (!s->audio_switch && packet_queue_get(&s->audio_packet_queue, packet, 0) <= 0) //get packet from queue
         return -1;
+    if (!s->audio_switch)
+        flight_recorder_mark(s->flight, FLIGHT_PACKET_GET, s->audio_stream_index);
 
     //receive FLUSH data to flush codec, because of seeking
-    if(strcmp((char *)packet->data, FLUSH_DATA) == 0) {
-        avcodec_flush_buffers(s->audio_stream->codec);
-        //av_packet_unref(packet);  //快进时free会崩溃
+    if (!s->audio_switch && strcmp((char *)packet->data, FLUSH_DATA) == 0) {
+        //the seek may have gone into a file the decoder has not reached yet
+        audio_switch_item(s, demux_marker_item(packet));
+        avcodec_flush_buffers(s->audio_codec_ctx);
+        audio_ring_flush(&s->audio_ring);
+        s->audio_buf_index = s->audio_buf_size = 0;
+        s->audio_clock = NAN;
+        s->audio_diff_avg_count = 0;
+        s->audio_diff_cum = 0;
+        av_packet_unref(packet);
         return -1;
     }
 
-    int ret, got_frame;
-    AVFrame *frame = NULL;
-    SwrContext *swr_ctx = NULL;
-
-    frame = av_frame_alloc();
-    if (!frame) {
-        ret = -1;
-        goto clean;
+    if (!s->audio_switch && strcmp((char *)packet->data, SWITCH_DATA) == 0) {
+        s->audio_switch = demux_marker_item(packet);
+        av_packet_unref(packet);
     }
 
-    ret = avcodec_decode_audio4(s->audio_codec_ctx, frame, &got_frame, packet);
-    if (ret < 0){
-        goto clean;
-    }
+    int ret, got_frame;
+    AVFrame *frame = s->audio_out_frame;
+    int wanted_nb_samples, dst_nb_samples, convert_len, resampled_data_size;
+    int64_t decode_start = flight_recorder_now(s->flight);
 
-    if (!got_frame) {
+    ret = avcodec_decode_audio4(s->audio_codec_ctx, frame, &got_frame, packet);
+    flight_recorder_watch(s->flight, FLIGHT_AUDIO_DECODE, decode_start, packet->size);
+    if (ret < 0 || !got_frame) {
+        //drained, the samples of the next file follow in the ring without a gap
+        if (s->audio_switch) {
+            audio_switch_item(s, s->audio_switch);
+            s->audio_switch = NULL;
+        }
         ret = -1;
         goto clean;
     }
 
     if (packet->pts != AV_NOPTS_VALUE) {
-        s->audio_clock = av_q2d(s->audio_stream->time_base) * packet->pts;
+        s->audio_clock = av_q2d(s->audio_stream->time_base) * packet->pts + s->audio_pts_offset;
     }
 
     if (frame->channels > 0 && frame->channel_layout == 0) {
@@ -348,47 +838,61 @@ int audio_decode_frame(MediaState* s, uint8_t *audio_buf, int buf_size)
         frame->channels = av_get_channel_layout_nb_channels(frame->channel_layout);
     }
 
-    swr_ctx = swr_alloc_set_opts(NULL,
-                                 s->wanted_frame->channel_layout,
-                                 (AVSampleFormat)s->wanted_frame->format,
-                                 s->wanted_frame->sample_rate,
-                                 frame->channel_layout,
-                                 (AVSampleFormat)frame->format,
-                                 frame->sample_rate, 0, NULL);
+    //stretch or squeeze the frame a little when audio follows another clock
+    wanted_nb_samples = audio_synchronize(s, frame->nb_samples, frame->sample_rate);
 
-    if (!swr_ctx || swr_init(swr_ctx) < 0) {
-        ret = -1;
-        printf("swr_init failed!\n");
-        goto clean;
-    }
+    if (audio_passthrough(s, frame, wanted_nb_samples)) {
+        resampled_data_size = audio_frame_interleave(s, frame, audio_buf, buf_size);
+        if (resampled_data_size < 0) {
+            ret = -1;
+            printf("audio frame too large\n");
+            goto clean;
+        }
+    } else {
+        if (audio_resampler_config(s, frame) < 0) {
+            ret = -1;
+            printf("swr_init failed!\n");
+            goto clean;
+        }
+
+        if (wanted_nb_samples != frame->nb_samples) {
+            if (swr_set_compensation(s->swr_ctx,
+                                     (wanted_nb_samples - frame->nb_samples) * s->wanted_frame->sample_rate / frame->sample_rate,
+                                     wanted_nb_samples * s->wanted_frame->sample_rate / frame->sample_rate) < 0) {
+                ret = -1;
+                printf("swr_set_compensation failed\n");
+                goto clean;
+            }
+        }
 
-    int dst_nb_samples = av_rescale_rnd(swr_get_delay(swr_ctx, frame->sample_rate) + frame->nb_samples,
-                                        frame->sample_rate,
+        dst_nb_samples = av_rescale_rnd(swr_get_delay(s->swr_ctx, frame->sample_rate) + wanted_nb_samples,
+                                        s->wanted_frame->sample_rate,
                                         frame->sample_rate, AVRounding(1));
 
-    int convert_len = swr_convert(swr_ctx, &audio_buf, dst_nb_samples,
+        convert_len = swr_convert(s->swr_ctx, &audio_buf, dst_nb_samples,
                                   (const uint8_t **)frame->data,
                                   frame->nb_samples);//important!!! in front of all are for this, here
-    if (convert_len < 0) {
-        ret = -1;
-        printf("swr_convert failed\n");
-        goto clean;
+        if (convert_len < 0) {
+            ret = -1;
+            printf("swr_convert failed\n");
+            goto clean;
+        }
+
+        resampled_data_size = convert_len * s->wanted_frame->channels * av_get_bytes_per_sample((AVSampleFormat)s->wanted_frame->format);
     }
 
 //[][]important!!! convert to audio clock
-    int resampled_data_size = convert_len * s->wanted_frame->channels * av_get_bytes_per_sample((AVSampleFormat)s->wanted_frame->format);
-    int n = 2 * s->audio_stream->codec->channels;
-    s->audio_clock += (double)resampled_data_size / (double)(n * s->audio_stream->codec->sample_rate);
+    //the clock follows the media time, a compensated frame still lasts nb_samples
+    if (!isnan(s->audio_clock))
+        s->audio_clock += (double)frame->nb_samples / frame->sample_rate;
 //[][]
 
     ret = resampled_data_size;
 
 clean:
     av_packet_unref(packet);
-    if (frame)
-        av_frame_free(&frame);
-    if (swr_ctx)
-        swr_free(&swr_ctx);
+    //the buffers go back to the audio frame pool
+    av_frame_unref(frame);
 
     return ret;
 #else
@@ -453,8 +957,7 @@ clean:
             }
 //[][]important!!! convert to audio clock
             int resampled_data_size = convert_len * s->wanted_frame->channels * av_get_bytes_per_sample((AVSampleFormat)s->wanted_frame->format);
-            int n = 2 * s->audio_stream->codec->channels;
-            s->audio_clock += (double)resampled_data_size / (double)(n * s->audio_stream->codec->sample_rate);
+            s->audio_clock += (double)convert_len / s->wanted_frame->sample_rate;
 //[][]
             return resampled_data_size;
         } //end while
@@ -481,127 +984,622 @@ clean:
 #endif
 }
 
-// audio call back after every decode operation
+//decode audio ahead of the device into the ring, returns <0 when the session
+//quits, 0 when the ring is full or there is no packet and 1 otherwise
+static int audio_fill_step(MediaState *s)
+{
+    int n, space, audio_size;
+    double end_pts;
+
+    if (SDL_AtomicGet(&s->quit))
+        return -1;
+
+    if (s->audio_buf_index >= s->audio_buf_size) {
+        audio_size = audio_decode_frame(s, s->audio_buf, MAX_AUDIO_FRAME_SIZE * 2);
+        if (audio_size <= 0)
+            return 0;
+        s->audio_buf_size = audio_size;
+        s->audio_buf_index = 0;
+    }
+
+    space = audio_ring_space(&s->audio_ring);
+    n = FFMIN(space, (int)(s->audio_buf_size - s->audio_buf_index));
+    if (n <= 0)
+        return 0;
+
+    //audio_clock is the end of audio_buf, the ring gets the pts after its part
+    end_pts = s->audio_clock - (double)(s->audio_buf_size - s->audio_buf_index - n) / s->audio_bytes_per_sec;
+    audio_ring_write(&s->audio_ring, s->audio_buf + s->audio_buf_index, n, end_pts);
+    s->audio_buf_index += n;
+
+    return 1;
+}
+
+//audio decoder thread of a session without thread pool
+static int audio_fill_callback(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    if (!s)
+        return -1;
+
+    int ret;
+    while ((ret = audio_fill_step(s)) >= 0) {
+        if (ret == 0)
+            SDL_Delay(s->audio_fill_delay);
+    }
+
+    return 0;
+}
+
+//audio decoder task of a session on the thread pool
+static void audio_fill_task(void *userdata)
+{
+    MediaState *s = (MediaState *)userdata;
+    int ret = 1;
+
+    for (int i = 0; i < AUDIO_FILL_TASK_FRAMES && ret > 0; i++)
+        ret = audio_fill_step(s);
+
+    if (ret < 0)
+        return;
+
+    media_submit_task(s, audio_fill_task, ret == 0 ? s->audio_fill_delay : 0);
+}
+
+//device callback, only copies what the fill step decoded ahead
 void audio_callback(void *userdata, uint8_t *stream, int len)
 {
     MediaState* s = (MediaState *)userdata;
-    if (s && s->quit)
+    double callback_time = clock_time();
+    double end_pts = NAN;
+    int n, queued = 0, ahead;
+    int sample_size, channels;
+    float gain;
+
+    //the device plays whatever is left in stream, so clear it before any early return
+    SDL_memset(stream, 0, len);
+
+    if (s && SDL_AtomicGet(&s->quit))
         return;
 
-	if (s && s->seek_req)
-		return;
+    if (s && SDL_AtomicGet(&s->seek_req))
+        return;
 
-    int send_data_size, audio_size;
+    int64_t flight_start = flight_recorder_now(s->flight);
+    int flight_len = len;
 
-    SDL_memset(stream, 0, len);
+    sample_size = av_get_bytes_per_sample((AVSampleFormat)s->wanted_frame->format);
+    channels = s->wanted_frame->channels;
+    gain = (float)SDL_AtomicGet(&s->vol) / SDL_MIX_MAXVOLUME;
+    ahead = s->audio_sink->delay_bytes + len;
 
+    //straight into the device buffer, the volume is applied in place
     while (len > 0) {
-        //uint8_t audio_buff[MAX_AUDIO_FRAME_SIZE * 2];
-
-        if (s->audio_buf_index >= s->audio_buf_size) {
-            //数据已经全部发送，再去取
-            audio_size = audio_decode_frame(s, s->audio_buf, sizeof(s->audio_buf));
-
-            if (audio_size < 0) {
-                //错误则静音一下
-                s->audio_buf_size = 1024;
-                SDL_memset(s->audio_buf, 0, s->audio_buf_size);
-            } else {
-                //解码这么多
-                s->audio_buf_size = audio_size;
+        n = audio_ring_read(&s->audio_ring, stream, FFMIN(len, s->audio_hw_buf_size), &queued, &end_pts);
+        if (n <= 0) {
+            //the decoder fell behind. an empty ring without pts is the start or a
+            //seek, nothing was lost there
+            if (!isnan(end_pts)) {
+                SDL_AtomicAdd(&s->nb_underruns, 1);
+                flight_recorder_trip(s->flight, FLIGHT_UNDERRUN, len);
             }
-            s->audio_buf_index = 0;
+            break;
         }
 
-        send_data_size = s->audio_buf_size - s->audio_buf_index;
-        if (send_data_size > len)
-            send_data_size = len;
+        audio_gain_ramp(s->audio_gain_func, stream, n / (sample_size * channels), channels, sample_size, s->audio_gain, gain);
+        s->audio_gain = gain;
 
-        SDL_MixAudio(stream, s->audio_buf + s->audio_buf_index, send_data_size, s->vol);
+        len -= n;
+        stream += n;
+    }
 
-        len -= send_data_size;
-        stream += send_data_size;
-        s->audio_buf_index += send_data_size;
+    //end_pts is the end of the ring. what is audible now lies behind it by the rest
+    //of the ring, the stream just written and what the sink still plays before it
+    if (!isnan(end_pts) && s->audio_bytes_per_sec > 0) {
+        clock_set_at(&s->audio_clk, end_pts - (double)(ahead + queued) / s->audio_bytes_per_sec,
+                     callback_time);
+        clock_sync_to_slave(&s->ext_clk, &s->audio_clk);
     }
+
+    flight_recorder_span(s->flight, FLIGHT_AUDIO_CALLBACK, flight_start, flight_len);
 }
 
-int media_play(MediaState *s)
+//play the samples through sink instead of the sdl device, the session owns it
+//once this returns 0. must be called before media_open_audio_device
+int media_set_audio_sink(MediaState *s, AudioSink *sink)
 {
-    if (!s || !s->ic)
+    if (!s || !sink || audio_sink_is_open(s->audio_sink))
         return -1;
 
-    SDL_Thread *demux = SDL_CreateThread(demux_callback, "demuxer", s);
-    SDL_Thread *refresh = SDL_CreateThread(refresh_callback, "refresh", s);
+    audio_sink_free(&s->audio_sink);
+    s->audio_sink = sink;
 
-    SDL_Event event;
-    while(1) {
-        if (s->quit) {
+    return 0;
+}
+
+//hand the frames to sink instead of the window, the session owns it once this
+//returns 0. must be called before media_start
+int media_set_video_sink(MediaState *s, VideoSink *sink)
+{
+    if (!s || !sink || s->demux_tid || SDL_AtomicGet(&s->tasks.pending))
+        return -1;
+
+    video_sink_free(&s->video_sink);
+    s->video_sink = sink;
+
+    return 0;
+}
+
+//run decoded frames through a libavfilter graph like "yadif,crop=1280:720" before
+//they are shown, the graph slices on nb_threads (0 is one per cpu). must be called
+//before media_start
+int media_set_video_filter(MediaState *s, const char *desc, int nb_threads)
+{
+    VideoFilter *f;
+
+    if (!s || !desc || s->demux_tid || SDL_AtomicGet(&s->tasks.pending))
+        return -1;
+
+    f = video_filter_create(desc, nb_threads);
+    if (!f)
+        return -1;
+
+    video_filter_free(&s->video_filter);
+    s->video_filter = f;
+
+    return 0;
+}
+
+//record the input into a ring file of size bytes at path and play from there, a
+//pause or a rewind no longer holds up the source. realtime reads a file at the
+//pace of its timestamps to stand in for a live input. must be called before
+//media_start
+int media_set_timeshift(MediaState *s, const char *path, int64_t size, int realtime)
+{
+    TimeShift *ts;
+
+    if (!s || !s->ic || s->demux_tid || SDL_AtomicGet(&s->tasks.pending) || s->next_item)
+        return -1;
+
+    //seeks land on video key frames, any audio packet will do without video
+    ts = timeshift_create(path, size, TIMESHIFT_MAX_PACKETS,
+                          s->video_stream_index != -1 ? s->video_stream_index : s->audio_stream_index);
+    if (!ts)
+        return -1;
+
+    timeshift_free(&s->timeshift);
+    s->timeshift = ts;
+    s->record_realtime = realtime;
+
+    return 0;
+}
+
+//automatic dumps go to <prefix>-<session>-<n>.json, NULL or "" only records.
+//a decode or a held picture over stall_ms and a seek over seek_ms trip a dump,
+//0 keeps the defaults. must be called before media_start
+int media_set_flight_recorder(MediaState *s, const char *prefix, int stall_ms, int seek_ms)
+{
+    if (!s || !s->flight || s->demux_tid || SDL_AtomicGet(&s->tasks.pending))
+        return -1;
+
+    snprintf(s->flight->prefix, sizeof(s->flight->prefix), "%s", prefix ? prefix : "");
+    if (stall_ms > 0)
+        s->flight->stall_ms = stall_ms;
+    if (seek_ms > 0)
+        s->flight->seek_ms = seek_ms;
+
+    return 0;
+}
+
+//write the recent events now, path NULL names the file after the session
+int media_dump_flight(MediaState *s, const char *path)
+{
+    char name[64];
+
+    if (!s || !s->flight)
+        return -1;
+
+    if (!path) {
+        snprintf(name, sizeof(name), "%s-%d-%u.json", FLIGHT_PREFIX, s->flight->id, SDL_GetTicks());
+        path = name;
+    }
+
+    return flight_recorder_dump(s->flight, path, "on demand");
+}
+
+//copy in..out (session time, AV_TIME_BASE) of the file the demuxer is on to path
+//without decoding, the clip starts at the key frame before in. runs on its own
+//thread next to playback, one export at a time
+int media_export_clip(MediaState *s, const char *path, int64_t in, int64_t out)
+{
+    ClipExport *ce;
+    MediaItem *item;
+    int64_t offset;
+    char *filename;
+
+    if (!s || !s->items || !path)
+        return -1;
+
+    //a live input can't be opened a second time, its ring only holds packets
+    if (s->timeshift) {
+        printf("no clip export from a timeshifted session\n");
+        return -1;
+    }
+
+    if (s->export_tid) {
+        if (SDL_AtomicGet(&s->export_job->state) == CLIP_EXPORT_RUNNING)
+            return -1;
+        SDL_WaitThread(s->export_tid, NULL);
+        s->export_tid = NULL;
+    }
+
+    //the file in belongs to, a file ends where the next one starts. the demuxer
+    //moves along the chain on its own, it only changes it under the lock
+    SDL_AtomicLock(&s->items_lock);
+    for (item = s->items; item->next; item = item->next) {
+        if (in < (int64_t)((item->next->offset + item->next->start_time) * AV_TIME_BASE))
             break;
+    }
+    offset = (int64_t)(item->offset * AV_TIME_BASE);
+    filename = av_strdup(item->filename);
+    SDL_AtomicUnlock(&s->items_lock);
+
+    ce = clip_export_create(filename, path, FFMAX(in - offset, 0), out - offset);
+    av_freep(&filename);
+    if (!ce)
+        return -1;
+
+    clip_export_free(&s->export_job);
+    s->export_job = ce;
+    s->export_tid = SDL_CreateThread(clip_export_callback, "clip_export_thread", ce);
+    if (!s->export_tid) {
+        clip_export_free(&s->export_job);
+        return -1;
+    }
+    s->nb_exports++;
+
+    return 0;
+}
+
+//enum ClipExportState of the last export with its progress in per mille, -1
+//when there was none
+int media_export_state(MediaState *s, int *progress)
+{
+    if (!s || !s->export_job)
+        return -1;
+
+    if (progress)
+        *progress = SDL_AtomicGet(&s->export_job->progress);
+
+    return SDL_AtomicGet(&s->export_job->state);
+}
+
+//use a shared pool for the demux and decode work instead of the session threads,
+//must be called before media_start
+int media_set_thread_pool(MediaState *s, ThreadPool *pool)
+{
+    if (!s || s->demux_tid || SDL_AtomicGet(&s->tasks.pending))
+        return -1;
+
+    s->pool = pool;
+
+    return 0;
+}
+
+//focused sessions win over the others on a shared pool
+int media_set_priority(MediaState *s, int priority)
+{
+    if (!s)
+        return -1;
+
+    SDL_AtomicSet(&s->priority, priority);
+
+    return 0;
+}
+
+int media_submit_task(MediaState *s, ThreadTaskFunc func, Uint32 delay)
+{
+    if (!s || !s->pool || SDL_AtomicGet(&s->quit))
+        return -1;
+
+    return thread_pool_submit_delayed(s->pool, &s->tasks, SDL_AtomicGet(&s->priority), func, s, delay);
+}
+
+//point, bilinear or bicubic. with auto the converter steps down while it takes
+//more than half a frame and back up once it has headroom again
+int media_set_convert_quality(MediaState *s, int quality, int auto_quality)
+{
+    double fps;
+
+    if (!s)
+        return -1;
+
+    s->convert_quality = quality;
+    s->convert_auto = auto_quality;
+
+    if (s->converter) {
+        fps = s->video_stream ? av_q2d(s->video_stream->r_frame_rate) : 0;
+        video_converter_set_quality(s->converter, quality, auto_quality, fps > 0 ? 500 / fps : 20);
+    }
+
+    return 0;
+}
+
+//the converter slices on the session pool, or on a small process wide one
+//created on first use when the session runs its own threads
+VideoConverter *media_video_converter(MediaState *s)
+{
+    ThreadPool *pool = s->pool;
+
+    if (s->converter)
+        return s->converter;
+
+    if (!pool) {
+        pool = (ThreadPool *)SDL_AtomicGetPtr((void **)&convert_pool);
+        if (!pool) {
+            pool = thread_pool_create(FFMIN(SDL_GetCPUCount(), CONVERT_POOL_SIZE));
+            if (!pool)
+                return NULL;
+            //another session may have won the race
+            if (!SDL_AtomicCASPtr((void **)&convert_pool, NULL, pool)) {
+                thread_pool_free(&pool);
+                pool = (ThreadPool *)SDL_AtomicGetPtr((void **)&convert_pool);
+            }
         }
+    }
+
+    s->converter = video_converter_create(pool, 0);
+    if (!s->converter)
+        return NULL;
+
+    media_set_convert_quality(s, s->convert_quality, s->convert_auto);
+
+    return s->converter;
+}
 
-        SDL_WaitEvent(&event);
-        switch (event.type) {
-            case REFRESH_EVENT: {
+int media_start(MediaState *s)
+{
+    if (!s || !s->ic)
+        return -1;
+
+    if (s->demux_tid || SDL_AtomicGet(&s->tasks.pending)) //already started
+        return 0;
+
+    //frames of a session without window or compositor are dropped
+    if (!s->video_sink) {
+        s->video_sink = s->display || s->compositor ? video_sink_sdl_create(s) : video_sink_null_create();
+        //subtitles are drawn over the picture of the session's own window
+        if (s->display && s->subtitle_stream_index != -1)
+            s->subtitle_atlas = subtitle_atlas_create(s->render);
+    }
+    if (!s->video_sink)
+        return -1;
+    if (!s->subtitle_atlas)
+        s->subtitle_stream_index = -1;
+
+    //the decoders that run, every file of a playlist has the same audio and
+    //video streams
+    s->items->nb_users = (s->audio_stream_index != -1 && audio_sink_is_open(s->audio_sink))
+            + (s->video_stream_index != -1) + (s->subtitle_atlas != NULL);
+
+    if (s->timeshift) {
+        s->record_tid = SDL_CreateThread(record_callback, "recorder", s);
+        if (!s->record_tid) {
+            printf("create thread failed: %s", SDL_GetError());
+            return -1;
+        }
+    }
+
+    if (s->pool) {
+        //the refresh timer holds a reference on the group until it sees quit
+        thread_task_group_add(&s->tasks);
+        if (!SDL_AddTimer(SDL_AtomicGet(&s->delay), refresh_timer_callback, s)) {
+            thread_task_group_done(&s->tasks);
+            printf("create timer failed: %s", SDL_GetError());
+            return -1;
+        }
+
+        if (media_submit_task(s, demux_task, 0) < 0
+                || (audio_sink_is_open(s->audio_sink) && media_submit_task(s, audio_fill_task, 0) < 0)
+                || (s->video_stream_index != -1 && media_submit_task(s, decode_task, 0) < 0)
+                || (s->video_stream_index != -1 && s->video_filter && media_submit_task(s, filter_task, 0) < 0)
+                || (s->subtitle_atlas && media_submit_task(s, subtitle_task, 0) < 0)) {
+            media_stop(s);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    s->demux_tid = SDL_CreateThread(demux_callback, "demuxer", s);
+    s->refresh_tid = SDL_CreateThread(refresh_callback, "refresh", s);
+    if (audio_sink_is_open(s->audio_sink))
+        s->audio_tid = SDL_CreateThread(audio_fill_callback, "audio", s);
+    if (s->video_stream_index != -1)
+        s->decode_tid = SDL_CreateThread(decode_callback, "decoder", s);
+    if (s->video_stream_index != -1 && s->video_filter)
+        s->filter_tid = SDL_CreateThread(filter_callback, "filter", s);
+    if (s->subtitle_atlas)
+        s->subtitle_tid = SDL_CreateThread(subtitle_callback, "subtitle", s);
+    if (!s->demux_tid || !s->refresh_tid || (audio_sink_is_open(s->audio_sink) && !s->audio_tid)
+            || (s->video_stream_index != -1 && !s->decode_tid)
+            || (s->video_stream_index != -1 && s->video_filter && !s->filter_tid)
+            || (s->subtitle_atlas && !s->subtitle_tid)) {
+        printf("create thread failed: %s", SDL_GetError());
+        media_stop(s);
+        return -1;
+    }
+
+    return 0;
+}
+
+//return 1 if the event belonged to this session, so a shared loop can dispatch
+//the same event to every session
+int media_handle_event(MediaState *s, SDL_Event *event)
+{
+    if (!s || !event)
+        return 0;
+
+    Uint32 window_id = s->display ? SDL_GetWindowID(s->display) : 0;
+
+    //a compositor session has no window of its own, only its refresh ticks count
+    if (!s->display && event->type != REFRESH_EVENT && event->type != SDL_QUIT)
+        return 0;
+
+    switch (event->type) {
+        case REFRESH_EVENT: {
+            if (event->user.data1 != s)
+                return 0;
+            if (!SDL_AtomicGet(&s->quit))
                 decode_and_show(s);
-                break;
-            }
-            case SDL_WINDOWEVENT: {
-                SDL_GetWindowSize(s->display, &s->r.w, &s->r.h);
-                break;
+            flight_recorder_poll(s->flight);
+            break;
+        }
+        case SDL_WINDOWEVENT: {
+            if (event->window.windowID != window_id)
+                return 0;
+            switch (event->window.event) {
+                case SDL_WINDOWEVENT_CLOSE: {
+                    SDL_AtomicSet(&s->quit, 1);
+                    break;
+                }
+                case SDL_WINDOWEVENT_FOCUS_GAINED: {
+                    media_set_priority(s, TASK_PRIORITY_HIGH);
+                    break;
+                }
+                case SDL_WINDOWEVENT_FOCUS_LOST:
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_RESTORED: {
+                    media_set_priority(s, TASK_PRIORITY_NORMAL);
+                    break;
+                }
+                case SDL_WINDOWEVENT_HIDDEN:
+                case SDL_WINDOWEVENT_MINIMIZED: {
+                    media_set_priority(s, TASK_PRIORITY_LOW);
+                    break;
+                }
+                default: {
+                    SDL_GetWindowSize(s->display, &s->r.w, &s->r.h);
+                    media_update_output_size(s, s->r.w, s->r.h);
+                    break;
+                }
             }
-            case SDL_KEYUP: {
-                switch (event.key.keysym.sym) {
-                    case SDLK_UP: {
-                        s->vol += SDL_MIX_MAXVOLUME * 0.05;
-                        if (s->vol > SDL_MIX_MAXVOLUME)
-                            s->vol = SDL_MIX_MAXVOLUME;
-                        break;
-                    }
-                    case SDLK_DOWN: {
-                        s->vol -= SDL_MIX_MAXVOLUME * 0.05;
-                        if (s->vol < 0)
-                            s->vol = 0;
-                        break;
-                    }
-                    case SDLK_LEFT: {
-                        int64_t pos = s->audio_clock * AV_TIME_BASE;
-                        media_seek(s, pos - 5 * AV_TIME_BASE);
-                        break;
-                    }
-                    case SDLK_RIGHT: {
-                        int64_t pos = s->audio_clock * AV_TIME_BASE;
-                        media_seek(s, pos + 5 * AV_TIME_BASE);
+            break;
+        }
+        case SDL_KEYUP: {
+            if (event->key.windowID != window_id)
+                return 0;
+            switch (event->key.keysym.sym) {
+                case SDLK_UP: {
+                    int vol = SDL_AtomicGet(&s->vol) + SDL_MIX_MAXVOLUME * 0.05;
+                    SDL_AtomicSet(&s->vol, FFMIN(vol, SDL_MIX_MAXVOLUME));
+                    break;
+                }
+                case SDLK_DOWN: {
+                    int vol = SDL_AtomicGet(&s->vol) - SDL_MIX_MAXVOLUME * 0.05;
+                    SDL_AtomicSet(&s->vol, FFMAX(vol, 0));
+                    break;
+                }
+                case SDLK_LEFT: {
+                    double pos = media_master_clock(s);
+                    if (!isnan(pos))
+                        media_seek(s, (int64_t)(pos * AV_TIME_BASE) - 5 * AV_TIME_BASE);
+                    break;
+                }
+                case SDLK_RIGHT: {
+                    double pos = media_master_clock(s);
+                    if (!isnan(pos))
+                        media_seek(s, (int64_t)(pos * AV_TIME_BASE) + 5 * AV_TIME_BASE);
+                    break;
+                }
+                case SDLK_END: {
+                    //back to the live end of a timeshifted session
+                    int64_t start, end;
+                    if (s->timeshift && timeshift_window(s->timeshift, &start, &end) == 0)
+                        media_seek(s, end + (int64_t)(s->demux_item->offset * AV_TIME_BASE));
+                    break;
+                }
+                case SDLK_d: {
+                    media_dump_flight(s, NULL);
+                    break;
+                }
+                case SDLK_s: {
+                    //the subtitles go on being decoded and timed, only the drawing stops
+                    if (s->subtitle_atlas)
+                        s->subtitle_atlas->hidden = !s->subtitle_atlas->hidden;
+                    break;
+                }
+                case SDLK_i:
+                case SDLK_o: {
+                    double pos = media_master_clock(s);
+                    if (isnan(pos))
                         break;
-                    }
-                    case SDLK_SPACE: {
-                        int status = media_status(s);
-                        if (status == MediaState::PausedState) {
-                            media_pause(s, 0);
-                        } else if (status == MediaState::PlayingState) {
-                            media_pause(s, 1);
-                        }
+                    if (event->key.keysym.sym == SDLK_i)
+                        s->mark_in = (int64_t)(pos * AV_TIME_BASE);
+                    else
+                        s->mark_out = (int64_t)(pos * AV_TIME_BASE);
+                    printf("clip %s at %.3f s\n", event->key.keysym.sym == SDLK_i ? "in" : "out", pos);
+                    break;
+                }
+                case SDLK_e: {
+                    //into the working directory, in the container of the source
+                    char path[64];
+                    const char *ext = s->demux_item ? strrchr(s->demux_item->filename, '.') : NULL;
+                    if (s->mark_in == AV_NOPTS_VALUE || s->mark_out == AV_NOPTS_VALUE || s->mark_out <= s->mark_in) {
+                        printf("mark the clip with i and o first\n");
                         break;
                     }
-                    case SDLK_ESCAPE: {
-                        s->quit = 1;
-                        break;
+                    snprintf(path, sizeof(path), CLIP_EXPORT_FILE, s->nb_exports,
+                             ext && strlen(ext) < 8 && !strchr(ext, '/') ? ext : ".mkv");
+                    if (media_export_clip(s, path, s->mark_in, s->mark_out) == 0)
+                        printf("%s: exporting\n", path);
+                    break;
+                }
+                case SDLK_SPACE: {
+                    int status = media_status(s);
+                    if (status == MediaState::PausedState) {
+                        media_pause(s, 0);
+                    } else if (status == MediaState::PlayingState) {
+                        media_pause(s, 1);
                     }
+                    break;
+                }
+                case SDLK_ESCAPE: {
+                    SDL_AtomicSet(&s->quit, 1);
+                    break;
                 }
-                break;
-            }
-            case SDL_QUIT: {
-                s->quit = 1;
-                break;
-            }
-            default: {
-                break;
             }
+            break;
+        }
+        case SDL_QUIT: {
+            SDL_AtomicSet(&s->quit, 1);
+            break;
+        }
+        default: {
+            return 0;
         }
     }
 
-    SDL_Delay(100);
+    return 1;
+}
 
-    return 0;
+int media_play(MediaState *s)
+{
+    if (media_start(s) < 0)
+        return -1;
+
+    SDL_Event event;
+    while(1) {
+        if (SDL_AtomicGet(&s->quit)) {
+            break;
+        }
+
+        //timeout, the demuxer sets quit at the end of file without sending an event
+        if (SDL_WaitEventTimeout(&event, 100))
+            media_handle_event(s, &event);
+    }
+
+    return media_stop(s);
 }
 
 int media_stop(MediaState *s)
@@ -609,7 +1607,53 @@ int media_stop(MediaState *s)
     if (!s)
         return -1;
 
-    s->quit = 1;
+    SDL_AtomicSet(&s->quit, 1);
+
+    audio_sink_pause(s->audio_sink, 1);
+
+    if (s->demux_tid) {
+        SDL_WaitThread(s->demux_tid, NULL);
+        s->demux_tid = NULL;
+    }
+    if (s->refresh_tid) {
+        SDL_WaitThread(s->refresh_tid, NULL);
+        s->refresh_tid = NULL;
+    }
+    if (s->audio_tid) {
+        SDL_WaitThread(s->audio_tid, NULL);
+        s->audio_tid = NULL;
+    }
+    if (s->decode_tid) {
+        SDL_WaitThread(s->decode_tid, NULL);
+        s->decode_tid = NULL;
+    }
+    if (s->filter_tid) {
+        SDL_WaitThread(s->filter_tid, NULL);
+        s->filter_tid = NULL;
+    }
+    if (s->subtitle_tid) {
+        SDL_WaitThread(s->subtitle_tid, NULL);
+        s->subtitle_tid = NULL;
+    }
+    if (s->record_tid) {
+        SDL_WaitThread(s->record_tid, NULL);
+        s->record_tid = NULL;
+    }
+
+    //pool tasks and the refresh timer see quit and don't come back
+    thread_task_group_wait(&s->tasks);
+
+    if (s->prepare_tid) {
+        SDL_WaitThread(s->prepare_tid, NULL);
+        s->prepare_tid = NULL;
+    }
+
+    //an unfinished clip is removed
+    if (s->export_tid) {
+        SDL_AtomicSet(&s->export_job->cancel, 1);
+        SDL_WaitThread(s->export_tid, NULL);
+        s->export_tid = NULL;
+    }
 
     return 0;
 }
@@ -619,11 +1663,14 @@ int media_pause(MediaState *s, int on)
     if (!s)
         return -1;
 
-    if (s->audio_stream_index > -1) {
-        SDL_PauseAudio(on);
-    } else {
-        s->pause = on;
-    }
+    SDL_AtomicSet(&s->pause, on);
+    //the picture held over a pause is no stall
+    s->frame_last_show_time = 0;
+    clock_set_paused(&s->audio_clk, on);
+    clock_set_paused(&s->video_clk, on);
+    clock_set_paused(&s->ext_clk, on);
+    audio_sink_pause(s->audio_sink, on);
+
     return 0;
 }
 
@@ -635,13 +1682,8 @@ int media_status(MediaState *s)
 //    if(s->is_buffering)
 //        return MediaState::BufferingState;
 
-    if (s->audio_stream_index > -1) {
-        if(SDL_AUDIO_PLAYING == SDL_GetAudioStatus())
-            return MediaState::PlayingState;
-    } else {
-        if (s->pause == 0)
-            return MediaState::PlayingState;
-    }
+    if (SDL_AtomicGet(&s->pause) == 0)
+        return MediaState::PlayingState;
 
     return MediaState::PausedState;
 }
@@ -651,14 +1693,66 @@ int media_seek(MediaState *s, int64_t pos)
     if (!s)
         return -1;
 
-    if(!s->seek_req) {
-        s->seek_pos = pos;
-        s->seek_req = 1;
+    //the position is published before the request the demuxer polls
+    if (!SDL_AtomicGet(&s->seek_req)) {
+        s->seek_request_time = flight_recorder_now(s->flight);
+        flight_recorder_mark(s->flight, FLIGHT_SEEK_REQUEST, (int)(pos / 1000));
+        atomic_value_set_int64(&s->seek_pos, pos);
+        SDL_AtomicSet(&s->seek_req, 1);
+        //the picture held until the first frame after the seek is no stall
+        s->frame_last_show_time = 0;
     }
 
     return 0;
 }
 
+//audio, video or external (the system time). a master without a stream falls back
+//to the next one, so a file without audio still plays at the right speed
+int media_set_sync_master(MediaState *s, int master)
+{
+    if (!s || master < CLOCK_SYNC_AUDIO || master > CLOCK_SYNC_EXTERNAL)
+        return -1;
+
+    SDL_AtomicSet(&s->sync_master, master);
+
+    return 0;
+}
+
+int media_sync_master(MediaState *s)
+{
+    int master = SDL_AtomicGet(&s->sync_master);
+
+    if (master == CLOCK_SYNC_VIDEO && !s->video_stream)
+        master = CLOCK_SYNC_AUDIO;
+    if (master == CLOCK_SYNC_AUDIO && !audio_sink_is_open(s->audio_sink))
+        master = CLOCK_SYNC_EXTERNAL;
+
+    return master;
+}
+
+double media_master_clock(MediaState *s)
+{
+    switch (media_sync_master(s)) {
+        case CLOCK_SYNC_AUDIO:
+            return clock_get(&s->audio_clk);
+        case CLOCK_SYNC_VIDEO:
+            return clock_get(&s->video_clk);
+        default:
+            return clock_get(&s->ext_clk);
+    }
+}
+
+//seconds the picture is ahead of the sound (negative when behind), NAN while
+//one of them has not started yet
+double media_av_offset(MediaState *s)
+{
+    if (!s || !audio_sink_is_open(s->audio_sink) || !s->video_stream)
+        return NAN;
+
+    return clock_get(&s->video_clk) - clock_get(&s->audio_clk);
+}
+
+//in AV_TIME_BASE units, 0 when unknown
 int64_t media_duration(MediaState *s)
 {
     if (!s)
@@ -668,8 +1762,8 @@ int64_t media_duration(MediaState *s)
         return s->ic->duration + (s->ic->duration <= INT64_MAX - 5000 ? 5000 : 0);
     }
 
-    if (s->video_stream)
-        return av_rescale_q(s->video_stream->duration, AVRational{ 1, AV_TIME_BASE }, s->video_stream->time_base);
+    if (s->video_stream && s->video_stream->duration != AV_NOPTS_VALUE)
+        return av_rescale_q(s->video_stream->duration, s->video_stream->time_base, AVRational{ 1, AV_TIME_BASE });
 
     return 0;
 }
@@ -2,9 +2,14 @@
 #define MEDIASTATE_H
 
 #define MAX_AUDIO_FRAME_SIZE 192000//1 second of 48khz 32bit audio
-#define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_SIZE (5 * 16 * 1024)
 #define MAX_VIDEO_SIZE (5 * 256 * 1024)
+#define VIDEO_FRAME_QUEUE_SIZE 3
+#define VIDEO_TEXTURE_COUNT 2
+#define CONVERT_POOL_SIZE 4 //workers converting for sessions without a pool
+#define AUDIO_DIFF_AVG_NB 20 //a/v differences averaged before audio is corrected
+#define SAMPLE_CORRECTION_PERCENT_MAX 10
+#define AUDIO_FILL_TASK_FRAMES 4
 
 #define REFRESH_EVENT (SDL_USEREVENT + 1)
 #define BREAK_EVENT (SDL_USEREVENT + 2)
@@ -14,65 +19,259 @@ extern "C" {
 #endif
 
 #include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
 #include <libswresample/swresample.h>
 #include "packetqueue.h"
+#include "framequeue.h"
+#include "framepool.h"
+#include "threadpool.h"
+#include "atomicvalue.h"
+#include "clock.h"
+#include "audioring.h"
+#include "audiokernels.h"
 
+enum AudioLatency {
+    AUDIO_LATENCY_LOW = 0, //small device buffer, more decoded ahead to ride out stalls
+    AUDIO_LATENCY_BALANCED,
+    AUDIO_LATENCY_POWER, //large buffers, the device and the decoder wake up rarely
+    AUDIO_LATENCY_COUNT
+};
+#include "compositor.h"
+#include "videosink.h"
+#include "videofilter.h"
+#include "timeshift.h"
+#include "flightrecorder.h"
+#include "clipexport.h"
+#include "subtitle.h"
+#include "audiosink.h"
 
-typedef struct MediaState {
-    AVFormatContext *ic;
-    AVPacket pkt;
+enum MediaNextState {
+    MEDIA_NEXT_NONE = 0,
+    MEDIA_NEXT_OPENING, //opened and probed on a background thread
+    MEDIA_NEXT_READY, //the demuxer continues with it at the end of the current file
+    MEDIA_NEXT_FAILED //could not be opened or has other streams, nothing was spliced
+};
 
-    //audio
+//first frame after a splice or a seek in the frame queue, the presenter picks
+//up the size of a new file with it
+enum VideoFrameMark {
+    VIDEO_MARK_NONE = 0,
+    VIDEO_MARK_SPLICE, //gapless, right after the last frame of the previous file
+    VIDEO_MARK_SEEK, //within the file the decoder is on, the size stays
+    VIDEO_MARK_SEEK_SWITCH //into a file the decoder had not reached yet
+};
+
+//one file of a session. the files of a playlist follow each other in a chain,
+//the demuxer and each decoder move along it on their own and the demuxer closes
+//a file once every decoder has left it
+typedef struct MediaItem {
+    char *filename;
+    AVFormatContext *ic;
     int audio_stream_index;
     AVStream *audio_stream;
-    AVCodecContext *audio_codec_ctx;
     AVCodec *audio_codec;
-    PacketQueue audio_packet_queue;
+    int video_stream_index;
+    AVStream *video_stream;
+    AVCodec *video_codec;
+    int subtitle_stream_index; //the first one, -1 without
+    AVStream *subtitle_stream;
+    double start_time; //first pts of the file
+    double offset; //added to the pts, the session time goes on across files
+    double prepare_time; //seconds the background open and probe took
+    int nb_users; //decoders that read the file
+    SDL_atomic_t nb_left;
+    struct MediaItem *next;
+} MediaItem;
+
+typedef struct MediaState {
+    //control shared by every thread of the session, read often and written
+    //rarely, so it gets its own cache lines
+    SDL_atomic_t quit;
+    SDL_atomic_t pause;
+    SDL_atomic_t seek_req; //set after seek_pos, the demuxer reads it first
+    AtomicValue seek_pos;
+    SDL_atomic_t priority;
+    SDL_atomic_t delay; //ms to the next refresh, written by the presenter
+    SDL_atomic_t vol;
+    SDL_atomic_t sync_master; //enum ClockSyncMaster
+    Clock audio_clk; //what is audible now
+    Clock video_clk; //what is on screen now
+    Clock ext_clk;
+    AtomicValue video_next_size; //source size of the next file, width << 32 | height
+    AtomicValue video_scale_size; //video_width, video_height, out_w, out_h in 16 bits each, for the decoder
+    SDL_atomic_t next_state; //enum MediaNextState
+    CACHELINE_PAD(pad_shared);
 
+    //written by the audio decoder only (the fill step)
+    AVPacket pkt;
 //    uint8_t *audio_pkt_data;
     int audio_pkt_size;
     struct SwrContext* swr_ctx;
+    int64_t swr_in_layout; //input the resampler was set up for
+    int swr_in_format;
+    int swr_in_rate;
     AVFrame *audio_out_frame;
-    AVFrame *wanted_frame;
-
     uint8_t *audio_buf;
     unsigned int audio_buf_size;
     unsigned int audio_buf_index;
+    double audio_clock; //pts at the end of audio_buf, ahead of what is audible
+    double audio_diff_cum; //running a/v difference when audio is not the master
+    double audio_diff_avg_coef;
+    int audio_diff_avg_count;
+    MediaItem *audio_item;
+    MediaItem *audio_switch; //the previous file is drained before the decoder moves on
+    double audio_pts_offset;
+    CACHELINE_PAD(pad_audio);
+
+    //decoded audio on its way from the fill step to the device callback
+    AudioRing audio_ring;
+    CACHELINE_PAD(pad_ring);
+
+    //written by the audio callback only
+    float audio_gain; //volume of the last callback, the next one ramps from it
+    SDL_atomic_t nb_underruns; //callbacks the ring could not fill
+    CACHELINE_PAD(pad_callback);
+
+    //written by the demuxer only
     int is_buffering;
-    int seek_req;
-    int64_t seek_pos;
+    int demux_eof;
+    MediaItem *demux_item; //also switches ic and the stream indexes below
+    MediaItem *items; //oldest file still open
+    SDL_SpinLock items_lock; //the demuxer changes the chain under it, others walk it under it
+    double demux_end; //end of the packets read so far, in session time
+    double prepare_time_max;
+    int nb_splices;
+    CACHELINE_PAD(pad_demux);
+
+    //written by the video decoder only
+    double video_clock; //pts predicted for the next decoded frame
+    MediaItem *video_item;
+    MediaItem *video_switch;
+    double video_pts_offset;
+    int video_mark; //enum VideoFrameMark for the next decoded frame
+    CACHELINE_PAD(pad_decode);
+
+    //written by the subtitle decoder only
+    MediaItem *subtitle_item;
+    AVStream *subtitle_stream;
+    AVCodecContext *subtitle_codec_ctx; //NULL while the file has no subtitles
+    double subtitle_pts_offset;
+    CACHELINE_PAD(pad_subtitle);
+
+    //written by the presenter only (the event loop)
+    double frame_last_pts; 			//前一帧显示时间
+    double frame_last_delay; 	//当前帧和前一帧的延时，前面两个相减的结果
+    int texture_index;
+    //bytes the cpu writes for the shown frames, there is no copy after converting
+    int64_t nb_frames_shown;
+    int64_t nb_bytes_converted;
+    int video_sink_pending; //video_show_frame was refused and is offered again
+    double video_sink_pts;
+    double frame_last_show_time;
+    int nb_transitions; //spliced files shown
+    double transition_late_max; //worst stall of the picture at a splice
+    int64_t seek_request_time; //flight recorder time of the last media_seek
+    CACHELINE_PAD(pad_present);
+
+    //next file of a playlist, opened while the current one plays
+    SDL_Thread *prepare_tid;
+    MediaItem *next_item;
+
+    //live input recorded into a ring on disk, the demuxer reads from the ring
+    TimeShift *timeshift;
+    SDL_Thread *record_tid;
+    int record_realtime; //the recorder paces a file like a live source
+
+    //a range of the file copied into another on a thread of its own, the marks
+    //are set from the event loop in session time
+    ClipExport *export_job;
+    SDL_Thread *export_tid;
+    int64_t mark_in;
+    int64_t mark_out;
+    int nb_exports;
+
+    //set up before the threads start, the decoders and the demuxer switch their
+    //parts of it at the end of a file
+    AVFormatContext *ic;
+
+    //audio
+    int audio_stream_index;
+    AVStream *audio_stream;
+    AVCodecContext *audio_codec_ctx;
+    AVCodec *audio_codec;
+    PacketQueue audio_packet_queue;
+    FramePool audio_frame_pool;
+    AVFrame *wanted_frame;
+    int audio_latency; //enum AudioLatency
+    int audio_hw_buf_size; //bytes of the device buffer
+    int audio_bytes_per_sec;
+    int audio_fill_delay; //ms the fill step backs off while the ring is full
+    AudioInterleaveFunc audio_interleave; //for frames the device takes as they are
+    AudioGainFunc audio_gain_func;
 
     //video
     int video_stream_index;
     AVStream *video_stream;
     AVCodecContext *video_codec_ctx;
     AVCodec *video_codec;
+    int video_width; //source size, the codec context shrinks with lowres. with a
+    int video_height; //filter the size of its output, the presenter follows the frames
+    AVRational video_sar; //of the filter output, 0 for square pixels
     PacketQueue video_packet_queue;
+    FrameQueue video_frame_queue;
+    FramePool video_frame_pool;
+    AVFrame *video_decode_frame;
+    AVFrame *video_show_frame;
 
-    uint8_t *video_buf;
-    unsigned int video_buf_size;
-    struct SwsContext *sws_ctx;
-    AVFrame *video_out_frame;
+    VideoConverter *converter;
+    int convert_quality;
+    int convert_auto; //step the quality down when converting falls behind
 
     AVPixelFormat display_pix_fmt;
 
-    //sync
-    double audio_clock;
-    double video_clock;
-    double frame_last_pts; 			//前一帧显示时间
-    double frame_last_delay; 	//当前帧和前一帧的延时，前面两个相减的结果
-    uint32_t delay;
-
     SDL_Rect r;
+    int out_w; //picture size on screen, frames are converted to it
+    int out_h;
+    int texture_w;
+    int texture_h;
     SDL_Window *display;
     SDL_Renderer *render;
-    SDL_Texture *texture;
+    //frames are converted straight into the locked textures in turn, the
+    //renderer may still be drawing the previous one
+    SDL_Texture *textures[VIDEO_TEXTURE_COUNT];
+
+    //subtitles of the window, decoded ahead into the queue and drawn from the
+    //atlas. the decoder only runs when the atlas was created in media_start
+    int subtitle_stream_index;
+    PacketQueue subtitle_packet_queue;
+    SubtitleQueue subtitle_queue;
+    SubtitleAtlas *subtitle_atlas;
+
+    //shared canvas instead of the window above
+    Compositor *compositor;
+    SDL_Rect tile;
+
+    //gets the frames, the window or compositor unless the host set its own
+    VideoSink *video_sink;
+
+    //recent timing events of every thread, dumped when something stalls
+    FlightRecorder *flight;
 
-    //other
-    int vol;
-    int quit;
-    int pause;
+    //optional graph between the decoder and the frame queue, on a thread or task of its own
+    VideoFilter *video_filter;
+
+    //plays the samples, the session's own sdl device unless the host set a sink
+    AudioSink *audio_sink;
+    SDL_Thread *demux_tid;
+    SDL_Thread *audio_tid;
+    SDL_Thread *refresh_tid;
+    SDL_Thread *decode_tid;
+    SDL_Thread *filter_tid;
+    SDL_Thread *subtitle_tid;
+
+    //shared scheduler, the session threads above are not used with a pool
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
 
     enum State {
         PlayingState = 0,
@@ -85,6 +284,8 @@ typedef struct MediaState {
 
 void media_init();
 
+void media_uninit();
+
 MediaState *media_state_alloc();
 
 void media_state_init(MediaState *s);
@@ -93,10 +294,60 @@ void media_state_free(MediaState **s);
 
 int media_open_input_file(MediaState **s, const char *filename);
 
+int media_queue_next(MediaState *s, const char *filename);
+
+int media_next_state(MediaState *s);
+
+void media_item_leave(MediaItem **cur, MediaItem *item);
+
+void media_item_free(MediaItem **item);
+
+void media_update_output_size(MediaState *s, int w, int h);
+
+void media_publish_output_size(MediaState *s);
+
+double media_video_ratio(MediaState *s);
+
 int media_create_video_display(MediaState *s, void *handle);
 
+int media_attach_compositor(MediaState *s, Compositor *c, int tile);
+
+int media_set_audio_latency(MediaState *s, int latency);
+
+int media_set_audio_sink(MediaState *s, AudioSink *sink);
+
 int media_open_audio_device(MediaState *s);
 
+int media_set_video_sink(MediaState *s, VideoSink *sink);
+
+int media_set_video_filter(MediaState *s, const char *desc, int nb_threads);
+
+int media_set_timeshift(MediaState *s, const char *path, int64_t size, int realtime);
+
+int media_set_flight_recorder(MediaState *s, const char *prefix, int stall_ms, int seek_ms);
+
+int media_dump_flight(MediaState *s, const char *path);
+
+int media_export_clip(MediaState *s, const char *path, int64_t in, int64_t out);
+
+int media_export_state(MediaState *s, int *progress);
+
+double media_audio_latency(MediaState *s);
+
+int media_set_thread_pool(MediaState *s, ThreadPool *pool);
+
+int media_set_priority(MediaState *s, int priority);
+
+int media_submit_task(MediaState *s, ThreadTaskFunc func, Uint32 delay);
+
+int media_set_convert_quality(MediaState *s, int quality, int auto_quality);
+
+VideoConverter *media_video_converter(MediaState *s);
+
+int media_start(MediaState *s);
+
+int media_handle_event(MediaState *s, SDL_Event *event);
+
 int media_play(MediaState *s);
 
 int media_stop(MediaState *s);
@@ -107,6 +358,16 @@ int media_status(MediaState *s);
 
 int media_seek(MediaState *s, int64_t pos);
 
+int media_set_sync_master(MediaState *s, int master);
+
+int media_sync_master(MediaState *s);
+
+double media_master_clock(MediaState *s);
+
+double media_av_offset(MediaState *s);
+
+int64_t media_duration(MediaState *s);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,16 +34,74 @@ LIBS += -L$$PWD/lib/ -lavcodec\
         -L$$PWD/lib/ -lSDL2 \
         -L$$PWD/lib/ -lSDL2main
 
+# GetProcessMemoryInfo of the bench suite
+win32: LIBS += -lpsapi
+# dlsym of the benchheap shim, see benchheap.pro
+unix: LIBS += -ldl
+
 INCLUDEPATH +=$$PWD/include
 
 SOURCES += main.cpp\
     demuxer.cpp \
     decoder.cpp \
     packetqueue.cpp \
-    mediastate.cpp
+    mediastate.cpp \
+    framequeue.cpp \
+    threadpool.cpp \
+    bench.cpp \
+    compositor.cpp \
+    converter.cpp \
+    pixelkernels.cpp \
+    framepool.cpp \
+    atomicvalue.cpp \
+    clock.cpp \
+    audioring.cpp \
+    audiokernels.cpp \
+    videosink.cpp \
+    audiosink.cpp \
+    batch.cpp \
+    extract.cpp \
+    thumbnail.cpp \
+    scanner.cpp \
+    videofilter.cpp \
+    timeshift.cpp \
+    benchsuite.cpp \
+    flightrecorder.cpp \
+    clipexport.cpp \
+    subtitle.cpp
 
 HEADERS  += \
     demuxer.h \
     decoder.h \
     packetqueue.h \
-    mediastate.h
+    mediastate.h \
+    framequeue.h \
+    threadpool.h \
+    bench.h \
+    compositor.h \
+    converter.h \
+    pixelkernels.h \
+    framepool.h \
+    atomicvalue.h \
+    clock.h \
+    audioring.h \
+    audiokernels.h \
+    videosink.h \
+    audiosink.h \
+    batch.h \
+    extract.h \
+    thumbnail.h \
+    scanner.h \
+    videofilter.h \
+    timeshift.h \
+    benchsuite.h \
+    flightrecorder.h \
+    benchheap.h \
+    clipexport.h \
+    subtitle.h
+
+# qmake CONFIG+=tsan, then run "-bench atomics" and a few sessions under ThreadSanitizer
+tsan {
+    QMAKE_CXXFLAGS += -fsanitize=thread -g
+    QMAKE_LFLAGS += -fsanitize=thread
+}
@@ -5,8 +5,10 @@ void packet_queue_init(PacketQueue *q)
 {
     q->last_pkt = NULL;
     q->first_pkt = NULL;
+    q->free_pkt = NULL;
     q->nb_packets = 0;
     q->size = 0;
+    q->nb_node_allocs = 0;
 #if USE_MUTE
     q->mutex = SDL_CreateMutex();
     q->cond = SDL_CreateCond();
@@ -22,11 +24,9 @@ void packet_queue_flush(PacketQueue *q)
 
     for(pkt = q->first_pkt; pkt != NULL; pkt = pkt1) {
         pkt1 = pkt->next;
-        if(pkt1->pkt.data != (uint8_t *)"FLUSH") {
-
-        }
         av_packet_unref(&pkt->pkt);
-        av_freep(&pkt);
+        pkt->next = q->free_pkt;
+        q->free_pkt = pkt;
     }
 
     q->last_pkt = NULL;
@@ -38,6 +38,26 @@ void packet_queue_flush(PacketQueue *q)
 #endif
 }
 
+// flush and release the lock objects, the queue can't be used afterwards
+void packet_queue_destroy(PacketQueue *q)
+{
+    AVPacketList *pkt, *pkt1;
+
+    packet_queue_flush(q);
+
+    for (pkt = q->free_pkt; pkt != NULL; pkt = pkt1) {
+        pkt1 = pkt->next;
+        av_free(pkt);
+    }
+    q->free_pkt = NULL;
+#if USE_MUTE
+    SDL_DestroyMutex(q->mutex);
+    SDL_DestroyCond(q->cond);
+    q->mutex = NULL;
+    q->cond = NULL;
+#endif
+}
+
 // push packet into queue
 int packet_queue_put(PacketQueue *q, AVPacket *pkt)
 {
@@ -46,15 +66,25 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     if (av_dup_packet(pkt) < 0)
         return -1;
 
-    pktl = (AVPacketList *)av_malloc(sizeof(AVPacketList));
-    if (!pktl)
-        return -1;
-
-    pktl->pkt = *pkt;
-    pktl->next = NULL;
 #if USE_MUTE
     SDL_LockMutex(q->mutex);
 #endif
+    pktl = q->free_pkt;
+    if (pktl) {
+        q->free_pkt = pktl->next;
+    } else {
+        pktl = (AVPacketList *)av_malloc(sizeof(AVPacketList));
+        if (!pktl) {
+#if USE_MUTE
+            SDL_UnlockMutex(q->mutex);
+#endif
+            return -1;
+        }
+        q->nb_node_allocs++;
+    }
+
+    pktl->pkt = *pkt;
+    pktl->next = NULL;
     if (!q->last_pkt) // if the queue is empty, the new one will be the first
         q->first_pkt = pktl;
     else // or else push into rear
@@ -70,6 +100,22 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     return 0;
 }
 
+// bytes queued, the other threads read it through here instead of the fields
+int packet_queue_size(PacketQueue *q, int *nb_packets)
+{
+    int size;
+#if USE_MUTE
+    SDL_LockMutex(q->mutex);
+#endif
+    size = q->size;
+    if (nb_packets)
+        *nb_packets = q->nb_packets;
+#if USE_MUTE
+    SDL_UnlockMutex(q->mutex);
+#endif
+    return size;
+}
+
 // pop up packet from queue
 int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
 {
@@ -89,7 +135,8 @@ int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
             q->size -= pkt1->pkt.size;
 
             *pkt = pkt1->pkt;
-            av_free(pkt1);
+            pkt1->next = q->free_pkt;
+            q->free_pkt = pkt1;
             ret = 1;
             break;
         } else if (!block) {
@@ -2,6 +2,7 @@
 #define PACKETQUEUE_H
 
 #define FLUSH_DATA "FLUSH"
+#define SWITCH_DATA "SWITCH" //the next file of a playlist follows
 
 #define USE_MUTE 1
 #define UNUSED (void *)
@@ -15,8 +16,10 @@ extern "C"{
 
 typedef struct PacketQueue {
     AVPacketList *first_pkt, *last_pkt;
+    AVPacketList *free_pkt; //nodes of popped packets, reused by the next puts
     int nb_packets;
     int size;
+    int nb_node_allocs;
     SDL_mutex *mutex;
     SDL_cond *cond;
 } PacketQueue;
@@ -25,10 +28,14 @@ void packet_queue_init(PacketQueue *q);
 
 void packet_queue_flush(PacketQueue *q);
 
+void packet_queue_destroy(PacketQueue *q);
+
 int packet_queue_put(PacketQueue *q, AVPacket *pkt);
 
 int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block);
 
+int packet_queue_size(PacketQueue *q, int *nb_packets);
+
 #ifdef __cplusplus
 }
 #endif
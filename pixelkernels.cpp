@@ -0,0 +1,291 @@
+#include "pixelkernels.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+//msvc emits any intrinsic, gcc and clang need the isa enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PIXEL_TARGET_SSE2
+#define PIXEL_TARGET_AVX2
+#else
+#define PIXEL_TARGET_SSE2 __attribute__((target("sse2")))
+#define PIXEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//full to limited range in 16 bit fixed point, so the vector versions compute
+//exactly the same: y' = y * 219 / 255 + 16, c' = (c - 128) * 224 / 255 + 128
+#define RANGE_LUMA_MUL 3518 //219 / 255 * 16 * 256
+#define RANGE_LUMA_ADD (16 * 16 + 8)
+#define RANGE_CHROMA_MUL 7196 //224 / 255 * 16 * 512
+#define RANGE_CHROMA_ADD (128 * 16 + 8)
+
+//rows of one plane, every isa has the same set and must give identical output
+struct PixelRowsScalar {
+    static void deinterleave(const uint8_t *src, uint8_t *u, uint8_t *v, int n, int i)
+    {
+        for (; i < n; i++) {
+            u[i] = src[2 * i];
+            v[i] = src[2 * i + 1];
+        }
+    }
+
+    //10 to 8 bit, rounded without dither
+    static void narrow10(const uint16_t *src, uint8_t *dst, int n, int i)
+    {
+        for (; i < n; i++) {
+            int v = (src[i] + 2) >> 2;
+            dst[i] = v > 255 ? 255 : v;
+        }
+    }
+
+    static void range_luma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        for (; i < n; i++)
+            dst[i] = ((((src[i] << 8) * RANGE_LUMA_MUL) >> 16) + RANGE_LUMA_ADD) >> 4;
+    }
+
+    static void range_chroma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        for (; i < n; i++)
+            dst[i] = ((((src[i] - 128) * 128 * RANGE_CHROMA_MUL) >> 16) + RANGE_CHROMA_ADD) >> 4;
+    }
+};
+
+#ifdef PIXEL_KERNELS_X86
+struct PixelRowsSse2 {
+    PIXEL_TARGET_SSE2 static void deinterleave(const uint8_t *src, uint8_t *u, uint8_t *v, int n, int i)
+    {
+        const __m128i mask = _mm_set1_epi16(0xff);
+
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+            _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+            _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+        }
+        PixelRowsScalar::deinterleave(src, u, v, n, i);
+    }
+
+    PIXEL_TARGET_SSE2 static void narrow10(const uint16_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m128i round = _mm_set1_epi16(2);
+
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+            a = _mm_srli_epi16(_mm_add_epi16(a, round), 2);
+            b = _mm_srli_epi16(_mm_add_epi16(b, round), 2);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+        }
+        PixelRowsScalar::narrow10(src, dst, n, i);
+    }
+
+    PIXEL_TARGET_SSE2 static void range_luma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mul = _mm_set1_epi16(RANGE_LUMA_MUL);
+        const __m128i add = _mm_set1_epi16(RANGE_LUMA_ADD);
+
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            //unpacking below zero gives y << 8 directly
+            __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, x), mul);
+            __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, x), mul);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, add), 4);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, add), 4);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        PixelRowsScalar::range_luma(src, dst, n, i);
+    }
+
+    PIXEL_TARGET_SSE2 static void range_chroma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16(128);
+        const __m128i mul = _mm_set1_epi16(RANGE_CHROMA_MUL);
+        const __m128i add = _mm_set1_epi16(RANGE_CHROMA_ADD);
+
+        for (; i + 16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i lo = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(x, zero), bias), 7);
+            __m128i hi = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(x, zero), bias), 7);
+            lo = _mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(lo, mul), add), 4);
+            hi = _mm_srai_epi16(_mm_add_epi16(_mm_mulhi_epi16(hi, mul), add), 4);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        PixelRowsScalar::range_chroma(src, dst, n, i);
+    }
+};
+
+//the 256 bit packs work per 128 bit lane, the permute puts the halves back in order
+struct PixelRowsAvx2 {
+    PIXEL_TARGET_AVX2 static void deinterleave(const uint8_t *src, uint8_t *u, uint8_t *v, int n, int i)
+    {
+        const __m256i mask = _mm256_set1_epi16(0xff);
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(src + 2 * i + 32));
+            __m256i pu = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+            __m256i pv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+            _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(pu, 0xd8));
+            _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(pv, 0xd8));
+        }
+        PixelRowsSse2::deinterleave(src, u, v, n, i);
+    }
+
+    PIXEL_TARGET_AVX2 static void narrow10(const uint16_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m256i round = _mm256_set1_epi16(2);
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 16));
+            a = _mm256_srli_epi16(_mm256_add_epi16(a, round), 2);
+            b = _mm256_srli_epi16(_mm256_add_epi16(b, round), 2);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+        }
+        PixelRowsSse2::narrow10(src, dst, n, i);
+    }
+
+    PIXEL_TARGET_AVX2 static void range_luma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m256i mul = _mm256_set1_epi16(RANGE_LUMA_MUL);
+        const __m256i add = _mm256_set1_epi16(RANGE_LUMA_ADD);
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i lo = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i))), 8);
+            __m256i hi = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i + 16))), 8);
+            lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(lo, mul), add), 4);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(hi, mul), add), 4);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+        }
+        PixelRowsSse2::range_luma(src, dst, n, i);
+    }
+
+    PIXEL_TARGET_AVX2 static void range_chroma(const uint8_t *src, uint8_t *dst, int n, int i)
+    {
+        const __m256i bias = _mm256_set1_epi16(128);
+        const __m256i mul = _mm256_set1_epi16(RANGE_CHROMA_MUL);
+        const __m256i add = _mm256_set1_epi16(RANGE_CHROMA_ADD);
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+            __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i + 16)));
+            lo = _mm256_slli_epi16(_mm256_sub_epi16(lo, bias), 7);
+            hi = _mm256_slli_epi16(_mm256_sub_epi16(hi, bias), 7);
+            lo = _mm256_srai_epi16(_mm256_add_epi16(_mm256_mulhi_epi16(lo, mul), add), 4);
+            hi = _mm256_srai_epi16(_mm256_add_epi16(_mm256_mulhi_epi16(hi, mul), add), 4);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+        }
+        PixelRowsSse2::range_chroma(src, dst, n, i);
+    }
+};
+#endif
+
+//one specialisation per supported format pair, all of them 4:2:0
+template <enum AVPixelFormat SRC, enum AVPixelFormat DST>
+struct PixelRepack;
+
+template <>
+struct PixelRepack<AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P> {
+    template <class Rows>
+    static void run(const uint8_t *const src[4], const int src_stride[4],
+                    uint8_t *const dst[4], const int dst_stride[4], int w, int h)
+    {
+        int cw = (w + 1) >> 1, ch = (h + 1) >> 1;
+
+        for (int y = 0; y < h; y++)
+            memcpy(dst[0] + y * dst_stride[0], src[0] + y * src_stride[0], w);
+        for (int y = 0; y < ch; y++)
+            Rows::deinterleave(src[1] + y * src_stride[1],
+                               dst[1] + y * dst_stride[1], dst[2] + y * dst_stride[2], cw, 0);
+    }
+};
+
+template <>
+struct PixelRepack<AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P> {
+    template <class Rows>
+    static void run(const uint8_t *const src[4], const int src_stride[4],
+                    uint8_t *const dst[4], const int dst_stride[4], int w, int h)
+    {
+        for (int p = 0; p < 3; p++) {
+            int pw = p ? (w + 1) >> 1 : w, ph = p ? (h + 1) >> 1 : h;
+            for (int y = 0; y < ph; y++)
+                Rows::narrow10((const uint16_t *)(src[p] + y * src_stride[p]), dst[p] + y * dst_stride[p], pw, 0);
+        }
+    }
+};
+
+template <>
+struct PixelRepack<AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUV420P> {
+    template <class Rows>
+    static void run(const uint8_t *const src[4], const int src_stride[4],
+                    uint8_t *const dst[4], const int dst_stride[4], int w, int h)
+    {
+        int cw = (w + 1) >> 1, ch = (h + 1) >> 1;
+
+        for (int y = 0; y < h; y++)
+            Rows::range_luma(src[0] + y * src_stride[0], dst[0] + y * dst_stride[0], w, 0);
+        for (int p = 1; p < 3; p++) {
+            for (int y = 0; y < ch; y++)
+                Rows::range_chroma(src[p] + y * src_stride[p], dst[p] + y * dst_stride[p], cw, 0);
+        }
+    }
+};
+
+#ifdef PIXEL_KERNELS_X86
+#define PIXEL_KERNEL(src, dst) { src, dst, { PixelRepack<src, dst>::run<PixelRowsScalar>, \
+                                             PixelRepack<src, dst>::run<PixelRowsSse2>, \
+                                             PixelRepack<src, dst>::run<PixelRowsAvx2> } }
+#else
+#define PIXEL_KERNEL(src, dst) { src, dst, { PixelRepack<src, dst>::run<PixelRowsScalar>, NULL, NULL } }
+#endif
+
+static const struct {
+    enum AVPixelFormat src_fmt;
+    enum AVPixelFormat dst_fmt;
+    PixelKernelFunc funcs[PIXEL_ISA_COUNT];
+} pixel_kernels[] = {
+    PIXEL_KERNEL(AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P),
+    PIXEL_KERNEL(AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P),
+    PIXEL_KERNEL(AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUV420P),
+};
+
+int pixel_kernel_best_isa()
+{
+#ifdef PIXEL_KERNELS_X86
+    if (SDL_HasAVX2())
+        return PIXEL_ISA_AVX2;
+    if (SDL_HasSSE2())
+        return PIXEL_ISA_SSE2;
+#endif
+    return PIXEL_ISA_SCALAR;
+}
+
+const char *pixel_isa_name(int isa)
+{
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    return isa >= 0 && isa < PIXEL_ISA_COUNT ? names[isa] : "unknown";
+}
+
+//isa < 0 picks the best one of this cpu, NULL when there is no kernel for the
+//pair or the cpu lacks the isa
+PixelKernelFunc pixel_kernel_find(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt, int isa)
+{
+    if (isa < 0)
+        isa = pixel_kernel_best_isa();
+    else if (isa >= PIXEL_ISA_COUNT || isa > pixel_kernel_best_isa())
+        return NULL;
+
+    for (unsigned int i = 0; i < sizeof(pixel_kernels) / sizeof(pixel_kernels[0]); i++) {
+        if (pixel_kernels[i].src_fmt == src_fmt && pixel_kernels[i].dst_fmt == dst_fmt)
+            return pixel_kernels[i].funcs[isa];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavutil/pixfmt.h>
+#include <SDL2/SDL.h>
+
+enum PixelIsa {
+    PIXEL_ISA_SCALAR = 0,
+    PIXEL_ISA_SSE2,
+    PIXEL_ISA_AVX2,
+    PIXEL_ISA_COUNT
+};
+
+//same size repack of a band of h rows, the pointers are already at the first row
+typedef void (*PixelKernelFunc)(const uint8_t *const src[4], const int src_stride[4],
+                                uint8_t *const dst[4], const int dst_stride[4],
+                                int w, int h);
+
+int pixel_kernel_best_isa();
+
+const char *pixel_isa_name(int isa);
+
+PixelKernelFunc pixel_kernel_find(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt, int isa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,605 @@
+#include "scanner.h"
+#include "batch.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+#define SCAN_CACHE_VERSION "myplayer-scan 1"
+#define SCAN_MAX_STREAMS 1024 //more in a cache line means the cache is damaged
+
+Scanner *scanner_create(ThreadPool *pool, const char *cache_path)
+{
+    Scanner *sc = (Scanner *)av_mallocz(sizeof(Scanner));
+    if (!sc)
+        return NULL;
+
+    sc->pool = pool;
+    thread_task_group_init(&sc->tasks);
+
+    if (cache_path && !(sc->cache_path = av_strdup(cache_path))) {
+        scanner_free(&sc);
+        return NULL;
+    }
+
+    return sc;
+}
+
+static void scan_entries_free(ScanEntry **entries, int *nb_entries, int *max_entries)
+{
+    for (int i = 0; i < *nb_entries; i++) {
+        av_freep(&(*entries)[i].path);
+        av_freep(&(*entries)[i].streams);
+    }
+    av_freep(entries);
+    *nb_entries = 0;
+    *max_entries = 0;
+}
+
+void scanner_free(Scanner **psc)
+{
+    Scanner *sc;
+    int max = 0;
+
+    if (!psc || !*psc)
+        return;
+
+    sc = *psc;
+
+    scan_entries_free(&sc->entries, &sc->nb_entries, &sc->max_entries);
+    scan_entries_free(&sc->cache, &sc->nb_cache, &max);
+    av_freep(&sc->probe);
+    av_freep(&sc->cache_path);
+    thread_task_group_destroy(&sc->tasks);
+
+    av_freep(psc);
+}
+
+//a zeroed entry at the end, NULL when out of memory
+static ScanEntry *scan_entries_append(ScanEntry **entries, int *nb_entries, int *max_entries)
+{
+    ScanEntry *e;
+
+    if (*nb_entries == *max_entries) {
+        int max = FFMAX(2 * *max_entries, 256);
+        e = (ScanEntry *)av_realloc_array(*entries, max, sizeof(ScanEntry));
+        if (!e)
+            return NULL;
+        *entries = e;
+        *max_entries = max;
+    }
+
+    e = &(*entries)[(*nb_entries)++];
+    memset(e, 0, sizeof(ScanEntry));
+    e->duration = NAN;
+
+    return e;
+}
+
+static int scanner_add_file(Scanner *sc, const char *path, int64_t size, int64_t mtime)
+{
+    ScanEntry *e = scan_entries_append(&sc->entries, &sc->nb_entries, &sc->max_entries);
+    if (!e)
+        return -1;
+
+    e->path = av_strdup(path);
+    if (!e->path) {
+        sc->nb_entries--;
+        return -1;
+    }
+    e->size = size;
+    e->mtime = mtime;
+
+    return 0;
+}
+
+//a file, or every file below a directory. hidden files and directories are left
+//out. below the path given, links to files are followed and links to directories
+//are not, so a link back up the tree can't loop
+#ifdef _WIN32
+//100ns ticks since 1601 to unix seconds
+static int64_t scanner_filetime(FILETIME t)
+{
+    return (((int64_t)t.dwHighDateTime << 32 | t.dwLowDateTime) - 116444736000000000LL) / 10000000;
+}
+
+//what path resolves to, links followed, mtime in unix seconds
+static int scanner_stat(const char *path, int64_t *size, int64_t *mtime, int *is_dir)
+{
+    BY_HANDLE_FILE_INFORMATION info;
+    HANDLE h = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    int ok;
+
+    if (h == INVALID_HANDLE_VALUE)
+        return -1;
+    ok = GetFileInformationByHandle(h, &info);
+    CloseHandle(h);
+    if (!ok)
+        return -1;
+
+    *size = (int64_t)info.nFileSizeHigh << 32 | info.nFileSizeLow;
+    *mtime = scanner_filetime(info.ftLastWriteTime);
+    *is_dir = !!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+
+    return 0;
+}
+
+static int scanner_add_path(Scanner *sc, const char *path, int top)
+{
+    WIN32_FIND_DATAA fd;
+    HANDLE find;
+    char child[SCAN_MAX_PATH];
+    int64_t size, mtime;
+    int is_dir;
+
+    (void)top;
+
+    if (scanner_stat(path, &size, &mtime, &is_dir) < 0)
+        return -1;
+    if (!is_dir)
+        return scanner_add_file(sc, path, size, mtime);
+
+    if (snprintf(child, sizeof(child), "%s\\*", path) >= (int)sizeof(child))
+        return -1;
+    find = FindFirstFileA(child, &fd);
+    if (find == INVALID_HANDLE_VALUE) {
+        printf("scan: can't open %s\n", path);
+        return -1;
+    }
+    do {
+        if (fd.cFileName[0] == '.')
+            continue;
+        //too deep
+        if (snprintf(child, sizeof(child), "%s\\%s", path, fd.cFileName) >= (int)sizeof(child))
+            continue;
+        //a reparse point is a link or a junction
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                scanner_add_path(sc, child, 0);
+        } else if (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+            if (scanner_stat(child, &size, &mtime, &is_dir) == 0 && !is_dir)
+                scanner_add_file(sc, child, size, mtime);
+        } else {
+            scanner_add_file(sc, child, (int64_t)fd.nFileSizeHigh << 32 | fd.nFileSizeLow,
+                             scanner_filetime(fd.ftLastWriteTime));
+        }
+    } while (FindNextFileA(find, &fd));
+    FindClose(find);
+
+    return 0;
+}
+#else
+static int scanner_add_path(Scanner *sc, const char *path, int top)
+{
+    struct stat st;
+    struct dirent *de;
+    DIR *dir;
+    char child[SCAN_MAX_PATH];
+
+    if (top ? stat(path, &st) != 0 : lstat(path, &st) != 0)
+        return -1;
+
+    if (S_ISLNK(st.st_mode)) {
+        if (stat(path, &st) != 0 || S_ISDIR(st.st_mode))
+            return 0;
+    }
+
+    if (S_ISREG(st.st_mode))
+        return scanner_add_file(sc, path, st.st_size, st.st_mtime);
+
+    if (!S_ISDIR(st.st_mode))
+        return 0;
+
+    dir = opendir(path);
+    if (!dir) {
+        printf("scan: can't open %s\n", path);
+        return -1;
+    }
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] == '.')
+            continue;
+        //too deep
+        if (snprintf(child, sizeof(child), "%s/%s", path, de->d_name) >= (int)sizeof(child))
+            continue;
+        scanner_add_path(sc, child, 0);
+    }
+    closedir(dir);
+
+    return 0;
+}
+#endif
+
+int scanner_add(Scanner *sc, const char *path)
+{
+    if (!sc || !path)
+        return -1;
+
+    return scanner_add_path(sc, path, 1);
+}
+
+static int scan_entry_cmp(const void *a, const void *b)
+{
+    return strcmp(((const ScanEntry *)a)->path, ((const ScanEntry *)b)->path);
+}
+
+//text: the version, then a line per file with its streams on the lines after it.
+//"-" stands for an empty string, -1 for an unknown duration
+static int scanner_save_cache(Scanner *sc)
+{
+    char tmp_path[SCAN_MAX_PATH + 8];
+    FILE *f;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", sc->cache_path);
+    f = fopen(tmp_path, "w");
+    if (!f)
+        return -1;
+
+    fprintf(f, "%s\n", SCAN_CACHE_VERSION);
+    for (int i = 0; i < sc->nb_entries; i++) {
+        ScanEntry *e = &sc->entries[i];
+        if (strchr(e->path, '\n'))
+            continue;
+        fprintf(f, "%lld %lld %d %.6f %s %d %s\n", (long long)e->size, (long long)e->mtime, e->error,
+                isnan(e->duration) ? -1.0 : e->duration, e->format[0] ? e->format : "-",
+                e->nb_streams, e->path);
+        for (int j = 0; j < e->nb_streams; j++) {
+            ScanStream *st = &e->streams[j];
+            fprintf(f, "%d %s %d %d %d %d %s\n", st->type, st->codec, st->width, st->height,
+                    st->sample_rate, st->channels, st->language[0] ? st->language : "-");
+        }
+    }
+
+    //written next to the cache and renamed, a crash never leaves half a cache
+    if (fclose(f) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    remove(sc->cache_path);
+    if (rename(tmp_path, sc->cache_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+//a missing cache or one of another version means every file is probed
+static int scanner_load_cache(Scanner *sc)
+{
+    char line[SCAN_MAX_PATH + 256];
+    FILE *f;
+    int max = 0;
+
+    scan_entries_free(&sc->cache, &sc->nb_cache, &max);
+
+    f = fopen(sc->cache_path, "r");
+    if (!f)
+        return 0;
+
+    if (!fgets(line, sizeof(line), f) || strncmp(line, SCAN_CACHE_VERSION, strlen(SCAN_CACHE_VERSION))) {
+        fclose(f);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        ScanEntry *e;
+        long long size, mtime;
+        int nb_streams, error, n = 0, len;
+        double duration;
+        char format[32];
+
+        if (sscanf(line, "%lld %lld %d %lf %31s %d %n", &size, &mtime, &error, &duration,
+                   format, &nb_streams, &n) < 6 || !n || nb_streams < 0 || nb_streams > SCAN_MAX_STREAMS)
+            break;
+        len = strlen(line + n);
+        if (len && line[n + len - 1] == '\n')
+            line[n + --len] = 0;
+        if (!len)
+            break;
+
+        e = scan_entries_append(&sc->cache, &sc->nb_cache, &max);
+        if (!e || !(e->path = av_strdup(line + n))
+                || (nb_streams && !(e->streams = (ScanStream *)av_mallocz_array(nb_streams, sizeof(ScanStream))))) {
+            fclose(f);
+            return -1;
+        }
+        e->size = size;
+        e->mtime = mtime;
+        e->error = error;
+        e->duration = duration < 0 ? NAN : duration;
+        if (strcmp(format, "-"))
+            snprintf(e->format, sizeof(e->format), "%s", format);
+
+        for (e->nb_streams = 0; e->nb_streams < nb_streams; e->nb_streams++) {
+            ScanStream *st = &e->streams[e->nb_streams];
+            if (!fgets(line, sizeof(line), f)
+                    || sscanf(line, "%d %31s %d %d %d %d %7s", &st->type, st->codec, &st->width, &st->height,
+                              &st->sample_rate, &st->channels, st->language) < 7)
+                break;
+            if (!strcmp(st->language, "-"))
+                st->language[0] = 0;
+        }
+        //a cut off entry is probed again
+        if (e->nb_streams < nb_streams) {
+            e->size = -1;
+            break;
+        }
+    }
+    fclose(f);
+
+    qsort(sc->cache, sc->nb_cache, sizeof(ScanEntry), scan_entry_cmp);
+
+    return 0;
+}
+
+//unchanged files are taken from the cache, the others are lined up for probing
+static int scanner_match(Scanner *sc)
+{
+    av_freep(&sc->probe);
+    sc->nb_probe = 0;
+    sc->probe = (int *)av_malloc_array(FFMAX(sc->nb_entries, 1), sizeof(int));
+    if (!sc->probe)
+        return -1;
+
+    for (int i = 0; i < sc->nb_entries; i++) {
+        ScanEntry *e = &sc->entries[i];
+        ScanEntry *c = sc->nb_cache ? (ScanEntry *)bsearch(e, sc->cache, sc->nb_cache, sizeof(ScanEntry), scan_entry_cmp) : NULL;
+
+        if (!c || c->size != e->size || c->mtime != e->mtime) {
+            sc->probe[sc->nb_probe++] = i;
+            continue;
+        }
+
+        if (c->nb_streams && !(e->streams = (ScanStream *)av_memdup(c->streams, c->nb_streams * sizeof(ScanStream))))
+            return -1;
+        e->nb_streams = c->nb_streams;
+        e->error = c->error;
+        e->duration = c->duration;
+        memcpy(e->format, c->format, sizeof(e->format));
+        e->cached = 1;
+    }
+
+    return 0;
+}
+
+//containers with a header describe their streams in it. the others, and headers
+//leaving something out, need packets parsed to fill the gaps
+static int scanner_needs_stream_info(AVFormatContext *ic)
+{
+    int has_duration = ic->duration != AV_NOPTS_VALUE;
+
+    if (!ic->nb_streams || (ic->ctx_flags & AVFMTCTX_NOHEADER))
+        return 1;
+
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        AVCodecContext *c = st->codec;
+
+        if (c->codec_id == AV_CODEC_ID_NONE)
+            return 1;
+        if (c->codec_type == AVMEDIA_TYPE_VIDEO && (c->width <= 0 || c->height <= 0))
+            return 1;
+        if (c->codec_type == AVMEDIA_TYPE_AUDIO && (c->sample_rate <= 0 || c->channels <= 0))
+            return 1;
+        has_duration |= st->duration != AV_NOPTS_VALUE;
+    }
+
+    return !has_duration;
+}
+
+//format, duration and streams with bounded reads, no decoder is opened for files
+//with a complete header
+static int scanner_probe(ScanEntry *e)
+{
+    AVFormatContext *ic = avformat_alloc_context();
+    int ret = -1;
+
+    if (!ic)
+        return -1;
+
+    ic->probesize = SCAN_PROBE_SIZE;
+    ic->format_probesize = SCAN_PROBE_SIZE;
+    ic->max_analyze_duration = SCAN_ANALYZE_DURATION;
+
+    //frees ic when it fails
+    if (avformat_open_input(&ic, e->path, NULL, NULL) < 0)
+        return -1;
+
+    if (scanner_needs_stream_info(ic) && avformat_find_stream_info(ic, NULL) < 0)
+        goto clean;
+    if (!ic->nb_streams)
+        goto clean;
+
+    e->streams = (ScanStream *)av_mallocz_array(ic->nb_streams, sizeof(ScanStream));
+    if (!e->streams)
+        goto clean;
+    e->nb_streams = ic->nb_streams;
+
+    snprintf(e->format, sizeof(e->format), "%s", ic->iformat->name);
+    if (ic->duration != AV_NOPTS_VALUE)
+        e->duration = (double)ic->duration / AV_TIME_BASE;
+
+    for (unsigned int i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        AVCodecContext *c = st->codec;
+        ScanStream *s = &e->streams[i];
+        AVDictionaryEntry *lang = av_dict_get(st->metadata, "language", NULL, 0);
+
+        s->type = c->codec_type;
+        snprintf(s->codec, sizeof(s->codec), "%s", avcodec_get_name(c->codec_id));
+        s->width = c->width;
+        s->height = c->height;
+        s->sample_rate = c->sample_rate;
+        s->channels = c->channels;
+        if (lang && lang->value[0])
+            snprintf(s->language, sizeof(s->language), "%s", lang->value);
+        //the cache separates fields with spaces
+        for (char *p = s->language; *p; p++) {
+            if (*p == ' ' || *p == '\n')
+                *p = '_';
+        }
+
+        //without the demuxer's estimate the longest stream is the file
+        if (ic->duration == AV_NOPTS_VALUE && st->duration != AV_NOPTS_VALUE) {
+            double duration = st->duration * av_q2d(st->time_base);
+            if (isnan(e->duration) || duration > e->duration)
+                e->duration = duration;
+        }
+    }
+
+    ret = 0;
+
+clean:
+    avformat_close_input(&ic);
+
+    return ret;
+}
+
+static void scanner_worker(void *opaque)
+{
+    Scanner *sc = (Scanner *)opaque;
+    int i;
+
+    while ((i = SDL_AtomicAdd(&sc->next_probe, 1)) < sc->nb_probe) {
+        ScanEntry *e = &sc->entries[sc->probe[i]];
+        e->error = scanner_probe(e) < 0;
+    }
+}
+
+//fills every added entry, unchanged files from the cache and the others probed on
+//the pool (inline without one). the cache is then rewritten with just these
+//entries, so a library keeps a cache of its own
+int scanner_scan(Scanner *sc)
+{
+    if (!sc)
+        return -1;
+
+    if (sc->cache_path && scanner_load_cache(sc) < 0)
+        return -1;
+    if (scanner_match(sc) < 0)
+        return -1;
+
+    SDL_AtomicSet(&sc->next_probe, 0);
+    thread_pool_run_n(sc->pool, &sc->tasks, scanner_worker, sc, sc->nb_probe);
+
+    sc->nb_errors = 0;
+    for (int i = 0; i < sc->nb_entries; i++)
+        sc->nb_errors += sc->entries[i].error;
+
+    //nothing new and nothing gone, the cache is still right
+    if (sc->cache_path && (sc->nb_probe || sc->nb_entries != sc->nb_cache)
+            && scanner_save_cache(sc) < 0) {
+        printf("scan: can't write %s\n", sc->cache_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void scanner_entry_line(FILE *out, ScanEntry *e)
+{
+    fprintf(out, "{\"kind\":\"file\",\"file\":");
+    json_put_string(out, e->path);
+    fprintf(out, ",\"size\":%lld,\"cached\":%s,\"status\":\"%s\"", (long long)e->size,
+            e->cached ? "true" : "false", e->error ? "error" : "ok");
+    if (e->error) {
+        fprintf(out, "}\n");
+        return;
+    }
+
+    fprintf(out, ",\"format\":");
+    json_put_string(out, e->format);
+    if (isnan(e->duration))
+        fprintf(out, ",\"duration\":null");
+    else
+        fprintf(out, ",\"duration\":%.3f", e->duration);
+    fprintf(out, ",\"streams\":[");
+    for (int i = 0; i < e->nb_streams; i++) {
+        ScanStream *st = &e->streams[i];
+        const char *type = av_get_media_type_string((enum AVMediaType)st->type);
+
+        fprintf(out, "%s{\"index\":%d,\"type\":\"%s\",\"codec\":", i ? "," : "", i, type ? type : "unknown");
+        json_put_string(out, st->codec);
+        if (st->type == AVMEDIA_TYPE_VIDEO)
+            fprintf(out, ",\"width\":%d,\"height\":%d", st->width, st->height);
+        else if (st->type == AVMEDIA_TYPE_AUDIO)
+            fprintf(out, ",\"sample_rate\":%d,\"channels\":%d", st->sample_rate, st->channels);
+        if (st->language[0]) {
+            fprintf(out, ",\"language\":");
+            json_put_string(out, st->language);
+        }
+        fputc('}', out);
+    }
+    fprintf(out, "]}\n");
+}
+
+//-scan [-j N] [-cache FILE|none] [-o out.jsonl] path [path ...]
+//a json line per file below the paths and one for the whole scan. new and changed
+//files are probed on N workers (0 = one per cpu), the rest comes from the cache
+int scanner_run(int argc, char *argv[])
+{
+    const char *cache_path = SCAN_CACHE_FILE, *out_name = NULL;
+    ThreadPool *pool = NULL;
+    Scanner *sc = NULL;
+    FILE *out = stdout;
+    int nb_workers = 0, first = 0, ret = -1;
+    Uint64 start;
+    double ms;
+
+    while (first < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "-j") && first + 1 < argc) {
+            nb_workers = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-cache") && first + 1 < argc) {
+            cache_path = strcmp(argv[first + 1], "none") ? argv[first + 1] : NULL;
+            first += 2;
+        } else if (!strcmp(argv[first], "-o") && first + 1 < argc) {
+            out_name = argv[first + 1];
+            first += 2;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc)
+        return -1;
+
+    if (out_name && !(out = fopen(out_name, "w"))) {
+        printf("scan: can't open %s\n", out_name);
+        return -1;
+    }
+
+    start = SDL_GetPerformanceCounter();
+
+    pool = thread_pool_create(nb_workers);
+    sc = pool ? scanner_create(pool, cache_path) : NULL;
+    if (!sc)
+        goto clean;
+
+    for (int i = first; i < argc; i++) {
+        if (scanner_add(sc, argv[i]) < 0)
+            printf("scan: can't read %s\n", argv[i]);
+    }
+
+    if (scanner_scan(sc) < 0)
+        goto clean;
+
+    for (int i = 0; i < sc->nb_entries; i++)
+        scanner_entry_line(out, &sc->entries[i]);
+
+    ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    fprintf(out, "{\"kind\":\"scan\",\"files\":%d,\"probed\":%d,\"cached\":%d,\"errors\":%d,\"workers\":%d,\"ms\":%.1f}\n",
+            sc->nb_entries, sc->nb_probe, sc->nb_entries - sc->nb_probe, sc->nb_errors, pool->nb_workers, ms);
+
+    ret = 0;
+
+clean:
+    scanner_free(&sc);
+    thread_pool_free(&pool);
+    if (out != stdout)
+        fclose(out);
+
+    return ret;
+}
@@ -0,0 +1,60 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "mediastate.h"
+
+#define SCAN_PROBE_SIZE (256 * 1024) //bytes read to recognize the format and find the streams
+#define SCAN_ANALYZE_DURATION 500000 //us of packets parsed for formats without a header
+#define SCAN_MAX_PATH 4096
+#define SCAN_CACHE_FILE "scan.cache"
+
+typedef struct ScanStream {
+    int type; //enum AVMediaType
+    char codec[32];
+    int width;
+    int height;
+    int sample_rate;
+    int channels;
+    char language[8];
+} ScanStream;
+
+typedef struct ScanEntry {
+    char *path;
+    int64_t size;
+    int64_t mtime;
+    int error; //not a media file, kept in the cache so it is not probed again
+    int cached; //unchanged since the last scan, nothing was read
+    double duration; //seconds, NAN when unknown
+    char format[32];
+    ScanStream *streams;
+    int nb_streams;
+} ScanEntry;
+
+//files are added (directories recursively) and stat'ed on the calling thread, the
+//ones missing from the cache or changed since are probed on the pool
+typedef struct Scanner {
+    ThreadPool *pool;
+    ThreadTaskGroup tasks;
+    char *cache_path;
+    ScanEntry *cache; //the last scan, sorted by path
+    int nb_cache;
+    ScanEntry *entries; //in the order they were added
+    int nb_entries;
+    int max_entries;
+    int *probe; //entries to probe
+    int nb_probe;
+    SDL_atomic_t next_probe;
+    int nb_errors; //files that are not media, cached ones included
+} Scanner;
+
+Scanner *scanner_create(ThreadPool *pool, const char *cache_path);
+
+void scanner_free(Scanner **sc);
+
+int scanner_add(Scanner *sc, const char *path);
+
+int scanner_scan(Scanner *sc);
+
+int scanner_run(int argc, char *argv[]);
+
+#endif // SCANNER_H
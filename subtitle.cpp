@@ -0,0 +1,629 @@
+#include "subtitle.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SUBTITLE_GLYPH 10 //8x8 font cell with a 1 pixel outline
+#define SUBTITLE_TEXT_COLS (SUBTITLE_TEXT_WIDTH * 9 / 10 / (SUBTITLE_GLYPH * SUBTITLE_TEXT_SCALE))
+#define SUBTITLE_TEXT_LINES 8
+#define SUBTITLE_TEXT_SIZE 1024
+
+//printable ascii from 0x20, one byte per row and the lowest bit on the left
+static const uint8_t subtitle_font[95][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, //
+    { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // !
+    { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+    { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // #
+    { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // $
+    { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // %
+    { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // &
+    { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+    { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // (
+    { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // )
+    { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // *
+    { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ,
+    { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // .
+    { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // /
+    { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // 0
+    { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // 1
+    { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // 2
+    { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // 3
+    { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // 4
+    { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // 5
+    { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // 6
+    { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // 7
+    { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // 8
+    { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ;
+    { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // <
+    { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // =
+    { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // >
+    { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // ?
+    { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // @
+    { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // A
+    { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // B
+    { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // C
+    { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // D
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // E
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // F
+    { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // G
+    { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // H
+    { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // I
+    { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // J
+    { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // K
+    { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // L
+    { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // M
+    { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // N
+    { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // O
+    { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // P
+    { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // Q
+    { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // R
+    { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // S
+    { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // T
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // U
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // V
+    { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // W
+    { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // X
+    { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // Y
+    { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // Z
+    { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // [
+    { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // backslash
+    { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ]
+    { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // _
+    { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+    { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // a
+    { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // b
+    { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // c
+    { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // d
+    { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // e
+    { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // f
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // g
+    { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // h
+    { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // i
+    { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // j
+    { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // k
+    { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // l
+    { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // m
+    { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // n
+    { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // o
+    { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // p
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // q
+    { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // r
+    { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // s
+    { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // t
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // u
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // v
+    { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // w
+    { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // x
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // y
+    { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // z
+    { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // {
+    { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // |
+    { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // }
+    { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ~
+};
+
+//white glyphs with a black outline, they stay readable on any picture
+static uint32_t subtitle_glyph_pixel(int c, int x, int y)
+{
+    const uint8_t *glyph = subtitle_font[c - 0x20];
+
+    //the cell has the outline around the 8x8 glyph
+    x--;
+    y--;
+    if (x >= 0 && x < 8 && y >= 0 && y < 8 && (glyph[y] >> x & 1))
+        return 0xffffffff;
+
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int gx = x + dx, gy = y + dy;
+            if (gx >= 0 && gx < 8 && gy >= 0 && gy < 8 && (glyph[gy] >> gx & 1))
+                return 0xff000000;
+        }
+    }
+
+    return 0;
+}
+
+//the text of an ass dialogue line without its override tags. older decoders
+//give "Dialogue: Layer,Start,End,Style,..." and newer ones "ReadOrder,Layer,
+//Style,...", the text comes after the 9th or the 8th comma
+static void subtitle_ass_text(const char *ass, char *out, int size)
+{
+    const char *p = ass;
+    int commas = strncmp(ass, "Dialogue:", 9) ? 8 : 9;
+    int n = 0;
+
+    for (int i = 0; i < commas && p; i++) {
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+    if (!p)
+        p = ass;
+
+    while (*p && n < size - 1) {
+        if (*p == '{' && strchr(p, '}')) {
+            p = strchr(p, '}') + 1;
+        } else if (*p == '\\' && (p[1] == 'N' || p[1] == 'n')) {
+            out[n++] = '\n';
+            p += 2;
+        } else if (*p == '\\' && p[1] == 'h') {
+            out[n++] = ' ';
+            p += 2;
+        } else {
+            out[n++] = *p++;
+        }
+    }
+    out[n] = '\0';
+}
+
+//the font only has ascii, any other character becomes one '?'
+static void subtitle_ascii(char *text)
+{
+    unsigned char *in = (unsigned char *)text;
+    char *out = text;
+
+    for (; *in; in++) {
+        if (*in == '\n')
+            *out++ = '\n';
+        else if (*in == '\t')
+            *out++ = ' ';
+        else if (*in >= 0xc0)
+            *out++ = '?';
+        else if (*in >= 0x20 && *in < 0x7f)
+            *out++ = *in;
+    }
+    *out = '\0';
+}
+
+//break the text into lines of at most SUBTITLE_TEXT_COLS at the spaces,
+//returns the number of lines
+static int subtitle_text_wrap(const char *p, char lines[][SUBTITLE_TEXT_COLS + 1], int *lens)
+{
+    int nb_lines = 0, len = 0;
+
+    while (*p && nb_lines < SUBTITLE_TEXT_LINES) {
+        int wl;
+
+        if (*p == '\n' || (*p == ' ' && len == 0)) {
+            if (*p == '\n') {
+                lens[nb_lines++] = len;
+                len = 0;
+            }
+            p++;
+            continue;
+        }
+
+        wl = *p == ' ' ? 1 : (int)strcspn(p, " \n");
+        if (len > 0 && len + wl > SUBTITLE_TEXT_COLS) {
+            lens[nb_lines++] = len;
+            len = 0;
+            continue;
+        }
+
+        wl = FFMIN(wl, SUBTITLE_TEXT_COLS - len);
+        memcpy(lines[nb_lines] + len, p, wl);
+        len += wl;
+        p += wl;
+    }
+    if (len > 0 && nb_lines < SUBTITLE_TEXT_LINES)
+        lens[nb_lines++] = len;
+
+    //no spaces at the end of a line and no empty lines at the bottom
+    for (int i = 0; i < nb_lines; i++) {
+        while (lens[i] > 0 && lines[i][lens[i] - 1] == ' ')
+            lens[i]--;
+    }
+    while (nb_lines > 0 && lens[nb_lines - 1] == 0)
+        nb_lines--;
+
+    return nb_lines;
+}
+
+//the lines centered at the bottom of the text canvas, each character drawn
+//once here and never again while the subtitle lasts
+static int subtitle_text_bitmap(SubtitleBitmap *b, const char *text)
+{
+    char lines[SUBTITLE_TEXT_LINES][SUBTITLE_TEXT_COLS + 1];
+    int lens[SUBTITLE_TEXT_LINES];
+    int nb_lines, max_len = 0;
+    int cell = SUBTITLE_GLYPH * SUBTITLE_TEXT_SCALE;
+
+    nb_lines = subtitle_text_wrap(text, lines, lens);
+    for (int i = 0; i < nb_lines; i++)
+        max_len = FFMAX(max_len, lens[i]);
+    if (!max_len)
+        return 0;
+
+    b->w = max_len * cell;
+    b->h = nb_lines * cell;
+    b->x = (SUBTITLE_TEXT_WIDTH - b->w) / 2;
+    b->y = SUBTITLE_TEXT_HEIGHT - b->h - SUBTITLE_TEXT_HEIGHT / 20;
+    b->pixels = (uint32_t *)av_mallocz((size_t)b->w * b->h * sizeof(uint32_t));
+    if (!b->pixels)
+        return -1;
+
+    for (int i = 0; i < nb_lines; i++) {
+        int x0 = (max_len - lens[i]) * cell / 2;
+        for (int j = 0; j < lens[i]; j++) {
+            for (int y = 0; y < cell; y++) {
+                uint32_t *row = b->pixels + (size_t)(i * cell + y) * b->w + x0 + j * cell;
+                for (int x = 0; x < cell; x++)
+                    row[x] = subtitle_glyph_pixel(lines[i][j], x / SUBTITLE_TEXT_SCALE, y / SUBTITLE_TEXT_SCALE);
+            }
+        }
+    }
+
+    return 1;
+}
+
+//a palettized rect to argb, the palette already is 0xaarrggbb
+static int subtitle_rect_bitmap(SubtitleBitmap *b, AVSubtitleRect *rect)
+{
+    const uint32_t *palette = (const uint32_t *)rect->data[1];
+
+    if (rect->w <= 0 || rect->h <= 0 || !rect->data[0] || !palette)
+        return 0;
+
+    b->x = rect->x;
+    b->y = rect->y;
+    b->w = rect->w;
+    b->h = rect->h;
+    b->pixels = (uint32_t *)av_malloc((size_t)b->w * b->h * sizeof(uint32_t));
+    if (!b->pixels)
+        return -1;
+
+    for (int y = 0; y < b->h; y++) {
+        const uint8_t *src = rect->data[0] + y * rect->linesize[0];
+        uint32_t *dst = b->pixels + (size_t)y * b->w;
+        for (int x = 0; x < b->w; x++)
+            dst[x] = palette[src[x]];
+    }
+
+    return 1;
+}
+
+//on the decoder thread: everything the presenter needs is made here, sub can
+//be freed afterwards. a subtitle without rects clears the screen
+Subtitle *subtitle_create(AVSubtitle *sub, double start, double end, int canvas_w, int canvas_h)
+{
+    Subtitle *st = (Subtitle *)av_mallocz(sizeof(Subtitle));
+    char text[SUBTITLE_TEXT_SIZE];
+
+    if (!st)
+        return NULL;
+
+    st->start = start;
+    st->end = end;
+    if (sub->num_rects) {
+        st->bitmaps = (SubtitleBitmap *)av_mallocz_array(sub->num_rects, sizeof(SubtitleBitmap));
+        if (!st->bitmaps)
+            goto fail;
+    }
+
+    for (unsigned int i = 0; i < sub->num_rects; i++) {
+        AVSubtitleRect *rect = sub->rects[i];
+        SubtitleBitmap *b = &st->bitmaps[st->nb_bitmaps];
+        int ret;
+
+        if (rect->type == SUBTITLE_BITMAP) {
+            ret = subtitle_rect_bitmap(b, rect);
+            st->canvas_w = canvas_w;
+            st->canvas_h = canvas_h;
+        } else {
+            if (rect->type == SUBTITLE_ASS && rect->ass)
+                subtitle_ass_text(rect->ass, text, sizeof(text));
+            else if (rect->text)
+                snprintf(text, sizeof(text), "%s", rect->text);
+            else
+                continue;
+            subtitle_ascii(text);
+            ret = subtitle_text_bitmap(b, text);
+            st->canvas_w = SUBTITLE_TEXT_WIDTH;
+            st->canvas_h = SUBTITLE_TEXT_HEIGHT;
+        }
+        if (ret < 0)
+            goto fail;
+        st->nb_bitmaps += ret;
+    }
+
+    return st;
+
+fail:
+    subtitle_free(&st);
+    return NULL;
+}
+
+void subtitle_free(Subtitle **psub)
+{
+    Subtitle *sub;
+
+    if (!psub || !*psub)
+        return;
+
+    sub = *psub;
+
+    for (int i = 0; i < sub->nb_bitmaps; i++)
+        av_freep(&sub->bitmaps[i].pixels);
+    av_freep(&sub->bitmaps);
+
+    av_freep(psub);
+}
+
+void subtitle_queue_init(SubtitleQueue *q)
+{
+    memset(q->subs, 0, sizeof(q->subs));
+    q->rindex = 0;
+    q->nb_subs = 0;
+    SDL_AtomicSet(&q->serial, 0);
+    q->mutex = SDL_CreateMutex();
+}
+
+//after a seek, what is queued and what is on screen belongs to the old position
+void subtitle_queue_flush(SubtitleQueue *q)
+{
+    SDL_LockMutex(q->mutex);
+    for (int i = 0; i < q->nb_subs; i++)
+        subtitle_free(&q->subs[(q->rindex + i) % SUBTITLE_QUEUE_SIZE]);
+    q->rindex = 0;
+    q->nb_subs = 0;
+    SDL_AtomicAdd(&q->serial, 1);
+    SDL_UnlockMutex(q->mutex);
+}
+
+void subtitle_queue_destroy(SubtitleQueue *q)
+{
+    if (!q->mutex)
+        return;
+
+    subtitle_queue_flush(q);
+    SDL_DestroyMutex(q->mutex);
+    q->mutex = NULL;
+}
+
+int subtitle_queue_full(SubtitleQueue *q)
+{
+    int full;
+
+    SDL_LockMutex(q->mutex);
+    full = q->nb_subs >= SUBTITLE_QUEUE_SIZE;
+    SDL_UnlockMutex(q->mutex);
+
+    return full;
+}
+
+//the queue owns sub when it returns 1
+int subtitle_queue_put(SubtitleQueue *q, Subtitle *sub)
+{
+    int ret = 0;
+
+    SDL_LockMutex(q->mutex);
+    if (q->nb_subs < SUBTITLE_QUEUE_SIZE) {
+        q->subs[(q->rindex + q->nb_subs) % SUBTITLE_QUEUE_SIZE] = sub;
+        q->nb_subs++;
+        ret = 1;
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
+}
+
+//the oldest subtitle once its start time has come, the caller owns it
+Subtitle *subtitle_queue_get(SubtitleQueue *q, double time)
+{
+    Subtitle *sub = NULL;
+
+    SDL_LockMutex(q->mutex);
+    if (q->nb_subs > 0 && q->subs[q->rindex]->start <= time) {
+        sub = q->subs[q->rindex];
+        q->subs[q->rindex] = NULL;
+        q->rindex = (q->rindex + 1) % SUBTITLE_QUEUE_SIZE;
+        q->nb_subs--;
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    return sub;
+}
+
+SubtitleAtlas *subtitle_atlas_create(SDL_Renderer *render)
+{
+    SubtitleAtlas *a;
+    SDL_RendererInfo info;
+
+    if (!render)
+        return NULL;
+
+    a = (SubtitleAtlas *)av_mallocz(sizeof(SubtitleAtlas));
+    if (!a)
+        return NULL;
+
+    a->render = render;
+    a->width = SUBTITLE_ATLAS_WIDTH;
+    a->height = SUBTITLE_ATLAS_HEIGHT;
+    if (SDL_GetRendererInfo(render, &info) == 0 && info.max_texture_width > 0 && info.max_texture_height > 0) {
+        a->width = FFMIN(a->width, info.max_texture_width);
+        a->height = FFMIN(a->height, info.max_texture_height);
+    }
+
+    a->texture = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, a->width, a->height);
+    if (!a->texture) {
+        printf("create subtitle texture failed: %s\n", SDL_GetError());
+        av_freep(&a);
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(a->texture, SDL_BLENDMODE_BLEND);
+    a->gen = 1;
+
+    return a;
+}
+
+void subtitle_atlas_free(SubtitleAtlas **pa)
+{
+    SubtitleAtlas *a;
+
+    if (!pa || !*pa)
+        return;
+
+    a = *pa;
+
+    for (int i = 0; i < a->nb_shown; i++)
+        subtitle_free(&a->shown[i]);
+    if (a->texture)
+        SDL_DestroyTexture(a->texture);
+
+    av_freep(pa);
+}
+
+static void subtitle_atlas_remove(SubtitleAtlas *a, int index)
+{
+    subtitle_free(&a->shown[index]);
+    memmove(&a->shown[index], &a->shown[index + 1], (a->nb_shown - index - 1) * sizeof(Subtitle *));
+    a->nb_shown--;
+}
+
+//the space of subtitles no longer shown comes back all at once
+static void subtitle_atlas_reset(SubtitleAtlas *a)
+{
+    a->gen++;
+    a->shelf_x = 0;
+    a->shelf_y = 0;
+    a->shelf_h = 0;
+    a->nb_resets++;
+}
+
+//1 when the bitmap got its place, 0 when the atlas is full and <0 when it is
+//larger than the whole atlas
+static int subtitle_atlas_place(SubtitleAtlas *a, SubtitleBitmap *b)
+{
+    if (b->w > a->width || b->h > a->height)
+        return -1;
+
+    if (a->shelf_x + b->w > a->width) {
+        a->shelf_y += a->shelf_h;
+        a->shelf_x = 0;
+        a->shelf_h = 0;
+    }
+    if (a->shelf_y + b->h > a->height)
+        return 0;
+
+    b->src.x = a->shelf_x;
+    b->src.y = a->shelf_y;
+    b->src.w = b->w;
+    b->src.h = b->h;
+    a->shelf_x += b->w;
+    a->shelf_h = FFMAX(a->shelf_h, b->h);
+
+    return 1;
+}
+
+//returns 0 when the atlas is full and the caller should reset it, after a reset
+//(last) the bitmaps that still don't fit are left out
+static int subtitle_atlas_upload(SubtitleAtlas *a, Subtitle *sub, int last)
+{
+    for (int i = 0; i < sub->nb_bitmaps; i++) {
+        SubtitleBitmap *b = &sub->bitmaps[i];
+        int ret = subtitle_atlas_place(a, b);
+
+        if (ret == 0 && !last)
+            return 0;
+        if (ret <= 0) {
+            b->src.w = 0;
+            continue;
+        }
+        SDL_UpdateTexture(a->texture, &b->src, b->pixels, b->w * sizeof(uint32_t));
+        a->nb_uploads++;
+    }
+    sub->atlas_gen = a->gen;
+
+    return 1;
+}
+
+//from the presenter: take the subtitles due at time, drop the ended ones and
+//upload what is new. a subtitle on screen costs no upload on later refreshes.
+//returns the number of subtitles shown
+int subtitle_atlas_update(SubtitleAtlas *a, SubtitleQueue *q, double time)
+{
+    Subtitle *sub;
+    int serial;
+
+    if (!a)
+        return 0;
+
+    serial = SDL_AtomicGet(&q->serial);
+    if (serial != a->serial) {
+        while (a->nb_shown > 0)
+            subtitle_atlas_remove(a, 0);
+        a->serial = serial;
+    }
+
+    if (isnan(time))
+        return a->nb_shown;
+
+    while ((sub = subtitle_queue_get(q, time))) {
+        //a subtitle without an end lasts until this one
+        for (int i = 0; i < a->nb_shown; i++) {
+            if (isinf(a->shown[i]->end))
+                a->shown[i]->end = sub->start;
+        }
+        if (!sub->nb_bitmaps) {
+            subtitle_free(&sub);
+            continue;
+        }
+        if (a->nb_shown == SUBTITLE_MAX_SHOWN)
+            subtitle_atlas_remove(a, 0);
+        a->shown[a->nb_shown++] = sub;
+        a->nb_subtitles++;
+    }
+
+    for (int i = a->nb_shown - 1; i >= 0; i--) {
+        if (a->shown[i]->end <= time)
+            subtitle_atlas_remove(a, i);
+    }
+
+    for (int last = 0; last < 2; last++) {
+        int full = 0;
+        for (int i = 0; i < a->nb_shown && !full; i++) {
+            if (a->shown[i]->atlas_gen != a->gen)
+                full = !subtitle_atlas_upload(a, a->shown[i], last);
+        }
+        if (!full)
+            break;
+        subtitle_atlas_reset(a);
+    }
+
+    return a->nb_shown;
+}
+
+//over the picture in r, the bitmaps are scaled from their canvas by the renderer
+void subtitle_atlas_draw(SubtitleAtlas *a, const SDL_Rect *r, int video_w, int video_h)
+{
+    if (!a || a->hidden)
+        return;
+
+    for (int i = 0; i < a->nb_shown; i++) {
+        Subtitle *sub = a->shown[i];
+        int cw = sub->canvas_w > 0 ? sub->canvas_w : video_w;
+        int ch = sub->canvas_h > 0 ? sub->canvas_h : video_h;
+
+        if (cw <= 0 || ch <= 0)
+            continue;
+
+        for (int j = 0; j < sub->nb_bitmaps; j++) {
+            SubtitleBitmap *b = &sub->bitmaps[j];
+            SDL_Rect dst;
+
+            if (!b->src.w)
+                continue;
+            dst.x = r->x + (int)((int64_t)b->x * r->w / cw);
+            dst.y = r->y + (int)((int64_t)b->y * r->h / ch);
+            dst.w = (int)((int64_t)b->w * r->w / cw);
+            dst.h = (int)((int64_t)b->h * r->h / ch);
+            SDL_RenderCopy(a->render, a->texture, &b->src, &dst);
+        }
+    }
+}
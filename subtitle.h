@@ -0,0 +1,98 @@
+#ifndef SUBTITLE_H
+#define SUBTITLE_H
+
+#define SUBTITLE_QUEUE_SIZE 16 //decoded subtitles waiting for their time
+#define SUBTITLE_MAX_SHOWN 4 //on screen at once, the oldest goes first
+#define SUBTITLE_ATLAS_WIDTH 2048 //a full 1080p bitmap row fits
+#define SUBTITLE_ATLAS_HEIGHT 1024
+#define SUBTITLE_TEXT_WIDTH 1920 //canvas text subtitles are laid out on
+#define SUBTITLE_TEXT_HEIGHT 1080
+#define SUBTITLE_TEXT_SCALE 4 //glyph cells of 10x10 pixels scaled up, 40 pixel lines
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL.h>
+
+//one picture of a subtitle in argb, kept until the subtitle is gone so the
+//atlas can take it again after a reset
+typedef struct SubtitleBitmap {
+    int x, y, w, h; //on the subtitle's canvas
+    uint32_t *pixels;
+    SDL_Rect src; //in the atlas, w 0 when it did not fit
+} SubtitleBitmap;
+
+//bitmap and text subtitles both end up as bitmaps, text is rasterised once by
+//the decoder with the built-in font
+typedef struct Subtitle {
+    double start; //session time
+    double end; //INFINITY until the next subtitle starts
+    int canvas_w; //size the bitmaps are placed on, 0 for the video size
+    int canvas_h;
+    int nb_bitmaps;
+    SubtitleBitmap *bitmaps;
+    int atlas_gen; //of the atlas holding the bitmaps, 0 before the upload
+} Subtitle;
+
+Subtitle *subtitle_create(AVSubtitle *sub, double start, double end, int canvas_w, int canvas_h);
+
+void subtitle_free(Subtitle **sub);
+
+//from the subtitle decoder to the presenter
+typedef struct SubtitleQueue {
+    Subtitle *subs[SUBTITLE_QUEUE_SIZE];
+    int rindex;
+    int nb_subs;
+    SDL_atomic_t serial; //changed by a flush, the presenter drops what it shows
+    SDL_mutex *mutex;
+} SubtitleQueue;
+
+void subtitle_queue_init(SubtitleQueue *q);
+
+void subtitle_queue_flush(SubtitleQueue *q);
+
+void subtitle_queue_destroy(SubtitleQueue *q);
+
+int subtitle_queue_full(SubtitleQueue *q);
+
+int subtitle_queue_put(SubtitleQueue *q, Subtitle *sub);
+
+Subtitle *subtitle_queue_get(SubtitleQueue *q, double time);
+
+//one static texture the subtitles on screen are uploaded to once, every
+//refresh only draws parts of it over the picture
+typedef struct SubtitleAtlas {
+    SDL_Renderer *render;
+    SDL_Texture *texture;
+    int width;
+    int height;
+    int gen; //next upload generation, a reset moves to a new one
+    int shelf_x; //bitmaps are packed in rows, the shelves
+    int shelf_y;
+    int shelf_h;
+    Subtitle *shown[SUBTITLE_MAX_SHOWN];
+    int nb_shown;
+    int serial;
+    int hidden;
+
+    //statistics
+    int64_t nb_subtitles;
+    int64_t nb_uploads;
+    int64_t nb_resets;
+} SubtitleAtlas;
+
+SubtitleAtlas *subtitle_atlas_create(SDL_Renderer *render);
+
+void subtitle_atlas_free(SubtitleAtlas **a);
+
+int subtitle_atlas_update(SubtitleAtlas *a, SubtitleQueue *q, double time);
+
+void subtitle_atlas_draw(SubtitleAtlas *a, const SDL_Rect *r, int video_w, int video_h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SUBTITLE_H
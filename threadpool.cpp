@@ -0,0 +1,352 @@
+#include "threadpool.h"
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+typedef struct DelayedTask {
+    ThreadPool *pool;
+    int priority;
+    ThreadTask task;
+} DelayedTask;
+
+static int task_deque_push(TaskDeque *d, const ThreadTask *task)
+{
+    int count;
+
+    SDL_AtomicLock(&d->lock);
+    count = SDL_AtomicGet(&d->count);
+    if (count == d->capacity) { //full, grow the ring and unwrap it
+        int capacity = d->capacity ? d->capacity * 2 : TASK_DEQUE_INIT_SIZE;
+        ThreadTask *tasks = (ThreadTask *)av_malloc(capacity * sizeof(ThreadTask));
+        if (!tasks) {
+            SDL_AtomicUnlock(&d->lock);
+            return -1;
+        }
+        for (int i = 0; i < count; i++)
+            tasks[i] = d->tasks[(d->head + i) % d->capacity];
+        av_free(d->tasks);
+        d->tasks = tasks;
+        d->capacity = capacity;
+        d->head = 0;
+    }
+    d->tasks[(d->head + count) % d->capacity] = *task;
+    SDL_AtomicAdd(&d->count, 1);
+    SDL_AtomicUnlock(&d->lock);
+    return 0;
+}
+
+//owner and thieves both take the oldest task, so a task that resubmits
+//itself can't starve the others queued on the same worker
+static int task_deque_pop(TaskDeque *d, ThreadTask *task)
+{
+    int ret = 0;
+
+    if (!SDL_AtomicGet(&d->count)) //peek, avoids the lock on empty deques
+        return 0;
+
+    SDL_AtomicLock(&d->lock);
+    if (SDL_AtomicGet(&d->count)) {
+        *task = d->tasks[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        SDL_AtomicAdd(&d->count, -1);
+        ret = 1;
+    }
+    SDL_AtomicUnlock(&d->lock);
+    return ret;
+}
+
+static int worker_find_task(ThreadWorker *w, ThreadTask *task)
+{
+    ThreadPool *pool = w->pool;
+
+    for (int prio = TASK_PRIORITY_COUNT - 1; prio >= 0; prio--) {
+        if (task_deque_pop(&w->deques[prio], task))
+            return 1;
+
+        //steal before falling back to a lower priority of our own
+        for (int i = 1; i < pool->nb_workers; i++) {
+            ThreadWorker *victim = &pool->workers[(w->index + i) % pool->nb_workers];
+            if (task_deque_pop(&victim->deques[prio], task))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void run_task(ThreadTask *task)
+{
+    task->func(task->opaque);
+    if (task->group)
+        thread_task_group_done(task->group);
+}
+
+static int worker_thread(void *userdata)
+{
+    ThreadWorker *w = (ThreadWorker *)userdata;
+    ThreadPool *pool = w->pool;
+    ThreadTask task;
+
+    SDL_TLSSet(pool->tls, w, NULL);
+
+    while (!SDL_AtomicGet(&pool->quit)) {
+        if (worker_find_task(w, &task)) {
+            SDL_AtomicAdd(&pool->nb_queued, -1);
+            run_task(&task);
+            continue;
+        }
+
+        SDL_LockMutex(pool->mutex);
+        pool->nb_idle++;
+        while (!SDL_AtomicGet(&pool->quit) && SDL_AtomicGet(&pool->nb_queued) <= 0)
+            SDL_CondWait(pool->cond, pool->mutex);
+        pool->nb_idle--;
+        SDL_UnlockMutex(pool->mutex);
+    }
+
+    return 0;
+}
+
+static int thread_pool_push(ThreadPool *pool, int priority, const ThreadTask *task)
+{
+    ThreadWorker *w;
+
+    if (priority < 0)
+        priority = 0;
+    if (priority >= TASK_PRIORITY_COUNT)
+        priority = TASK_PRIORITY_COUNT - 1;
+
+    //a worker keeps the tasks it spawns, other threads spread them round robin
+    w = (ThreadWorker *)SDL_TLSGet(pool->tls);
+    if (!w) {
+        unsigned int next = (unsigned int)SDL_AtomicAdd(&pool->next_worker, 1);
+        w = &pool->workers[next % pool->nb_workers];
+    }
+
+    if (task_deque_push(&w->deques[priority], task) < 0)
+        return -1;
+
+    SDL_AtomicAdd(&pool->nb_queued, 1);
+
+    SDL_LockMutex(pool->mutex);
+    if (pool->nb_idle > 0)
+        SDL_CondSignal(pool->cond);
+    SDL_UnlockMutex(pool->mutex);
+
+    return 0;
+}
+
+//nb_workers <= 0 sizes the pool to the hardware
+ThreadPool *thread_pool_create(int nb_workers)
+{
+    ThreadPool *pool;
+
+    if (nb_workers <= 0)
+        nb_workers = SDL_GetCPUCount();
+    if (nb_workers <= 0)
+        nb_workers = 1;
+
+    pool = (ThreadPool *)av_mallocz(sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+
+    pool->workers = (ThreadWorker *)av_mallocz(nb_workers * sizeof(ThreadWorker));
+    pool->mutex = SDL_CreateMutex();
+    pool->cond = SDL_CreateCond();
+    pool->tls = SDL_TLSCreate();
+    if (!pool->workers || !pool->mutex || !pool->cond || !pool->tls)
+        goto clean;
+
+    pool->nb_workers = nb_workers;
+    for (int i = 0; i < nb_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+
+    for (int i = 0; i < nb_workers; i++) {
+        pool->workers[i].thread = SDL_CreateThread(worker_thread, "worker", &pool->workers[i]);
+        if (!pool->workers[i].thread) {
+            printf("create worker failed: %s", SDL_GetError());
+            goto clean;
+        }
+    }
+
+    return pool;
+
+clean:
+    thread_pool_free(&pool);
+    return NULL;
+}
+
+//every group must have been waited for, queued tasks are dropped
+void thread_pool_free(ThreadPool **ppool)
+{
+    ThreadPool *pool;
+
+    if (!ppool || !*ppool)
+        return;
+
+    pool = *ppool;
+
+    SDL_AtomicSet(&pool->quit, 1);
+    if (pool->mutex) {
+        SDL_LockMutex(pool->mutex);
+        SDL_CondBroadcast(pool->cond);
+        SDL_UnlockMutex(pool->mutex);
+    }
+
+    for (int i = 0; pool->workers && i < pool->nb_workers; i++) {
+        ThreadWorker *w = &pool->workers[i];
+        if (w->thread)
+            SDL_WaitThread(w->thread, NULL);
+
+        for (int prio = 0; prio < TASK_PRIORITY_COUNT; prio++) {
+            ThreadTask task;
+            while (task_deque_pop(&w->deques[prio], &task)) {
+                if (task.group)
+                    thread_task_group_done(task.group);
+            }
+            av_freep(&w->deques[prio].tasks);
+        }
+    }
+
+    av_freep(&pool->workers);
+    if (pool->mutex)
+        SDL_DestroyMutex(pool->mutex);
+    if (pool->cond)
+        SDL_DestroyCond(pool->cond);
+
+    av_free(pool);
+
+    *ppool = NULL;
+}
+
+int thread_pool_submit(ThreadPool *pool, ThreadTaskGroup *group, int priority,
+                       ThreadTaskFunc func, void *opaque)
+{
+    ThreadTask task;
+
+    if (!pool || !func || SDL_AtomicGet(&pool->quit))
+        return -1;
+
+    task.func = func;
+    task.opaque = opaque;
+    task.group = group;
+
+    if (group)
+        thread_task_group_add(group);
+
+    if (thread_pool_push(pool, priority, &task) < 0) {
+        if (group)
+            thread_task_group_done(group);
+        return -1;
+    }
+
+    return 0;
+}
+
+static Uint32 delayed_task_callback(Uint32 interval, void *userdata)
+{
+    DelayedTask *d = (DelayedTask *)userdata;
+    (void)interval;
+
+    //the group was already counted when the task was submitted
+    if (thread_pool_push(d->pool, d->priority, &d->task) < 0 && d->task.group)
+        thread_task_group_done(d->task.group);
+
+    av_free(d);
+
+    return 0;
+}
+
+//queue the task after ms milliseconds from the shared SDL timer thread
+int thread_pool_submit_delayed(ThreadPool *pool, ThreadTaskGroup *group, int priority,
+                               ThreadTaskFunc func, void *opaque, Uint32 ms)
+{
+    DelayedTask *d;
+
+    if (!ms)
+        return thread_pool_submit(pool, group, priority, func, opaque);
+
+    if (!pool || !func || SDL_AtomicGet(&pool->quit))
+        return -1;
+
+    d = (DelayedTask *)av_malloc(sizeof(DelayedTask));
+    if (!d)
+        return -1;
+
+    d->pool = pool;
+    d->priority = priority;
+    d->task.func = func;
+    d->task.opaque = opaque;
+    d->task.group = group;
+
+    if (group)
+        thread_task_group_add(group);
+
+    if (!SDL_AddTimer(ms, delayed_task_callback, d)) {
+        if (group)
+            thread_task_group_done(group);
+        av_free(d);
+        return -1;
+    }
+
+    return 0;
+}
+
+int thread_pool_is_worker(ThreadPool *pool)
+{
+    return pool && SDL_TLSGet(pool->tls) != NULL;
+}
+
+//func is run inline and on up to nb_tasks workers, it takes its own share of the
+//work until none is left. returns once all of them are done
+void thread_pool_run_n(ThreadPool *pool, ThreadTaskGroup *group,
+                       ThreadTaskFunc func, void *opaque, int nb_tasks)
+{
+    //a worker waiting for its own tasks could deadlock the pool
+    if (thread_pool_is_worker(pool))
+        pool = NULL;
+    if (!pool)
+        nb_tasks = 0;
+    else if (nb_tasks > pool->nb_workers)
+        nb_tasks = pool->nb_workers;
+    for (int i = 0; i < nb_tasks; i++) {
+        if (thread_pool_submit(pool, group, TASK_PRIORITY_NORMAL, func, opaque) < 0)
+            break;
+    }
+    func(opaque);
+    thread_task_group_wait(group);
+}
+
+void thread_task_group_init(ThreadTaskGroup *group)
+{
+    SDL_AtomicSet(&group->pending, 0);
+    group->done = SDL_CreateSemaphore(0);
+}
+
+void thread_task_group_destroy(ThreadTaskGroup *group)
+{
+    if (group->done)
+        SDL_DestroySemaphore(group->done);
+    group->done = NULL;
+}
+
+void thread_task_group_add(ThreadTaskGroup *group)
+{
+    SDL_AtomicAdd(&group->pending, 1);
+}
+
+void thread_task_group_done(ThreadTaskGroup *group)
+{
+    if (SDL_AtomicAdd(&group->pending, -1) == 1)
+        SDL_SemPost(group->done);
+}
+
+//block until every task of the group has finished
+void thread_task_group_wait(ThreadTaskGroup *group)
+{
+    while (SDL_AtomicGet(&group->pending) > 0)
+        SDL_SemWaitTimeout(group->done, 10);
+}
@@ -0,0 +1,95 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#define TASK_DEQUE_INIT_SIZE 64
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <SDL2/SDL.h>
+#include "atomicvalue.h"
+
+//tasks of a higher priority always run before queued lower ones
+enum TaskPriority {
+    TASK_PRIORITY_LOW = 0, //hidden or minimized
+    TASK_PRIORITY_NORMAL,
+    TASK_PRIORITY_HIGH, //focused
+    TASK_PRIORITY_COUNT
+};
+
+typedef void (*ThreadTaskFunc)(void *opaque);
+
+//counts the queued and running tasks of one owner (a session, a frame...)
+typedef struct ThreadTaskGroup {
+    SDL_atomic_t pending;
+    SDL_sem *done;
+} ThreadTaskGroup;
+
+typedef struct ThreadTask {
+    ThreadTaskFunc func;
+    void *opaque;
+    ThreadTaskGroup *group;
+} ThreadTask;
+
+typedef struct TaskDeque {
+    ThreadTask *tasks;
+    int capacity;
+    int head;
+    SDL_atomic_t count;
+    SDL_SpinLock lock;
+} TaskDeque;
+
+typedef struct ThreadWorker {
+    struct ThreadPool *pool;
+    SDL_Thread *thread;
+    int index;
+    TaskDeque deques[TASK_PRIORITY_COUNT];
+    CACHELINE_PAD(pad); //the next worker's deques are locked by other threads
+} ThreadWorker;
+
+typedef struct ThreadPool {
+    ThreadWorker *workers;
+    int nb_workers;
+    SDL_TLSID tls; //ThreadWorker of the calling thread
+
+    SDL_atomic_t nb_queued;
+    SDL_atomic_t next_worker;
+    SDL_atomic_t quit;
+
+    //idle workers sleep here
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    int nb_idle;
+} ThreadPool;
+
+ThreadPool *thread_pool_create(int nb_workers);
+
+void thread_pool_free(ThreadPool **pool);
+
+int thread_pool_submit(ThreadPool *pool, ThreadTaskGroup *group, int priority,
+                       ThreadTaskFunc func, void *opaque);
+
+int thread_pool_submit_delayed(ThreadPool *pool, ThreadTaskGroup *group, int priority,
+                               ThreadTaskFunc func, void *opaque, Uint32 ms);
+
+int thread_pool_is_worker(ThreadPool *pool);
+
+void thread_pool_run_n(ThreadPool *pool, ThreadTaskGroup *group,
+                       ThreadTaskFunc func, void *opaque, int nb_tasks);
+
+void thread_task_group_init(ThreadTaskGroup *group);
+
+void thread_task_group_destroy(ThreadTaskGroup *group);
+
+void thread_task_group_add(ThreadTaskGroup *group);
+
+void thread_task_group_done(ThreadTaskGroup *group);
+
+void thread_task_group_wait(ThreadTaskGroup *group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREADPOOL_H
@@ -0,0 +1,408 @@
+#include "thumbnail.h"
+#include "extract.h"
+#include <sys/stat.h>
+
+extern "C"{
+#include <libavutil/md5.h>
+}
+
+#define THUMBNAIL_MAX_PACKETS 8 //keyframes tried per slot before it stays black
+
+typedef struct ThumbnailJob {
+    const char *filename;
+    const ThumbnailOptions *opts;
+    int stream_index;
+    AVRational time_base;
+    int64_t start; //in the stream time base
+    int64_t duration;
+
+    //every worker scales into its own tiles, nothing else is shared
+    AVFrame *sprite;
+    int tile_w;
+    int tile_h;
+    int rows;
+    double *times; //pts of the frame in every slot, NAN while empty
+
+    SDL_atomic_t next_slot;
+    ThreadTaskGroup tasks;
+} ThumbnailJob;
+
+void thumbnail_options_init(ThumbnailOptions *opts)
+{
+    opts->nb_thumbs = THUMBNAIL_COUNT;
+    opts->tile_w = THUMBNAIL_WIDTH;
+    opts->cols = THUMBNAIL_COLUMNS;
+    opts->cache_dir = ".";
+}
+
+//the keyframe at or before the middle of the slot, at most a few keyframe packets
+//read. a decoder with delay gives the picture back only when drained
+static int thumbnail_decode_slot(ThumbnailJob *job, AVFormatContext *ic, AVCodecContext *c,
+                                 int stream_index, int slot, AVFrame *frame)
+{
+    int64_t ts = job->start + av_rescale(job->duration, 2 * slot + 1, 2 * job->opts->nb_thumbs);
+    AVPacket pkt;
+    int got_frame = 0, eof = 0, ret;
+
+    avcodec_flush_buffers(c);
+    if (av_seek_frame(ic, stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        return -1;
+
+    for (int i = 0; !got_frame && !eof && i < THUMBNAIL_MAX_PACKETS; ) {
+        av_init_packet(&pkt);
+        if (av_read_frame(ic, &pkt) < 0) {
+            eof = 1;
+            pkt.data = NULL;
+            pkt.size = 0;
+        } else if (pkt.stream_index != stream_index || !(pkt.flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        ret = avcodec_decode_video2(c, frame, &got_frame, &pkt);
+        av_packet_unref(&pkt);
+        i++;
+
+        if (ret >= 0 && !got_frame && !eof) {
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            avcodec_decode_video2(c, frame, &got_frame, &pkt);
+            avcodec_flush_buffers(c);
+        }
+    }
+
+    return got_frame ? 0 : -1;
+}
+
+//downscaled straight into the slot's place on the sheet
+static void thumbnail_put_tile(ThumbnailJob *job, VideoConverter *cv, AVFrame *frame, int slot)
+{
+    AVFrame *sprite = job->sprite;
+    int x = slot % job->opts->cols * job->tile_w;
+    int y = slot / job->opts->cols * job->tile_h;
+    uint8_t *dst[4] = { NULL };
+    int dst_stride[4] = { 0 };
+
+    for (int p = 0; p < 3; p++) {
+        int shift = p ? 1 : 0;
+        dst[p] = sprite->data[p] + (y >> shift) * sprite->linesize[p] + (x >> shift);
+        dst_stride[p] = sprite->linesize[p];
+    }
+
+    if (video_converter_scale(cv, frame, dst, dst_stride, job->tile_w, job->tile_h, AV_PIX_FMT_YUVJ420P) == 0)
+        job->times[slot] = av_frame_get_best_effort_timestamp(frame) * av_q2d(job->time_base);
+}
+
+//one worker: its own demuxer, decoder and scaler, slots taken until none is left
+static void thumbnail_worker(void *opaque)
+{
+    ThumbnailJob *job = (ThumbnailJob *)opaque;
+    AVFormatContext *ic = NULL;
+    AVCodecContext *c = NULL;
+    AVCodec *codec;
+    AVFrame *frame = av_frame_alloc();
+    VideoConverter *cv = video_converter_create(NULL, 1);
+    int stream_index, slot;
+
+    if (frame && cv && extract_open_video(job->filename, &ic, &stream_index) == 0) {
+        c = ic->streams[stream_index]->codec;
+        codec = avcodec_find_decoder(c->codec_id);
+        c->thread_count = 1;
+        c->refcounted_frames = 1;
+        //one keyframe per slot, the demuxer and the decoder skip the rest
+        c->skip_frame = AVDISCARD_NONKEY;
+        ic->streams[stream_index]->discard = AVDISCARD_NONKEY;
+        if (!codec || avcodec_open2(c, codec, NULL) < 0)
+            c = NULL;
+    }
+
+    while (c && (slot = SDL_AtomicAdd(&job->next_slot, 1)) < job->opts->nb_thumbs) {
+        if (thumbnail_decode_slot(job, ic, c, stream_index, slot, frame) == 0)
+            thumbnail_put_tile(job, cv, frame, slot);
+        av_frame_unref(frame);
+    }
+
+    if (c)
+        avcodec_close(c);
+    avformat_close_input(&ic);
+    av_frame_free(&frame);
+    video_converter_free(&cv);
+}
+
+static int thumbnail_write_jpeg(AVFrame *sprite, const char *path)
+{
+    AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    AVCodecContext *c = codec ? avcodec_alloc_context3(codec) : NULL;
+    AVPacket pkt;
+    FILE *f;
+    int got_packet = 0, ret = -1;
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+
+    if (!c)
+        return -1;
+
+    c->width = sprite->width;
+    c->height = sprite->height;
+    c->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    c->time_base.num = 1;
+    c->time_base.den = 25;
+    c->flags |= AV_CODEC_FLAG_QSCALE;
+    c->global_quality = FF_QP2LAMBDA * THUMBNAIL_JPEG_QSCALE;
+    sprite->quality = c->global_quality;
+    sprite->pts = 0;
+
+    if (avcodec_open2(c, codec, NULL) < 0
+            || avcodec_encode_video2(c, &pkt, sprite, &got_packet) < 0 || !got_packet)
+        goto clean;
+
+    f = fopen(path, "wb");
+    if (!f)
+        goto clean;
+    if (fwrite(pkt.data, 1, pkt.size, f) == (size_t)pkt.size)
+        ret = 0;
+    if (fclose(f) != 0)
+        ret = -1;
+
+clean:
+    av_packet_unref(&pkt);
+    avcodec_free_context(&c);
+    return ret;
+}
+
+//where every tile sits and which time it shows, for the seek bar
+static int thumbnail_write_index(ThumbnailJob *job, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    int ret;
+
+    if (!f)
+        return -1;
+
+    fprintf(f, "{\"cols\":%d,\"rows\":%d,\"tile_w\":%d,\"tile_h\":%d,\"interval\":%.6f,\"times\":[",
+            job->opts->cols, job->rows, job->tile_w, job->tile_h,
+            job->duration * av_q2d(job->time_base) / job->opts->nb_thumbs);
+    for (int i = 0; i < job->opts->nb_thumbs; i++) {
+        if (isnan(job->times[i]))
+            fprintf(f, "%snull", i ? "," : "");
+        else
+            fprintf(f, "%s%.3f", i ? "," : "", job->times[i]);
+    }
+    fprintf(f, "]}\n");
+
+    ret = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+//written next to the target and renamed, so a sprite in the cache is always whole
+static int thumbnail_commit(const char *tmp_path, const char *path)
+{
+    remove(path);
+    if (rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int file_exists(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0;
+}
+
+//a changed file gets a new key, the old sprite is simply never asked for again
+static void thumbnail_cache_key(const char *filename, const struct stat *st,
+                                const ThumbnailOptions *opts, char key[33])
+{
+    char id[THUMBNAIL_MAX_PATH + 128];
+    uint8_t sum[16];
+    int len;
+
+    len = snprintf(id, sizeof(id), "%s|%lld|%lld|%d|%d|%d", filename, (long long)st->st_size,
+                   (long long)st->st_mtime, opts->nb_thumbs, opts->tile_w, opts->cols);
+    av_md5_sum(sum, (const uint8_t *)id, FFMIN(len, (int)sizeof(id) - 1));
+    for (int i = 0; i < 16; i++)
+        snprintf(key + 2 * i, 3, "%02x", sum[i]);
+}
+
+//a sheet of nb_thumbs evenly spaced keyframes, cols wide, as a jpeg in the cache
+//with a .json index of the tiles next to it. the slots are decoded on pool (inline
+//without one), every worker with its own demuxer. path gets the jpeg, cached is
+//set when it was already there
+int thumbnail_sprite(const char *filename, const ThumbnailOptions *opts, ThreadPool *pool,
+                     char *path, int path_size, int *cached)
+{
+    ThumbnailJob job;
+    AVFormatContext *ic = NULL;
+    AVStream *stream;
+    AVRational sar;
+    struct stat st;
+    char key[33], index_path[THUMBNAIL_MAX_PATH], tmp_path[THUMBNAIL_MAX_PATH + 8];
+    int nb_found = 0, ret = -1;
+
+    *cached = 0;
+    if (!filename || opts->nb_thumbs <= 0 || opts->tile_w < 2 || opts->cols <= 0)
+        return -1;
+
+    if (stat(filename, &st) != 0) {
+        printf("thumbnail: can't stat %s\n", filename);
+        return -1;
+    }
+
+    thumbnail_cache_key(filename, &st, opts, key);
+    snprintf(path, path_size, "%s/%s.jpg", opts->cache_dir, key);
+    snprintf(index_path, sizeof(index_path), "%s/%s.json", opts->cache_dir, key);
+    if (file_exists(path) && file_exists(index_path)) {
+        *cached = 1;
+        return 0;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.filename = filename;
+    job.opts = opts;
+    thread_task_group_init(&job.tasks);
+
+    if (extract_open_video(filename, &ic, &job.stream_index) < 0) {
+        printf("thumbnail: no video in %s\n", filename);
+        goto clean;
+    }
+
+    stream = ic->streams[job.stream_index];
+    job.time_base = stream->time_base;
+    job.start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    if (stream->duration > 0)
+        job.duration = stream->duration;
+    else if (ic->duration > 0)
+        job.duration = av_rescale_q(ic->duration, AVRational{ 1, AV_TIME_BASE }, stream->time_base);
+    if (job.duration <= 0 || stream->codec->width <= 0 || stream->codec->height <= 0) {
+        printf("thumbnail: %s has no duration or size\n", filename);
+        goto clean;
+    }
+
+    //tiles keep the display aspect, chroma needs even sizes
+    sar = av_guess_sample_aspect_ratio(ic, stream, NULL);
+    if (sar.num <= 0 || sar.den <= 0)
+        sar.num = sar.den = 1;
+    job.tile_w = opts->tile_w & ~1;
+    job.tile_h = FFMAX((int)av_rescale(job.tile_w, (int64_t)stream->codec->height * sar.den,
+                                       (int64_t)stream->codec->width * sar.num) & ~1, 2);
+    job.rows = (opts->nb_thumbs + opts->cols - 1) / opts->cols;
+
+    avformat_close_input(&ic);
+
+    job.times = (double *)av_malloc(opts->nb_thumbs * sizeof(double));
+    job.sprite = av_frame_alloc();
+    if (!job.times || !job.sprite)
+        goto clean;
+    for (int i = 0; i < opts->nb_thumbs; i++)
+        job.times[i] = NAN;
+
+    job.sprite->format = AV_PIX_FMT_YUVJ420P;
+    job.sprite->width = FFMIN(opts->nb_thumbs, opts->cols) * job.tile_w;
+    job.sprite->height = job.rows * job.tile_h;
+    if (av_frame_get_buffer(job.sprite, 32) < 0)
+        goto clean;
+    //empty slots stay black
+    memset(job.sprite->data[0], 0, job.sprite->linesize[0] * job.sprite->height);
+    memset(job.sprite->data[1], 128, job.sprite->linesize[1] * job.sprite->height / 2);
+    memset(job.sprite->data[2], 128, job.sprite->linesize[2] * job.sprite->height / 2);
+
+    //the calling thread takes slots too, and all of them without a pool
+    thread_pool_run_n(pool, &job.tasks, thumbnail_worker, &job, opts->nb_thumbs);
+
+    for (int i = 0; i < opts->nb_thumbs; i++)
+        nb_found += !isnan(job.times[i]);
+    if (!nb_found) {
+        printf("thumbnail: no keyframe decoded in %s\n", filename);
+        goto clean;
+    }
+
+    //the jpeg goes last, the cache looks for it
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path);
+    if (thumbnail_write_index(&job, tmp_path) < 0 || thumbnail_commit(tmp_path, index_path) < 0) {
+        remove(tmp_path);
+        printf("thumbnail: can't write %s\n", index_path);
+        goto clean;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (thumbnail_write_jpeg(job.sprite, tmp_path) < 0 || thumbnail_commit(tmp_path, path) < 0) {
+        remove(tmp_path);
+        printf("thumbnail: can't write %s\n", path);
+        goto clean;
+    }
+
+    ret = 0;
+
+clean:
+    avformat_close_input(&ic);
+    av_frame_free(&job.sprite);
+    av_freep(&job.times);
+    thread_task_group_destroy(&job.tasks);
+
+    return ret;
+}
+
+//-thumbs [-n N] [-w W] [-cols C] [-j N] [-cache DIR] file [file ...]
+//one sprite per file, the slots of each file on N workers (0 = one per cpu)
+int thumbnail_run(int argc, char *argv[])
+{
+    ThumbnailOptions opts;
+    ThreadPool *pool;
+    char path[THUMBNAIL_MAX_PATH];
+    int nb_workers = 0, first = 0, cached, ret = 0;
+
+    thumbnail_options_init(&opts);
+
+    while (first < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "-n") && first + 1 < argc) {
+            opts.nb_thumbs = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-w") && first + 1 < argc) {
+            opts.tile_w = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-cols") && first + 1 < argc) {
+            opts.cols = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-j") && first + 1 < argc) {
+            nb_workers = atoi(argv[first + 1]);
+            first += 2;
+        } else if (!strcmp(argv[first], "-cache") && first + 1 < argc) {
+            opts.cache_dir = argv[first + 1];
+            first += 2;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc)
+        return -1;
+
+    pool = thread_pool_create(nb_workers);
+    if (!pool)
+        return -1;
+
+    for (int i = first; i < argc; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        if (thumbnail_sprite(argv[i], &opts, pool, path, sizeof(path), &cached) < 0) {
+            printf("%s: failed\n", argv[i]);
+            ret = -1;
+            continue;
+        }
+        printf("%s: %s (%.1f ms%s)\n", argv[i], path,
+               (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(),
+               cached ? ", cached" : "");
+    }
+
+    thread_pool_free(&pool);
+
+    return ret;
+}
@@ -0,0 +1,26 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include "mediastate.h"
+
+#define THUMBNAIL_COUNT 100
+#define THUMBNAIL_WIDTH 160
+#define THUMBNAIL_COLUMNS 10
+#define THUMBNAIL_JPEG_QSCALE 4 //2 is best, 31 worst
+#define THUMBNAIL_MAX_PATH 1024
+
+typedef struct ThumbnailOptions {
+    int nb_thumbs;
+    int tile_w; //the height follows the display aspect
+    int cols;
+    const char *cache_dir; //sprites are kept here, keyed by path, size and mtime
+} ThumbnailOptions;
+
+void thumbnail_options_init(ThumbnailOptions *opts);
+
+int thumbnail_sprite(const char *filename, const ThumbnailOptions *opts, ThreadPool *pool,
+                     char *path, int path_size, int *cached);
+
+int thumbnail_run(int argc, char *argv[]);
+
+#endif // THUMBNAIL_H
@@ -0,0 +1,297 @@
+#include "timeshift.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+//the file goes away with its last handle, nothing is left after a crash either
+static int timeshift_map(TimeShift *ts)
+{
+    HANDLE file, mapping;
+
+    file = CreateFileA(ts->path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("%s: can't create the timeshift file\n", ts->path);
+        return -1;
+    }
+    ts->file = file;
+
+    //the mapping grows the file to its size
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(ts->size >> 32), (DWORD)ts->size, NULL);
+    if (!mapping) {
+        printf("%s: can't grow the timeshift file to %lld bytes\n", ts->path, (long long)ts->size);
+        return -1;
+    }
+    ts->mapping = mapping;
+
+    ts->data = (uint8_t *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)ts->size);
+    if (!ts->data) {
+        printf("%s: can't map the timeshift file\n", ts->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void timeshift_unmap(TimeShift *ts)
+{
+    if (ts->data)
+        UnmapViewOfFile(ts->data);
+    if (ts->mapping)
+        CloseHandle((HANDLE)ts->mapping);
+    if (ts->file)
+        CloseHandle((HANDLE)ts->file);
+}
+#else
+static int timeshift_map(TimeShift *ts)
+{
+    void *data;
+
+    ts->fd = open(ts->path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (ts->fd < 0) {
+        printf("%s: can't create the timeshift file\n", ts->path);
+        return -1;
+    }
+    if (ftruncate(ts->fd, ts->size) < 0) {
+        printf("%s: can't grow the timeshift file to %lld bytes\n", ts->path, (long long)ts->size);
+        return -1;
+    }
+
+    data = mmap(NULL, ts->size, PROT_READ | PROT_WRITE, MAP_SHARED, ts->fd, 0);
+    if (data == MAP_FAILED) {
+        printf("%s: can't map the timeshift file\n", ts->path);
+        return -1;
+    }
+    ts->data = (uint8_t *)data;
+
+    return 0;
+}
+
+static void timeshift_unmap(TimeShift *ts)
+{
+    if (ts->data)
+        munmap(ts->data, ts->size);
+    if (ts->fd >= 0) {
+        close(ts->fd);
+        unlink(ts->path);
+    }
+}
+#endif
+
+//the file is created (or cut) to size and mapped, it is removed again on free
+TimeShift *timeshift_create(const char *path, int64_t size, int max_entries, int key_stream)
+{
+    TimeShift *ts;
+
+    if (!path || size <= 0 || max_entries <= 0)
+        return NULL;
+
+    ts = (TimeShift *)av_mallocz(sizeof(TimeShift));
+    if (!ts)
+        return NULL;
+
+#ifndef _WIN32
+    ts->fd = -1;
+#endif
+    ts->size = size;
+    ts->max_entries = max_entries;
+    ts->key_stream = key_stream;
+    ts->path = av_strdup(path);
+    ts->entries = (TimeShiftEntry *)av_malloc_array(max_entries, sizeof(TimeShiftEntry));
+    ts->mutex = SDL_CreateMutex();
+    if (!ts->path || !ts->entries || !ts->mutex)
+        goto fail;
+
+    if (timeshift_map(ts) < 0)
+        goto fail;
+
+    return ts;
+
+fail:
+    timeshift_free(&ts);
+    return NULL;
+}
+
+void timeshift_free(TimeShift **pts)
+{
+    TimeShift *ts;
+
+    if (!pts || !*pts)
+        return;
+
+    ts = *pts;
+
+    timeshift_unmap(ts);
+    if (ts->mutex)
+        SDL_DestroyMutex(ts->mutex);
+    av_freep(&ts->entries);
+    av_freep(&ts->path);
+
+    av_freep(pts);
+}
+
+static TimeShiftEntry *timeshift_entry(TimeShift *ts, int64_t seq)
+{
+    return &ts->entries[seq % ts->max_entries];
+}
+
+//append a packet at the live end, the oldest packets make room. the copy into
+//the file runs unlocked, the reader never gets to the bytes being written
+int timeshift_write(TimeShift *ts, AVPacket *packet, int64_t time)
+{
+    TimeShiftEntry *e;
+    int64_t pos;
+
+    if (packet->size > ts->size) {
+        printf("timeshift: a packet of %d bytes is larger than the ring\n", packet->size);
+        return -1;
+    }
+
+    SDL_LockMutex(ts->mutex);
+    //packets don't wrap around, the rest of the file is skipped
+    pos = ts->write_pos;
+    if (pos % ts->size + packet->size > ts->size)
+        pos += ts->size - pos % ts->size;
+    while (ts->head < ts->tail && (timeshift_entry(ts, ts->head)->pos < pos + packet->size - ts->size
+                                   || ts->tail - ts->head >= ts->max_entries)) {
+        ts->head++;
+        ts->nb_evicted++;
+    }
+    SDL_UnlockMutex(ts->mutex);
+
+    memcpy(ts->data + pos % ts->size, packet->data, packet->size);
+
+    SDL_LockMutex(ts->mutex);
+    e = timeshift_entry(ts, ts->tail);
+    e->pos = pos;
+    e->size = packet->size;
+    e->stream_index = packet->stream_index;
+    e->flags = packet->flags;
+    e->pts = packet->pts;
+    e->dts = packet->dts;
+    e->duration = packet->duration;
+    e->time = time;
+    ts->write_pos = pos + packet->size;
+    ts->tail++;
+    SDL_UnlockMutex(ts->mutex);
+
+    return 0;
+}
+
+void timeshift_set_eof(TimeShift *ts)
+{
+    SDL_LockMutex(ts->mutex);
+    ts->eof = 1;
+    SDL_UnlockMutex(ts->mutex);
+}
+
+//the next packet after the read position, returns 1 with a packet, 0 when the
+//reader is at the live end and <0 when the input has ended there
+int timeshift_read(TimeShift *ts, AVPacket *packet)
+{
+    TimeShiftEntry *e;
+    int ret = 1;
+
+    SDL_LockMutex(ts->mutex);
+    if (ts->read_seq < ts->head) {
+        //overwritten, the caller sees timeshift_lost first
+        ret = 0;
+        goto clean;
+    }
+    if (ts->read_seq >= ts->tail) {
+        ret = ts->eof ? AVERROR_EOF : 0;
+        goto clean;
+    }
+
+    e = timeshift_entry(ts, ts->read_seq);
+    if (av_new_packet(packet, e->size) < 0) {
+        ret = AVERROR(ENOMEM);
+        goto clean;
+    }
+    //under the lock, the recorder can't evict it meanwhile
+    memcpy(packet->data, ts->data + e->pos % ts->size, e->size);
+    packet->stream_index = e->stream_index;
+    packet->flags = e->flags;
+    packet->pts = e->pts;
+    packet->dts = e->dts;
+    packet->duration = e->duration;
+    ts->read_seq++;
+
+clean:
+    SDL_UnlockMutex(ts->mutex);
+
+    return ret;
+}
+
+//the read position was overwritten, the reader was paused for longer than the
+//ring holds
+int timeshift_lost(TimeShift *ts)
+{
+    int lost;
+
+    SDL_LockMutex(ts->mutex);
+    lost = ts->read_seq < ts->head;
+    SDL_UnlockMutex(ts->mutex);
+
+    return lost;
+}
+
+static int timeshift_is_key(TimeShift *ts, TimeShiftEntry *e)
+{
+    return (ts->key_stream < 0 || e->stream_index == ts->key_stream) && (e->flags & AV_PKT_FLAG_KEY);
+}
+
+//move the read position to the last key frame at or before time, clamped to the
+//window, a time past the live end goes to the last one
+int timeshift_seek(TimeShift *ts, int64_t time)
+{
+    int64_t seq, found = -1;
+
+    SDL_LockMutex(ts->mutex);
+    for (seq = ts->tail - 1; seq >= ts->head; seq--) {
+        TimeShiftEntry *e = timeshift_entry(ts, seq);
+        if (!timeshift_is_key(ts, e))
+            continue;
+        found = seq;
+        if (e->time <= time)
+            break;
+    }
+    if (found < 0) {
+        SDL_UnlockMutex(ts->mutex);
+        return -1;
+    }
+    ts->read_seq = found;
+    SDL_UnlockMutex(ts->mutex);
+
+    return 0;
+}
+
+//times of the first and last key frame the reader can be moved to
+int timeshift_window(TimeShift *ts, int64_t *start, int64_t *end)
+{
+    int64_t seq;
+    int ret = -1;
+
+    SDL_LockMutex(ts->mutex);
+    for (seq = ts->head; seq < ts->tail; seq++) {
+        if (timeshift_is_key(ts, timeshift_entry(ts, seq))) {
+            *start = timeshift_entry(ts, seq)->time;
+            ret = 0;
+            break;
+        }
+    }
+    for (seq = ts->tail - 1; ret == 0 && seq >= ts->head; seq--) {
+        if (timeshift_is_key(ts, timeshift_entry(ts, seq))) {
+            *end = timeshift_entry(ts, seq)->time;
+            break;
+        }
+    }
+    SDL_UnlockMutex(ts->mutex);
+
+    return ret;
+}
@@ -0,0 +1,76 @@
+#ifndef TIMESHIFT_H
+#define TIMESHIFT_H
+
+#define TIMESHIFT_DEFAULT_SIZE (256 * 1024 * 1024) //bytes of packets on disk
+#define TIMESHIFT_MAX_PACKETS (64 * 1024) //index entries, some 15 minutes of 25 fps video with aac audio
+#define TIMESHIFT_FILE "timeshift-%d.ring"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL.h>
+
+//where a packet is in the ring file, only the index is kept in memory
+typedef struct TimeShiftEntry {
+    int64_t pos; //virtual byte position, the file offset is pos % size
+    int size;
+    int stream_index;
+    int flags;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    int64_t time; //us, what seeks are matched against
+} TimeShiftEntry;
+
+//demuxed packets of a live input go round a memory-mapped file of a fixed size,
+//the oldest are overwritten. the recorder writes at the live end while the
+//demuxer reads anywhere in the window, so a pause or a rewind doesn't stall the
+//source and doesn't hold the packets in ram
+typedef struct TimeShift {
+    char *path;
+#ifdef _WIN32
+    void *file; //HANDLEs of the file and of its mapping
+    void *mapping;
+#else
+    int fd;
+#endif
+    uint8_t *data;
+    int64_t size;
+    int key_stream; //seeks land on its key frames
+    SDL_mutex *mutex;
+
+    TimeShiftEntry *entries; //by sequence number modulo max_entries
+    int max_entries;
+    int64_t head; //oldest packet still in the file
+    int64_t tail; //next packet written
+    int64_t write_pos;
+    int64_t read_seq; //next packet the demuxer gets
+    int eof; //the recorder got to the end of the input
+
+    int64_t nb_evicted;
+    int nb_lost; //the reader was overwritten and went back to the window start
+} TimeShift;
+
+TimeShift *timeshift_create(const char *path, int64_t size, int max_entries, int key_stream);
+
+void timeshift_free(TimeShift **ts);
+
+int timeshift_write(TimeShift *ts, AVPacket *packet, int64_t time);
+
+void timeshift_set_eof(TimeShift *ts);
+
+int timeshift_read(TimeShift *ts, AVPacket *packet);
+
+int timeshift_lost(TimeShift *ts);
+
+int timeshift_seek(TimeShift *ts, int64_t time);
+
+int timeshift_window(TimeShift *ts, int64_t *start, int64_t *end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMESHIFT_H
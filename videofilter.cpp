@@ -0,0 +1,181 @@
+#include "videofilter.h"
+#include "clock.h"
+
+extern "C"{
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+}
+
+VideoFilter *video_filter_create(const char *desc, int nb_threads)
+{
+    VideoFilter *f;
+
+    if (!desc || !desc[0])
+        return NULL;
+
+    f = (VideoFilter *)av_mallocz(sizeof(VideoFilter));
+    if (!f)
+        return NULL;
+
+    f->nb_threads = nb_threads;
+    frame_queue_init(&f->in_queue, VIDEO_FILTER_QUEUE_SIZE);
+    f->desc = av_strdup(desc);
+    f->frame = av_frame_alloc();
+    if (!f->desc || !f->frame || !f->in_queue.mutex) {
+        video_filter_free(&f);
+        return NULL;
+    }
+
+    return f;
+}
+
+void video_filter_free(VideoFilter **pf)
+{
+    VideoFilter *f;
+
+    if (!pf || !*pf)
+        return;
+
+    f = *pf;
+
+    avfilter_graph_free(&f->graph);
+    av_frame_free(&f->frame);
+    frame_queue_destroy(&f->in_queue);
+    av_freep(&f->desc);
+
+    av_freep(pf);
+}
+
+//after a seek: the decoder drops what waits for the graph, the step resets the
+//graph and the presenter's queue before the next frame
+void video_filter_flush(VideoFilter *f)
+{
+    frame_queue_flush(&f->in_queue);
+    SDL_AtomicSet(&f->reset, 1);
+}
+
+//buffer -> desc -> buffersink for frames like this one, pts in AV_TIME_BASE
+static int video_filter_config(VideoFilter *f, AVFrame *frame)
+{
+    AVFilterInOut *outputs = NULL, *inputs = NULL;
+    AVRational sar = frame->sample_aspect_ratio;
+    char args[256];
+    int ret = -1;
+
+    avfilter_graph_free(&f->graph);
+    f->graph = avfilter_graph_alloc();
+    if (!f->graph)
+        return -1;
+    //slice threads are set up with the first filter
+    f->graph->thread_type = AVFILTER_THREAD_SLICE;
+    f->graph->nb_threads = f->nb_threads;
+
+    if (sar.num <= 0 || sar.den <= 0)
+        sar = AVRational{ 1, 1 };
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/%d:pixel_aspect=%d/%d",
+             frame->width, frame->height, frame->format, AV_TIME_BASE, sar.num, sar.den);
+
+    if (avfilter_graph_create_filter(&f->src, avfilter_get_by_name("buffer"), "in", args, NULL, f->graph) < 0
+            || avfilter_graph_create_filter(&f->sink, avfilter_get_by_name("buffersink"), "out", NULL, NULL, f->graph) < 0)
+        goto clean;
+
+    outputs = avfilter_inout_alloc();
+    inputs = avfilter_inout_alloc();
+    if (!outputs || !inputs)
+        goto clean;
+
+    //the open ends of desc: its input is fed by buffer, its output drained by buffersink
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = f->src;
+    outputs->pad_idx = 0;
+    outputs->next = NULL;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = f->sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+
+    if (avfilter_graph_parse_ptr(f->graph, f->desc, &inputs, &outputs, NULL) < 0
+            || avfilter_graph_config(f->graph, NULL) < 0)
+        goto clean;
+
+    f->in_w = frame->width;
+    f->in_h = frame->height;
+    f->in_format = frame->format;
+    f->nb_configs++;
+    ret = 0;
+
+clean:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0)
+        avfilter_graph_free(&f->graph);
+
+    return ret;
+}
+
+static void video_filter_account(VideoFilter *f, double start)
+{
+    double t = clock_time() - start;
+
+    f->filter_time += t;
+    f->filter_time_max = FFMAX(f->filter_time_max, t);
+}
+
+//one frame out of the graph into out, or one decoded frame into the graph. returns
+//0 when there is nothing to do (no decoded frame or out is full) and 1 otherwise
+int video_filter_step(VideoFilter *f, FrameQueue *out)
+{
+    AVFrame *frame = f->frame;
+    double pts, start;
+    int ret;
+
+    //rebuilt with the next frame, anything it held is from before the seek
+    if (SDL_AtomicGet(&f->reset)) {
+        avfilter_graph_free(&f->graph);
+        frame_queue_flush(out);
+        SDL_AtomicSet(&f->reset, 0);
+    }
+
+    if (frame_queue_full(out))
+        return 0;
+
+    //what the graph has ready goes first, a deinterlacer at field rate gives two
+    //frames for one
+    if (f->graph) {
+        start = clock_time();
+        ret = av_buffersink_get_frame(f->sink, frame);
+        video_filter_account(f, start);
+        if (ret >= 0) {
+            pts = frame->pts != AV_NOPTS_VALUE ? (double)frame->pts / AV_TIME_BASE : 0;
+            frame_queue_put(out, frame, pts);
+            f->nb_frames_out++;
+            return 1;
+        }
+    }
+
+    if (!frame_queue_get(&f->in_queue, frame, &pts))
+        return 0;
+    f->nb_frames_in++;
+
+    if (!f->failed && (!f->graph || frame->width != f->in_w || frame->height != f->in_h
+                       || frame->format != f->in_format) && video_filter_config(f, frame) < 0) {
+        printf("video filter \"%s\" failed, frames pass unfiltered\n", f->desc);
+        f->failed = 1;
+    }
+
+    if (f->failed) {
+        frame_queue_put(out, frame, pts);
+        f->nb_frames_out++;
+        return 1;
+    }
+
+    //the graph takes the reference, nothing is copied
+    frame->pts = llrint(pts * AV_TIME_BASE);
+    start = clock_time();
+    ret = av_buffersrc_add_frame(f->src, frame);
+    video_filter_account(f, start);
+    if (ret < 0)
+        av_frame_unref(frame);
+
+    return 1;
+}
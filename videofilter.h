@@ -0,0 +1,50 @@
+#ifndef VIDEOFILTER_H
+#define VIDEOFILTER_H
+
+#define VIDEO_FILTER_QUEUE_SIZE 4 //decoded frames waiting for the graph
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavfilter/avfilter.h>
+#include "framequeue.h"
+
+//a libavfilter graph (deinterlace, crop, scale...) between the decoder and the
+//presenter's frame queue. the step runs on a thread or pool task of its own and
+//the graph slices its filters on nb_threads, frames go through by reference
+typedef struct VideoFilter {
+    char *desc;
+    int nb_threads; //0 is one per cpu
+    FrameQueue in_queue; //filled by the decoder
+    SDL_atomic_t reset; //set on a seek, the graph drops the frames it holds
+
+    //written by the filter step only
+    AVFilterGraph *graph;
+    AVFilterContext *src;
+    AVFilterContext *sink;
+    AVFrame *frame;
+    int in_w; //the graph is rebuilt when the decoded frames change
+    int in_h;
+    int in_format;
+    int failed; //frames pass unfiltered
+    int nb_configs;
+    int64_t nb_frames_in;
+    int64_t nb_frames_out;
+    double filter_time; //seconds spent in the graph
+    double filter_time_max; //longest single call
+} VideoFilter;
+
+VideoFilter *video_filter_create(const char *desc, int nb_threads);
+
+void video_filter_free(VideoFilter **f);
+
+void video_filter_flush(VideoFilter *f);
+
+int video_filter_step(VideoFilter *f, FrameQueue *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIDEOFILTER_H
@@ -0,0 +1,75 @@
+#include "videosink.h"
+
+VideoSink *video_sink_alloc(VideoSinkWriteFunc write, void *opaque)
+{
+    VideoSink *sink = (VideoSink *)av_mallocz(sizeof(VideoSink));
+    if (!sink)
+        return NULL;
+
+    sink->write = write;
+    sink->opaque = opaque;
+
+    return sink;
+}
+
+static int video_sink_null_write(VideoSink *, AVFrame *, double)
+{
+    return 0;
+}
+
+//takes every frame and drops it, for sessions without any output
+VideoSink *video_sink_null_create()
+{
+    return video_sink_alloc(video_sink_null_write, NULL);
+}
+
+static int video_sink_callback_write(VideoSink *sink, AVFrame *frame, double pts)
+{
+    AVFrame *ref = av_frame_clone(frame);
+    int ret;
+
+    if (!ref)
+        return -1;
+
+    ret = sink->callback(sink->opaque, ref, pts);
+    if (ret != 0)
+        av_frame_free(&ref);
+
+    return ret;
+}
+
+VideoSink *video_sink_callback_create(VideoSinkCallback callback, void *opaque)
+{
+    VideoSink *sink;
+
+    if (!callback)
+        return NULL;
+
+    sink = video_sink_alloc(video_sink_callback_write, opaque);
+    if (sink)
+        sink->callback = callback;
+
+    return sink;
+}
+
+int video_sink_write(VideoSink *sink, AVFrame *frame, double pts)
+{
+    int ret = sink->write(sink, frame, pts);
+
+    if (ret == 0)
+        sink->nb_frames++;
+    else if (ret == VIDEO_SINK_AGAIN)
+        sink->nb_again++;
+
+    return ret;
+}
+
+void video_sink_free(VideoSink **sink)
+{
+    if (!sink || !*sink)
+        return;
+
+    if ((*sink)->close)
+        (*sink)->close(*sink);
+    av_freep(sink);
+}
@@ -0,0 +1,48 @@
+#ifndef VIDEOSINK_H
+#define VIDEOSINK_H
+
+#define VIDEO_SINK_AGAIN 1 //the sink is full, the same frame is offered on the next refresh
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libavcodec/avcodec.h>
+
+typedef struct VideoSink VideoSink;
+
+//frame is only lent for the call. returns 0, VIDEO_SINK_AGAIN to hold the player
+//back (the decoder stalls once the frame queue is full) or <0 on error
+typedef int (*VideoSinkWriteFunc)(VideoSink *sink, AVFrame *frame, double pts);
+
+//frame is a new reference on the decoder's own buffers, nothing is copied. the
+//callee owns it when it returns 0 and must av_frame_free it, otherwise the sink
+//frees it. pts is the presentation time in seconds
+typedef int (*VideoSinkCallback)(void *opaque, AVFrame *frame, double pts);
+
+//where a session presents its decoded frames, at the pace of the master clock
+struct VideoSink {
+    VideoSinkWriteFunc write;
+    void (*close)(VideoSink *sink);
+    int scaled; //shows frames at the output size, so the decoder may use lowres
+    VideoSinkCallback callback;
+    void *opaque;
+    int64_t nb_frames;
+    int64_t nb_again;
+};
+
+VideoSink *video_sink_alloc(VideoSinkWriteFunc write, void *opaque);
+
+VideoSink *video_sink_null_create();
+
+VideoSink *video_sink_callback_create(VideoSinkCallback callback, void *opaque);
+
+int video_sink_write(VideoSink *sink, AVFrame *frame, double pts);
+
+void video_sink_free(VideoSink **sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIDEOSINK_H